@@ -1,4 +0,0 @@
-@echo off
-glslangvalidator.exe -V test.vert
-glslangvalidator.exe -V test.frag
-pause
\ No newline at end of file
@@ -0,0 +1,33 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//Position only depth pre-pass, shares test.vert's pipeline layout
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : require
+#define VIEW_INDEX gl_ViewIndex
+#else
+#define VIEW_INDEX 0
+#endif
+#define MAX_VIEWS 4 //FrameUniforms::MaxViews
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view[MAX_VIEWS];
+    mat4 proj[MAX_VIEWS];
+} frame;
+
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+    uint objectIndex;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+//Must match test.vert exactly, so the forward pass can depth test with eEqual
+invariant gl_Position;
+
+void main() {
+    gl_Position = frame.proj[VIEW_INDEX] * frame.view[VIEW_INDEX] * draw.model * vec4(inPosition, 1.0);
+}
\ No newline at end of file
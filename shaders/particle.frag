@@ -0,0 +1,15 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 fragCorner;
+layout(location = 1) in vec4 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    //Round, soft edged sprite
+    const float r = length(fragCorner);
+    if (r > 1.0)
+        discard;
+    outColor = vec4(fragColor.rgb, fragColor.a * (1.0 - smoothstep(0.5, 1.0, r)));
+}
@@ -0,0 +1,47 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//Pipelines rendering multiple views (see RenderGraph::setViewMask) are compiled with MULTIVIEW defined
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : require
+#define VIEW_INDEX gl_ViewIndex
+#else
+#define VIEW_INDEX 0
+#endif
+#define MAX_VIEWS 4 //FrameUniforms::MaxViews
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view[MAX_VIEWS];
+    mat4 proj[MAX_VIEWS];
+} frame;
+
+//Written by the compact step of particles.comp, xyz position and w normalised age
+layout(std430, set = 0, binding = 1) readonly buffer Instances { vec4 instance[]; };
+
+//Matches ParticleSystem::DrawConstants
+layout(push_constant) uniform DrawConstants {
+    uint instanceOffset;//Start of the copy compacted this frame
+    float size;
+} draw;
+
+layout(location = 0) out vec2 fragCorner;
+layout(location = 1) out vec4 fragColor;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+//Two triangles, counter-clockwise when facing the camera
+const vec2 CORNERS[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0), vec2(-1.0, -1.0));
+
+void main() {
+    const vec4 p = instance[draw.instanceOffset + gl_InstanceIndex];
+    const vec2 corner = CORNERS[gl_VertexIndex];
+    const float t = clamp(p.w, 0.0, 1.0);
+    //Expanded in view space, so billboards always face the camera
+    vec4 viewPos = frame.view[VIEW_INDEX] * vec4(p.xyz, 1.0);
+    viewPos.xy += corner * draw.size * (1.0 - 0.5 * t);
+    gl_Position = frame.proj[VIEW_INDEX] * viewPos;
+    fragCorner = corner;
+    fragColor = vec4(mix(vec3(1.0, 0.8, 0.3), vec3(0.8, 0.2, 0.1), t), 1.0 - t);
+}
@@ -6,9 +6,16 @@ layout(location = 1) in vec2 fragTexCoord;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+//Set via GraphicsPipeline specialization, the untaken branch is eliminated at pipeline creation
+layout(constant_id = 0) const bool USE_TEXTURE = true;
+
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    vec4 tex = texture(texSampler, fragTexCoord);
-    outColor = vec4(fragColor * tex.rgb, tex.a);
+    if (USE_TEXTURE) {
+        vec4 tex = texture(texSampler, fragTexCoord);
+        outColor = vec4(fragColor * tex.rgb, tex.a);
+    } else {
+        outColor = vec4(fragColor, 1.0);
+    }
 }
\ No newline at end of file
@@ -1,11 +1,26 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(set = 0, binding = 0) uniform UniformBufferObject {
+//Pipelines rendering multiple views (see RenderGraph::setViewMask) are compiled with MULTIVIEW defined
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : require
+#define VIEW_INDEX gl_ViewIndex
+#else
+#define VIEW_INDEX 0
+#endif
+#define MAX_VIEWS 4 //FrameUniforms::MaxViews
+
+//Per-frame, only rewritten when the camera or swapchain extent changes
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view[MAX_VIEWS];
+    mat4 proj[MAX_VIEWS];
+} frame;
+
+//Per-draw, recorded with vkCmdPushConstants
+layout(push_constant) uniform DrawConstants {
     mat4 model;
-    mat4 view;
-    mat4 proj;
-} ubo;
+    uint objectIndex;
+} draw;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -17,9 +32,11 @@ layout(location = 1) out vec2 fragTexCoord;
 out gl_PerVertex {
     vec4 gl_Position;
 };
+//Must match depth.vert exactly, so the forward pass can depth test with eEqual after the pre-pass
+invariant gl_Position;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = frame.proj[VIEW_INDEX] * frame.view[VIEW_INDEX] * draw.model * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
 }
\ No newline at end of file
@@ -1,6 +1,4 @@
 #include "Camera.h"
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/rotate_vector.hpp>
 
 Camera::Camera()
 	: Camera(glm::vec3(1, 1, 1))
@@ -8,98 +6,119 @@ Camera::Camera()
 Camera::Camera(glm::vec3 eye)
 	: Camera(eye, glm::vec3(0, 0, 0))
 {}
-//Initialiser list written to remove any references to member variables
-//Because member variables are initialised via initaliser lists in the order they are declared in the class declaration (rather than the order of the initialiser list)
 Camera::Camera(glm::vec3 eye, glm::vec3 target)
 	: pureUp(0.0f, 1.0f, 0.0f)
 	, eye(eye)
-	, look(normalize(target - eye))
-	, right(normalize(cross(target - eye, glm::vec3(0, 1, 0))))
-	, up(normalize(cross(cross(target - eye, glm::vec3(0, 1, 0)), target - eye)))
 	, stabilise(true)
+	, projMat(1.0f)
+	, viewDirty(true)
+	, frustumDirty(true)
 {
-	//this->eye = eye;                                  //Eye is the location passed by user
-	//this->look = target - eye;                        //Look is the direction from eye to target
-	//this->right = cross(look, pureUp);                //Right is perpendicular to look and pureUp
-	//this->up = cross(right, look);                    //Up is perpendicular to right and look
-
-	this->updateViews();
+	const glm::vec3 look = normalize(target - eye);                 //Look is the direction from eye to target
+	const glm::vec3 right = normalize(cross(look, this->pureUp));   //Right is perpendicular to look and pureUp
+	this->setOrientation(look, cross(right, look));                 //Up is perpendicular to right and look
 }
 Camera::~Camera() {
 }
 void Camera::turn(float yaw, float pitch) {
-	//Rotate everything yaw rads about up vector
-	this->look = rotate(this->look, -yaw, this->up);
-	this->right = rotate(this->right, -yaw, this->up);
-	//Rotate everything pitch rads about right vector
-	glm::vec3 look = rotate(this->look, -pitch, this->right);
-	glm::vec3 up = rotate(this->up, -pitch, this->right);
-	glm::vec3 right = this->right;
+	//Rotate yaw rads about up, then pitch rads about right, both camera space axes
+	glm::quat o = orientation * glm::angleAxis(-yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+	o = o * glm::angleAxis(-pitch, glm::vec3(1.0f, 0.0f, 0.0f));
 	if (stabilise)
 	{
-		//Right is perpendicular to look and pureUp
-		right = cross(look, this->pureUp);
-		//Stabilised up is perpendicular to right and look
-		up = cross(right, look);
+		const glm::vec3 look = o * glm::vec3(0.0f, 0.0f, -1.0f);
 		//Don't let look get too close to pure up, else we will spin
 		if (abs(dot(look, this->pureUp)) > 0.98)
 			return;
+		//Right is perpendicular to look and pureUp
+		const glm::vec3 right = normalize(cross(look, this->pureUp));
+		//Stabilised up is perpendicular to right and look
+		this->setOrientation(look, cross(right, look));
+	}
+	else
+	{
+		orientation = normalize(o);
 	}
-	//Commit changes
-	this->look = normalize(look);
-	this->right = normalize(right);
-	this->up = normalize(up);
-	this->updateViews();
+	moved();
 }
 void Camera::move(float distance) {
-	eye += look*distance;
-	this->updateViews();
+	eye += getLook()*distance;
+	moved();
 }
 void Camera::strafe(float distance) {
-	eye += right*distance;
-	this->updateViews();
+	eye += getRight()*distance;
+	moved();
 }
 void Camera::ascend(float distance) {
 	eye += pureUp*distance;
-	this->updateViews();
+	moved();
 }
 void Camera::roll(float roll) {
-	pureUp = normalize(rotate(pureUp, roll, look));
-	right = normalize(rotate(right, roll, look));
-	up = normalize(rotate(up, roll, look));
-	this->updateViews();
+	//World space rotation about look
+	const glm::quat r = glm::angleAxis(roll, getLook());
+	pureUp = normalize(r * pureUp);
+	orientation = normalize(r * orientation);
+	moved();
 }
 void Camera::setStabilise(bool stabilise) {
 	this->stabilise = stabilise;
 }
-glm::mat4 Camera::view() const {
+void Camera::setTransform(const Transform &t) {
+	eye = t.position;
+	orientation = normalize(t.rotation);
+	moved();
+}
+void Camera::setProjection(const glm::mat4 &proj) {
+	projMat = proj;
+	frustumDirty = true;
+}
+const glm::mat4 &Camera::view() const {
+	if (viewDirty)
+	{
+		//Inverse of the orientation, rows are right, up and -look as with glm::lookAt()
+		skyboxViewMat = glm::mat4_cast(glm::conjugate(orientation));
+		viewMat = skyboxViewMat;
+		viewMat[3] = glm::vec4(-(glm::mat3(skyboxViewMat) * eye), 1.0f);
+		viewDirty = false;
+	}
 	return viewMat;
 }
-glm::mat4 Camera::skyboxView() const {
+const glm::mat4 &Camera::skyboxView() const {
+	view();
 	return skyboxViewMat;
 }
+const Frustum &Camera::frustum() const {
+	if (frustumDirty)
+	{
+		frustumPlanes = Frustum::fromMatrix(projMat * view());
+		frustumDirty = false;
+	}
+	return frustumPlanes;
+}
 glm::vec3 Camera::getEye() const {
 	return eye;
 }
 glm::vec3 Camera::getLook() const {
-	return look;
+	return orientation * glm::vec3(0.0f, 0.0f, -1.0f);
 }
 glm::vec3 Camera::getUp() const {
-	return up;
+	return orientation * glm::vec3(0.0f, 1.0f, 0.0f);
 }
 glm::vec3 Camera::getPureUp() const {
 	return pureUp;
 }
 glm::vec3 Camera::getRight() const {
-	return right;
+	return orientation * glm::vec3(1.0f, 0.0f, 0.0f);
 }
-const glm::mat4 *Camera::getViewMatPtr() const {
-	return &viewMat;
+Transform Camera::transform() const {
+	Transform t;
+	t.position = eye;
+	t.rotation = orientation;
+	return t;
 }
-const glm::mat4 *Camera::getSkyboxViewMatPtr() const {
-	return &skyboxViewMat;
+void Camera::setOrientation(const glm::vec3 &look, const glm::vec3 &up) {
+	const glm::vec3 l = normalize(look);
+	const glm::vec3 u = normalize(up);
+	//Columns map camera space axes to world space
+	orientation = normalize(glm::quat_cast(glm::mat3(normalize(cross(l, u)), u, -l)));
 }
-void Camera::updateViews() {
-	viewMat = glm::lookAt(eye, eye + look, up);
-	skyboxViewMat = glm::lookAt(glm::vec3(0), look, up);
-}
\ No newline at end of file
@@ -2,7 +2,15 @@
 #define __Camera_h__
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "Transform.h"
+#include "Frustum.h"
 
+/**
+ * First person camera, stored as an eye location and a quaternion orientation
+ * Movement only updates these, the view, skybox view and frustum are computed when next requested
+ * Cached matrices are mutable, so calling the const accessors from multiple threads is not thread-safe
+ */
 class Camera
 {
 public:
@@ -61,17 +69,31 @@ public:
 	*/
 	void setStabilise(bool stabilise);
 	/**
-	* Returns the projection matrix
-	* For use with shader uniforms or glLoadMatrixf() after calling glMatrixMode(GL_MODELVIEW)
-	* @return the modelview matrix as calculated by glm::lookAt(glm::vec3, glm::vec3, glm::vec3)
+	* Places the camera at a world space location and orientation, e.g. one interpolated between simulation steps
+	* pureUp is left unchanged
+	* @param t The transform of the camera, as returned by transform()
 	*/
-	glm::mat4 view() const;
+	void setTransform(const Transform &t);
 	/**
-	* Returns the projection matrix from the perspective required for rendering a skybox (direction only)
-	* For use with shader uniforms or glLoadMatrixf() after calling glMatrixMode(GL_MODELVIEW)
-	* @return the modelview matrix as calculated by glm::lookAt(glm::vec3, glm::vec3, glm::vec3)
+	* Sets the projection matrix the frustum is extracted with
+	* @param proj The projection matrix used to render from this camera
 	*/
-	glm::mat4 skyboxView() const;
+	void setProjection(const glm::mat4 &proj);
+	/**
+	* Returns the view matrix, recomputed if the camera has moved since it was last requested
+	* @return the view matrix, equivalent to glm::lookAt(getEye(), getEye() + getLook(), getUp())
+	*/
+	const glm::mat4 &view() const;
+	/**
+	* Returns the view matrix required for rendering a skybox (direction only)
+	* @return the view matrix, equivalent to glm::lookAt(glm::vec3(0), getLook(), getUp())
+	*/
+	const glm::mat4 &skyboxView() const;
+	/**
+	* Returns the world space frustum of the view and the projection passed to setProjection()
+	* @return The frustum, recomputed if the camera has moved or the projection changed since it was last requested
+	*/
+	const Frustum &frustum() const;
 	/**
 	* Returns the cameras location
 	* @return The location of the camera in world space
@@ -99,36 +121,36 @@ public:
 	*/
 	glm::vec3 getRight() const;
 	/**
-	* Returns a constant pointer to the cameras modelview matrix
-	* This pointer can be used to continuously track the modelview matrix
-	* @return A pointer to the modelview matrix
+	* Returns the cameras location and orientation in world space
+	* The inverse of view(), in a form which can be interpolated
+	* @return The transform of the camera
 	*/
-	const glm::mat4 *Camera::getViewMatPtr() const;
+	Transform transform() const;
+private:
 	/**
-	* Returns a constant pointer to the cameras skybox modelview matrix
-	* This pointer can be used to continuously track the skybox modelview matrix
-	* @return A pointer to the modelview matrix
+	* Sets orientation from an orthonormal basis
 	*/
-	const glm::mat4 *Camera::getSkyboxViewMatPtr() const;
-private:
+	void setOrientation(const glm::vec3 &look, const glm::vec3 &up);
 	/**
-	* Updates the view and skyboxView matrices
-	* Called whenever any internal camera variables are updated
+	* Marks the cached view matrices and frustum out of date
 	*/
-	void updateViews();
-	//ModelView matrix
-	glm::mat4 viewMat;
-	//Model view matrix without camera position taken into consideration
-	glm::mat4 skyboxViewMat;
+	void moved() { viewDirty = true; frustumDirty = true; }
 	//Up vector used for stabilisation, only rotated when roll is called
 	glm::vec3 pureUp;
 	//Eyelocation
 	glm::vec3 eye;
-	//3 perpendicular vectors which represent the cameras direction and orientation
-	glm::vec3 look;
-	glm::vec3 right;
-	glm::vec3 up;
+	//Rotation from camera space (right +x, up +y, look -z) to world space
+	glm::quat orientation;
 	bool stabilise;
+	glm::mat4 projMat;
+	//Computed on demand
+	mutable bool viewDirty;
+	mutable bool frustumDirty;
+	//View matrix
+	mutable glm::mat4 viewMat;
+	//View matrix without camera position taken into consideration
+	mutable glm::mat4 skyboxViewMat;
+	mutable Frustum frustumPlanes;
 };
 
 #endif //ifndef __Camera_h__
\ No newline at end of file
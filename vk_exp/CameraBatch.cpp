@@ -0,0 +1,131 @@
+#include "CameraBatch.h"
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define CAMERA_BATCH_SSE
+#include <xmmintrin.h>
+#endif
+
+size_t CameraBatch::add(const Transform &t)
+{
+	for (unsigned int c = 0; c < 3; ++c)
+		m_position[c].push_back(t.position[c]);
+	m_rotation[0].push_back(t.rotation.x);
+	m_rotation[1].push_back(t.rotation.y);
+	m_rotation[2].push_back(t.rotation.z);
+	m_rotation[3].push_back(t.rotation.w);
+	return m_count++;
+}
+void CameraBatch::set(const size_t &i, const Transform &t)
+{
+	for (unsigned int c = 0; c < 3; ++c)
+		m_position[c][i] = t.position[c];
+	m_rotation[0][i] = t.rotation.x;
+	m_rotation[1][i] = t.rotation.y;
+	m_rotation[2][i] = t.rotation.z;
+	m_rotation[3][i] = t.rotation.w;
+}
+Transform CameraBatch::get(const size_t &i) const
+{
+	Transform t;
+	t.position = glm::vec3(m_position[0][i], m_position[1][i], m_position[2][i]);
+	t.rotation = glm::quat(m_rotation[3][i], m_rotation[0][i], m_rotation[1][i], m_rotation[2][i]);
+	return t;
+}
+void CameraBatch::clear()
+{
+	for (auto &p : m_position)
+		p.clear();
+	for (auto &r : m_rotation)
+		r.clear();
+	m_count = 0;
+}
+void CameraBatch::moveLocal(const glm::vec3 &delta)
+{
+	size_t i = 0;
+#ifdef CAMERA_BATCH_SSE
+	//v' = v + 2w(u x v) + 2u x (u x v), u being the quaternion's vector part
+	const __m128 vx = _mm_set1_ps(delta.x), vy = _mm_set1_ps(delta.y), vz = _mm_set1_ps(delta.z);
+	const __m128 two = _mm_set1_ps(2.0f);
+	for (; i + 4 <= m_count; i += 4)
+	{
+		const __m128 qx = _mm_loadu_ps(&m_rotation[0][i]);
+		const __m128 qy = _mm_loadu_ps(&m_rotation[1][i]);
+		const __m128 qz = _mm_loadu_ps(&m_rotation[2][i]);
+		const __m128 qw = _mm_loadu_ps(&m_rotation[3][i]);
+		//t = 2(u x v)
+		const __m128 tx = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qy, vz), _mm_mul_ps(qz, vy)));
+		const __m128 ty = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qz, vx), _mm_mul_ps(qx, vz)));
+		const __m128 tz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qx, vy), _mm_mul_ps(qy, vx)));
+		//v' = v + wt + u x t
+		const __m128 rx = _mm_add_ps(_mm_add_ps(vx, _mm_mul_ps(qw, tx)), _mm_sub_ps(_mm_mul_ps(qy, tz), _mm_mul_ps(qz, ty)));
+		const __m128 ry = _mm_add_ps(_mm_add_ps(vy, _mm_mul_ps(qw, ty)), _mm_sub_ps(_mm_mul_ps(qz, tx), _mm_mul_ps(qx, tz)));
+		const __m128 rz = _mm_add_ps(_mm_add_ps(vz, _mm_mul_ps(qw, tz)), _mm_sub_ps(_mm_mul_ps(qx, ty), _mm_mul_ps(qy, tx)));
+		_mm_storeu_ps(&m_position[0][i], _mm_add_ps(_mm_loadu_ps(&m_position[0][i]), rx));
+		_mm_storeu_ps(&m_position[1][i], _mm_add_ps(_mm_loadu_ps(&m_position[1][i]), ry));
+		_mm_storeu_ps(&m_position[2][i], _mm_add_ps(_mm_loadu_ps(&m_position[2][i]), rz));
+	}
+#endif
+	for (; i < m_count; ++i)
+	{
+		const glm::quat q(m_rotation[3][i], m_rotation[0][i], m_rotation[1][i], m_rotation[2][i]);
+		const glm::vec3 d = q * delta;
+		for (unsigned int c = 0; c < 3; ++c)
+			m_position[c][i] += d[c];
+	}
+}
+void CameraBatch::move(const glm::vec3 &delta)
+{
+	//Contiguous per component, so the compiler vectorises this
+	for (unsigned int c = 0; c < 3; ++c)
+		for (size_t i = 0; i < m_count; ++i)
+			m_position[c][i] += delta[c];
+}
+void CameraBatch::computeViews(glm::mat4 *views) const
+{
+	size_t i = 0;
+#ifdef CAMERA_BATCH_SSE
+	const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+	for (; i + 4 <= m_count; i += 4)
+	{
+		const __m128 qx = _mm_loadu_ps(&m_rotation[0][i]);
+		const __m128 qy = _mm_loadu_ps(&m_rotation[1][i]);
+		const __m128 qz = _mm_loadu_ps(&m_rotation[2][i]);
+		const __m128 qw = _mm_loadu_ps(&m_rotation[3][i]);
+		const __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+		const __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+		const __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+		//Rows of the rotation (local to world), which are the columns of its inverse
+		__m128 r[3][3];
+		r[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		r[0][1] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+		r[0][2] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+		r[1][0] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+		r[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		r[1][2] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+		r[2][0] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+		r[2][1] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+		r[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+		//Translation is the position brought into camera space, negated
+		const __m128 px = _mm_loadu_ps(&m_position[0][i]);
+		const __m128 py = _mm_loadu_ps(&m_position[1][i]);
+		const __m128 pz = _mm_loadu_ps(&m_position[2][i]);
+		__m128 t[3];
+		for (unsigned int c = 0; c < 3; ++c)
+			t[c] = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[0][c], px), _mm_mul_ps(r[1][c], py)), _mm_mul_ps(r[2][c], pz)));
+		//Each register holds one element of 4 cameras' matrices, transpose to give each camera's column
+		for (unsigned int c = 0; c < 4; ++c)
+		{
+			__m128 e0 = c < 3 ? r[c][0] : t[0];
+			__m128 e1 = c < 3 ? r[c][1] : t[1];
+			__m128 e2 = c < 3 ? r[c][2] : t[2];
+			__m128 e3 = c < 3 ? zero : one;
+			_MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+			_mm_storeu_ps(&views[i + 0][c][0], e0);
+			_mm_storeu_ps(&views[i + 1][c][0], e1);
+			_mm_storeu_ps(&views[i + 2][c][0], e2);
+			_mm_storeu_ps(&views[i + 3][c][0], e3);
+		}
+	}
+#endif
+	for (; i < m_count; ++i)
+		views[i] = get(i).inverseMatrix();
+}
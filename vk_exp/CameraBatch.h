@@ -0,0 +1,42 @@
+#ifndef __CameraBatch_h__
+#define __CameraBatch_h__
+#include <vector>
+#include <glm/glm.hpp>
+#include "Transform.h"
+
+/**
+ * Many cameras (e.g. reflection probes, split views) updated together
+ * Transforms are stored as a structure of arrays, so updates and view matrices are computed 4 cameras at a time with SSE
+ * Cameras beyond the last multiple of 4, or all of them on platforms without SSE, take the scalar path
+ */
+class CameraBatch
+{
+public:
+	/**
+	 * @return The camera's index
+	 */
+	size_t add(const Transform &t);
+	void set(const size_t &i, const Transform &t);
+	Transform get(const size_t &i) const;
+	size_t size() const { return m_count; }
+	void clear();
+	/**
+	 * Moves every camera by delta, in its own camera space (right +x, up +y, look -z)
+	 */
+	void moveLocal(const glm::vec3 &delta);
+	/**
+	 * Moves every camera by delta, in world space
+	 */
+	void move(const glm::vec3 &delta);
+	/**
+	 * Computes each camera's view matrix, the inverse of its transform
+	 * @param views Array of at least size() matrices
+	 */
+	void computeViews(glm::mat4 *views) const;
+private:
+	size_t m_count = 0;
+	std::vector<float> m_position[3];//x, y, z
+	std::vector<float> m_rotation[4];//Quaternion x, y, z, w
+};
+
+#endif //__CameraBatch_h__
@@ -0,0 +1,116 @@
+#include "ComputePipeline.h"
+
+#include "Context.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "LayoutCache.h"
+#include <cstring>
+
+ComputePipeline::ComputePipeline(Context &ctx, const char *compPath, const SpecializationConstants &spec)
+	: m_context(ctx)
+	, m_compPath(compPath)
+	, m_spec(spec)
+	, m_rebuildRequested(false)
+{
+	m_localSize[0] = m_localSize[1] = m_localSize[2] = 1;
+	m_pipeline = buildPipeline();
+	m_stateKey = m_builtKey;
+}
+ComputePipeline::~ComputePipeline()
+{
+	m_context.Device().destroyPipeline(m_pipeline);
+	m_pipeline = nullptr;
+	m_pipelineLayout = nullptr;
+	m_setLayouts.clear();
+}
+vk::Pipeline ComputePipeline::buildPipeline()
+{
+	auto cFuture = m_context.Shaders().compileAsync(m_compPath);
+	//Snapshot the specialization, so changes during the build trigger another rebuild
+	SpecializationConstants spec;
+	{
+		std::lock_guard<std::mutex> lock(m_specMutex);
+		spec = m_spec;
+		m_rebuildRequested = false;
+	}
+	auto c = cFuture.get();
+	m_builtKey = stateKey({ &c }, spec);
+	if (m_pipeline && m_builtKey == m_stateKey)
+		return nullptr;
+	ShaderReflection cr(c);
+	if (cr.Stage() != vk::ShaderStageFlagBits::eCompute)
+		throw std::runtime_error("ComputePipeline: '" + m_compPath + "' is not a compute shader.");
+	validateSpecialization(spec, cr);
+	vk::PipelineLayout layout = pipelineLayout(cr);
+	//Dispatch sizes are derived from the local size, so it must not change across hot reloads
+	if (!m_pipeline)
+		memcpy(m_localSize, cr.LocalSize(), sizeof(m_localSize));
+	else if (memcmp(m_localSize, cr.LocalSize(), sizeof(m_localSize)) != 0)
+		throw std::runtime_error("ComputePipeline: Workgroup size of '" + m_compPath + "' has changed. Restart required.");
+	vk::ShaderModule _c = createShader(m_context.Device(), c);
+	vk::Pipeline rtn;
+	try
+	{
+		vk::SpecializationInfo si;
+		std::vector<vk::SpecializationMapEntry> sme;
+		std::vector<unsigned char> sd;
+		const bool cSpec = spec.buildInfo(vk::ShaderStageFlagBits::eCompute, si, sme, sd);
+		vk::ComputePipelineCreateInfo pipelineInfo;
+		{
+			pipelineInfo.flags = {};
+			pipelineInfo.stage.flags = {};
+			pipelineInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+			pipelineInfo.stage.module = _c;
+			pipelineInfo.stage.pName = "main";
+			pipelineInfo.stage.pSpecializationInfo = cSpec ? &si : nullptr;
+			pipelineInfo.layout = layout;
+			pipelineInfo.basePipelineHandle = nullptr;
+			pipelineInfo.basePipelineIndex = -1;
+		}
+		rtn = m_context.Device().createComputePipeline(m_context.PipelineCache(), pipelineInfo);
+	}
+	catch (...)
+	{//e.g. a hot reloaded shader the driver rejects
+		m_context.Device().destroyShaderModule(_c);
+		throw;
+	}
+	m_context.Device().destroyShaderModule(_c);
+	return rtn;
+}
+vk::Pipeline ComputePipeline::swapPipeline(const vk::Pipeline &pipeline)
+{
+	vk::Pipeline rtn = m_pipeline;
+	m_pipeline = pipeline;
+	m_stateKey = m_builtKey;
+	return rtn;
+}
+void ComputePipeline::setSpecialization(const SpecializationConstants &spec)
+{
+	std::lock_guard<std::mutex> lock(m_specMutex);
+	m_spec = spec;
+	m_rebuildRequested = true;
+}
+SpecializationConstants ComputePipeline::Specialization() const
+{
+	std::lock_guard<std::mutex> lock(m_specMutex);
+	return m_spec;
+}
+bool ComputePipeline::usesShader(const std::string &filename) const
+{
+	return pathMatches(m_compPath, filename);
+}
+vk::PipelineLayout ComputePipeline::pipelineLayout(const ShaderReflection &c)
+{
+	std::vector<vk::DescriptorSetLayout> setLayouts;
+	vk::PipelineLayout rtn = m_context.Layouts().getPipelineLayout({ &c }, &setLayouts);
+	if (!m_pipelineLayout)
+	{//First build
+		m_pipelineLayout = rtn;
+		m_setLayouts = setLayouts;
+	}
+	else if (rtn != m_pipelineLayout)
+	{//Rebuild, descriptor sets and command buffers are bound against the existing layout
+		throw std::runtime_error("Shader resource interface has changed, the pipeline layout is no longer compatible. Restart required.");
+	}
+	return rtn;
+}
@@ -0,0 +1,64 @@
+#ifndef __ComputePipeline_h__
+#define __ComputePipeline_h__
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <vulkan/vulkan.hpp>
+#include "SpecializationConstants.h"
+#include "ReloadablePipeline.h"
+class Context;
+class ShaderReflection;
+
+/**
+ * Compute counterpart of GraphicsPipeline
+ * The pipeline layout is generated from SPIR-V reflection and shared via Context's LayoutCache,
+ * pipelines are created through Context's pipeline cache and hot reload alongside the graphics pipelines
+ * The local workgroup size is read from the shader (local_size_x/y/z), see groupCount()
+ */
+class ComputePipeline : public ReloadablePipeline
+{
+public:
+	ComputePipeline(Context &ctx, const char *compPath, const SpecializationConstants &spec = SpecializationConstants());
+	~ComputePipeline();
+	const vk::Pipeline& Pipeline() const { return m_pipeline; }
+	const vk::PipelineLayout& PipelineLayout() const { return m_pipelineLayout; }
+	const vk::DescriptorSetLayout& DescriptorSetLayout(const unsigned int &set) const { return m_setLayouts.at(set); }
+	/**
+	 * Workgroups required to cover invocations along an axis (0: x, 1: y, 2: z)
+	 */
+	uint32_t groupCount(const uint32_t &invocations, const unsigned int &axis = 0) const { return (invocations + m_localSize[axis] - 1) / m_localSize[axis]; }
+	/**
+	 * Compiles the shader and builds a new vk::Pipeline from the current state
+	 * The active pipeline is not modified, so this may be called from a worker thread whilst it is in use
+	 * Shader compile errors, changes to the pipeline layout and mismatched specialization constants are thrown as std::runtime_error
+	 * @return nullptr if the pipeline state key (SPIR-V and specialization constants) matches the active pipeline
+	 */
+	vk::Pipeline buildPipeline() override;
+	vk::Pipeline swapPipeline(const vk::Pipeline &pipeline) override;
+	/**
+	 * Replaces the specialization constant values, these take effect at the next buildPipeline()
+	 * Thread-safe, also flags that a rebuild is required (see rebuildRequested())
+	 */
+	void setSpecialization(const SpecializationConstants &spec);
+	SpecializationConstants Specialization() const;
+	bool rebuildRequested() const override { return m_rebuildRequested.load(); }
+	bool usesShader(const std::string &filename) const override;
+private:
+	vk::PipelineLayout pipelineLayout(const ShaderReflection &c);
+	Context &m_context;
+	const std::string m_compPath;
+
+	vk::Pipeline m_pipeline = nullptr;
+	vk::PipelineLayout m_pipelineLayout = nullptr;//Owned by LayoutCache
+	std::vector<vk::DescriptorSetLayout> m_setLayouts;//Owned by LayoutCache
+	uint32_t m_localSize[3];
+
+	mutable std::mutex m_specMutex;
+	SpecializationConstants m_spec;
+	std::atomic<bool> m_rebuildRequested;
+	uint64_t m_stateKey = 0;//State key of m_pipeline
+	uint64_t m_builtKey = 0;//State key of the most recent buildPipeline(), becomes m_stateKey on swap
+};
+
+#endif //__ComputePipeline_h__
@@ -2,9 +2,20 @@
 #include <sstream>
 #include <fstream>
 #include "GraphicsPipeline.h"
+#include "ComputePipeline.h"
+#include "ShaderCompiler.h"
+#include "ShaderWatcher.h"
+#include "LayoutCache.h"
+#include "MemoryManager.h"
+#include "RenderGraph.h"
+#include "GpuTimer.h"
+#include "ParticleSystem.h"
+#include "DeviceCapabilities.h"
+#include "Profiler.h"
 #include <SDL/SDL_vulkan.h>
 #include "vk.h"
-#include <set>
+#include <cctype>
+#include <algorithm>
 #include <chrono>
 #include <glm/gtc/matrix_transform.hpp>
 #define STB_IMAGE_IMPLEMENTATION
@@ -17,52 +28,99 @@ void Context::init(unsigned int width, unsigned int height, const char * title)
 {
 	if (isInit.load())
 		return;
+	PROFILE_FUNCTION();
 	try
 	{
-		//SDL_Vulkan_LoadLibrary(nullptr);
-		//Create hidden window so we can init Vulkan context
-		createWindow(width, height, title);
-		//Create the basic vulkan instance
-		createInstance(title);
+		{
+			PROFILE_ZONE("Context::init instance");
+			//SDL_Vulkan_LoadLibrary(nullptr);
+			//Create hidden window so we can init Vulkan context
+			createWindow(width, height, title);
+			//Create the basic vulkan instance
+			createInstance(title);
 #ifdef _DEBUG
-		//Create debug output callbacks
-		createDebugCallbacks();
+			//Create debug output callbacks
+			createDebugCallbacks();
 #endif
-		//Create a rendering surface for the window
-		createSurface();
-		//Select the most suitable GPU
-		auto qs = selectPhysicalDevice();//0:graphicsQIndex, 1:presentQIndex
-		m_graphicsQueueId = std::get<0>(qs);
-		m_presentQueueId = std::get<1>(qs);
-		//Create a logical device from the physical device
-		createLogicalDevice(m_graphicsQueueId, m_presentQueueId);
-		//Grab the graphical and present queues
-		m_graphicsQueue = m_device.getQueue(m_graphicsQueueId, 0);
-		m_presentQueue = m_device.getQueue(m_presentQueueId, 0);
-		//Create/Load pipeline cache
-		setupPipelineCache();
-		createDescriptorPool();
-		//Create Swapchain and dependencies
-		createSwapchainStuff();
-		//Create semaphores for queue sync
-		m_imageAvailableSemaphore = m_device.createSemaphore({});
-		m_renderingFinishedSemaphore = m_device.createSemaphore({});
-		//Create memory fences for swapchain images
-		createFences();
-		createTextureImage();
-		createTextureImageView();
-		createTextureSampler();
-		//Build a Vertex Buf with model data
-		createVertexBuffer();
-		createIndexBuffer();
-		createUniformBuffer();
-		updateDescriptorSet();
+			//Create a rendering surface for the window
+			createSurface();
+		}
+		{
+			PROFILE_ZONE("Context::init device");
+			//Select the most suitable GPU
+			auto qs = selectPhysicalDevice();//0:graphicsQIndex, 1:presentQIndex, 2:computeQIndex
+			m_graphicsQueueId = std::get<0>(qs);
+			m_presentQueueId = std::get<1>(qs);
+			m_computeQueueId = std::get<2>(qs);
+			//Create a logical device from the physical device
+			createLogicalDevice(m_graphicsQueueId, m_presentQueueId, m_computeQueueId);
+		}
+		//Lease the graphical, present and compute queues, the remainder are left for other threads
+		m_graphicsLease = m_queues->tryAcquire(m_graphicsQueueId);
+		m_graphicsQueue = m_graphicsLease.Queue();
+		if (m_presentQueueId != m_graphicsQueueId)
+		{
+			m_presentLease = m_queues->tryAcquire(m_presentQueueId);
+			m_presentQueue = m_presentLease.Queue();
+		}
+		else
+			m_presentQueue = m_graphicsQueue;
+		if (hasAsyncCompute())
+		{
+			m_computeLease = m_queues->tryAcquire(m_computeQueueId);
+			m_computeQueue = m_computeLease.Queue();
+		}
+		else
+			m_computeQueue = m_graphicsQueue;
+		printf("Compute queue family %u%s\n", m_computeQueueId, hasAsyncCompute() ? " (dedicated, async)" : " (shared with graphics)");
+		printf("Transfer queue family %u%s\n", m_queues->Family(QueuePool::Transfer), m_queues->Family(QueuePool::Transfer) != m_computeQueueId ? " (dedicated)" : "");
+		{
+			PROFILE_ZONE("Context::init services");
+			//All device memory is placed through the memory manager, so heap budgets can be respected
+			m_memory = new MemoryManager(m_physicalDevice, m_device, m_memoryBudgetSupported);
+			//Start the shader compiler, GLSL is compiled at runtime and SPIR-V cached to disk
+			m_shaderCompiler = new ShaderCompiler("../shaders/cache");
+			//Watch for shader edits, so pipelines can be rebuilt without restarting
+			m_shaderWatcher = new ShaderWatcher("../shaders", [this](const std::string &f) { onShaderChanged(f); });
+			//Descriptor set and pipeline layouts are built from shader reflection
+			m_layoutCache = new LayoutCache(m_device);
+			//Create/Load pipeline cache
+			setupPipelineCache();
+		}
+		{
+			PROFILE_ZONE("Context::init swapchain");
+			//Create Swapchain and dependencies
+			createSwapchainStuff();
+			createDescriptorPool();
+			//Create semaphores for the swapchain's acquire and present
+			for (unsigned int slot = 0; slot < UniformSlots; ++slot)
+			{
+				m_imageAvailableSemaphores[slot] = m_device.createSemaphore({});
+				m_renderingFinishedSemaphores[slot] = m_device.createSemaphore({});
+			}
+		}
+		{
+			PROFILE_ZONE("Context::init resources");
+			createTextureImage();
+			createTextureImageView();
+			createTextureSampler();
+			//Build a Vertex Buf with model data
+			createVertexBuffer();
+			createIndexBuffer();
+			createUniformBuffer();
+			updateDescriptorSet();
+		}
+		{
+			PROFILE_ZONE("Context::init particles");
+			//GPU particles, simulated by compute and drawn in the forward pass
+			m_particles = new ParticleSystem(*this, m_uniformBuffer, m_uniformStride, UniformSlots, 65536);
+			createParticlePipeline();
+			addComputeWork("particles", [this](vk::CommandBuffer &cb, const unsigned int &frame, const unsigned int &copy) { m_particles->recordCompute(cb, frame, copy); },
+				vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader);
+		}
 		SDL_ShowWindow(m_window);
 		isInit.store(true);
-		/**
-		 * Start Drawing!
-		 **/
-		fillCommandBuffers();
+		//Command buffers are recorded by getNextImage() each frame
 	}
 	catch (std::exception ex)
 	{
@@ -75,29 +133,41 @@ void Context::destroy()
 {
 	if(m_window)
 		SDL_HideWindow(m_window);
-	m_presentQueue.waitIdle();
+	//Shutdown is the only point the GPU is drained, so released resources are then destroyed in the flush below
+	if (m_device)
+		m_device.waitIdle();
+	delete m_shaderWatcher;
+	m_shaderWatcher = nullptr;
+	cancelShaderReloads();
+	removeComputeWork("particles");
+	delete m_particles;
+	m_particles = nullptr;
 	destroyVertexBuffer();
 	destroyIndexBuffer();
 	destroyUniformBuffer();
 	destroyTextureSampler();
 	destroyTextureImageView();
 	destroyTextureImage();
-	destroyFences();
-	if (m_renderingFinishedSemaphore)
-	{
-		m_device.destroySemaphore(m_renderingFinishedSemaphore);
-		m_renderingFinishedSemaphore = nullptr;
-	}
-	if (m_imageAvailableSemaphore)
-	{
-		m_device.destroySemaphore(m_imageAvailableSemaphore);
-		m_imageAvailableSemaphore = nullptr;
-	}
 	backupPipelineCache();
 	destroyPipelineCache();
 	destroySwapchainStuff();
+	for (auto &p : m_computePipelines)
+		delete p;
+	m_computePipelines.clear();
+	m_computeWork.clear();
+	m_deletions.flush();
+	//After the swapchain's image views
+	destroySwapChain();
+	destroySemaphores();
 	destroyDescriptorPool();
+	delete m_layoutCache;
+	m_layoutCache = nullptr;
+	delete m_shaderCompiler;
+	m_shaderCompiler = nullptr;
+	delete m_memory;
+	m_memory = nullptr;
 	destroyLogicalDevice();
+	destroyPhysicalDevice();
 	destroySurface();
 #ifdef _DEBUG
 	destroyDebugCallbacks();
@@ -111,10 +181,13 @@ void Context::rebuildSwapChain()
 {
 	if (ready())
 	{
-		m_device.waitIdle();
+		//Frames in flight keep the old swapchain's resources, which are destroyed once they complete rather than draining the GPU
+		cancelShaderReloads();
 		destroySwapchainStuff();
-		createSwapchainStuff(); 
-		fillCommandBuffers();
+		//The old swapchain is retired by its replacement
+		createSwapchainStuff();
+		m_frameUniformsDirty = true;//Aspect ratio may have changed
+		m_redrawPending = true;
 	}
 }
 /**
@@ -126,26 +199,32 @@ void Context::createSwapchainStuff()
 	createSwapchain();
 	//Create views for the swap chain images
 	createSwapchainImages();
-	//Create GFX pipeline? (framebuffer/commandpool dependent on this for renderpass)
+	//Declare the frame's passes, compiling creates their render passes and transient attachments (e.g. depth)
+	createRenderGraph();
+	//Create GFX pipeline, requires the forward pass's render pass
 	createGraphicsPipeline();
 	//Create the command pool
 	createCommandPool(m_graphicsQueueId);
-	//Create the depth buffer stuff
-	createDepthResources();
-	//Create Framebuffer
-	createFramebuffers();
 	//Create the command buffers, begin Renderpasses (inside each command buff)
 	createCommandBuffers();
+	//Timestamps bracketing each command buffer
+	m_gpuTimer = new GpuTimer(m_physicalDevice, m_device, m_graphicsQueueId, (unsigned int)m_scImages.size());
+	m_computeTimer = new GpuTimer(m_physicalDevice, m_device, m_computeQueueId, (unsigned int)m_scImages.size());
+	createComputeCommandBuffers();
 }
 void Context::destroySwapchainStuff()
 {
+	destroyComputeCommandBuffers();
 	destroyCommandPool();
-	destroyFramebuffers();
-	destroyDepthResources();
-	delete m_gfxPipeline;
-	m_gfxPipeline = nullptr;
+	GpuTimer *gpuTimer = m_gpuTimer, *computeTimer = m_computeTimer;
+	deferDestroy("timer", [gpuTimer, computeTimer]() { delete gpuTimer; delete computeTimer; });
+	m_gpuTimer = nullptr;
+	m_computeTimer = nullptr;
+	destroyGraphicsPipelines();
+	RenderGraph *renderGraph = m_renderGraph;
+	deferDestroy("render graph", [renderGraph]() { delete renderGraph; });
+	m_renderGraph = nullptr;
 	destroySwapChainImages();
-	destroySwapChain();
 }
 std::vector<const char*> Context::requiredInstanceExtensions() const
 {
@@ -190,7 +269,7 @@ void Context::createInstance(const char * title)
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "vk_exp";
 		appInfo.engineVersion = VK_MAKE_VERSION(0, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = VK_API_VERSION_1_1;//vkGetPhysicalDeviceMemoryProperties2 for VK_EXT_memory_budget
 	}
 #ifdef _DEBUG
 	const std::vector<const char*> validationLayers = supportedValidationLayers();
@@ -251,94 +330,206 @@ void Context::createSurface()
 		throw std::exception("createSurface()");
 	}
 }
-std::pair<unsigned int, unsigned int> Context::selectPhysicalDevice()
+std::tuple<unsigned int, unsigned int, unsigned int> Context::selectPhysicalDevice()
 {
-	//Could improve this method to score available devices
-	//https://vulkan-tutorial.com/Drawing_a_triangle/Setup/Physical_devices_and_queue_families
+	//Command line override takes precedence over the environment
+	std::string deviceOverride = m_deviceOverride;
+	if (deviceOverride.empty())
+	{
+		const char *env = SDL_getenv("VK_EXP_DEVICE");
+		if (env)
+			deviceOverride = env;
+	}
 	//Enumerate physical devices
 	std::vector<vk::PhysicalDevice> physicalDevices = m_instance.enumeratePhysicalDevices();
-	//Select most suitable physical device
-	unsigned int chosenGraphicsQueueFamilyIndex = UINT_MAX;
-	unsigned int chosenPresentQueueFamilyIndex = UINT_MAX;
-	for (vk::PhysicalDevice &pd : physicalDevices)
+	struct Candidate
 	{
-		bool hasSwapchainExtension = false;
-
-		vk::PhysicalDeviceProperties pdp = pd.getProperties();
-		if (VK_VERSION_MAJOR(pdp.apiVersion) < 1)
-			continue;
-
-		std::vector<vk::QueueFamilyProperties> pdqf = pd.getQueueFamilyProperties();
-		if (pdqf.empty())
-			continue;
-		unsigned int graphicsQueueFamilyIndex = UINT_MAX;
-		unsigned int  presentQueueFamilyIndex = UINT_MAX;
-		for (unsigned int q_index = 0; q_index < pdqf.size(); ++q_index)
+		DeviceCapabilities *caps;
+		unsigned int graphicsQueueFamilyIndex;
+		unsigned int presentQueueFamilyIndex;
+		unsigned int computeQueueFamilyIndex;
+		int score;//Negative if unsuitable
+	};
+	std::vector<Candidate> candidates;
+	int best = -1;
+	int overridden = -1;
+	printf("Physical devices:\n");
+	for (unsigned int d = 0; d < physicalDevices.size(); ++d)
+	{
+		Candidate c;
 		{
-			vk::QueueFamilyProperties &_pdqf = pdqf[q_index];
-			if (_pdqf.queueCount == 0)
-				continue;
-			if (_pdqf.queueFlags.operator&(vk::QueueFlags(VK_QUEUE_GRAPHICS_BIT)))
-				graphicsQueueFamilyIndex = q_index;
-			if (pd.getSurfaceSupportKHR(q_index, m_surface))
-			{
-				presentQueueFamilyIndex = q_index;
-				if (_pdqf.queueFlags.operator&(vk::QueueFlags(VK_QUEUE_GRAPHICS_BIT)))
-					break; // use this queue because it can present and do graphics
-			}
+			c.caps = new DeviceCapabilities(physicalDevices[d]);
+			c.graphicsQueueFamilyIndex = UINT_MAX;
+			c.presentQueueFamilyIndex = UINT_MAX;
+			c.computeQueueFamilyIndex = UINT_MAX;
+			c.score = -1;
 		}
-		if (graphicsQueueFamilyIndex == UINT_MAX) // no good queues found
-			continue;
-		if (presentQueueFamilyIndex == UINT_MAX) // no good queues found
+		const vk::PhysicalDeviceProperties &pdp = c.caps->Properties();
+		//Queue synchronisation is built on timeline semaphores
+		if (pdp.apiVersion >= VK_API_VERSION_1_1
+			&& c.caps->hasExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME)
+			&& c.caps->hasExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)
+			&& selectQueueFamilies(*c.caps, c.graphicsQueueFamilyIndex, c.presentQueueFamilyIndex, c.computeQueueFamilyIndex))
+			c.score = scoreDevice(*c.caps, c.graphicsQueueFamilyIndex, c.presentQueueFamilyIndex, c.computeQueueFamilyIndex);
+		printf("\t%u: %s (%s, %lluMB device local, UUID %s%s): ", d, pdp.deviceName, vk::to_string(pdp.deviceType).c_str(),
+			(unsigned long long)(c.caps->DeviceLocalBytes() >> 20), c.caps->UUIDString().c_str(), c.caps->LoadedFromCache() ? ", cached" : "");
+		if (c.score >= 0)
+			printf("score %d\n", c.score);
+		else
+			printf("unsuitable\n");
+		if (c.score >= 0 && (best < 0 || c.score > candidates[best].score))
+			best = (int)d;
+		if (c.score >= 0 && overridden < 0 && !deviceOverride.empty() && matchesDeviceOverride(deviceOverride, *c.caps, d))
+			overridden = (int)d;
+		candidates.push_back(c);
+	}
+	if (!deviceOverride.empty() && overridden < 0)
+		fprintf(stderr, "Device override '%s' matches no suitable device, using the highest scoring.\n", deviceOverride.c_str());
+	const int chosen = overridden >= 0 ? overridden : best;
+	for (int d = 0; d < (int)candidates.size(); ++d)
+	{
+		if (d != chosen)
+			delete candidates[d].caps;
+	}
+	if (chosen < 0)
+	{//if(physicalDevice)
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Vulkan: no viable physical devices found");
+		throw std::exception("selectPhysicalDevice()");
+	}
+	const Candidate &c = candidates[chosen];
+	m_capabilities = c.caps;
+	m_physicalDevice = c.caps->PhysicalDevice();
+	printf("Using device %d: %s%s\n", chosen, c.caps->Properties().deviceName, overridden >= 0 ? " (override)" : "");
+	return std::make_tuple(c.graphicsQueueFamilyIndex, c.presentQueueFamilyIndex, c.computeQueueFamilyIndex);
+}
+bool Context::selectQueueFamilies(const DeviceCapabilities &caps, unsigned int &graphics, unsigned int &present, unsigned int &compute) const
+{
+	const std::vector<vk::QueueFamilyProperties> &pdqf = caps.QueueFamilies();
+	graphics = UINT_MAX;
+	present = UINT_MAX;
+	for (unsigned int q_index = 0; q_index < pdqf.size(); ++q_index)
+	{
+		const vk::QueueFamilyProperties &_pdqf = pdqf[q_index];
+		if (_pdqf.queueCount == 0)
 			continue;
-		std::vector<vk::ExtensionProperties> pde = pd.enumerateDeviceExtensionProperties();
-		for (auto &_pde : pde)
+		if (_pdqf.queueFlags & vk::QueueFlagBits::eGraphics)
+			graphics = q_index;
+		//Surface support is per surface, so is never cached
+		if (caps.PhysicalDevice().getSurfaceSupportKHR(q_index, m_surface))
 		{
-			if (0 == strcmp(_pde.extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
-			{
-				hasSwapchainExtension = true;
-				break;
-			}
+			present = q_index;
+			if (_pdqf.queueFlags & vk::QueueFlagBits::eGraphics)
+				break; // use this queue because it can present and do graphics
 		}
-		if (!hasSwapchainExtension)
-			continue;
-		m_physicalDeviceFeatures = pd.getFeatures();
-		m_physicalDevice = pd;
-		chosenGraphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
-		chosenPresentQueueFamilyIndex = presentQueueFamilyIndex;
-		break;
 	}
-	if (chosenGraphicsQueueFamilyIndex == UINT_MAX || chosenPresentQueueFamilyIndex == UINT_MAX)
-	{//if(physicalDevice)
-		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Vulkan: no viable physical devices found");
-		throw std::exception("selectPhysicalDevice()");
+	if (graphics == UINT_MAX || present == UINT_MAX) // no good queues found
+		return false;
+	//A compute-only family executes independently of graphics work, otherwise share the graphics family (which always supports compute)
+	compute = graphics;
+	for (unsigned int q_index = 0; q_index < pdqf.size(); ++q_index)
+	{
+		if (pdqf[q_index].queueCount && (pdqf[q_index].queueFlags & vk::QueueFlagBits::eCompute) && !(pdqf[q_index].queueFlags & vk::QueueFlagBits::eGraphics))
+		{
+			compute = q_index;
+			break;
+		}
+	}
+	return true;
+}
+int Context::scoreDevice(const DeviceCapabilities &caps, const unsigned int &graphics, const unsigned int &present, const unsigned int &compute)
+{
+	int score = 0;
+	//Type dominates, so a software rasteriser is only used as a last resort
+	switch (caps.Properties().deviceType)
+	{
+	case vk::PhysicalDeviceType::eDiscreteGpu: score += 10000; break;
+	case vk::PhysicalDeviceType::eIntegratedGpu: score += 5000; break;
+	case vk::PhysicalDeviceType::eVirtualGpu: score += 1000; break;
+	case vk::PhysicalDeviceType::eCpu: break;
+	default: score += 500; break;
+	}
+	//VRAM, 1 per 64MB up to 256GB
+	score += (int)std::min<vk::DeviceSize>(caps.DeviceLocalBytes() >> 26, 4096);
+	//Features
+	if (caps.Properties().apiVersion >= VK_API_VERSION_1_1)
+		score += 100;//Multiview, memory budget
+	if (caps.hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+		score += 25;
+	if (caps.Features().samplerAnisotropy)
+		score += 50;
+	//Queue layout
+	if (graphics == present)
+		score += 100;
+	if (compute != graphics)
+		score += 100;//Async compute
+	for (auto &f : caps.QueueFamilies())
+	{
+		if (f.queueCount && (f.queueFlags & vk::QueueFlagBits::eTransfer) && !(f.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+		{
+			score += 50;//Dedicated transfer (DMA) engine
+			break;
+		}
 	}
-	return std::make_pair(chosenGraphicsQueueFamilyIndex, chosenPresentQueueFamilyIndex);
+	return score;
+}
+bool Context::matchesDeviceOverride(const std::string &deviceOverride, const DeviceCapabilities &caps, const unsigned int &index)
+{
+	//Index
+	if (deviceOverride.find_first_not_of("0123456789") == std::string::npos)
+		return (unsigned int)std::stoul(deviceOverride) == index;
+	std::string lower = deviceOverride;
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](char ch) { return (char)tolower(ch); });
+	//UUID, as printed or with dashes
+	std::string hex = lower;
+	hex.erase(std::remove(hex.begin(), hex.end(), '-'), hex.end());
+	if (hex.size() == VK_UUID_SIZE * 2 && hex.find_first_not_of("0123456789abcdef") == std::string::npos)
+		return hex == caps.UUIDString();
+	//Case insensitive substring of the name
+	std::string name = caps.Properties().deviceName;
+	std::transform(name.begin(), name.end(), name.begin(), [](char ch) { return (char)tolower(ch); });
+	return name.find(lower) != std::string::npos;
 }
-void Context::createLogicalDevice(unsigned int graphicsQIndex, unsigned int presentQIndex)
+void Context::createLogicalDevice(unsigned int graphicsQIndex, unsigned int presentQIndex, unsigned int computeQIndex)
 {
-	static const std::vector<const char*> deviceExtensionNames = {
+	std::vector<const char*> deviceExtensionNames = {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+		VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
 	};
-	const float priority = 1.0f;
-	std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
-	std::set<unsigned int> uniqueQueueFamilies = { graphicsQIndex, presentQIndex };
-	for (int queueFamily : uniqueQueueFamilies) {
-		vk::DeviceQueueCreateInfo deviceQueueCreateInfo;
-		{//Graphics q
-			deviceQueueCreateInfo.flags = {};
-			deviceQueueCreateInfo.queueFamilyIndex = queueFamily;
-			deviceQueueCreateInfo.queueCount = 1;
-			deviceQueueCreateInfo.pQueuePriorities = &priority;
+	//Optional extensions
+	m_memoryBudgetSupported = m_capabilities->hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (m_memoryBudgetSupported)
+		deviceExtensionNames.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	//Multiview is core in Vulkan 1.1, but remains an optional feature
+	m_multiviewSupported = false;
+	m_maxViews = 1;
+	if (m_capabilities->Properties().apiVersion >= VK_API_VERSION_1_1)
+	{
+		auto features = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceMultiviewFeatures>();
+		m_multiviewSupported = features.get<vk::PhysicalDeviceMultiviewFeatures>().multiview == VK_TRUE;
+		if (m_multiviewSupported)
+		{
+			auto properties = m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceMultiviewProperties>();
+			m_maxViews = std::min<uint32_t>(FrameUniforms::MaxViews, properties.get<vk::PhysicalDeviceMultiviewProperties>().maxMultiviewViewCount);
 		}
-		queueCreateInfos.push_back(deviceQueueCreateInfo);
 	}
+	vk::PhysicalDeviceMultiviewFeatures multiviewFeatures;
+	{
+		multiviewFeatures.multiview = m_multiviewSupported;
+	}
+	vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures;
+	{
+		timelineFeatures.timelineSemaphore = VK_TRUE;
+		multiviewFeatures.pNext = &timelineFeatures;
+	}
+	//Queues for each role's family, including any transfer-only family, several per family where available
+	m_queues = new QueuePool(*m_capabilities, graphicsQIndex, presentQIndex, computeQIndex);
+	const std::vector<vk::DeviceQueueCreateInfo> &queueCreateInfos = m_queues->CreateInfos();
 	vk::PhysicalDeviceFeatures pdf;
 	{
 		/**
 		* Enable features like geometry shaders here
 		*/
-		pdf.samplerAnisotropy = m_physicalDeviceFeatures.samplerAnisotropy;
+		pdf.samplerAnisotropy = m_capabilities->Features().samplerAnisotropy;
 		//pdf.geometryShader = true;
 	}
 #ifdef _DEBUG
@@ -359,75 +550,50 @@ void Context::createLogicalDevice(unsigned int graphicsQIndex, unsigned int pres
 		deviceCreateInfo.enabledExtensionCount = (unsigned int)deviceExtensionNames.size();
 		deviceCreateInfo.ppEnabledExtensionNames = deviceExtensionNames.data();
 		deviceCreateInfo.pEnabledFeatures = &pdf;
+		deviceCreateInfo.pNext = &multiviewFeatures;
 	}
 	m_device = m_physicalDevice.createDevice(deviceCreateInfo);
     m_dynamicLoader = vk::DispatchLoaderDynamic(m_instance, m_device);
+	m_queues->init(m_physicalDevice, m_device, m_dynamicLoader);
 }
 vk::PresentModeKHR Context::selectPresentMode()
 {//https://vulkan.lunarg.com/doc/view/1.0.26.0/linux/vkspec.chunked/ch29s05.html#VkPresentModeKHR
 	std::vector<vk::PresentModeKHR> pm = m_physicalDevice.getSurfacePresentModesKHR(m_surface);
-	vk::PresentModeKHR bestMode = vk::PresentModeKHR::eFifo;//Vsync
-	for (const auto& availablePresentMode : pm) {
-		if (availablePresentMode == vk::PresentModeKHR::eMailbox) {//Vsync where fast frames cause frames to be skipped if 2nd is delivered before vsync barrier
-			return availablePresentMode;
-		}
-		//else if (availablePresentMode == vk::PresentModeKHR::eImmediate) {//Immediate mode, not support on NV?
-		//	bestMode = availablePresentMode;
-		//}
-	}
-	return bestMode;
+	if (std::find(pm.begin(), pm.end(), m_presentMode) != pm.end())
+		return m_presentMode;
+	fprintf(stderr, "Present mode %s is not supported by this surface, falling back to %s.\n", vk::to_string(m_presentMode).c_str(), vk::to_string(vk::PresentModeKHR::eFifo).c_str());
+	return vk::PresentModeKHR::eFifo;//Vsync, support is required by the spec
 }
 void Context::createDescriptorPool()
 {
-	/*Uniform Buffer Descriptor Set Layout*/
-	vk::DescriptorSetLayoutBinding uniformBufferLayoutBinding;
-	{
-		uniformBufferLayoutBinding.binding = 0;
-		uniformBufferLayoutBinding.descriptorType = vk::DescriptorType::eUniformBuffer;
-		uniformBufferLayoutBinding.descriptorCount = 1;
-		uniformBufferLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eVertex;
-		uniformBufferLayoutBinding.pImmutableSamplers = nullptr;
-	}
-	/*Texture Sampler Descriptor Set Layout*/
-	vk::DescriptorSetLayoutBinding textureSamplerLayoutBinding;
-	{
-		textureSamplerLayoutBinding.binding = 1;
-		textureSamplerLayoutBinding.descriptorType = vk::DescriptorType::eCombinedImageSampler;
-		textureSamplerLayoutBinding.descriptorCount = 1;
-		textureSamplerLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eFragment;
-		textureSamplerLayoutBinding.pImmutableSamplers = nullptr;
-	} 
-	std::array<vk::DescriptorSetLayoutBinding, 2> bindings = { uniformBufferLayoutBinding, textureSamplerLayoutBinding };
-	vk::DescriptorSetLayoutCreateInfo descSetCreateInfo;
-	{
-		descSetCreateInfo.bindingCount = (unsigned int)bindings.size();
-		descSetCreateInfo.pBindings = bindings.data();
-	}
-	m_descriptorSetLayout = m_device.createDescriptorSetLayout(descSetCreateInfo);
+	//Layouts are shared via the cache, so the set remains compatible with pipelines rebuilt from the same shaders
+	m_descriptorSetLayout = m_gfxPipeline->DescriptorSetLayout(0);
 	/*Desc Pool*/
-	std::array<vk::DescriptorPoolSize, 2> poolSizes;
-	{
-		poolSizes[0].type = vk::DescriptorType::eUniformBuffer;
-		poolSizes[0].descriptorCount = 1;
-		poolSizes[1].type = vk::DescriptorType::eCombinedImageSampler;
-		poolSizes[1].descriptorCount = 1;
-	}
+	std::map<vk::DescriptorType, unsigned int> descriptorCounts;
+	for (auto &b : m_layoutCache->Bindings(m_descriptorSetLayout))
+		descriptorCounts[b.descriptorType] += b.descriptorCount * UniformSlots;
+	std::vector<vk::DescriptorPoolSize> poolSizes;
+	for (auto &dc : descriptorCounts)
+		poolSizes.push_back(vk::DescriptorPoolSize(dc.first, dc.second));
 	vk::DescriptorPoolCreateInfo poolCreateInfo;
 	{
 		poolCreateInfo.poolSizeCount = (unsigned int)poolSizes.size();
 		poolCreateInfo.pPoolSizes = poolSizes.data();
-		poolCreateInfo.maxSets = 1;
+		poolCreateInfo.maxSets = UniformSlots;
 		poolCreateInfo.flags = {};
 	}
 	m_descriptorPool = m_device.createDescriptorPool(poolCreateInfo);
-	vk::DescriptorSetLayout layouts[] = { m_descriptorSetLayout };
+	//One set per uniform slot, differing only in the slot bound
+	const std::vector<vk::DescriptorSetLayout> layouts(UniformSlots, m_descriptorSetLayout);
 	vk::DescriptorSetAllocateInfo descSetAllocInfo;
 	{
 		descSetAllocInfo.descriptorPool = m_descriptorPool;
-		descSetAllocInfo.descriptorSetCount = 1;
-		descSetAllocInfo.pSetLayouts = layouts;
+		descSetAllocInfo.descriptorSetCount = UniformSlots;
+		descSetAllocInfo.pSetLayouts = layouts.data();
 	}
-	m_descriptorSet = m_device.allocateDescriptorSets(descSetAllocInfo)[0];
+	const std::vector<vk::DescriptorSet> sets = m_device.allocateDescriptorSets(descSetAllocInfo);
+	for (unsigned int slot = 0; slot < UniformSlots; ++slot)
+		m_descriptorSets[slot] = sets[slot];
 }
 void Context::createSwapchain()
 {
@@ -465,6 +631,7 @@ void Context::createSwapchain()
 			}
 		}
 	}
+	m_activePresentMode = selectPresentMode();
 	//Select size
 	int windowWidth = 0, windowHeight = 0;
 	SDL_Vulkan_GetDrawableSize(m_window, &windowWidth, &windowHeight);
@@ -481,17 +648,24 @@ void Context::createSwapchain()
 		swapChainCreateInfo.imageColorSpace = m_surfaceFormat.colorSpace;
 		swapChainCreateInfo.imageExtent = m_swapchainDims;
 		swapChainCreateInfo.imageArrayLayers = 1; //Always 1 unless stereo rendering
-		swapChainCreateInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment;
+		swapChainCreateInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst;//Multiview composes by blit
 		swapChainCreateInfo.imageSharingMode = vk::SharingMode::eExclusive,
 		swapChainCreateInfo.queueFamilyIndexCount = 0;//Unnecessary for eExclusive
 		swapChainCreateInfo.pQueueFamilyIndices = nullptr;
 		swapChainCreateInfo.preTransform = surfaceCap.currentTransform;
 		swapChainCreateInfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque;
-		swapChainCreateInfo.presentMode = selectPresentMode();
+		swapChainCreateInfo.presentMode = m_activePresentMode;
 		swapChainCreateInfo.clipped = true;
-		swapChainCreateInfo.oldSwapchain = nullptr;
+		swapChainCreateInfo.oldSwapchain = m_swapchain;//Null unless rebuilding
 	}
+	const vk::SwapchainKHR oldSwapchain = m_swapchain;
 	m_swapchain = m_device.createSwapchainKHR(swapChainCreateInfo);
+	if (oldSwapchain)
+		deferDestroy("swapchain", [this, oldSwapchain]() { m_device.destroySwapchainKHR(oldSwapchain); });
+	//Pacing targets the display's refresh
+	SDL_DisplayMode displayMode;
+	const int refreshRate = SDL_GetWindowDisplayMode(m_window, &displayMode) == 0 && displayMode.refresh_rate > 0 ? displayMode.refresh_rate : 60;
+	m_pacer.reset(m_activePresentMode, 1000.0 / refreshRate);
 }
 void Context::createSwapchainImages()
 {
@@ -501,24 +675,8 @@ void Context::createSwapchainImages()
 	{
 		m_scImageViews[i] = createImageView(m_scImages[i], m_surfaceFormat.format, vk::ImageAspectFlagBits::eColor);
 	}
-}
-void Context::createFramebuffers()
-{
-	m_scFramebuffers.resize(m_scImageViews.size());
-	for (size_t i = 0; i < m_scImageViews.size(); i++) {
-		//Can reuse depth as only one subpass operates at a time, due to use of semaphores
-		std::array<vk::ImageView, 2> attachments = { m_scImageViews[i], m_depthImageView };
-		vk::FramebufferCreateInfo fbCreate;
-		{
-			fbCreate.renderPass = m_gfxPipeline->RenderPass();
-			fbCreate.attachmentCount = (unsigned int)attachments.size();
-			fbCreate.pAttachments = attachments.data();
-			fbCreate.width = m_swapchainDims.width;
-			fbCreate.height = m_swapchainDims.height;
-			fbCreate.layers = 1;
-		}
-		m_scFramebuffers[i] = m_device.createFramebuffer(fbCreate);
-	}
+	//The images' command buffers are new, so nothing need be waited on before their first use
+	m_imageSync.assign(m_scImages.size(), QueuePool::SyncPoint());
 }
 void Context::setupPipelineCache()
 {
@@ -563,82 +721,118 @@ void Context::createCommandPool(unsigned int graphicsQIndex)
 	// createCommandPool();
 	vk::CommandPoolCreateInfo commandPoolCreateInfo;
 	{
-		commandPoolCreateInfo.flags = {};// vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient;
+		commandPoolCreateInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;//Individual command buffers are re-recorded after pipeline swaps
+
 		commandPoolCreateInfo.queueFamilyIndex = graphicsQIndex;
 	}
 	m_commandPool = m_device.createCommandPool(commandPoolCreateInfo);
 	//createCommandBuffers();
 }
-void Context::createDepthResources()
-{
-	vk::Format depthFormat = findDepthFormat();
-	createImage(m_swapchainDims.width, m_swapchainDims.height, depthFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal, m_depthImage, m_depthImageMemory);
-	m_depthImageView = createImageView(m_depthImage, depthFormat, vk::ImageAspectFlagBits::eDepth);
-	transitionImageLayout(m_depthImage, depthFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-}
 void Context::createCommandBuffers()
 {
 	vk::CommandBufferAllocateInfo commandBufferAllocInfo;
 	{
 		commandBufferAllocInfo.commandPool = m_commandPool;
 		commandBufferAllocInfo.level = vk::CommandBufferLevel::ePrimary;
-		commandBufferAllocInfo.commandBufferCount = (unsigned int)m_scFramebuffers.size();
+		commandBufferAllocInfo.commandBufferCount = (unsigned int)m_scImages.size();
 	}
 	m_commandBuffers = m_device.allocateCommandBuffers(commandBufferAllocInfo);
 }
-void Context::createFences()
+void Context::createComputeCommandBuffers()
 {
-	m_fences.resize(m_scImages.size());
-	for (unsigned int i = 0; i < m_scImages.size(); i++)
+	vk::CommandPoolCreateInfo commandPoolCreateInfo;
 	{
-		try
-		{
-			m_fences[i] = m_device.createFence({ vk::FenceCreateFlagBits::eSignaled });
-		}
-		catch (...)
-		{
-			for (; i > 0; i--)
-			{
-				m_device.destroyFence(m_fences[i - 1]);
-			}
-			m_fences.clear();
-			throw;
-		}
+		commandPoolCreateInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient;//Re-recorded every frame
+		commandPoolCreateInfo.queueFamilyIndex = m_computeQueueId;
 	}
+	m_computeCommandPool = m_device.createCommandPool(commandPoolCreateInfo);
+	vk::CommandBufferAllocateInfo commandBufferAllocInfo;
+	{
+		commandBufferAllocInfo.commandPool = m_computeCommandPool;
+		commandBufferAllocInfo.level = vk::CommandBufferLevel::ePrimary;
+		commandBufferAllocInfo.commandBufferCount = (unsigned int)m_scImages.size();
+	}
+	m_computeCommandBuffers = m_device.allocateCommandBuffers(commandBufferAllocInfo);
 }
-void Context::fillCommandBuffers()
+void Context::fillCommandBuffer(unsigned int i)
 {
-	for (unsigned int i = 0; i<m_commandBuffers.size(); ++i)
+	PROFILE_FUNCTION();
+	vk::CommandBufferBeginInfo cbBegin;
 	{
-		vk::CommandBufferBeginInfo cbBegin;
+		cbBegin.flags = {};//The image's sync point is waited on before resubmission, so simultaneous use is unnecessary
+		cbBegin.pInheritanceInfo = nullptr;
+	}
+	m_commandBuffers[i].begin(cbBegin);
+	//The graph records each pass with the barriers/layout transitions between them
+	m_renderGraph->setImportedImage(m_rgBackbuffer, m_scImages[i], m_scImageViews[i]);
+	submitDraws();
+	//Scene passes render to the dynamic resolution's scaled region of their attachments
+	const vk::Extent2D area = renderExtent();
+	m_renderGraph->setRenderArea(m_rgForward, area);
+	if (m_depthPrepass)
+		m_renderGraph->setRenderArea(m_rgDepthPrepass, area);
+	m_gpuTimer->begin(m_commandBuffers[i], i);
+	m_renderGraph->execute(m_commandBuffers[i]);
+	m_gpuTimer->end(m_commandBuffers[i], i);
+	m_commandBuffers[i].end();
+}
+void Context::recordForwardPass(vk::CommandBuffer &cb)
+{
+	m_renderQueue.record(cb, ForwardDraws);
+	//Blended without sorting, after the queue's transparent draws
+	if (m_particles)
+		m_particles->recordDraw(cb, m_uniformSlot);
+}
+void Context::recordDepthPrepass(vk::CommandBuffer &cb)
+{
+	m_renderQueue.record(cb, DepthPrepassDraws);
+}
+void Context::submitDraws()
+{
+	//The two quads of tempIndices, the nearer (z=0) is alpha blended over the other
+	struct SceneDraw
+	{
+		uint32_t firstIndex;
+		glm::vec3 centre;//Model space, used for culling and depth sorting
+		float radius;//Bounding sphere, the model matrix is rigid so this holds in world space
+		bool transparent;
+	};
+	static const SceneDraw scene[] = {
+		{ 0, glm::vec3(0.0f, 0.0f, -0.5f), 0.7072f, false },
+		{ 6, glm::vec3(0.0f, 0.0f, 0.0f), 0.7072f, true },
+	};
+	const glm::mat4 &view = m_camera.view();
+	//Multiview draws every view at once, each view is offset from the camera along its right axis by up to this
+	//so spheres are grown by it, which keeps any draw a view sees
+	const float maxViewOffset = (m_viewCount - 1) * 0.5f * m_viewSeparation;
+	m_renderQueue.clear();
+	for (unsigned int i = 0; i < sizeof(scene) / sizeof(SceneDraw); ++i)
+	{
+		const glm::vec4 centre = m_drawConstants.model * glm::vec4(scene[i].centre, 1.0f);
+		if (!m_camera.frustum().intersectsSphere(glm::vec3(centre), scene[i].radius + maxViewOffset))
+			continue;
+		RenderQueue::Draw draw;
 		{
-			cbBegin.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;//Command buffer can be resubmitted whilst awaiting execution
-			cbBegin.pInheritanceInfo = nullptr;
+			draw.pipeline = scene[i].transparent ? m_transparentPipeline : m_gfxPipeline;
+			draw.descriptorSet = m_descriptorSets[m_uniformSlot];
+			draw.vertexBuffer = m_vertexBuffer;
+			draw.indexBuffer = m_indexBuffer;
+			draw.firstIndex = scene[i].firstIndex;
+			draw.indexCount = 6;
+			draw.constants = m_drawConstants;
+			draw.constants.objectIndex = i;
 		}
-		m_commandBuffers[i].begin(cbBegin);
-		vk::RenderPassBeginInfo rpBegin;
-		std::array<vk::ClearValue, 2> clearValues = {};
-		clearValues[0].color = vk::ClearColorValue(std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 1.0f });
-		clearValues[1].depthStencil = vk::ClearDepthStencilValue(1.0f, 0);
+		//View space looks down -z
+		const float viewDepth = -(view * centre).z;
+		m_renderQueue.submit(ForwardDraws, draw, viewDepth, scene[i].transparent);
+		//Transparent draws must not occlude what is behind them, so are excluded from the pre-pass
+		if (m_depthPrepass && !scene[i].transparent)
 		{
-			rpBegin.renderPass = m_gfxPipeline->RenderPass();
-			rpBegin.framebuffer = m_scFramebuffers[i];
-			rpBegin.renderArea.offset = vk::Offset2D({ 0, 0 });
-			rpBegin.renderArea.extent = m_swapchainDims;
-			rpBegin.clearValueCount = (unsigned int)clearValues.size();
-			rpBegin.pClearValues = clearValues.data();
+			draw.pipeline = m_depthPipeline;
+			m_renderQueue.submit(DepthPrepassDraws, draw, viewDepth, false);
 		}
-		m_commandBuffers[i].beginRenderPass(rpBegin, vk::SubpassContents::eInline);
-		m_commandBuffers[i].bindPipeline(vk::PipelineBindPoint::eGraphics, m_gfxPipeline->Pipeline());
-		m_commandBuffers[i].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_gfxPipeline->PipelineLayout(), 0, { m_descriptorSet }, {});
-		VkDeviceSize offsets[] = { 0 };
-		m_commandBuffers[i].bindVertexBuffers(0, 1, &m_vertexBuffer, offsets);
-		m_commandBuffers[i].bindIndexBuffer(m_indexBuffer, 0, vk::IndexType::eUint16);
-		//m_commandBuffers[i].draw((unsigned int)tempVertices.size(), 1, 0, 0);//Drawing triangles without index
-		m_commandBuffers[i].drawIndexed((unsigned int)tempIndices.size(), 1, 0, 0, 0);
-		m_commandBuffers[i].endRenderPass();
-		m_commandBuffers[i].end();
 	}
+	m_renderQueue.sort();
 }
 void Context::createTextureImage()
 {
@@ -655,7 +849,7 @@ void Context::createTextureImage()
 	createBuffer(
 		imageSize,
 		vk::BufferUsageFlagBits::eTransferSrc,
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		MemoryManager::Usage(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, {}, vk::MemoryPropertyFlagBits::eDeviceLocal),//Leave device local host visible memory for streaming
 		stagingBuffer,
 		stagingBufferMemory
 	); 
@@ -664,40 +858,47 @@ void Context::createTextureImage()
 	memcpy(data, pixels, imageSize);
 	m_device.unmapMemory(stagingBufferMemory); 
 	stbi_image_free(pixels);
+	//Mipmaps are generated with linear blits, which not all formats support
+	const vk::Format format = vk::Format::eR8G8B8A8Unorm;
+	m_textureMipLevels = 1;
+	if (m_capabilities->FormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear)
+	{
+		for (int dim = std::max(texWidth, texHeight); dim > 1; dim /= 2)
+			m_textureMipLevels++;
+	}
 	createImage(
 		(uint32_t)texWidth,
 		(uint32_t)texHeight,
-		vk::Format::eR8G8B8A8Unorm,
+		format,
 		vk::ImageTiling::eOptimal,
-		vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-		vk::MemoryPropertyFlagBits::eDeviceLocal,
-		m_textureImage,
-		m_textureImageMemory
-	);
-	transitionImageLayout(
+		vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		MemoryManager::Usage({}, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlagBits::eHostVisible),//Falls back to system memory under pressure
 		m_textureImage,
-		vk::Format::eR8G8B8A8Unorm,
-		vk::ImageLayout::eUndefined,
-		vk::ImageLayout::eTransferDstOptimal
+		m_textureImageMemory,
+		m_textureMipLevels
 	);
+	m_imageLayouts.track(m_textureImage, format, m_textureMipLevels);
+	//Upload, mip generation and transitions are recorded into a single submission
+	vk::CommandBuffer cb = beginSingleTimeCommands();
+	m_imageLayouts.transition(m_textureImage, vk::ImageLayout::eTransferDstOptimal);
+	m_imageLayouts.flush(cb);
 	copyBufferToImage(
+		cb,
 		stagingBuffer,
 		m_textureImage,
 		(uint32_t)texWidth,
 		(uint32_t)texHeight
 	);
-	transitionImageLayout(
-		m_textureImage,
-		vk::Format::eR8G8B8A8Unorm,
-		vk::ImageLayout::eTransferDstOptimal,
-		vk::ImageLayout::eShaderReadOnlyOptimal
-	);
+	generateMipmaps(cb, m_textureImage, texWidth, texHeight, m_textureMipLevels);
+	m_imageLayouts.transition(m_textureImage, vk::ImageLayout::eShaderReadOnlyOptimal);
+	m_imageLayouts.flush(cb);
+	endSingleTimeCommands(cb);
 	m_device.destroyBuffer(stagingBuffer);
-	m_device.freeMemory(stagingBufferMemory);
+	freeMemory(stagingBufferMemory);
 }
 void Context::createTextureImageView()
 {
-	m_textureImageView = createImageView(m_textureImage, vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor);
+	m_textureImageView = createImageView(m_textureImage, vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, m_textureMipLevels);
 }
 void Context::createTextureSampler()
 {
@@ -708,7 +909,7 @@ void Context::createTextureSampler()
 		samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
 		samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
 		samplerInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
-		samplerInfo.anisotropyEnable = m_physicalDeviceFeatures.samplerAnisotropy;
+		samplerInfo.anisotropyEnable = m_capabilities->Features().samplerAnisotropy;
 		samplerInfo.maxAnisotropy = 16;
 		samplerInfo.borderColor = vk::BorderColor::eIntOpaqueBlack;
 		samplerInfo.unnormalizedCoordinates = false;
@@ -717,7 +918,7 @@ void Context::createTextureSampler()
 		samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
 		samplerInfo.mipLodBias = 0.0f;
 		samplerInfo.minLod = 0.0f;
-		samplerInfo.maxLod = 0.0f;
+		samplerInfo.maxLod = (float)m_textureMipLevels;
 	}
 	m_textureSampler = m_device.createSampler(samplerInfo);
 }
@@ -730,7 +931,7 @@ void Context::createVertexBuffer()
 	createBuffer(
 		buffSize,
 		vk::BufferUsageFlagBits::eTransferSrc,
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		MemoryManager::Usage(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, {}, vk::MemoryPropertyFlagBits::eDeviceLocal),//Leave device local host visible memory for streaming
 		stagingBuffer,
 		stagingBufferMemory
 	);
@@ -741,13 +942,13 @@ void Context::createVertexBuffer()
 	createBuffer(
 		buffSize,
 		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		MemoryManager::Usage({}, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlagBits::eHostVisible),//Falls back to system memory under pressure
 		m_vertexBuffer,
 		m_vertexBufferMemory
 	);
 	copyBuffer(stagingBuffer, m_vertexBuffer, buffSize);
 	m_device.destroyBuffer(stagingBuffer);
-	m_device.freeMemory(stagingBufferMemory);
+	freeMemory(stagingBufferMemory);
 	//Mapped buffer data transfer
 	/*
 	createBuffer(
@@ -773,7 +974,7 @@ void Context::createIndexBuffer()
 	createBuffer(
 		buffSize,
 		vk::BufferUsageFlagBits::eTransferSrc,
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		MemoryManager::Usage(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, {}, vk::MemoryPropertyFlagBits::eDeviceLocal),//Leave device local host visible memory for streaming
 		stagingBuffer,
 		stagingBufferMemory
 	);
@@ -784,129 +985,157 @@ void Context::createIndexBuffer()
 	createBuffer(
 		buffSize,
 		vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		MemoryManager::Usage({}, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlagBits::eHostVisible),//Falls back to system memory under pressure
 		m_indexBuffer,
 		m_indexBufferMemory
 	);
 	copyBuffer(stagingBuffer, m_indexBuffer, buffSize);
 	m_device.destroyBuffer(stagingBuffer);
-	m_device.freeMemory(stagingBufferMemory);
+	freeMemory(stagingBufferMemory);
 }
 void Context::createUniformBuffer()
 {
-	size_t buffSize = sizeof(UniformBufferObject);
+	const vk::DeviceSize alignment = std::max<vk::DeviceSize>(m_capabilities->Properties().limits.minUniformBufferOffsetAlignment, 1);
+	m_uniformStride = (sizeof(FrameUniforms) + alignment - 1) / alignment * alignment;
+	const vk::DeviceSize buffSize = m_uniformStride * UniformSlots;
 	//Transfer queue data transfer
 	createBuffer(
 		buffSize,
 		vk::BufferUsageFlagBits::eUniformBuffer,
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		MemoryManager::Usage(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlagBits::eDeviceLocal),//Streaming, prefer device local if host visible
 		m_uniformBuffer,
 		m_uniformBufferMemory
 	);
+	m_uniformBufferMapped = m_device.mapMemory(m_uniformBufferMemory, 0, buffSize, {});
+	for (unsigned int slot = 0; slot < UniformSlots; ++slot)
+	{
+		m_uniformSync[slot] = QueuePool::SyncPoint();
+		m_uniformSlotVersion[slot] = 0;
+	}
+	m_frameUniformsDirty = true;
 }
 void Context::updateDescriptorSet()
 {
-	vk::DescriptorBufferInfo bufferInfo;
-	{
-		bufferInfo.buffer = m_uniformBuffer;
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
-	}
-	vk::DescriptorImageInfo imageInfo;
+	for (unsigned int slot = 0; slot < UniformSlots; ++slot)
 	{
-		imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-		imageInfo.imageView = m_textureImageView;
-		imageInfo.sampler = m_textureSampler;
-	}
-	std::array<vk::WriteDescriptorSet, 2> descWrites;
-	{
-		descWrites[0].dstSet = m_descriptorSet;
-		descWrites[0].dstBinding = 0;
-		descWrites[0].dstArrayElement = 0;
-		descWrites[0].descriptorType = vk::DescriptorType::eUniformBuffer;
-		descWrites[0].descriptorCount = 1;
-		descWrites[0].pBufferInfo = &bufferInfo;
-		descWrites[0].pImageInfo = nullptr;
-		descWrites[0].pTexelBufferView = nullptr;
-	}
-	{
-		descWrites[1].dstSet = m_descriptorSet;
-		descWrites[1].dstBinding = 1;
-		descWrites[1].dstArrayElement = 0;
-		descWrites[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-		descWrites[1].descriptorCount = 1;
-		descWrites[1].pImageInfo = &imageInfo;
-		descWrites[1].pBufferInfo = nullptr;
-		descWrites[1].pTexelBufferView = nullptr;
+		vk::DescriptorBufferInfo bufferInfo;
+		{
+			bufferInfo.buffer = m_uniformBuffer;
+			bufferInfo.offset = slot * m_uniformStride;
+			bufferInfo.range = sizeof(FrameUniforms);
+		}
+		vk::DescriptorImageInfo imageInfo;
+		{
+			imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+			imageInfo.imageView = m_textureImageView;
+			imageInfo.sampler = m_textureSampler;
+		}
+		std::array<vk::WriteDescriptorSet, 2> descWrites;
+		{
+			descWrites[0].dstSet = m_descriptorSets[slot];
+			descWrites[0].dstBinding = 0;
+			descWrites[0].dstArrayElement = 0;
+			descWrites[0].descriptorType = vk::DescriptorType::eUniformBuffer;
+			descWrites[0].descriptorCount = 1;
+			descWrites[0].pBufferInfo = &bufferInfo;
+			descWrites[0].pImageInfo = nullptr;
+			descWrites[0].pTexelBufferView = nullptr;
+		}
+		{
+			descWrites[1].dstSet = m_descriptorSets[slot];
+			descWrites[1].dstBinding = 1;
+			descWrites[1].dstArrayElement = 0;
+			descWrites[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+			descWrites[1].descriptorCount = 1;
+			descWrites[1].pImageInfo = &imageInfo;
+			descWrites[1].pBufferInfo = nullptr;
+			descWrites[1].pTexelBufferView = nullptr;
+		}
+		m_device.updateDescriptorSets((unsigned int)descWrites.size(), descWrites.data(), 0, nullptr);
 	}
-	m_device.updateDescriptorSets((unsigned int)descWrites.size(), descWrites.data(), 0, nullptr);
 }
 /**
  * Destruction utility fns
  */
 void Context::destroyVertexBuffer()
 {
-	m_device.destroyBuffer(m_vertexBuffer);
+	const vk::Buffer buffer = m_vertexBuffer;
+	vk::DeviceMemory memory = m_vertexBufferMemory;
+	deferDestroy("buffer", [this, buffer, memory]() mutable { m_device.destroyBuffer(buffer); freeMemory(memory); });
 	m_vertexBuffer = nullptr;
-	m_device.freeMemory(m_vertexBufferMemory);
 	m_vertexBufferMemory = nullptr;
 }
 void Context::destroyIndexBuffer()
 {
-	m_device.destroyBuffer(m_indexBuffer);
+	const vk::Buffer buffer = m_indexBuffer;
+	vk::DeviceMemory memory = m_indexBufferMemory;
+	deferDestroy("buffer", [this, buffer, memory]() mutable { m_device.destroyBuffer(buffer); freeMemory(memory); });
 	m_indexBuffer = nullptr;
-	m_device.freeMemory(m_indexBufferMemory);
 	m_indexBufferMemory = nullptr;
 }
 void Context::destroyUniformBuffer()
 {
-	m_device.destroyBuffer(m_uniformBuffer);
+	//Rewritten by the host every frame, so no longer written once released
+	if (m_uniformBufferMapped)
+		m_device.unmapMemory(m_uniformBufferMemory);
+	m_uniformBufferMapped = nullptr;
+	const vk::Buffer buffer = m_uniformBuffer;
+	vk::DeviceMemory memory = m_uniformBufferMemory;
+	deferDestroy("buffer", [this, buffer, memory]() mutable { m_device.destroyBuffer(buffer); freeMemory(memory); });
 	m_uniformBuffer = nullptr;
-	m_device.freeMemory(m_uniformBufferMemory);
 	m_uniformBufferMemory = nullptr;
 }
 void Context::destroyTextureSampler()
 {
-	m_device.destroySampler(m_textureSampler);
+	const vk::Sampler sampler = m_textureSampler;
+	deferDestroy("sampler", [this, sampler]() { m_device.destroySampler(sampler); });
 	m_textureSampler = nullptr;
 }
 void Context::destroyTextureImageView()
 {
-	m_device.destroyImageView(m_textureImageView);
+	const vk::ImageView view = m_textureImageView;
+	deferDestroy("image view", [this, view]() { m_device.destroyImageView(view); });
 	m_textureImageView = nullptr;
 }
 void Context::destroyTextureImage()
 {
-	m_device.destroyImage(m_textureImage);
+	m_imageLayouts.forget(m_textureImage);
+	const vk::Image image = m_textureImage;
+	vk::DeviceMemory memory = m_textureImageMemory;
+	deferDestroy("image", [this, image, memory]() mutable { m_device.destroyImage(image); freeMemory(memory); });
 	m_textureImage = nullptr;
-	m_device.freeMemory(m_textureImageMemory);
 	m_textureImageMemory = nullptr;
 }
-void Context::destroyFences()
+void Context::destroyCommandPool()
 {
-	for (auto &fence : m_fences)
-	{
-		m_device.destroyFence(fence);
+	if(m_commandPool)
+	{//Frees the command buffers
+		const vk::CommandPool pool = m_commandPool;
+		deferDestroy("command pool", [this, pool]() { m_device.destroyCommandPool(pool); });
+		m_commandPool = nullptr;
 	}
-	m_fences.clear();
+	m_commandBuffers.clear();
 }
-void Context::destroyDepthResources()
+void Context::destroyComputeCommandBuffers()
 {
-	m_device.destroyImageView(m_depthImageView);
-	m_device.destroyImage(m_depthImage);
-	m_device.freeMemory(m_depthImageMemory);
+	if (m_computeCommandPool)
+	{//Frees the command buffers
+		const vk::CommandPool pool = m_computeCommandPool;
+		deferDestroy("command pool", [this, pool]() { m_device.destroyCommandPool(pool); });
+		m_computeCommandPool = nullptr;
+	}
+	m_computeCommandBuffers.clear();
 }
-void Context::destroyCommandPool()
+void Context::destroySemaphores()
 {
-	if (m_commandBuffers.size()&& m_commandPool)
+	for (unsigned int slot = 0; slot < UniformSlots; ++slot)
 	{
-		m_device.freeCommandBuffers(m_commandPool, (unsigned int)m_commandBuffers.size(), m_commandBuffers.data());
-		m_commandBuffers.clear();
-	}
-	if(m_commandPool)
-	{
-		m_device.destroyCommandPool(m_commandPool);
-		m_commandPool = nullptr;
+		if (m_renderingFinishedSemaphores[slot])
+			m_device.destroySemaphore(m_renderingFinishedSemaphores[slot]);
+		m_renderingFinishedSemaphores[slot] = nullptr;
+		if (m_imageAvailableSemaphores[slot])
+			m_device.destroySemaphore(m_imageAvailableSemaphores[slot]);
+		m_imageAvailableSemaphores[slot] = nullptr;
 	}
 }
 void Context::backupPipelineCache()
@@ -933,18 +1162,14 @@ void Context::destroyPipelineCache()
 	m_device.destroyPipelineCache(m_pipelineCache);
 	m_pipelineCache = nullptr;
 }
-void Context::destroyFramebuffers()
-{
-	for(auto &fb : m_scFramebuffers)
-	{
-		m_device.destroyFramebuffer(fb);
-	}
-	m_scFramebuffers.clear();
-}
 void Context::destroySwapChainImages()
 {
-	for (auto &a : m_scImageViews)
-		m_device.destroyImageView(a);
+	const std::vector<vk::ImageView> views = m_scImageViews;
+	deferDestroy("image view", [this, views]()
+	{
+		for (auto &v : views)
+			m_device.destroyImageView(v);
+	});
 	m_scImageViews.clear();
 	m_scImages.clear();
 }
@@ -960,21 +1185,36 @@ void Context::destroySwapChain()
 }
 void Context::destroyDescriptorPool()
 {
-	m_device.destroyDescriptorSetLayout(m_descriptorSetLayout);
 	m_descriptorSetLayout = nullptr;
 	m_device.destroyDescriptorPool(m_descriptorPool);
 	m_descriptorPool = nullptr;
-	m_descriptorSet = nullptr;
+	for (auto &set : m_descriptorSets)
+		set = nullptr;
 }
 void Context::destroyLogicalDevice()
 {
 	if(m_device)
 	{
 		m_device.waitIdle();
+		m_graphicsLease.release();
+		m_presentLease.release();
+		m_computeLease.release();
+		m_graphicsQueue = nullptr;
+		m_presentQueue = nullptr;
+		m_computeQueue = nullptr;
+		m_queues->destroy();
 		m_dynamicLoader = vk::DispatchLoaderDynamic(m_instance);
 		m_device.destroy();
 		m_device = nullptr;
 	}
+	delete m_queues;
+	m_queues = nullptr;
+}
+void Context::destroyPhysicalDevice()
+{
+	delete m_capabilities;
+	m_capabilities = nullptr;
+	m_physicalDevice = nullptr;
 }
 void Context::destroySurface()
 {
@@ -1065,9 +1305,165 @@ void Context::destroyDebugCallbacks()
 }
 #endif
 
+void Context::createRenderGraph()
+{
+	m_renderGraph = new RenderGraph(*this);
+	//The acquire semaphore is waited on at eColorAttachmentOutput, so the first access must wait on that stage
+	m_rgBackbuffer = m_renderGraph->importImage("backbuffer", RenderGraph::ImageDesc(m_surfaceFormat.format, m_swapchainDims),
+		vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::ImageLayout::ePresentSrcKHR);
+	//With multiple views, every attachment has a layer per view
+	const bool multiview = m_viewCount > 1;
+	const uint32_t viewMask = (1u << m_viewCount) - 1;
+	const vk::Extent2D dims = viewExtent();
+	m_rgDepth = m_renderGraph->createImage("depth", RenderGraph::ImageDesc(findDepthFormat(), dims, m_msaaSamples, m_viewCount));
+	vk::ClearValue clearColor, clearDepth;
+	clearColor.color = vk::ClearColorValue(std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 1.0f });
+	clearDepth.depthStencil = vk::ClearDepthStencilValue(0.0f, 0);//Reversed-Z, far is 0
+	if (m_depthPrepass)
+	{
+		m_rgDepthPrepass = m_renderGraph->addPass("depth_prepass", RenderGraph::PassType::Graphics, [this](vk::CommandBuffer &cb) { recordDepthPrepass(cb); });
+		m_renderGraph->clear(m_rgDepthPrepass, m_rgDepth, RenderGraph::Access::DepthAttachment, clearDepth);
+		if (multiview)
+			m_renderGraph->setViewMask(m_rgDepthPrepass, viewMask);
+	}
+	m_rgForward = m_renderGraph->addPass("forward", RenderGraph::PassType::Graphics, [this](vk::CommandBuffer &cb) { recordForwardPass(cb); });
+	//Multiple views, or a scaled resolution, render into an intermediate target composed onto the backbuffer
+	const bool composed = multiview || m_dynamicResolution.enabled();
+	RenderGraph::Resource target = m_rgBackbuffer;
+	if (composed)
+	{
+		m_rgViews = m_renderGraph->createImage("views", RenderGraph::ImageDesc(m_surfaceFormat.format, dims, vk::SampleCountFlagBits::e1, m_viewCount));
+		target = m_rgViews;
+	}
+	if (multiview)
+		m_renderGraph->setViewMask(m_rgForward, viewMask);
+	if (m_msaaSamples == vk::SampleCountFlagBits::e1)
+	{
+		m_renderGraph->clear(m_rgForward, target, RenderGraph::Access::ColorAttachment, clearColor);
+	}
+	else
+	{//Multisample attachments live only within the pass, so can be lazily allocated, the target only receives the resolve
+		m_rgColorMS = m_renderGraph->createImage("color_ms", RenderGraph::ImageDesc(m_surfaceFormat.format, dims, m_msaaSamples, m_viewCount));
+		m_renderGraph->clear(m_rgForward, m_rgColorMS, RenderGraph::Access::ColorAttachment, clearColor);
+		m_renderGraph->resolve(m_rgForward, m_rgColorMS, target);
+	}
+	if (m_depthPrepass)
+		m_renderGraph->read(m_rgForward, m_rgDepth, RenderGraph::Access::DepthReadOnly);
+	else
+		m_renderGraph->clear(m_rgForward, m_rgDepth, RenderGraph::Access::DepthAttachment, clearDepth);
+	if (composed)
+	{
+		const vk::FormatFeatureFlags features = m_capabilities->FormatProperties(m_surfaceFormat.format).optimalTilingFeatures;
+		m_upscaleFilter = features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear ? vk::Filter::eLinear : vk::Filter::eNearest;
+		m_rgCompose = m_renderGraph->addPass("compose", RenderGraph::PassType::Transfer, [this](vk::CommandBuffer &cb) { recordCompose(cb); });
+		m_renderGraph->read(m_rgCompose, m_rgViews, RenderGraph::Access::TransferSrc);
+		m_renderGraph->write(m_rgCompose, m_rgBackbuffer, RenderGraph::Access::TransferDst);
+	}
+	m_renderGraph->compile();
+#ifdef _DEBUG
+	m_renderGraph->printSchedule();
+#endif
+}
+void Context::viewGrid(unsigned int &columns, unsigned int &rows) const
+{
+	columns = m_viewCount == 4 ? 2 : m_viewCount;
+	rows = m_viewCount / columns;
+}
+vk::Extent2D Context::viewExtent() const
+{
+	unsigned int columns, rows;
+	viewGrid(columns, rows);
+	return vk::Extent2D(std::max(1u, m_swapchainDims.width / columns), std::max(1u, m_swapchainDims.height / rows));
+}
+vk::Extent2D Context::renderExtent() const
+{
+	return m_dynamicResolution.scale(viewExtent());
+}
+void Context::recordCompose(vk::CommandBuffer &cb)
+{
+	//Blit rather than copy, as views may be rendered at a reduced resolution and grid cells
+	//may be a pixel larger than the views when the backbuffer doesn't divide evenly
+	unsigned int columns, rows;
+	viewGrid(columns, rows);
+	const vk::Extent2D dims = renderExtent();
+	std::vector<vk::ImageBlit> blits(m_viewCount);
+	for (unsigned int v = 0; v < m_viewCount; ++v)
+	{
+		const unsigned int x = v % columns, y = v / columns;
+		vk::ImageBlit &blit = blits[v];
+		{
+			blit.srcSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, v, 1);
+			blit.srcOffsets[0] = vk::Offset3D(0, 0, 0);
+			blit.srcOffsets[1] = vk::Offset3D(dims.width, dims.height, 1);
+			blit.dstSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+			blit.dstOffsets[0] = vk::Offset3D(m_swapchainDims.width * x / columns, m_swapchainDims.height * y / rows, 0);
+			blit.dstOffsets[1] = vk::Offset3D(m_swapchainDims.width * (x + 1) / columns, m_swapchainDims.height * (y + 1) / rows, 1);
+		}
+	}
+	cb.blitImage(m_renderGraph->Image(m_rgViews), vk::ImageLayout::eTransferSrcOptimal, m_renderGraph->Image(m_rgBackbuffer), vk::ImageLayout::eTransferDstOptimal, (unsigned int)blits.size(), blits.data(), dims == viewExtent() ? vk::Filter::eNearest : m_upscaleFilter);
+}
 void Context::createGraphicsPipeline()
 {
-	m_gfxPipeline = new GraphicsPipeline(*this,"../shaders/vert.spv","../shaders/frag.spv");
+	SpecializationConstants spec;
+	spec.set(vk::ShaderStageFlagBits::eFragment, 0, m_useTexture);//USE_TEXTURE
+	PipelineState state;
+	{
+		state.samples = m_msaaSamples;
+		//After a pre-pass, only the nearest fragment of each pixel passes so nothing is shaded twice
+		state.depthWrite = !m_depthPrepass;
+		state.depthCompareOp = m_depthPrepass ? vk::CompareOp::eEqual : vk::CompareOp::eGreater;
+		state.multiview = m_viewCount > 1;
+	}
+	m_gfxPipeline = new GraphicsPipeline(*this, m_renderGraph->RenderPass(m_rgForward), "../shaders/test.vert", "../shaders/test.frag", spec, state);
+	if (m_depthPrepass)
+	{
+		PipelineState depthState;
+		{
+			depthState.samples = m_msaaSamples;
+			depthState.layoutSource = m_gfxPipeline;
+			depthState.multiview = m_viewCount > 1;
+		}
+		m_depthPipeline = new GraphicsPipeline(*this, m_renderGraph->RenderPass(m_rgDepthPrepass), "../shaders/depth.vert", nullptr, SpecializationConstants(), depthState);
+	}
+	//Transparent draws are tested against, but don't write, depth so are never culled by each other
+	PipelineState transparentState;
+	{
+		transparentState.samples = m_msaaSamples;
+		transparentState.depthWrite = false;
+		transparentState.depthCompareOp = vk::CompareOp::eGreater;
+		transparentState.blend = true;
+		transparentState.layoutSource = m_gfxPipeline;
+		transparentState.multiview = m_viewCount > 1;
+	}
+	m_transparentPipeline = new GraphicsPipeline(*this, m_renderGraph->RenderPass(m_rgForward), "../shaders/test.vert", "../shaders/test.frag", spec, transparentState);
+	if (m_particles)
+		createParticlePipeline();
+}
+void Context::createParticlePipeline()
+{
+	PipelineState state;
+	{
+		state.samples = m_msaaSamples;
+		state.depthWrite = false;
+		state.depthCompareOp = vk::CompareOp::eGreater;
+		state.blend = true;
+		state.multiview = m_viewCount > 1;
+	}
+	m_particles->createRenderPipeline(m_renderGraph->RenderPass(m_rgForward), state);
+}
+void Context::destroyGraphicsPipelines()
+{
+	if (m_particles)
+		m_particles->destroyRenderPipeline();
+	GraphicsPipeline *pipelines[] = { m_transparentPipeline, m_depthPipeline, m_gfxPipeline };
+	for (GraphicsPipeline *p : pipelines)
+	{
+		if (p)
+			deferDestroy("pipeline", [p]() { delete p; });
+	}
+	m_transparentPipeline = nullptr;
+	m_depthPipeline = nullptr;
+	m_gfxPipeline = nullptr;
 }
 
 std::string Context::pipelineCacheFilepath()
@@ -1075,7 +1471,7 @@ std::string Context::pipelineCacheFilepath()
 	if (!m_physicalDevice)
 		throw std::exception("Pipeline cache filename requires knowledge of device.");
 	//Get physical device vendorId/deviceId
-	auto deviceProp = m_physicalDevice.getProperties();
+	const vk::PhysicalDeviceProperties &deviceProp = m_capabilities->Properties();
 	std::ostringstream cachepath;
 	cachepath << "pipeline";
 	cachepath << deviceProp.vendorID;
@@ -1084,63 +1480,128 @@ std::string Context::pipelineCacheFilepath()
 	cachepath << ".cache";
 	return cachepath.str();
 }
+void Context::setFrameState(const FrameSnapshot::State &state, const std::chrono::steady_clock::time_point &inputTime)
+{
+	m_camera.setTransform(state.camera);
+	m_model = state.model.matrix();
+	m_frameInputTime = inputTime;
+}
 void Context::updateUniformBuffer()
 {
-	static auto startTime = std::chrono::high_resolution_clock::now();
-
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
-
-	//Spin around z axis
-	UniformBufferObject ubo = {};
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.view = e_viewMat ? *e_viewMat : glm::mat4();
-	ubo.proj = glm::perspective(glm::radians(45.0f), m_swapchainDims.width / (float)m_swapchainDims.height, 0.1f, 10.0f);
-	ubo.proj[1][1] *= -1;
-	//Copy to uniform buffer
-	void* data = m_device.mapMemory(m_uniformBufferMemory, 0, sizeof(ubo), {});
-	memcpy(data, &ubo, sizeof(ubo));
-	m_device.unmapMemory(m_uniformBufferMemory);
+	PROFILE_FUNCTION();
+	//Animated by the simulation, pushed when the command buffer is recorded
+	m_drawConstants.model = m_model;
+	m_drawConstants.objectIndex = 0;
+	//Per-frame uniforms only change with the camera or swapchain extent
+	const glm::mat4 &view = m_camera.view();
+	if (!m_frameUniformsDirty && view == m_cameraView)
+		return;
+	const vk::Extent2D dims = viewExtent();
+	glm::mat4 proj = reversedInfinitePerspective(glm::radians(45.0f), dims.width / (float)dims.height, 0.1f);
+	proj[1][1] *= -1;
+	m_camera.setProjection(proj);
+	//Each view shares the camera's orientation, offset along its right axis centred on the camera
+	const Transform camera = m_camera.transform();
+	const glm::vec3 right = m_camera.getRight();
+	m_viewCameras.clear();
+	for (unsigned int v = 0; v < FrameUniforms::MaxViews; ++v)
+	{
+		const float offset = v < m_viewCount ? (v - (m_viewCount - 1) * 0.5f) * m_viewSeparation : 0.0f;
+		Transform t = camera;
+		t.position += right * offset;
+		m_viewCameras.add(t);
+		m_frameUniforms.proj[v] = proj;
+	}
+	//All 4 views at once
+	m_viewCameras.computeViews(m_frameUniforms.view);
+	m_cameraView = view;
+	m_frameUniformsDirty = false;
+	m_frameUniformsVersion++;
+}
+void Context::writeFrameUniforms(const unsigned int &slot)
+{
+	if (m_uniformSlotVersion[slot] == m_frameUniformsVersion)
+		return;
+	memcpy(static_cast<char*>(m_uniformBufferMapped) + slot * m_uniformStride, &m_frameUniforms, sizeof(FrameUniforms));
+	m_uniformSlotVersion[slot] = m_frameUniformsVersion;
 }
 void Context::getNextImage()
 {
+	PROFILE_FUNCTION();
 	try
 	{
-		vk::ResultValue<uint32_t> imageIndex = m_device.acquireNextImageKHR(m_swapchain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphore, nullptr);
+		//Refresh heap budgets, so this frame's allocations are placed against current usage
+		m_memory->updateBudget();
+		//Frame boundary, swap in any shader reloads which have finished building
+		processShaderReloads();
+		//Time blocked on the GPU or swapchain is reported to the pacer, which moves it before the next frame's input sampling
+		const auto blockStart = std::chrono::steady_clock::now();
+		//Frames in flight read the uniform slots they were recorded with, and signal the slot's swapchain semaphores
+		//So the slot is recycled once the graphics timeline reaches the frame which last used it
+		m_uniformSlot = (m_uniformSlot + 1) % UniformSlots;
+		{
+			PROFILE_ZONE("Context::waitForSlot");
+			m_queues->wait(m_uniformSync[m_uniformSlot]);
+		}
+		vk::ResultValue<uint32_t> imageIndex = m_device.acquireNextImageKHR(m_swapchain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphores[m_uniformSlot], nullptr);
 		if (imageIndex.result == vk::Result::eSuccess)
 		{
 			uint32_t i = imageIndex.value;
 			//Success
-			//Submit command buffer and setup semaphores to flag ready
-			vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-			auto submitInfo = vk::SubmitInfo();
+			//Wait for the previous submission using this image's command buffers to complete
+			{
+				PROFILE_ZONE("Context::waitForImage");
+				m_queues->wait(m_imageSync[i]);
+			}
+			m_pacer.addBlocked(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - blockStart).count());
+			const double gpuMs = collectGpuTime(i);
+			if (gpuMs >= 0)
+				m_dynamicResolution.addFrame(gpuMs);
+			if (m_particles)
+				m_particles->frameCompleted(i, gpuMs);
+			collectDeletions();
+			writeFrameUniforms(m_uniformSlot);
+			//Compute is submitted first, graphics only waits for it at the stages consuming its results
+			//Recorded before the graphics command buffer, as compute work may select what graphics draws (e.g. the particles' alive list)
+			const QueuePool::SyncPoint computeDone = submitCompute(i);
+			//Re-recorded every frame, so push constants carry this frame's per-draw data
+			fillCommandBuffer(i);
+			vk::PipelineStageFlags computeStages;
+			for (auto &w : m_computeWork)
+				computeStages |= w.consumerStages;
+			std::vector<QueuePool::Wait> waits;
+			if (computeDone)
+				waits.push_back({ computeDone, computeStages ? computeStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eAllCommands) });
+			//The swapchain's acquire and present only accept binary semaphores
+			m_imageSync[i] = m_graphicsLease.submit(m_commandBuffers[i], waits,
+				m_imageAvailableSemaphores[m_uniformSlot], vk::PipelineStageFlagBits::eColorAttachmentOutput, m_renderingFinishedSemaphores[m_uniformSlot]);
+			m_uniformSync[m_uniformSlot] = m_imageSync[i];
+			if (computeDone)
 			{
-				submitInfo.waitSemaphoreCount = 1;
-				submitInfo.pWaitSemaphores = &m_imageAvailableSemaphore;
-				submitInfo.pWaitDstStageMask = &waitStage;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = &m_commandBuffers[i];
-				submitInfo.signalSemaphoreCount = 1;
-				submitInfo.pSignalSemaphores = &m_renderingFinishedSemaphore;
+				m_computeReaders[m_computeCopy] = m_imageSync[i];
+				m_computeCopy = (m_computeCopy + 1) % ComputeCopies;
 			}
-			vk::Result a = m_graphicsQueue.submit(1, &submitInfo, nullptr);
 			auto presentInfo = vk::PresentInfoKHR();
 			{
 				presentInfo.waitSemaphoreCount = 1;
-				presentInfo.pWaitSemaphores = &m_renderingFinishedSemaphore;
+				presentInfo.pWaitSemaphores = &m_renderingFinishedSemaphores[m_uniformSlot];
 				presentInfo.swapchainCount = 1;
 				presentInfo.pSwapchains = &m_swapchain;
 				presentInfo.pImageIndices = &i;
 				presentInfo.pResults = nullptr;
 			}
-			vk::Result b = m_presentQueue.presentKHR(&presentInfo);
-			//if (a != vk::Result::eSuccess)
-			//	fprintf(stderr, "m_graphicsQueue.submit(): %s\n", getVulkanResultString(a));
-			//if (b != vk::Result::eSuccess)
-			//	fprintf(stderr, "m_presentQueue.presentKHR(): %s\n", getVulkanResultString(b));
-#ifdef _DEBUG
-			m_presentQueue.waitIdle();
-#endif
+			{
+				PROFILE_ZONE("Context::present");
+				m_presentQueue.presentKHR(&presentInfo);
+			}
+			m_pacer.presented(m_frameInputTime);
+			m_redrawPending = false;
+			if (m_reloadPresentPending)
+			{//First frame presented with a reloaded pipeline
+				m_reloadPresentPending = false;
+				float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_reloadDetected).count();
+				printf("Shader reload: edit-to-present latency %.1fms\n", ms);
+			}
 		}
 		else
 		{
@@ -1161,6 +1622,412 @@ void Context::getNextImage()
 		getchar();
 	}
 }
+/**
+ * Shader hot reload
+ */
+void Context::onShaderChanged(const std::string &filename)
+{
+	std::lock_guard<std::mutex> lock(m_changedShadersMutex);
+	//Keep the earliest detection time, if an edit is still waiting to be processed
+	m_changedShaders.emplace(filename, std::chrono::steady_clock::now());
+}
+QueuePool::SyncPoint Context::submitCompute(const unsigned int &frame)
+{
+	if (m_computeWork.empty())
+		return QueuePool::SyncPoint();
+	PROFILE_FUNCTION();
+	//The graphics submission waits on this, so reaching the image's sync point also guarantees this command buffer has completed
+	vk::CommandBuffer &cb = m_computeCommandBuffers[frame];
+	vk::CommandBufferBeginInfo cbBegin;
+	{
+		cbBegin.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		cbBegin.pInheritanceInfo = nullptr;
+	}
+	cb.begin(cbBegin);
+	m_computeTimer->begin(cb, frame);
+	for (auto &w : m_computeWork)
+		w.record(cb, frame, m_computeCopy);
+	m_computeTimer->end(cb, frame);
+	cb.end();
+	//Only the copy being written must no longer be read, the previous frame's graphics reads the other
+	const QueuePool::Lease &lease = hasAsyncCompute() ? m_computeLease : m_graphicsLease;
+	std::vector<QueuePool::Wait> waits;
+	if (m_computeReaders[m_computeCopy])
+		waits.push_back({ m_computeReaders[m_computeCopy], vk::PipelineStageFlagBits::eComputeShader });
+	return lease.submit(cb, waits);
+}
+void Context::addComputeWork(const std::string &name, std::function<void(vk::CommandBuffer &cb, const unsigned int &frame, const unsigned int &copy)> record, const vk::PipelineStageFlags &consumerStages)
+{
+	ComputeWork w;
+	{
+		w.name = name;
+		w.record = record;
+		w.consumerStages = consumerStages;
+	}
+	m_computeWork.push_back(w);
+}
+void Context::removeComputeWork(const std::string &name)
+{
+	m_computeWork.erase(std::remove_if(m_computeWork.begin(), m_computeWork.end(), [&name](const ComputeWork &w) { return w.name == name; }), m_computeWork.end());
+}
+ComputePipeline *Context::createComputePipeline(const char *compPath, const SpecializationConstants &spec)
+{
+	ComputePipeline *rtn = new ComputePipeline(*this, compPath, spec);
+	m_computePipelines.push_back(rtn);
+	return rtn;
+}
+void Context::destroyComputePipeline(ComputePipeline *pipeline)
+{
+	//A pending hot reload would swap into the deleted pipeline
+	for (auto it = m_pendingReloads.begin(); it != m_pendingReloads.end();)
+	{
+		if (it->pipeline != pipeline)
+		{
+			++it;
+			continue;
+		}
+		try
+		{
+			m_device.destroyPipeline(it->result.get());
+		}
+		catch (std::exception &) { }
+		it = m_pendingReloads.erase(it);
+	}
+	m_computePipelines.erase(std::remove(m_computePipelines.begin(), m_computePipelines.end(), pipeline), m_computePipelines.end());
+	deferDestroy("pipeline", [pipeline]() { delete pipeline; });
+}
+std::vector<ReloadablePipeline*> Context::allPipelines() const
+{
+	std::vector<ReloadablePipeline*> rtn(m_computePipelines.begin(), m_computePipelines.end());
+	if (m_gfxPipeline)
+		rtn.push_back(m_gfxPipeline);
+	if (m_depthPipeline)
+		rtn.push_back(m_depthPipeline);
+	if (m_transparentPipeline)
+		rtn.push_back(m_transparentPipeline);
+	if (m_particles && m_particles->RenderPipeline())
+		rtn.push_back(m_particles->RenderPipeline());
+	return rtn;
+}
+void Context::processShaderReloads()
+{
+	//Start background rebuilds for pipelines using changed shaders
+	{
+		std::lock_guard<std::mutex> lock(m_changedShadersMutex);
+		for (auto it = m_changedShaders.begin(); it != m_changedShaders.end();)
+		{
+			bool deferred = false;
+			for (auto &p : allPipelines())
+			{
+				if (!p->usesShader(it->first))
+					continue;
+				bool busy = false;
+				for (auto &r : m_pendingReloads)
+					busy |= r.pipeline == p;
+				if (busy)
+				{//Only one build per pipeline at a time, retry once the current build completes
+					deferred = true;
+					continue;
+				}
+				PendingReload r;
+				{
+					r.pipeline = p;
+					r.filename = it->first;
+					r.detected = it->second;
+					r.result = std::async(std::launch::async, [p]() { return p->buildPipeline(); });
+				}
+				m_pendingReloads.push_back(std::move(r));
+			}
+			it = deferred ? std::next(it) : m_changedShaders.erase(it);
+		}
+	}
+	//Start rebuilds for pipelines whose specialization constants have changed
+	for (auto &p : allPipelines())
+	{
+		if (!p->rebuildRequested())
+			continue;
+		bool busy = false;
+		for (auto &r : m_pendingReloads)
+			busy |= r.pipeline == p;
+		if (busy)
+			continue;//buildPipeline() snapshots the specialization, so retry once the current build completes
+		PendingReload r;
+		{
+			r.pipeline = p;
+			r.filename = "specialization";
+			r.detected = std::chrono::steady_clock::now();
+			r.result = std::async(std::launch::async, [p]() { return p->buildPipeline(); });
+		}
+		m_pendingReloads.push_back(std::move(r));
+	}
+	//Swap in completed rebuilds
+	for (auto it = m_pendingReloads.begin(); it != m_pendingReloads.end();)
+	{
+		if (it->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			++it;
+			continue;
+		}
+		try
+		{
+			vk::Pipeline newPipeline = it->result.get();
+			if (!newPipeline)
+			{//Pipeline state key unchanged
+				printf("Shader reload '%s': pipeline state unchanged, skipped.\n", it->filename.c_str());
+				it = m_pendingReloads.erase(it);
+				continue;
+			}
+			const vk::Pipeline retired = it->pipeline->swapPipeline(newPipeline);
+			deferDestroy("pipeline", [this, retired]() { m_device.destroyPipeline(retired); });
+			//Command buffers are re-recorded individually, after their previous submission completes
+			float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - it->detected).count();
+			printf("Shader reload '%s': pipeline rebuilt in %.1fms\n", it->filename.c_str(), ms);
+			m_reloadPresentPending = true;
+			m_reloadDetected = it->detected;
+		}
+		catch (std::exception &ex)
+		{//Keep the old pipeline
+			fprintf(stderr, "Shader reload '%s' failed, keeping previous pipeline.\n%s\n", it->filename.c_str(), ex.what());
+		}
+		it = m_pendingReloads.erase(it);
+	}
+}
+void Context::cancelShaderReloads()
+{
+	//Pipelines are about to be destroyed, so builds referencing them must finish first
+	for (auto &r : m_pendingReloads)
+	{
+		try
+		{
+			m_device.destroyPipeline(r.result.get());
+		}
+		catch (std::exception &) { }
+	}
+	m_pendingReloads.clear();
+	m_reloadPresentPending = false;
+}
+void Context::collectDeletions()
+{
+	m_deletions.collect(*m_queues);
+}
+void Context::deferDestroy(const char *kind, std::function<void()> destroy)
+{
+	//Compute only uses resources between graphics submissions it waits on and is waited on by, so the graphics timeline covers both
+	deferDestroy(kind, std::move(destroy), m_graphicsLease.Submitted());
+}
+void Context::deferDestroy(const char *kind, std::function<void()> destroy, const QueuePool::SyncPoint &lastUse)
+{
+	m_deletions.push(kind, lastUse, std::move(destroy));
+}
+void Context::waitForSubmitted() const
+{
+	m_queues->wait({ m_graphicsLease.Submitted(), hasAsyncCompute() ? m_computeLease.Submitted() : QueuePool::SyncPoint() });
+}
+void Context::printDeletionStats() const
+{
+	const QueuePool::SyncPoint graphics = m_graphicsLease.Submitted();
+	printf("Graphics timeline %llu submitted, %llu completed\n", (unsigned long long)graphics.value, (unsigned long long)(graphics ? m_queues->completedValue(graphics.timeline) : 0));
+	m_deletions.printStats(*m_queues);
+}
+void Context::toggleTexturing()
+{
+	m_useTexture = !m_useTexture;
+	for (GraphicsPipeline *p : { m_gfxPipeline, m_transparentPipeline })
+	{
+		SpecializationConstants spec = p->Specialization();
+		spec.set(vk::ShaderStageFlagBits::eFragment, 0, m_useTexture);//USE_TEXTURE
+		p->setSpecialization(spec);
+	}
+	printf("Texturing %s\n", m_useTexture ? "enabled" : "disabled");
+}
+void Context::cycleMSAA()
+{
+	//Next supported count, wrapping back to 1x after 8x
+	const vk::SampleCountFlags supported = supportedSampleCounts();
+	VkSampleCountFlags next = static_cast<VkSampleCountFlags>(m_msaaSamples);
+	do
+	{
+		next = next >= VK_SAMPLE_COUNT_8_BIT ? VK_SAMPLE_COUNT_1_BIT : next << 1;
+	} while (!(supported & vk::SampleCountFlagBits(next)));
+	setMSAA(vk::SampleCountFlagBits(next));
+}
+void Context::setMSAA(const vk::SampleCountFlagBits &samples)
+{
+	if (!(supportedSampleCounts() & samples))
+	{
+		fprintf(stderr, "MSAA %s is not supported by this device.\n", vk::to_string(samples).c_str());
+		return;
+	}
+	if (samples == m_msaaSamples)
+		return;
+	//Attribute outstanding timings to the sample count they were rendered with
+	waitForSubmitted();
+	for (unsigned int i = 0; i < m_scImages.size(); ++i)
+		collectGpuTime(i);
+	m_msaaSamples = samples;
+	rebuildRenderGraph();
+	printf("MSAA %s\n", samples == vk::SampleCountFlagBits::e1 ? "disabled" : vk::to_string(samples).c_str());
+	printGpuTimings();
+}
+void Context::toggleDepthPrepass()
+{
+	waitForSubmitted();
+	for (unsigned int i = 0; i < m_scImages.size(); ++i)
+		collectGpuTime(i);
+	m_depthPrepass = !m_depthPrepass;
+	rebuildRenderGraph();
+	printf("Depth pre-pass %s\n", m_depthPrepass ? "enabled" : "disabled");
+	printGpuTimings();
+}
+void Context::setViewCount(const unsigned int &count)
+{
+	if (count < 1 || count > FrameUniforms::MaxViews || (count > 1 && !m_multiviewSupported))
+	{
+		fprintf(stderr, "%u views are not supported (multiview %s).\n", count, m_multiviewSupported ? "available" : "unavailable");
+		return;
+	}
+	if (count > m_maxViews)
+	{
+		fprintf(stderr, "%u views exceeds the device's limit of %u.\n", count, m_maxViews);
+		return;
+	}
+	if (count == m_viewCount)
+		return;
+	m_viewCount = count;
+	rebuildRenderGraph();
+	m_frameUniformsDirty = true;//Per view matrices and aspect ratio
+	printf("Rendering %u view%s\n", m_viewCount, m_viewCount > 1 ? "s (multiview)" : "");
+}
+void Context::cycleViewCount()
+{
+	if (m_maxViews < 2)
+	{
+		fprintf(stderr, "Multiview is not supported by this device.\n");
+		return;
+	}
+	unsigned int next = m_viewCount >= 4 ? 1 : m_viewCount * 2;
+	if (next > m_maxViews)
+		next = 1;
+	setViewCount(next);
+}
+void Context::rebuildRenderGraph()
+{
+	//Pipelines reference the graph's render passes, so are rebuilt alongside it
+	//Both are destroyed once the frames using them complete
+	cancelShaderReloads();
+	destroyGraphicsPipelines();
+	RenderGraph *renderGraph = m_renderGraph;
+	deferDestroy("render graph", [renderGraph]() { delete renderGraph; });
+	m_renderGraph = nullptr;
+	createRenderGraph();
+	createGraphicsPipeline();
+}
+void Context::printGpuTimings() const
+{
+	if (!m_gpuTimer || !m_gpuTimer->supported())
+		return;
+	printf("GPU frame time by configuration:\n");
+	for (auto &t : m_gpuTimings)
+	{
+		printf("\t%s%s: %.3fms avg (%.3fms min, %.3fms max) over %u frames\n",
+			vk::to_string(t.first.first).c_str(), t.first.second ? " + depth pre-pass" : "",
+			t.second.totalMs / t.second.frames, t.second.minMs, t.second.maxMs, t.second.frames);
+	}
+}
+void Context::setPresentMode(const vk::PresentModeKHR &mode)
+{
+	std::vector<vk::PresentModeKHR> pm = m_physicalDevice.getSurfacePresentModesKHR(m_surface);
+	if (std::find(pm.begin(), pm.end(), mode) == pm.end())
+	{
+		fprintf(stderr, "Present mode %s is not supported by this surface.\n", vk::to_string(mode).c_str());
+		return;
+	}
+	if (mode == m_activePresentMode)
+		return;
+	m_presentMode = mode;
+	rebuildSwapChain();
+	printf("Present mode %s%s\n", vk::to_string(m_activePresentMode).c_str(), m_pacer.active() ? " (paced)" : "");
+	m_pacer.printStats();
+}
+void Context::cyclePresentMode()
+{
+	static const vk::PresentModeKHR order[] = { vk::PresentModeKHR::eFifo, vk::PresentModeKHR::eFifoRelaxed, vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate };
+	const unsigned int count = sizeof(order) / sizeof(vk::PresentModeKHR);
+	std::vector<vk::PresentModeKHR> pm = m_physicalDevice.getSurfacePresentModesKHR(m_surface);
+	unsigned int current = 0;
+	for (unsigned int m = 0; m < count; ++m)
+		if (order[m] == m_activePresentMode)
+			current = m;
+	for (unsigned int m = 1; m < count; ++m)
+	{
+		const vk::PresentModeKHR next = order[(current + m) % count];
+		if (std::find(pm.begin(), pm.end(), next) != pm.end())
+		{
+			setPresentMode(next);
+			return;
+		}
+	}
+	fprintf(stderr, "No other present modes are supported by this surface.\n");
+}
+void Context::toggleFramePacing()
+{
+	m_pacer.setEnabled(!m_pacer.enabled());
+	printf("Frame pacing %s%s\n", m_pacer.enabled() ? "enabled" : "disabled", m_pacer.enabled() && !m_pacer.active() ? " (only applies to FIFO modes)" : "");
+	m_pacer.printStats();
+}
+void Context::toggleDynamicResolution()
+{
+	m_dynamicResolution.printStats();
+	m_dynamicResolution.setEnabled(!m_dynamicResolution.enabled());
+	//The compose pass is only required whilst scaling
+	rebuildRenderGraph();
+	printf("Dynamic resolution %s", m_dynamicResolution.enabled() ? "enabled" : "disabled");
+	if (m_dynamicResolution.enabled())
+		printf(", %.2fms GPU budget (%s upscale)", m_dynamicResolution.BudgetMs(), m_upscaleFilter == vk::Filter::eLinear ? "bilinear" : "nearest");
+	printf("\n");
+}
+void Context::benchmarkParticles()
+{
+	if (m_particles)
+		m_particles->startBenchmark();
+}
+void Context::setAnimationPaused(const bool &paused)
+{
+	if (m_particles)
+		m_particles->setPaused(paused);
+}
+bool Context::needsRedraw()
+{
+	//Skipped frames don't wait on the timelines, so deferred resources are collected here instead
+	collectDeletions();
+	if (m_redrawPending || m_reloadPresentPending || !m_pendingReloads.empty())
+		return true;
+	if (m_particles && (!m_particles->paused() || m_particles->benchmarkRunning()))
+		return true;
+	std::lock_guard<std::mutex> lock(m_changedShadersMutex);
+	return !m_changedShaders.empty();
+}
+vk::SampleCountFlags Context::supportedSampleCounts() const
+{
+	const vk::PhysicalDeviceLimits &limits = m_capabilities->Properties().limits;
+	return limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+}
+double Context::collectGpuTime(const unsigned int &i)
+{
+	//Compute for the image completed before its graphics, which reaching the image's sync point guarantees
+	const double computeMs = m_computeTimer->collect(i);
+	(hasAsyncCompute() ? m_computeLease : m_graphicsLease).addBusy(computeMs);
+	const double ms = m_gpuTimer->collect(i);
+	if (ms < 0)
+		return ms;
+	m_graphicsLease.addBusy(ms);
+	GpuTimeStats &t = m_gpuTimings[std::make_pair(m_msaaSamples, m_depthPrepass)];
+	t.minMs = t.frames ? std::min(t.minMs, ms) : ms;
+	t.maxMs = std::max(t.maxMs, ms);
+	t.totalMs += ms;
+	t.frames++;
+	return ms;
+}
 void Context::toggleFullScreen()
 {
 	if (this->isFullscreen()) {
@@ -1184,33 +2051,22 @@ void Context::toggleFullScreen()
 		SDL_SetWindowPosition(m_window, displayBounds.x, displayBounds.y);
 		SDL_SetWindowSize(m_window, displayBounds.w, displayBounds.h);
 	}
-	rebuildSwapChain();
 }
 bool Context::isFullscreen()
 {
 	// Use window borders as a proxy to detect fullscreen.
 	return (SDL_GetWindowFlags(m_window) & SDL_WINDOW_BORDERLESS) == SDL_WINDOW_BORDERLESS;
 }
-unsigned int Context::findMemoryType(const unsigned int &typeFilter, const vk::MemoryPropertyFlags& properties) const
+void Context::freeMemory(vk::DeviceMemory &memory) const
 {
-	vk::PhysicalDeviceMemoryProperties memoryProps = m_physicalDevice.getMemoryProperties();
-	for (unsigned int i = 0; i < memoryProps.memoryTypeCount; ++i)
-	{
-		if (typeFilter & (1 << i))
-		{//Correct type available
-			if ((memoryProps.memoryTypes[i].propertyFlags & properties) == properties)
-			{//And it has the right properties (e.g. host_coherent, can be mapped to host memory)
-				return i;
-			}
-		}
-	}
-	throw std::runtime_error("failed to find suitable memory type!");
+	if (m_memory)
+		m_memory->free(memory);
 }
 vk::Format Context::findSupportedFormat(const std::vector<vk::Format>& candidates, const vk::ImageTiling &tiling, vk::FormatFeatureFlags features)
 {
 	for (vk::Format format : candidates) 
 	{
-		vk::FormatProperties props = m_physicalDevice.getFormatProperties(format);
+		vk::FormatProperties props = m_capabilities->FormatProperties(format);
 		if (tiling == vk::ImageTiling::eLinear && (props.linearTilingFeatures & features) == features)
 		{
 			return format;
@@ -1224,17 +2080,32 @@ vk::Format Context::findSupportedFormat(const std::vector<vk::Format>& candidate
 }
 vk::Format Context::findDepthFormat() 
 {
-	return findSupportedFormat(
+	//Reversed-Z relies on floating point depth for its precision
+	const vk::Format rtn = findSupportedFormat(
 	{ vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint, vk::Format::eD24UnormS8Uint },
 		vk::ImageTiling::eOptimal,
 		vk::FormatFeatureFlagBits::eDepthStencilAttachment
 	);
+	if (rtn == vk::Format::eD24UnormS8Uint)
+		fprintf(stderr, "Warning: D32 depth is unsupported, reversed-Z precision is reduced with D24.\n");
+	return rtn;
+}
+glm::mat4 Context::reversedInfinitePerspective(const float &fovy, const float &aspect, const float &zNear)
+{
+	//Clip z is the constant zNear and clip w is -z_eye, so depth = zNear / -z_eye
+	const float f = 1.0f / tan(fovy / 2.0f);
+	glm::mat4 rtn(0.0f);
+	rtn[0][0] = f / aspect;
+	rtn[1][1] = f;
+	rtn[2][3] = -1.0f;
+	rtn[3][2] = zNear;
+	return rtn;
 }
 bool Context::hasStencilComponent(const vk::Format &format) 
 {
 	return format == vk::Format::eD32SfloatS8Uint || format == vk::Format::eD24UnormS8Uint;
 }
-void Context::createBuffer(const vk::DeviceSize &size, const vk::BufferUsageFlags &usage, const vk::MemoryPropertyFlags &properties, vk::Buffer& buffer, vk::DeviceMemory& bufferMemory) const
+void Context::createBuffer(const vk::DeviceSize &size, const vk::BufferUsageFlags &usage, const MemoryManager::Usage &memoryUsage, vk::Buffer& buffer, vk::DeviceMemory& bufferMemory) const
 {
 	//Define buffer
 	vk::BufferCreateInfo bufferInfo;
@@ -1243,22 +2114,27 @@ void Context::createBuffer(const vk::DeviceSize &size, const vk::BufferUsageFlag
 		bufferInfo.size = size;
 		bufferInfo.usage = usage;
 		bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+		//Copies may run on another family's queue, concurrent sharing avoids queue family ownership transfers
+		if ((usage & vk::BufferUsageFlagBits::eTransferDst) && m_queues->Families().size() > 1)
+		{
+			bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+			bufferInfo.queueFamilyIndexCount = (uint32_t)m_queues->Families().size();
+			bufferInfo.pQueueFamilyIndices = m_queues->Families().data();
+		}
 	}
 	buffer = m_device.createBuffer(bufferInfo);
 	//Allocate memory
 	const vk::MemoryRequirements memReq = m_device.getBufferMemoryRequirements(buffer);
-	vk::MemoryAllocateInfo allocInfo;
-	{
-		allocInfo.allocationSize = memReq.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, properties);
-	}
-	bufferMemory = m_device.allocateMemory(allocInfo);
+	bufferMemory = m_memory->allocate(memReq, memoryUsage);
 	m_device.bindBufferMemory(buffer, bufferMemory, 0);//Offset must be divisble by memReq.alignment
 }
 
 void Context::copyBuffer(const vk::Buffer &src, const vk::Buffer &dest, const vk::DeviceSize &size, const vk::DeviceSize &srcOffset, const vk::DeviceSize &dstOffset) const
 {
-	vk::CommandBuffer cb = beginSingleTimeCommands();
+	//A transfer queue copies alongside graphics and compute, the graphics queue is only used if none is free
+	QueuePool::Lease transferLease = m_queues->tryAcquire(QueuePool::Transfer);
+	const QueuePool::Lease &lease = transferLease ? transferLease : m_graphicsLease;
+	vk::CommandBuffer cb = lease.begin();
 	vk::BufferCopy copyRegion;
 	{
 		copyRegion.srcOffset = srcOffset;
@@ -1266,9 +2142,9 @@ void Context::copyBuffer(const vk::Buffer &src, const vk::Buffer &dest, const vk
 		copyRegion.size = size;
 	}
 	cb.copyBuffer(src, dest, 1, &copyRegion);
-	endSingleTimeCommands(cb);
+	lease.submitAndWait(cb);
 }
-void Context::createImage(const uint32_t &width, const uint32_t &height, const vk::Format &format, const vk::ImageTiling &tiling, const vk::ImageUsageFlags &usage, const vk::MemoryPropertyFlags &properties, vk::Image& image, vk::DeviceMemory& imageMemory) const
+void Context::createImage(const uint32_t &width, const uint32_t &height, const vk::Format &format, const vk::ImageTiling &tiling, const vk::ImageUsageFlags &usage, const MemoryManager::Usage &memoryUsage, vk::Image& image, vk::DeviceMemory& imageMemory, const uint32_t &mipLevels) const
 {
 	vk::ImageCreateInfo imgCreate;
 	{
@@ -1276,7 +2152,7 @@ void Context::createImage(const uint32_t &width, const uint32_t &height, const v
 		imgCreate.extent.width = width;
 		imgCreate.extent.height = height;
 		imgCreate.extent.depth = 1;
-		imgCreate.mipLevels = 1;
+		imgCreate.mipLevels = mipLevels;
 		imgCreate.arrayLayers = 1;
 		imgCreate.format = format;
 		imgCreate.tiling = tiling;
@@ -1288,101 +2164,19 @@ void Context::createImage(const uint32_t &width, const uint32_t &height, const v
 	}
 	image = m_device.createImage(imgCreate);
 	vk::MemoryRequirements memReqs = m_device.getImageMemoryRequirements(image);
-	vk::MemoryAllocateInfo memAllocInfo;
-	{
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = findMemoryType(memReqs.memoryTypeBits, properties);
-	}
-	imageMemory = m_device.allocateMemory(memAllocInfo);
+	imageMemory = m_memory->allocate(memReqs, memoryUsage);
 	m_device.bindImageMemory(image, imageMemory, 0);
 }
 vk::CommandBuffer Context::beginSingleTimeCommands() const
 {
-	vk::CommandBufferAllocateInfo cbAllocInfo;
-	{
-		cbAllocInfo.level = vk::CommandBufferLevel::ePrimary;
-		cbAllocInfo.commandPool = m_commandPool;
-		cbAllocInfo.commandBufferCount = 1;
-	}
-	vk::CommandBuffer cb = m_device.allocateCommandBuffers(cbAllocInfo)[0];
-	vk::CommandBufferBeginInfo cbBeginInfo;
-	{
-		cbBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-	}
-	cb.begin(cbBeginInfo);
-	return cb;
+	return m_graphicsLease.begin();
 }
 void Context::endSingleTimeCommands(vk::CommandBuffer &cb) const
 {
-	cb.end();
-	vk::SubmitInfo submitInfo;
-	{
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &cb;
-	}
-	m_graphicsQueue.submit(1, &submitInfo, nullptr);
-	m_graphicsQueue.waitIdle();
-	m_device.freeCommandBuffers(m_commandPool, 1, &cb);
-}
-void Context::transitionImageLayout(vk::Image &image, const vk::Format &format, const vk::ImageLayout &oldLayout, const vk::ImageLayout &newLayout) const
-{
-	vk::CommandBuffer cb = beginSingleTimeCommands();
-	vk::PipelineStageFlags srcStage, dstStage;
-	vk::ImageMemoryBarrier barrier;
-	{
-		barrier.oldLayout = oldLayout;
-		barrier.newLayout = newLayout;
-		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier.image = image;
-		barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-		barrier.subresourceRange.baseMipLevel = 0;
-		barrier.subresourceRange.levelCount = 1;
-		barrier.subresourceRange.baseArrayLayer = 0;
-		barrier.subresourceRange.layerCount = 1;
-		//Configure stuff based on layout transition
-		if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eTransferDstOptimal)
-		{
-			barrier.srcAccessMask = {};
-			barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-			srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
-			dstStage = vk::PipelineStageFlagBits::eTransfer;
-		}
-		else if(oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal)
-		{
-			barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-			barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-			srcStage = vk::PipelineStageFlagBits::eTransfer;
-			dstStage = vk::PipelineStageFlagBits::eFragmentShader;
-		}
-		else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal)
-		{
-			barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
-			if (hasStencilComponent(format)) {
-				barrier.subresourceRange.aspectMask |= vk::ImageAspectFlagBits::eStencil;
-			}
-			barrier.srcAccessMask = {};
-			barrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-			srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
-			dstStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-		}
-		else
-		{
-			throw std::invalid_argument("Unexpected layout transition!");
-		}
-	}
-	cb.pipelineBarrier(
-		srcStage, dstStage,
-		{}, 
-		0, nullptr, 
-		0, nullptr, 
-		1, &barrier
-	);
-	endSingleTimeCommands(cb);
+	m_graphicsLease.submitAndWait(cb);
 }
-void Context::copyBufferToImage(const vk::Buffer &buffer, vk::Image &image, const uint32_t &width, const uint32_t &height) const
+void Context::copyBufferToImage(vk::CommandBuffer &cb, const vk::Buffer &buffer, const vk::Image &image, const uint32_t &width, const uint32_t &height) const
 {
-	vk::CommandBuffer cb = beginSingleTimeCommands();
 	vk::BufferImageCopy region;
 	{
 		region.bufferOffset = 0;
@@ -1397,9 +2191,36 @@ void Context::copyBufferToImage(const vk::Buffer &buffer, vk::Image &image, cons
 		region.imageExtent = vk::Extent3D(width, height, 1);
 	}
 	cb.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
-	endSingleTimeCommands(cb);
 }
-vk::ImageView Context::createImageView(const vk::Image &image, const vk::Format &format, const vk::ImageAspectFlags aspectFlags) const
+void Context::generateMipmaps(vk::CommandBuffer &cb, const vk::Image &image, const int32_t &width, const int32_t &height, const uint32_t &mipLevels)
+{
+	int32_t mipWidth = width, mipHeight = height;
+	for (uint32_t i = 1; i < mipLevels; ++i)
+	{
+		//Previous mip becomes the blit source, this mip is still eTransferDstOptimal from the upload
+		m_imageLayouts.transition(image, vk::ImageLayout::eTransferSrcOptimal, i - 1, 1);
+		m_imageLayouts.flush(cb);
+		vk::ImageBlit blit;
+		{
+			blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			blit.srcSubresource.mipLevel = i - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = 1;
+			blit.srcOffsets[0] = vk::Offset3D(0, 0, 0);
+			blit.srcOffsets[1] = vk::Offset3D(mipWidth, mipHeight, 1);
+			mipWidth = std::max(mipWidth / 2, 1);
+			mipHeight = std::max(mipHeight / 2, 1);
+			blit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			blit.dstSubresource.mipLevel = i;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = 1;
+			blit.dstOffsets[0] = vk::Offset3D(0, 0, 0);
+			blit.dstOffsets[1] = vk::Offset3D(mipWidth, mipHeight, 1);
+		}
+		cb.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, 1, &blit, vk::Filter::eLinear);
+	}
+}
+vk::ImageView Context::createImageView(const vk::Image &image, const vk::Format &format, const vk::ImageAspectFlags aspectFlags, const uint32_t &mipLevels) const
 {
 	vk::ImageViewCreateInfo viewInfo;
 	{
@@ -1408,7 +2229,7 @@ vk::ImageView Context::createImageView(const vk::Image &image, const vk::Format
 		viewInfo.format = format;
 		viewInfo.subresourceRange.aspectMask = aspectFlags;
 		viewInfo.subresourceRange.baseMipLevel = 0;
-		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.levelCount = mipLevels;
 		viewInfo.subresourceRange.baseArrayLayer = 0;
 		viewInfo.subresourceRange.layerCount = 1;
 		viewInfo.components = vk::ComponentMapping();//eIdentity
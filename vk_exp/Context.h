@@ -4,8 +4,34 @@
 #undef main //SDL breaks the regular main entry point, this fixes
 #include <vulkan/vulkan.hpp>
 #include <atomic>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <map>
+#include <tuple>
+#include <functional>
 #include <glm/glm.hpp>
+#include "MemoryManager.h"
+#include "ImageLayoutTracker.h"
+#include "SpecializationConstants.h"
+#include "RenderQueue.h"
+#include "FramePacer.h"
+#include "DynamicResolution.h"
+#include "FrameSnapshot.h"
+#include "Camera.h"
+#include "CameraBatch.h"
+#include "QueuePool.h"
+#include "DeletionQueue.h"
 class GraphicsPipeline;
+class ComputePipeline;
+class ReloadablePipeline;
+class ShaderCompiler;
+class ShaderWatcher;
+class LayoutCache;
+class RenderGraph;
+class GpuTimer;
+class ParticleSystem;
+class DeviceCapabilities;
 #ifdef _DEBUG
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugLayerCallback(
 	VkDebugReportFlagsEXT flags,
@@ -25,6 +51,16 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugLayerCallback(
  */
 class Context
 {
+public:
+	/**
+	 * Frames which may be in flight, each reading its own FrameUniforms and with its own swapchain semaphores
+	 */
+	static const unsigned int UniformSlots = 3;
+	/**
+	 * Copies compute work keeps of the results graphics reads, see addComputeWork()
+	 */
+	static const unsigned int ComputeCopies = 2;
+private:
 	std::atomic<bool> isInit = false;
 	SDL_Rect m_windowedBounds;//Storage of position/size of window before fullscreen
 	SDL_Window *m_window = nullptr;
@@ -32,63 +68,235 @@ class Context
 	vk::DispatchLoaderDynamic m_dynamicLoader;
 	vk::SurfaceKHR m_surface = nullptr;
 	vk::PhysicalDevice m_physicalDevice = nullptr;
-	vk::PhysicalDeviceFeatures m_physicalDeviceFeatures;
+	DeviceCapabilities *m_capabilities = nullptr;//Of m_physicalDevice
+	std::string m_deviceOverride;
 	vk::Device m_device = nullptr;
+	bool m_memoryBudgetSupported = false;//VK_EXT_memory_budget enabled
+	MemoryManager *m_memory = nullptr;
 	vk::Queue m_graphicsQueue = nullptr;
 	vk::Queue m_presentQueue = nullptr;
 	unsigned int m_graphicsQueueId = 0;
 	unsigned int m_presentQueueId = 0;
+	vk::Queue m_computeQueue = nullptr;
+	unsigned int m_computeQueueId = 0;//Dedicated compute-only family where available, otherwise the graphics family
+	QueuePool *m_queues = nullptr;
+	//Queues the frame is submitted to, leased for the device's lifetime
+	QueuePool::Lease m_graphicsLease;
+	QueuePool::Lease m_presentLease;//Only when the present family differs from the graphics family
+	QueuePool::Lease m_computeLease;//Only when hasAsyncCompute()
 	vk::Extent2D m_swapchainDims;
 	vk::SurfaceFormatKHR m_surfaceFormat;
 	vk::SwapchainKHR m_swapchain = nullptr;
+	vk::PresentModeKHR m_presentMode = vk::PresentModeKHR::eMailbox;//Requested, see selectPresentMode()
+	vk::PresentModeKHR m_activePresentMode = vk::PresentModeKHR::eFifo;//Of m_swapchain
+	FramePacer m_pacer;
 	std::vector<vk::Image> m_scImages;
 	std::vector<vk::ImageView> m_scImageViews;
 	vk::PipelineCache m_pipelineCache = nullptr;
 	vk::CommandPool m_commandPool = nullptr;
-	vk::Semaphore m_imageAvailableSemaphore = nullptr;
-	vk::Semaphore m_renderingFinishedSemaphore = nullptr;
-	std::vector<vk::Framebuffer> m_scFramebuffers;
+	//Binary, as the swapchain's acquire and present can't use timelines. Per uniform slot, reused once its graphics submission is reached
+	vk::Semaphore m_imageAvailableSemaphores[UniformSlots] = {};
+	vk::Semaphore m_renderingFinishedSemaphores[UniformSlots] = {};
 	std::vector<vk::CommandBuffer> m_commandBuffers;
-	std::vector<vk::Fence> m_fences;
+	std::vector<QueuePool::SyncPoint> m_imageSync;//Per swapchain image, the graphics submission which last used its command buffers
+	/**
+	 * Deferred destruction
+	 * Released resources are destroyed once the graphics timeline reaches the last value submitted before their release
+	 * Compute for a frame is waited on by its graphics, so the graphics timeline covers both
+	 */
+	DeletionQueue m_deletions;
 	vk::Image m_textureImage;
 	vk::DeviceMemory m_textureImageMemory;
 	vk::ImageView m_textureImageView;
+	uint32_t m_textureMipLevels = 1;
 	vk::Sampler m_textureSampler;
 	vk::Buffer m_vertexBuffer = nullptr;
 	vk::DeviceMemory m_vertexBufferMemory = nullptr;
 	vk::Buffer m_indexBuffer = nullptr;
 	vk::DeviceMemory m_indexBufferMemory = nullptr;
+	/**
+	 * FrameUniforms are written to a separate slot of the buffer each frame, with a descriptor set per slot
+	 * A slot is only rewritten once the graphics submission which last read it has completed
+	 */
 	vk::Buffer m_uniformBuffer = nullptr;
 	vk::DeviceMemory m_uniformBufferMemory = nullptr;
+	void *m_uniformBufferMapped = nullptr;//Persistently mapped (host coherent)
+	vk::DeviceSize m_uniformStride = 0;//sizeof(FrameUniforms), aligned to minUniformBufferOffsetAlignment
+	unsigned int m_uniformSlot = 0;//Slot of the frame being recorded
+	QueuePool::SyncPoint m_uniformSync[UniformSlots];//The graphics submission which last read each slot
+	uint64_t m_uniformSlotVersion[UniformSlots];//m_frameUniformsVersion last written to each slot
+	FrameUniforms m_frameUniforms;//Computed by updateUniformBuffer()
+	uint64_t m_frameUniformsVersion = 1;//Incremented whenever m_frameUniforms changes
+	bool m_frameUniformsDirty = true;//Set when the swapchain extent changes
+	DrawConstants m_drawConstants;//Transform of the scene, shared by both quads
 	vk::DescriptorPool m_descriptorPool = nullptr;
-	vk::DescriptorSet m_descriptorSet = nullptr;
-	vk::DescriptorSetLayout m_descriptorSetLayout = nullptr;
-	vk::Image m_depthImage = nullptr;
-	vk::DeviceMemory m_depthImageMemory = nullptr;
-	vk::ImageView m_depthImageView = nullptr;
+	vk::DescriptorSet m_descriptorSets[UniformSlots];//Per uniform slot
+	vk::DescriptorSetLayout m_descriptorSetLayout = nullptr;//Owned by m_layoutCache
 
 	GraphicsPipeline *m_gfxPipeline = nullptr;
+	GraphicsPipeline *m_depthPipeline = nullptr;//Depth pre-pass only
+	GraphicsPipeline *m_transparentPipeline = nullptr;//Forward pass, blended without depth writes
+	/**
+	 * Draws of the current frame, sorted by pass, state and depth
+	 */
+	enum DrawPass : unsigned int { DepthPrepassDraws = 0, ForwardDraws = 1 };
+	RenderQueue m_renderQueue;
+	RenderGraph *m_renderGraph = nullptr;
+	unsigned int m_rgBackbuffer = 0;//RenderGraph::Resource
+	unsigned int m_rgDepth = 0;//RenderGraph::Resource
+	unsigned int m_rgColorMS = 0;//RenderGraph::Resource, multisample colour resolved into the backbuffer (MSAA only)
+	unsigned int m_rgViews = 0;//RenderGraph::Resource, layer per view, composed onto the backbuffer (multiview or dynamic resolution only)
+	unsigned int m_rgCompose = 0;//RenderGraph::Pass
+	unsigned int m_rgForward = 0;//RenderGraph::Pass
+	unsigned int m_rgDepthPrepass = 0;//RenderGraph::Pass
+	bool m_depthPrepass = false;//Forward pass depth tests with eEqual against a position only pre-pass
+	/**
+	 * Multiview
+	 * With more than one view, each pass renders all views in one set of draws (VK_KHR_multiview)
+	 * into the layers of m_rgViews, which are then blitted side by side (2x2 for 4 views) onto the backbuffer
+	 * Views are offset along the camera's right axis, so 2 views form a stereo pair
+	 */
+	bool m_multiviewSupported = false;//Multiview feature enabled on the device
+	uint32_t m_maxViews = 1;
+	unsigned int m_viewCount = 1;
+	float m_viewSeparation = 0.065f;//Distance between adjacent views
+	glm::mat4 m_cameraView;//Camera view matrix m_frameUniforms were last built from
+	CameraBatch m_viewCameras;//FrameUniforms::MaxViews cameras, one per view, those beyond m_viewCount match the camera
+	/**
+	 * Dynamic resolution
+	 * The scene is rendered into the top-left renderExtent() of m_rgViews, scaled from GPU frame timings,
+	 * which the compose pass upscales onto the backbuffer, so attachments are never reallocated
+	 */
+	DynamicResolution m_dynamicResolution;
+	vk::Filter m_upscaleFilter = vk::Filter::eNearest;//Linear where the surface format supports it
+	ShaderCompiler *m_shaderCompiler = nullptr;
+	LayoutCache *m_layoutCache = nullptr;
+	ImageLayoutTracker m_imageLayouts;//Images outside of the render graph
+	/**
+	 * MSAA
+	 * GPU time of each frame is accumulated against the sample count and depth pre-pass mode it was rendered with
+	 */
+	struct GpuTimeStats
+	{
+		double totalMs = 0;
+		double minMs = 0;
+		double maxMs = 0;
+		unsigned int frames = 0;
+	};
+	vk::SampleCountFlagBits m_msaaSamples = vk::SampleCountFlagBits::e1;
+	GpuTimer *m_gpuTimer = nullptr;//Slot per swapchain image
+	GpuTimer *m_computeTimer = nullptr;//Slot per swapchain image, brackets the frame's compute submission
+	std::map<std::pair<vk::SampleCountFlagBits, bool>, GpuTimeStats> m_gpuTimings;
+	/**
+	 * Shader hot reload
+	 * The watcher thread records changed files, these are picked up at the next frame boundary
+	 * where affected pipelines are rebuilt in the background and swapped in once ready
+	 */
+	struct PendingReload
+	{
+		ReloadablePipeline *pipeline;
+		std::string filename;
+		std::future<vk::Pipeline> result;
+		std::chrono::steady_clock::time_point detected;
+	};
+	ShaderWatcher *m_shaderWatcher = nullptr;
+	std::mutex m_changedShadersMutex;
+	std::map<std::string, std::chrono::steady_clock::time_point> m_changedShaders;//Filename -> time change was detected
+	std::vector<PendingReload> m_pendingReloads;
+	bool m_reloadPresentPending = false;
+	bool m_redrawPending = true;//Swapchain (re)created and not yet presented to
+	std::chrono::steady_clock::time_point m_reloadDetected;
+	bool m_useTexture = true;//USE_TEXTURE specialization constant of test.frag
+	/**
+	 * Async compute
+	 * Work added with addComputeWork() is recorded each frame into a command buffer submitted to m_computeQueue
+	 * ahead of the frame's graphics submission, which waits on its timeline value only at the stages consuming its results
+	 * Each frame writes the next of ComputeCopies copies of what graphics reads, and waits only on the graphics submission
+	 * which last read that copy, so on a dedicated family compute overlaps the previous frame's graphics
+	 */
+	struct ComputeWork
+	{
+		std::string name;
+		std::function<void(vk::CommandBuffer &cb, const unsigned int &frame, const unsigned int &copy)> record;
+		vk::PipelineStageFlags consumerStages;
+	};
+	std::vector<ComputeWork> m_computeWork;
+	unsigned int m_computeCopy = 0;//Written by the next submitCompute()
+	QueuePool::SyncPoint m_computeReaders[ComputeCopies];//The graphics submission which last read each copy
+	std::vector<ComputePipeline*> m_computePipelines;//Owned, hot reloaded alongside the graphics pipelines
+	vk::CommandPool m_computeCommandPool = nullptr;
+	std::vector<vk::CommandBuffer> m_computeCommandBuffers;//Per swapchain image, reusable once the image's graphics submission completes
+	ParticleSystem *m_particles = nullptr;
 #ifdef _DEBUG
 	vk::DebugReportCallbackEXT m_debugCallback = nullptr;
 #endif
-	//External data (read only access)
-	const glm::mat4 *e_viewMat = nullptr;
+	//Interpolated from the simulation thread's snapshot, the frame being recorded is drawn with these
+	Camera m_camera;//View and frustum are cached until the camera next moves or its projection changes
+	glm::mat4 m_model = glm::mat4(1.0f);
+	std::chrono::steady_clock::time_point m_frameInputTime;//Of the snapshot, latency is measured from this once presented
 public:
 	void init(unsigned int width = 1280, unsigned int height = 720, const char * title = "vk_exp");
-	void setViewMatPtr(const glm::mat4 *viewMat) { e_viewMat = viewMat; };
+	/**
+	 * Sets the simulation state the following updateUniformBuffer() and getNextImage() draw
+	 * @param state Interpolated from the simulation thread's snapshot, see FrameSnapshot::interpolate()
+	 * @param inputTime The snapshot's FrameSnapshot::inputTime, frame latency is measured from this once presented
+	 */
+	void setFrameState(const FrameSnapshot::State &state, const std::chrono::steady_clock::time_point &inputTime);
 	bool ready() const { return isInit.load(); }
 	void destroy();
+	/**
+	 * Selects the physical device by enumeration index, UUID or name, takes precedence over VK_EXP_DEVICE
+	 * Must be called before init()
+	 */
+	void setDeviceOverride(const std::string &deviceOverride) { m_deviceOverride = deviceOverride; }
+	const vk::PhysicalDevice &PhysicalDevice() const { return m_physicalDevice; }
+	const DeviceCapabilities &Capabilities() const { return *m_capabilities; }
 	const vk::Device &Device() const { return m_device; }
 	const vk::Extent2D &SurfaceDims() const { return m_swapchainDims; }
 	const vk::SurfaceFormatKHR &SurfaceFormat() const { return m_surfaceFormat; }
 	const vk::PipelineCache &PipelineCache() const { return m_pipelineCache; }
-	const vk::DescriptorSetLayout &DescriptorSetLayout() const { return m_descriptorSetLayout; }
+	ShaderCompiler &Shaders() const { return *m_shaderCompiler; }
+	LayoutCache &Layouts() const { return *m_layoutCache; }
+	MemoryManager &Memory() const { return *m_memory; }
+	const RenderQueue &DrawQueue() const { return m_renderQueue; }
+	FramePacer &Pacer() { return m_pacer; }
+	vk::PresentModeKHR PresentMode() const { return m_activePresentMode; }
+	const vk::Queue &ComputeQueue() const { return m_computeQueue; }
+	/**
+	 * Queues not leased by the context may be leased by other threads, e.g. for uploads
+	 */
+	QueuePool &Queues() const { return *m_queues; }
+	unsigned int ComputeQueueFamily() const { return m_computeQueueId; }
+	unsigned int GraphicsQueueFamily() const { return m_graphicsQueueId; }
+	bool hasAsyncCompute() const { return m_computeQueueId != m_graphicsQueueId; }
+	/**
+	 * Registers work recorded every frame on the compute queue
+	 * @param record Called with the frame's compute command buffer, swapchain image index and the copy to write
+	 * Results graphics reads must have ComputeCopies copies, only the given copy may be written
+	 * as graphics may still be reading the others, state only compute uses can be single buffered
+	 * Successive frames' compute may overlap, so work must order itself against its previous submission with a barrier
+	 * @param consumerStages Graphics stages which consume the work's results, these wait on the compute submission
+	 * Resources written by compute and consumed by graphics should be created with vk::SharingMode::eConcurrent
+	 * across both queue families when hasAsyncCompute(), as the queues then belong to different families
+	 */
+	void addComputeWork(const std::string &name, std::function<void(vk::CommandBuffer &cb, const unsigned int &frame, const unsigned int &copy)> record, const vk::PipelineStageFlags &consumerStages);
+	void removeComputeWork(const std::string &name);
+	/**
+	 * The returned pipeline is owned by Context, and hot reloaded with the graphics pipelines
+	 */
+	ComputePipeline *createComputePipeline(const char *compPath, const SpecializationConstants &spec = SpecializationConstants());
+	/**
+	 * Destroyed once the frames submitted so far have completed
+	 */
+	void destroyComputePipeline(ComputePipeline *pipeline);
 	/**
 	 * Could switch to the active rebuild swapChainCreateInfo.oldSwapchain = m_swapChain; method
 	 */
 	void rebuildSwapChain();
 	/**
-	 * Could use push constants, more efficint for dynamic uniforms
+	 * Updates the per-draw push constants, and recomputes the per-frame uniforms
+	 * only if the view matrix or swapchain extent has changed
+	 * They are written to the uniform buffer by getNextImage(), once the slot they are written to is no longer being read
 	 */
 	void updateUniformBuffer();
 	void getNextImage();
@@ -106,15 +314,35 @@ private:
 	void createInstance(const char * title);
 	void createSurface();
 	/**
-	 * This could be improved to score devices better
-	 * and confirm externally passed vk::PhysicalDeviceFeature requirements
+	 * Selects the highest scoring device with graphics, present and swapchain support, or the first such device
+	 * matching the override (setDeviceOverride(), else the VK_EXP_DEVICE environment variable)
+	 * Every device's capabilities are loaded through DeviceCapabilities, so are cached to disk
 	 */
-	std::pair<unsigned int, unsigned int> selectPhysicalDevice();
+	std::tuple<unsigned int, unsigned int, unsigned int> selectPhysicalDevice();
+	/**
+	 * Graphics and present families (preferring one family for both), and a compute-only family if available
+	 * @return false if the device can't render to m_surface
+	 */
+	bool selectQueueFamilies(const DeviceCapabilities &caps, unsigned int &graphics, unsigned int &present, unsigned int &compute) const;
+	/**
+	 * Scored by type (discrete > integrated > virtual > other > CPU), then device local memory, features and queue layout
+	 */
+	static int scoreDevice(const DeviceCapabilities &caps, const unsigned int &graphics, const unsigned int &present, const unsigned int &compute);
+	/**
+	 * @param deviceOverride Enumeration index, UUID (32 hex digits, dashes optional) or case insensitive substring of the name
+	 */
+	static bool matchesDeviceOverride(const std::string &deviceOverride, const DeviceCapabilities &caps, const unsigned int &index);
 	/**
 	 * This should be improved to pass external vk::PhysicalDeviceFeature requirements
 	 */
-	void createLogicalDevice(unsigned int graphicsQIndex, unsigned int presentQIndex);
+	void createLogicalDevice(unsigned int graphicsQIndex, unsigned int presentQIndex, unsigned int computeQIndex);
+	/**
+	 * Returns m_presentMode if the surface supports it, otherwise FIFO (which is always supported)
+	 */
 	vk::PresentModeKHR selectPresentMode();//Used by CreateSwapchain
+	/**
+	 * Layout is taken from the graphics pipeline (via shader reflection), so must follow createGraphicsPipeline()
+	 */
 	void createDescriptorPool();
 	/**
 	 * Could improve selection of swap surface
@@ -122,13 +350,62 @@ private:
 	void createSwapchain();
 	void createSwapchainImages();
 	void setupPipelineCache();
+	/**
+	 * Declares and compiles the frame's passes, rebuilt with the swapchain
+	 */
+	void createRenderGraph();
 	void createGraphicsPipeline();
+	/**
+	 * Billboard pipeline of m_particles, sharing the forward pass's state
+	 */
+	void createParticlePipeline();
 	void createCommandPool(unsigned int graphicsQIndex);//Redundant arg?
-	void createDepthResources();
-	void createFramebuffers();
 	void createCommandBuffers();
-	void createFences();
-	void fillCommandBuffers();
+	void fillCommandBuffer(unsigned int i);
+	void recordForwardPass(vk::CommandBuffer &cb);
+	void recordDepthPrepass(vk::CommandBuffer &cb);
+	/**
+	 * Refills and sorts m_renderQueue from the scene, called before the frame's command buffer is recorded
+	 */
+	void submitDraws();
+	void destroyGraphicsPipelines();
+	void createComputeCommandBuffers();
+	void destroyComputeCommandBuffers();
+	void destroySemaphores();
+	/**
+	 * Records and submits the frame's compute work
+	 * @return The point graphics must wait on, empty if there was no work
+	 */
+	QueuePool::SyncPoint submitCompute(const unsigned int &frame);
+	/**
+	 * Columns and rows of the grid views are composed into on the backbuffer
+	 */
+	void viewGrid(unsigned int &columns, unsigned int &rows) const;
+	vk::Extent2D viewExtent() const;
+	/**
+	 * Extent each view is rendered at this frame, viewExtent() scaled by m_dynamicResolution
+	 */
+	vk::Extent2D renderExtent() const;
+	void recordCompose(vk::CommandBuffer &cb);
+	/**
+	 * Rebuilds the render graph and the pipelines using its render passes, e.g. after an MSAA change
+	 * The swapchain, command buffers and descriptor sets are retained
+	 */
+	void rebuildRenderGraph();
+	/**
+	 * Reversed-Z perspective projection with an infinite far plane, depth is 1 at zNear tending to 0 at infinity
+	 */
+	static glm::mat4 reversedInfinitePerspective(const float &fovy, const float &aspect, const float &zNear);
+	/**
+	 * Sample counts supported by both colour and depth framebuffer attachments
+	 */
+	vk::SampleCountFlags supportedSampleCounts() const;
+	/**
+	 * Accumulates the GPU time of swapchain image i's last submission, which must have completed
+	 * Call for all images before changing the configuration the timings are recorded against
+	 * @return The collected time in milliseconds, negative if unavailable
+	 */
+	double collectGpuTime(const unsigned int &i);
 	void createTextureImage();
 	void createTextureImageView();
 	void createTextureSampler();
@@ -138,7 +415,11 @@ private:
 	void createVertexBuffer();
 	void createIndexBuffer();
 	void createUniformBuffer();
-	void updateDescriptorSet();//This binds resources to the descriptor set
+	void updateDescriptorSet();//This binds resources to the descriptor sets
+	/**
+	 * Writes m_frameUniforms to the slot if it is out of date, the frame which last read it must have completed
+	 */
+	void writeFrameUniforms(const unsigned int &slot);
 	//Destroy
 	void destroyVertexBuffer();
 	void destroyIndexBuffer();
@@ -146,38 +427,130 @@ private:
 	void destroyTextureSampler();
 	void destroyTextureImageView();
 	void destroyTextureImage();
-	void destroyFences();
 	void destroyCommandPool();
-	void destroyFramebuffers();
-	void destroyDepthResources();
 	void backupPipelineCache();
 	void destroyPipelineCache();
 	void destroySwapChainImages();
 	void destroySwapChain();
 	void destroyDescriptorPool();
 	void destroyLogicalDevice();
+	void destroyPhysicalDevice();
 	void destroySurface();
 	void destroyInstance();
 	void destroyWindow();
+	//Shader hot reload
+	void onShaderChanged(const std::string &filename);//Called from watcher thread
+	std::vector<ReloadablePipeline*> allPipelines() const;
+	void processShaderReloads();
+	void cancelShaderReloads();
+	/**
+	 * Destroys the deferred resources whose timeline values have been reached, never blocks
+	 */
+	void collectDeletions();
 	//util
 	std::string pipelineCacheFilepath();
 	void createSwapchainStuff();
 	void destroySwapchainStuff();
-	unsigned int findMemoryType(const unsigned int &typeFilter, const vk::MemoryPropertyFlags& properties) const;
+	void freeMemory(vk::DeviceMemory &memory) const;
 	vk::Format findSupportedFormat(const std::vector<vk::Format>& candidates, const vk::ImageTiling &tiling, vk::FormatFeatureFlags features);
 	static bool hasStencilComponent(const vk::Format &format);
-	void createBuffer(const vk::DeviceSize &size, const vk::BufferUsageFlags &usage, const vk::MemoryPropertyFlags &properties, vk::Buffer& buffer, vk::DeviceMemory& bufferMemory) const;
+	/**
+	 * Transfer destinations are shared concurrently across the queue pool's families, as they may be written on a transfer queue
+	 */
+	void createBuffer(const vk::DeviceSize &size, const vk::BufferUsageFlags &usage, const MemoryManager::Usage &memoryUsage, vk::Buffer& buffer, vk::DeviceMemory& bufferMemory) const;
+	/**
+	 * Blocks until complete, on a leased transfer queue where one is free, otherwise on the graphics queue
+	 */
 	void copyBuffer(const vk::Buffer &src, const vk::Buffer &dest, const vk::DeviceSize &size, const vk::DeviceSize &srcOffset = 0, const vk::DeviceSize &dstOffset = 0) const;
-	void createImage(const uint32_t &width, const uint32_t &height, const vk::Format &format, const vk::ImageTiling &tiling, const vk::ImageUsageFlags &usage, const vk::MemoryPropertyFlags &properties, vk::Image& image, vk::DeviceMemory& imageMemory) const;
+	void createImage(const uint32_t &width, const uint32_t &height, const vk::Format &format, const vk::ImageTiling &tiling, const vk::ImageUsageFlags &usage, const MemoryManager::Usage &memoryUsage, vk::Image& image, vk::DeviceMemory& imageMemory, const uint32_t &mipLevels = 1) const;
 	vk::CommandBuffer beginSingleTimeCommands() const;
 	void endSingleTimeCommands(vk::CommandBuffer &cb) const;
-	void transitionImageLayout(vk::Image &image, const vk::Format &format, const vk::ImageLayout &oldLayout, const vk::ImageLayout &newLayout) const;
-	void copyBufferToImage(const vk::Buffer &buffer, vk::Image &image, const uint32_t &width, const uint32_t &height) const;
-	vk::ImageView createImageView(const vk::Image &image, const vk::Format &format, const vk::ImageAspectFlags aspectFlags) const;
+	/**
+	 * Records the copy into mip 0, image must be in eTransferDstOptimal
+	 */
+	void copyBufferToImage(vk::CommandBuffer &cb, const vk::Buffer &buffer, const vk::Image &image, const uint32_t &width, const uint32_t &height) const;
+	/**
+	 * Records blits filling mips 1+ from mip 0, image must be tracked by m_imageLayouts with mip 0 in eTransferDstOptimal
+	 * On return the last mip is in eTransferDstOptimal and the others in eTransferSrcOptimal
+	 */
+	void generateMipmaps(vk::CommandBuffer &cb, const vk::Image &image, const int32_t &width, const int32_t &height, const uint32_t &mipLevels);
+	vk::ImageView createImageView(const vk::Image &image, const vk::Format &format, const vk::ImageAspectFlags aspectFlags, const uint32_t &mipLevels = 1) const;
 	public:
 	vk::Format findDepthFormat();
+	/**
+	 * Only resizes the window, so must be called from the thread which polls its events
+	 * The swapchain is rebuilt on the window's SDL_WINDOWEVENT_SIZE_CHANGED event
+	 */
 	void toggleFullScreen();
 	bool isFullscreen();
+	/**
+	 * Flips the USE_TEXTURE specialization constant, the pipeline is rebuilt in the background
+	 */
+	void toggleTexturing();
+	/**
+	 * Switches to the next supported MSAA sample count (1x, 2x, 4x, 8x)
+	 * Only the render graph (and hence its attachments) and pipelines are rebuilt, the swapchain is retained
+	 */
+	void cycleMSAA();
+	void setMSAA(const vk::SampleCountFlagBits &samples);
+	/**
+	 * Toggles the position only depth pre-pass, after which the forward pass shades only visible fragments
+	 */
+	void toggleDepthPrepass();
+	/**
+	 * Renders count views of the scene (1 to FrameUniforms::MaxViews), requires the multiview feature for more than 1
+	 */
+	void setViewCount(const unsigned int &count);
+	/**
+	 * Cycles 1, 2 (stereo) and 4 views
+	 */
+	void cycleViewCount();
+	/**
+	 * Prints the GPU frame time recorded with each sample count and depth pre-pass mode
+	 */
+	void printGpuTimings() const;
+	/**
+	 * Measures how many GPU particles can be simulated and drawn within a 60Hz frame, results are printed on completion
+	 */
+	void benchmarkParticles();
+	/**
+	 * Freezes time dependent GPU work (particles), whilst the scene's animation is paused
+	 */
+	void setAnimationPaused(const bool &paused);
+	/**
+	 * Whether the next frame would differ from the last presented, for the same frame snapshot
+	 * True after the swapchain is rebuilt, whilst shader reloads are in progress, or whilst particles are animating
+	 */
+	bool needsRedraw();
+	/**
+	 * Queues a resource to be destroyed once every frame submitted so far has completed, without waiting on the GPU
+	 * @param kind Static string naming the type of resource, see printDeletionStats()
+	 */
+	void deferDestroy(const char *kind, std::function<void()> destroy);
+	/**
+	 * Queues a resource to be destroyed once a point on any queue's timeline has been reached, e.g. after an upload
+	 */
+	void deferDestroy(const char *kind, std::function<void()> destroy, const QueuePool::SyncPoint &lastUse);
+	void printDeletionStats() const;
+	/**
+	 * Blocks until everything submitted so far to the graphics and compute queues has completed
+	 * Waits on their timeline values, so unlike vkDeviceWaitIdle() other threads' queues are unaffected
+	 */
+	void waitForSubmitted() const;
+	/**
+	 * Recreates the swapchain with the present mode, if supported by the surface
+	 * FIFO (vsync) and FIFO relaxed (tears when late) are paced by m_pacer, mailbox and immediate run unthrottled
+	 */
+	void setPresentMode(const vk::PresentModeKHR &mode);
+	/**
+	 * Cycles FIFO, FIFO relaxed, mailbox and immediate, skipping modes the surface doesn't support
+	 */
+	void cyclePresentMode();
+	void toggleFramePacing();
+	/**
+	 * Toggles scaling of the render resolution to keep GPU frame time within the budget
+	 */
+	void toggleDynamicResolution();
 };
 
 #endif //__Context_h__
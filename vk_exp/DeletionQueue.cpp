@@ -0,0 +1,95 @@
+#include "DeletionQueue.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <cstdio>
+
+DeletionQueue::~DeletionQueue()
+{
+	if (!m_entries.empty())
+		fprintf(stderr, "DeletionQueue: %u resources were never destroyed.\n", (unsigned int)m_entries.size());
+}
+void DeletionQueue::push(const char *kind, const QueuePool::SyncPoint &lastUse, std::function<void()> destroy)
+{
+	Entry e;
+	{
+		e.lastUse = lastUse;
+		e.kind = kind;
+		e.queued = std::chrono::steady_clock::now();
+		e.destroy = std::move(destroy);
+	}
+	m_entries.push_back(std::move(e));
+}
+size_t DeletionQueue::collect(const QueuePool &queues)
+{
+	if (m_entries.empty())
+		return 0;
+	const auto now = std::chrono::steady_clock::now();
+	//Each timeline is queried once, entries on different timelines aren't ordered relative to each other
+	std::map<vk::Semaphore, uint64_t> completed;
+	std::deque<Entry> reached;
+	for (auto it = m_entries.begin(); it != m_entries.end();)
+	{
+		bool done = !it->lastUse;
+		if (!done)
+		{
+			auto c = completed.find(it->lastUse.timeline);
+			if (c == completed.end())
+				c = completed.emplace(it->lastUse.timeline, queues.completedValue(it->lastUse.timeline)).first;
+			done = c->second >= it->lastUse.value;
+		}
+		if (!done)
+		{
+			++it;
+			continue;
+		}
+		reached.push_back(std::move(*it));
+		it = m_entries.erase(it);
+	}
+	//Removed before destroying, so a destructor may queue further resources
+	for (auto &e : reached)
+	{
+		e.destroy();
+		m_maxWaitMs = std::max(m_maxWaitMs, std::chrono::duration<double, std::milli>(now - e.queued).count());
+	}
+	m_destroyed += reached.size();
+	return reached.size();
+}
+void DeletionQueue::flush()
+{
+	while (!m_entries.empty())
+	{
+		Entry e = std::move(m_entries.front());
+		m_entries.pop_front();
+		e.destroy();
+		m_destroyed++;
+	}
+}
+void DeletionQueue::printStats(const QueuePool &queues) const
+{
+	printf("Deferred deletions: %u pending, %llu destroyed, longest wait %.1fms\n", (unsigned int)m_entries.size(), (unsigned long long)m_destroyed, m_maxWaitMs);
+	struct KindStats
+	{
+		unsigned int count = 0;
+		QueuePool::SyncPoint oldest;
+		std::chrono::steady_clock::time_point oldestQueued;
+	};
+	std::map<std::string, KindStats> kinds;
+	for (auto &e : m_entries)
+	{
+		KindStats &k = kinds[e.kind];
+		if (!k.count)
+		{//Entries are ordered by when they were queued, so the first of each kind is the oldest
+			k.oldest = e.lastUse;
+			k.oldestQueued = e.queued;
+		}
+		k.count++;
+	}
+	const auto now = std::chrono::steady_clock::now();
+	for (auto &k : kinds)
+	{
+		printf("  %s: %u, oldest waiting on timeline value %llu (at %llu), queued %.1fms ago\n", k.first.c_str(), k.second.count,
+			(unsigned long long)k.second.oldest.value, (unsigned long long)(k.second.oldest ? queues.completedValue(k.second.oldest.timeline) : 0),
+			std::chrono::duration<double, std::milli>(now - k.second.oldestQueued).count());
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef __DeletionQueue_h__
+#define __DeletionQueue_h__
+#include <deque>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include "QueuePool.h"
+
+/**
+ * Resources released whilst submissions may still be using them
+ * Each is queued with the point on a queue's timeline after which nothing uses it, and destroyed once that point is reached
+ * Not thread-safe, owned by the render thread
+ */
+class DeletionQueue
+{
+public:
+	~DeletionQueue();
+	/**
+	 * @param kind Static string describing the resource, used to group stats
+	 * @param lastUse The resource is destroyed once this point has been reached
+	 */
+	void push(const char *kind, const QueuePool::SyncPoint &lastUse, std::function<void()> destroy);
+	/**
+	 * Destroys every resource whose point has been reached, never blocks
+	 * @return The number destroyed
+	 */
+	size_t collect(const QueuePool &queues);
+	/**
+	 * Destroys every resource, the device must be idle
+	 */
+	void flush();
+	size_t size() const { return m_entries.size(); }
+	/**
+	 * Prints the pending resources grouped by kind, with the point the oldest is waiting on and how long it has waited
+	 */
+	void printStats(const QueuePool &queues) const;
+private:
+	struct Entry
+	{
+		QueuePool::SyncPoint lastUse;
+		const char *kind;
+		std::chrono::steady_clock::time_point queued;
+		std::function<void()> destroy;
+	};
+	std::deque<Entry> m_entries;//Ordered by when they were queued
+	uint64_t m_destroyed = 0;
+	double m_maxWaitMs = 0;//Longest any resource has waited between being queued and destroyed
+};
+
+#endif //__DeletionQueue_h__
@@ -0,0 +1,193 @@
+#include "DeviceCapabilities.h"
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+namespace
+{
+	const uint32_t CacheMagic = 0x43445856;//"VXDC"
+	const uint32_t CacheVersion = 1;
+	/**
+	 * Written first, a cache file is rejected unless every field matches
+	 * Struct sizes guard against files written by a build with different headers
+	 */
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t apiVersion;
+		uint32_t driverVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t propertiesSize;
+		uint32_t featuresSize;
+		uint32_t memoryPropertiesSize;
+		uint32_t coreFormatCount;
+	};
+	template<typename T>
+	void writeVector(std::ofstream &f, const std::vector<T> &v)
+	{
+		const uint32_t count = (uint32_t)v.size();
+		f.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		f.write(reinterpret_cast<const char*>(v.data()), count * sizeof(T));
+	}
+	template<typename T>
+	bool readVector(std::ifstream &f, std::vector<T> &v)
+	{
+		uint32_t count = 0;
+		if (!f.read(reinterpret_cast<char*>(&count), sizeof(count)) || count > 4096)
+			return false;
+		v.resize(count);
+		return (bool)f.read(reinterpret_cast<char*>(v.data()), count * sizeof(T));
+	}
+}
+
+DeviceCapabilities::DeviceCapabilities(const vk::PhysicalDevice &physicalDevice)
+	: m_physicalDevice(physicalDevice)
+	, m_properties(physicalDevice.getProperties())//Always queried, validates the cache
+{
+	if (m_properties.apiVersion >= VK_API_VERSION_1_1)
+	{
+		auto chain = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+		memcpy(m_uuid.data(), chain.get<vk::PhysicalDeviceIDProperties>().deviceUUID, VK_UUID_SIZE);
+	}
+	else
+	{
+		memcpy(m_uuid.data(), m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+	}
+	m_loadedFromCache = load();
+	if (!m_loadedFromCache)
+	{
+		query();
+		save();
+	}
+}
+bool DeviceCapabilities::hasExtension(const char *name) const
+{
+	for (auto &e : m_extensions)
+	{
+		if (0 == strcmp(e.extensionName, name))
+			return true;
+	}
+	return false;
+}
+vk::FormatProperties DeviceCapabilities::FormatProperties(const vk::Format &format) const
+{
+	if ((uint32_t)format < CoreFormatCount)
+		return m_formats[(uint32_t)format];
+	std::lock_guard<std::mutex> lock(m_extensionFormatsMutex);
+	auto it = m_extensionFormats.find(format);
+	if (it == m_extensionFormats.end())
+		it = m_extensionFormats.emplace(format, m_physicalDevice.getFormatProperties(format)).first;
+	return it->second;
+}
+std::string DeviceCapabilities::UUIDString() const
+{
+	std::ostringstream s;
+	s << std::hex << std::setfill('0');
+	for (auto &b : m_uuid)
+		s << std::setw(2) << (unsigned int)b;
+	return s.str();
+}
+vk::DeviceSize DeviceCapabilities::DeviceLocalBytes() const
+{
+	vk::DeviceSize rtn = 0;
+	for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+	{
+		if (m_memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+			rtn = std::max(rtn, m_memoryProperties.memoryHeaps[i].size);
+	}
+	return rtn;
+}
+std::string DeviceCapabilities::cacheFilepath() const
+{
+	std::ostringstream cachepath;
+	cachepath << "device";
+	cachepath << UUIDString();
+	cachepath << ".cache";
+	return cachepath.str();
+}
+void DeviceCapabilities::query()
+{
+	m_features = m_physicalDevice.getFeatures();
+	m_memoryProperties = m_physicalDevice.getMemoryProperties();
+	m_queueFamilies = m_physicalDevice.getQueueFamilyProperties();
+	m_extensions = m_physicalDevice.enumerateDeviceExtensionProperties();
+	m_formats.resize(CoreFormatCount);
+	for (uint32_t f = 0; f < CoreFormatCount; ++f)
+		m_formats[f] = m_physicalDevice.getFormatProperties((vk::Format)f);
+}
+bool DeviceCapabilities::load()
+{
+	std::ifstream f(cacheFilepath(), std::ios::binary);
+	if (!f.is_open())
+		return false;
+	CacheHeader header;
+	if (!f.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	if (header.magic != CacheMagic || header.version != CacheVersion
+		|| header.apiVersion != m_properties.apiVersion || header.driverVersion != m_properties.driverVersion
+		|| header.vendorID != m_properties.vendorID || header.deviceID != m_properties.deviceID
+		|| header.propertiesSize != sizeof(vk::PhysicalDeviceProperties) || header.featuresSize != sizeof(vk::PhysicalDeviceFeatures)
+		|| header.memoryPropertiesSize != sizeof(vk::PhysicalDeviceMemoryProperties) || header.coreFormatCount != CoreFormatCount)
+		return false;
+	//Properties are always queried, so aren't stored
+	vk::PhysicalDeviceFeatures features;
+	vk::PhysicalDeviceMemoryProperties memoryProperties;
+	std::vector<vk::QueueFamilyProperties> queueFamilies;
+	std::vector<vk::ExtensionProperties> extensions;
+	std::vector<vk::FormatProperties> formats;
+	if (!f.read(reinterpret_cast<char*>(&features), sizeof(features))
+		|| !f.read(reinterpret_cast<char*>(&memoryProperties), sizeof(memoryProperties))
+		|| !readVector(f, queueFamilies)
+		|| !readVector(f, extensions))
+		return false;
+	formats.resize(CoreFormatCount);
+	if (!f.read(reinterpret_cast<char*>(formats.data()), CoreFormatCount * sizeof(vk::FormatProperties)))
+		return false;
+	m_features = features;
+	m_memoryProperties = memoryProperties;
+	m_queueFamilies.swap(queueFamilies);
+	m_extensions.swap(extensions);
+	m_formats.swap(formats);
+	return true;
+}
+void DeviceCapabilities::save() const
+{
+	//Write to a temporary then rename, so a reader never sees a partially written file
+	const std::string cachepath = cacheFilepath();
+	const std::string tmppath = cachepath + ".tmp";
+	{
+		std::ofstream f(tmppath, std::ios::binary | std::ios::trunc);
+		if (!f.is_open())
+		{
+			fprintf(stderr, "Failed to open file '%s' to update device capability cache.\n", tmppath.c_str());
+			return;
+		}
+		CacheHeader header;
+		{
+			header.magic = CacheMagic;
+			header.version = CacheVersion;
+			header.apiVersion = m_properties.apiVersion;
+			header.driverVersion = m_properties.driverVersion;
+			header.vendorID = m_properties.vendorID;
+			header.deviceID = m_properties.deviceID;
+			header.propertiesSize = sizeof(vk::PhysicalDeviceProperties);
+			header.featuresSize = sizeof(vk::PhysicalDeviceFeatures);
+			header.memoryPropertiesSize = sizeof(vk::PhysicalDeviceMemoryProperties);
+			header.coreFormatCount = CoreFormatCount;
+		}
+		f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		f.write(reinterpret_cast<const char*>(&m_features), sizeof(m_features));
+		f.write(reinterpret_cast<const char*>(&m_memoryProperties), sizeof(m_memoryProperties));
+		writeVector(f, m_queueFamilies);
+		writeVector(f, m_extensions);
+		f.write(reinterpret_cast<const char*>(m_formats.data()), m_formats.size() * sizeof(vk::FormatProperties));
+	}
+	std::remove(cachepath.c_str());
+	if (std::rename(tmppath.c_str(), cachepath.c_str()) != 0)
+		std::remove(tmppath.c_str());
+}
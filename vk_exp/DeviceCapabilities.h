@@ -0,0 +1,65 @@
+#ifndef __DeviceCapabilities_h__
+#define __DeviceCapabilities_h__
+#include <vector>
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vulkan/vulkan.hpp>
+
+/**
+ * Physical device properties, features, memory types, queue families, extensions and format support,
+ * queried once and persisted per device UUID, so later runs skip the queries
+ * A cache file is only used if it was written for the same driver and API version
+ * Surface support is per surface, so is never cached
+ * Methods are thread-safe
+ */
+class DeviceCapabilities
+{
+public:
+	typedef std::array<uint8_t, VK_UUID_SIZE> UUID;
+	/**
+	 * Loads the device's cache file if valid, otherwise queries the device and rewrites it
+	 */
+	explicit DeviceCapabilities(const vk::PhysicalDevice &physicalDevice);
+	const vk::PhysicalDevice &PhysicalDevice() const { return m_physicalDevice; }
+	const vk::PhysicalDeviceProperties &Properties() const { return m_properties; }
+	const vk::PhysicalDeviceFeatures &Features() const { return m_features; }
+	const vk::PhysicalDeviceMemoryProperties &MemoryProperties() const { return m_memoryProperties; }
+	const std::vector<vk::QueueFamilyProperties> &QueueFamilies() const { return m_queueFamilies; }
+	const std::vector<vk::ExtensionProperties> &Extensions() const { return m_extensions; }
+	bool hasExtension(const char *name) const;
+	/**
+	 * Core formats are cached, extension formats are queried on first use
+	 */
+	vk::FormatProperties FormatProperties(const vk::Format &format) const;
+	/**
+	 * VkPhysicalDeviceIDProperties::deviceUUID, or the pipeline cache UUID on Vulkan 1.0 devices
+	 */
+	const UUID &DeviceUUID() const { return m_uuid; }
+	std::string UUIDString() const;
+	/**
+	 * Size of the largest device local heap, on integrated devices this is shared system memory
+	 */
+	vk::DeviceSize DeviceLocalBytes() const;
+	bool LoadedFromCache() const { return m_loadedFromCache; }
+private:
+	static const uint32_t CoreFormatCount = VK_FORMAT_ASTC_12x12_SRGB_BLOCK + 1;
+	std::string cacheFilepath() const;
+	void query();
+	bool load();
+	void save() const;
+	vk::PhysicalDevice m_physicalDevice;
+	vk::PhysicalDeviceProperties m_properties;
+	vk::PhysicalDeviceFeatures m_features;
+	vk::PhysicalDeviceMemoryProperties m_memoryProperties;
+	std::vector<vk::QueueFamilyProperties> m_queueFamilies;
+	std::vector<vk::ExtensionProperties> m_extensions;
+	std::vector<vk::FormatProperties> m_formats;//Indexed by core format
+	mutable std::mutex m_extensionFormatsMutex;
+	mutable std::map<vk::Format, vk::FormatProperties> m_extensionFormats;
+	UUID m_uuid;
+	bool m_loadedFromCache = false;
+};
+
+#endif //__DeviceCapabilities_h__
@@ -0,0 +1,67 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+const float DynamicResolution::MinScale = 0.5f;
+const float DynamicResolution::Deadband = 0.05f;
+
+void DynamicResolution::setEnabled(const bool &enabled)
+{
+	m_enabled = enabled;
+	m_scale = 1.0f;
+	m_frames = 0;
+	m_settle = 0;
+	m_totalMs = 0;
+	m_statFrames = 0;
+	m_overBudgetFrames = 0;
+	m_adjustments = 0;
+	m_statTotalMs = 0;
+	m_minScale = 1.0f;
+}
+void DynamicResolution::addFrame(const double &gpuMs)
+{
+	if (!m_enabled)
+		return;
+	m_statFrames++;
+	m_statTotalMs += gpuMs;
+	if (gpuMs > m_budgetMs)
+		m_overBudgetFrames++;
+	if (m_settle)
+	{
+		m_settle--;
+		return;
+	}
+	m_totalMs += gpuMs;
+	if (++m_frames < AdjustInterval)
+		return;
+	const double averageMs = m_totalMs / m_frames;
+	m_frames = 0;
+	m_totalMs = 0;
+	const double ratio = m_budgetMs / std::max(averageMs, 0.001);
+	if (fabs(1.0 - ratio) < Deadband)
+		return;
+	//Half way to the estimate, as the cost isn't entirely proportional to pixel count
+	const float target = m_scale * (float)sqrt(ratio);
+	const float next = std::max(MinScale, std::min(1.0f, m_scale + 0.5f * (target - m_scale)));
+	if (fabs(next - m_scale) < 0.01f)
+		return;
+	m_scale = next;
+	m_minScale = std::min(m_minScale, m_scale);
+	m_settle = SettleFrames;
+	m_adjustments++;
+}
+vk::Extent2D DynamicResolution::scale(const vk::Extent2D &full) const
+{
+	const float s = Scale();
+	return vk::Extent2D(
+		std::max(1u, std::min(full.width, ((uint32_t)(full.width * s) + 7) & ~7u)),
+		std::max(1u, std::min(full.height, ((uint32_t)(full.height * s) + 7) & ~7u)));
+}
+void DynamicResolution::printStats() const
+{
+	if (!m_enabled || !m_statFrames)
+		return;
+	printf("Dynamic resolution: scale %.2f (min %.2f, %u adjustments), GPU %.3fms avg against a %.2fms budget, %.1f%% of %u frames over budget\n",
+		m_scale, m_minScale, m_adjustments, m_statTotalMs / m_statFrames, m_budgetMs, 100.0 * m_overBudgetFrames / m_statFrames, m_statFrames);
+}
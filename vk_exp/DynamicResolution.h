@@ -0,0 +1,53 @@
+#ifndef __DynamicResolution_h__
+#define __DynamicResolution_h__
+#include <vulkan/vulkan.hpp>
+
+/**
+ * Controls the resolution scale of the scene's render target from GPU frame timings
+ * Every AdjustInterval frames the average GPU time is compared against the budget, GPU cost is assumed proportional
+ * to pixel count, so the per axis scale moves (damped) towards scale * sqrt(budget / measured)
+ * A deadband around the budget stops the scale oscillating under steady load
+ */
+class DynamicResolution
+{
+public:
+	void setEnabled(const bool &enabled);
+	bool enabled() const { return m_enabled; }
+	void setBudget(const double &ms) { m_budgetMs = ms; }
+	double BudgetMs() const { return m_budgetMs; }
+	/**
+	 * Per axis scale of the render target, 1 when disabled
+	 */
+	float Scale() const { return m_enabled ? m_scale : 1.0f; }
+	/**
+	 * Accumulates the GPU time of a completed frame, adjusting the scale every AdjustInterval frames
+	 */
+	void addFrame(const double &gpuMs);
+	/**
+	 * Scales a full resolution extent, rounded up to a multiple of 8 pixels
+	 */
+	vk::Extent2D scale(const vk::Extent2D &full) const;
+	/**
+	 * Prints the current scale and the GPU times recorded since the controller was enabled
+	 */
+	void printStats() const;
+private:
+	static const unsigned int AdjustInterval = 8;
+	static const unsigned int SettleFrames = 3;//Frames in flight after an adjustment, rendered at the previous scale
+	static const float MinScale;
+	static const float Deadband;//Fraction of the budget the average may deviate by before adjusting
+	bool m_enabled = false;
+	double m_budgetMs = 15.0;//60Hz with 10% headroom
+	float m_scale = 1.0f;
+	unsigned int m_frames = 0;//Since the last adjustment
+	unsigned int m_settle = 0;
+	double m_totalMs = 0;
+	//Since enabled
+	unsigned int m_statFrames = 0;
+	unsigned int m_overBudgetFrames = 0;
+	unsigned int m_adjustments = 0;
+	double m_statTotalMs = 0;
+	float m_minScale = 1.0f;
+};
+
+#endif //__DynamicResolution_h__
@@ -0,0 +1,90 @@
+#include "FramePacer.h"
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+const double FramePacer::MarginMs = 1.0;
+const double FramePacer::Gain = 0.5;
+
+void FramePacer::reset(const vk::PresentModeKHR &mode, const double &refreshMs)
+{
+	m_mode = mode;
+	m_refreshMs = refreshMs;
+	m_sleepMs = 0;
+	m_blockedMs = 0;
+	m_frames = 0;
+}
+void FramePacer::setEnabled(const bool &enabled)
+{
+	m_enabled = enabled;
+	m_sleepMs = 0;
+	m_frames = 0;
+}
+bool FramePacer::active() const
+{
+	return m_enabled && (m_mode == vk::PresentModeKHR::eFifo || m_mode == vk::PresentModeKHR::eFifoRelaxed);
+}
+void FramePacer::waitForFrameStart()
+{
+	//The previous frame has just been presented, so the sleep is measured from now
+	if (active() && m_sleepMs > 0)
+		sleepUntil(clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(m_sleepMs)));
+	m_blockedMs = 0;
+}
+void FramePacer::addBlocked(const double &ms)
+{
+	m_blockedMs += ms;
+}
+void FramePacer::presented(const clock::time_point &inputTime)
+{
+	const clock::time_point now = clock::now();
+	const double intervalMs = std::chrono::duration<double, std::milli>(now - m_lastPresent).count();
+	const double latencyMs = std::chrono::duration<double, std::milli>(now - inputTime).count();
+	if (active() && m_frames > 0)
+	{
+		if (intervalMs > 1.5 * m_refreshMs)
+			m_sleepMs -= 0.25 * m_refreshMs;//Missed a refresh, the sleep (or this frame's work) was too long
+		else
+			m_sleepMs += Gain * (m_blockedMs - MarginMs);
+		m_sleepMs = std::max(0.0, std::min(m_sleepMs, m_refreshMs - MarginMs));
+	}
+	if (m_frames > WarmupFrames)
+	{
+		Stats &s = m_stats[std::make_pair(m_mode, active())];
+		s.frames++;
+		s.latencyTotalMs += latencyMs;
+		s.latencyMaxMs = std::max(s.latencyMaxMs, latencyMs);
+		s.sleepTotalMs += active() ? m_sleepMs : 0;
+		const double delta = intervalMs - s.frameTimeMeanMs;
+		s.frameTimeMeanMs += delta / s.frames;
+		s.frameTimeM2 += delta * (intervalMs - s.frameTimeMeanMs);
+	}
+	m_lastPresent = now;
+	m_frames++;
+}
+void FramePacer::printStats() const
+{
+	printf("Frame pacing by present mode (latency: input sampled to present):\n");
+	for (auto &t : m_stats)
+	{
+		const Stats &s = t.second;
+		const double variance = s.frames > 1 ? s.frameTimeM2 / (s.frames - 1) : 0;
+		printf("\t%s%s: latency %.2fms avg (%.2fms max), frame time %.2fms avg, variance %.3fms^2 (stddev %.3fms), sleep %.2fms avg over %u frames\n",
+			vk::to_string(t.first.first).c_str(), t.first.second ? " + pacing" : "",
+			s.latencyTotalMs / s.frames, s.latencyMaxMs, s.frameTimeMeanMs, variance, sqrt(variance), s.sleepTotalMs / s.frames, s.frames);
+	}
+}
+void FramePacer::sleepUntil(const clock::time_point &t)
+{
+	//Sleep only whilst the worst recent overshoot can't pass the deadline, then spin out the remainder
+	while (std::chrono::duration<double, std::milli>(t - clock::now()).count() > m_sleepGranularityMs + 0.5)
+	{
+		const clock::time_point before = clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		const double sleptMs = std::chrono::duration<double, std::milli>(clock::now() - before).count();
+		m_sleepGranularityMs = std::max(sleptMs, m_sleepGranularityMs * 0.99);
+	}
+	while (clock::now() < t)
+		std::this_thread::yield();
+}
@@ -0,0 +1,80 @@
+#ifndef __FramePacer_h__
+#define __FramePacer_h__
+#include <map>
+#include <chrono>
+#include <vulkan/vulkan.hpp>
+
+/**
+ * Delays the start of each frame, so the simulation snapshot is taken as late as possible before the frame is recorded
+ * In FIFO modes the render loop otherwise blocks in vkAcquireNextImageKHR/the GPU after taking the snapshot,
+ * so its input is already stale by the time the frame is recorded
+ * The controller moves that blocked time in front of taking the snapshot: the sleep grows by the time the previous frame
+ * spent blocked (less a safety margin), and backs off whenever a refresh is missed
+ * Latency (the presented snapshot's input sampled to vkQueuePresentKHR returning) and frame time variance are recorded per present mode
+ */
+class FramePacer
+{
+public:
+	struct Stats
+	{
+		unsigned int frames = 0;
+		double latencyTotalMs = 0;
+		double latencyMaxMs = 0;
+		double frameTimeMeanMs = 0;
+		double frameTimeM2 = 0;//Sum of squared differences from the mean (Welford)
+		double sleepTotalMs = 0;
+	};
+	/**
+	 * Called when the swapchain is (re)created, the controller restarts from no sleep
+	 * @param refreshMs Display refresh interval
+	 */
+	void reset(const vk::PresentModeKHR &mode, const double &refreshMs);
+	void setEnabled(const bool &enabled);
+	bool enabled() const { return m_enabled; }
+	/**
+	 * Pacing only applies to present modes which block on the display (FIFO, FIFO relaxed)
+	 */
+	bool active() const;
+	/**
+	 * Sleeps until the predicted start of the frame
+	 * Call at the top of the render loop, before taking the latest simulation snapshot
+	 */
+	void waitForFrameStart();
+	/**
+	 * Time the frame spent blocked on the swapchain (sync point and acquire waits) after it started
+	 */
+	void addBlocked(const double &ms);
+	/**
+	 * Call once vkQueuePresentKHR has returned
+	 * @param inputTime When the input of the snapshot the frame was drawn from was sampled (FrameSnapshot::inputTime)
+	 * Input is sampled on the simulation thread, so this precedes the frame's start by up to a simulation step
+	 */
+	void presented(const std::chrono::steady_clock::time_point &inputTime);
+	double SleepMs() const { return m_sleepMs; }
+	double RefreshMs() const { return m_refreshMs; }
+	/**
+	 * Prints the latency and frame time statistics recorded with each present mode and pacing state
+	 */
+	void printStats() const;
+private:
+	typedef std::chrono::steady_clock clock;
+	static const unsigned int WarmupFrames = 30;//Ignored after a reset, whilst the swapchain queue fills
+	static const double MarginMs;//Blocked time left in place, as slack against CPU time variance
+	static const double Gain;
+	/**
+	 * Sleeps in 1ms steps whilst the observed overshoot allows, then spins out the remainder
+	 * as OS sleeps can overshoot by a scheduler tick
+	 */
+	void sleepUntil(const clock::time_point &t);
+	vk::PresentModeKHR m_mode = vk::PresentModeKHR::eFifo;
+	double m_refreshMs = 1000.0 / 60.0;
+	bool m_enabled = true;
+	double m_sleepMs = 0;//Controller output
+	double m_sleepGranularityMs = 1.0;//Longest recent duration of a 1ms OS sleep
+	double m_blockedMs = 0;//Since the current frame started
+	unsigned int m_frames = 0;//Since reset
+	clock::time_point m_lastPresent;
+	std::map<std::pair<vk::PresentModeKHR, bool>, Stats> m_stats;
+};
+
+#endif //__FramePacer_h__
@@ -0,0 +1,54 @@
+#ifndef __FrameSnapshot_h__
+#define __FrameSnapshot_h__
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "Transform.h"
+
+/**
+ * Immutable state produced by the simulation thread, which the render thread draws a frame from
+ * Everything the render thread reads of the scene is copied in, so it never reads state the simulation is mutating
+ * The simulation advances in fixed steps, so the states either side of the latest step are carried
+ * and the render thread interpolates between them for the time it draws
+ */
+struct FrameSnapshot
+{
+	typedef std::chrono::steady_clock clock;
+	/**
+	 * Simulated state, interpolated between steps
+	 */
+	struct State
+	{
+		Transform camera;//World space, the view matrix is its inverse
+		Transform model;//Transform of the scene
+		bool operator==(const State &o) const { return camera == o.camera && model == o.model; }
+		bool operator!=(const State &o) const { return !(*this == o); }
+	};
+	State previous;
+	State current;
+	clock::time_point stepTime;//When current was due, previous was due one step earlier
+	clock::duration step = clock::duration::zero();
+	uint64_t simFrame = 0;//Simulation step which produced current
+	clock::time_point inputTime;//Input sampled
+	/**
+	 * Position between previous and current for a frame drawn at t
+	 * Frames are drawn one step behind the simulation, so never extrapolate past current
+	 */
+	float alpha(const clock::time_point &t) const
+	{
+		if (step <= clock::duration::zero())
+			return 1.0f;
+		const float a = std::chrono::duration<float>(t - stepTime).count() / std::chrono::duration<float>(step).count();
+		return std::max(0.0f, std::min(a, 1.0f));
+	}
+	State interpolate(const float &alpha) const
+	{
+		State s;
+		s.camera = Transform::interpolate(previous.camera, current.camera, alpha);
+		s.model = Transform::interpolate(previous.model, current.model, alpha);
+		return s;
+	}
+};
+
+#endif //__FrameSnapshot_h__
@@ -0,0 +1,50 @@
+#ifndef __Frustum_h__
+#define __Frustum_h__
+#include <glm/glm.hpp>
+
+/**
+ * View frustum as 6 world space planes (xyz normal facing inwards, w distance), extracted from a view-projection matrix
+ * Planes of an infinite (or reversed infinite) projection's far side degenerate to a zero normal with positive distance,
+ * so never reject anything
+ */
+struct Frustum
+{
+	enum Plane : unsigned int { Left = 0, Right, Bottom, Top, ClipZero, ClipW, PlaneCount };//Vulkan clip space, 0 <= z <= w
+	glm::vec4 planes[PlaneCount];
+	static Frustum fromMatrix(const glm::mat4 &viewProj)
+	{
+		//Rows of the matrix (glm is column major)
+		const glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+		const glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+		const glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+		const glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+		Frustum f;
+		f.planes[Left] = row3 + row0;
+		f.planes[Right] = row3 - row0;
+		f.planes[Bottom] = row3 + row1;
+		f.planes[Top] = row3 - row1;
+		f.planes[ClipZero] = row2;
+		f.planes[ClipW] = row3 - row2;
+		for (unsigned int i = 0; i < PlaneCount; ++i)
+		{
+			const float length = glm::length(glm::vec3(f.planes[i]));
+			if (length > 0.0f)
+				f.planes[i] /= length;
+		}
+		return f;
+	}
+	/**
+	 * @return false only if the sphere lies entirely outside a plane
+	 */
+	bool intersectsSphere(const glm::vec3 &centre, const float &radius) const
+	{
+		for (unsigned int i = 0; i < PlaneCount; ++i)
+		{
+			if (glm::dot(glm::vec3(planes[i]), centre) + planes[i].w < -radius)
+				return false;
+		}
+		return true;
+	}
+};
+
+#endif //__Frustum_h__
@@ -0,0 +1,55 @@
+#include "GpuTimer.h"
+#include <cstdio>
+
+GpuTimer::GpuTimer(const vk::PhysicalDevice &physicalDevice, const vk::Device &device, const uint32_t &queueFamily, const unsigned int &slots)
+	: m_device(device)
+	, m_recorded(slots, false)
+{
+	const uint32_t validBits = physicalDevice.getQueueFamilyProperties().at(queueFamily).timestampValidBits;
+	if (!validBits)
+	{
+		fprintf(stderr, "GpuTimer: Queue family %u does not support timestamps, GPU timings are unavailable.\n", queueFamily);
+		return;
+	}
+	m_validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+	m_periodMs = physicalDevice.getProperties().limits.timestampPeriod / 1e6;
+	vk::QueryPoolCreateInfo poolInfo;
+	{
+		poolInfo.flags = {};
+		poolInfo.queryType = vk::QueryType::eTimestamp;
+		poolInfo.queryCount = slots * 2;
+		poolInfo.pipelineStatistics = {};
+	}
+	m_queryPool = m_device.createQueryPool(poolInfo);
+}
+GpuTimer::~GpuTimer()
+{
+	if (m_queryPool)
+		m_device.destroyQueryPool(m_queryPool);
+	m_queryPool = nullptr;
+}
+void GpuTimer::begin(vk::CommandBuffer &cb, const unsigned int &slot)
+{
+	if (!m_queryPool)
+		return;
+	cb.resetQueryPool(m_queryPool, slot * 2, 2);
+	cb.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_queryPool, slot * 2);
+}
+void GpuTimer::end(vk::CommandBuffer &cb, const unsigned int &slot)
+{
+	if (!m_queryPool)
+		return;
+	cb.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_queryPool, slot * 2 + 1);
+	m_recorded[slot] = true;
+}
+double GpuTimer::collect(const unsigned int &slot)
+{
+	if (!m_queryPool || !m_recorded[slot])
+		return -1;
+	uint64_t ts[2];
+	const vk::Result r = m_device.getQueryPoolResults(m_queryPool, slot * 2, 2, sizeof(ts), ts, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+	if (r != vk::Result::eSuccess)
+		return -1;//eNotReady, submission hasn't completed
+	m_recorded[slot] = false;
+	return ((ts[1] - ts[0]) & m_validMask) * m_periodMs;
+}
@@ -0,0 +1,37 @@
+#ifndef __GpuTimer_h__
+#define __GpuTimer_h__
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+/**
+ * Measures GPU execution time between two points in a command buffer using timestamp queries
+ * Each slot (e.g. swapchain image) has its own query pair, so results can be read once that slot's
+ * submission has completed without stalling on frames still in flight
+ * If the queue family doesn't support timestamps, recording is a no-op and collect() returns a negative value
+ */
+class GpuTimer
+{
+public:
+	GpuTimer(const vk::PhysicalDevice &physicalDevice, const vk::Device &device, const uint32_t &queueFamily, const unsigned int &slots);
+	~GpuTimer();
+	bool supported() const { return !!m_queryPool; }
+	/**
+	 * Resets the slot's queries and writes the start timestamp, must be recorded outside a render pass
+	 */
+	void begin(vk::CommandBuffer &cb, const unsigned int &slot);
+	void end(vk::CommandBuffer &cb, const unsigned int &slot);
+	/**
+	 * Returns the milliseconds between the slot's most recent begin() and end()
+	 * Call after the submission has completed, each recording is only returned once
+	 * @return A negative value if nothing is available (not recorded, already collected, or unsupported)
+	 */
+	double collect(const unsigned int &slot);
+private:
+	const vk::Device m_device;
+	vk::QueryPool m_queryPool = nullptr;
+	double m_periodMs = 0;//Milliseconds per timestamp tick
+	uint64_t m_validMask = 0;
+	std::vector<bool> m_recorded;
+};
+
+#endif //__GpuTimer_h__
@@ -1,103 +1,150 @@
 #include "GraphicsPipeline.h"
 
-#include <fstream>
 #include "Context.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "LayoutCache.h"
+#include <memory>
 
 
-GraphicsPipeline::GraphicsPipeline(Context &ctx, const char * vertPath, const char * fragPath)
+GraphicsPipeline::GraphicsPipeline(Context &ctx, const vk::RenderPass &renderPass, const char * vertPath, const char * fragPath, const SpecializationConstants &spec, const PipelineState &state)
 	: m_context(ctx)
+	, m_renderPass(renderPass)
+	, m_state(state)
+	, m_vertPath(vertPath)
+	, m_fragPath(fragPath ? fragPath : "")
+	, m_spec(spec)
+	, m_rebuildRequested(false)
 {
-	m_pipelineLayout = pipelineLayout();
-	m_renderPass = renderPass();
-
-	auto v = readFile(vertPath);
-	auto f = readFile(fragPath);
-	auto _v = createShader(v);
-	auto _f = createShader(f);
-	auto s = createPipelineInfo(_v, _f);
+	m_pipeline = buildPipeline();
+	m_stateKey = m_builtKey;
+}
+vk::Pipeline GraphicsPipeline::buildPipeline()
+{
+	ShaderCompiler::Options options;
+	if (m_state.multiview)
+		options.defines.push_back(std::make_pair("MULTIVIEW", "1"));
+	//Both stages compile concurrently on the shader compiler's workers
+	auto vFuture = m_context.Shaders().compileAsync(m_vertPath, options);
+	auto fFuture = m_fragPath.empty() ? decltype(vFuture)() : m_context.Shaders().compileAsync(m_fragPath, options);
+	//Snapshot the specialization, so changes during the build trigger another rebuild
+	SpecializationConstants spec;
+	{
+		std::lock_guard<std::mutex> lock(m_specMutex);
+		spec = m_spec;
+		m_rebuildRequested = false;
+	}
+	auto v = vFuture.get();
+	auto f = m_fragPath.empty() ? std::vector<uint32_t>() : fFuture.get();
+	//Skip building if nothing that affects the pipeline has changed (e.g. a file was saved without edits)
+	m_builtKey = stateKey({ &v, &f }, spec);
+	if (m_pipeline && m_builtKey == m_stateKey)
+		return nullptr;
+	ShaderReflection vr(v);
+	std::unique_ptr<ShaderReflection> fr(m_fragPath.empty() ? nullptr : new ShaderReflection(f));
+	validateSpecialization(spec, vr);
+	if (fr)
+		validateSpecialization(spec, *fr);
+	vk::PipelineLayout layout = pipelineLayout(vr, fr.get());
+	vk::ShaderModule _v = createShader(m_context.Device(), v);
+	vk::ShaderModule _f;
+	vk::Pipeline rtn;
+	try
+	{
+		_f = fr ? createShader(m_context.Device(), f) : vk::ShaderModule();
+		auto s = createPipelineInfo(_v, _f, spec);
 
-	auto vi = vertexInput();
-	auto ia = inputAssembly();
-	auto vs = viewportState();
-	auto rs = rasterizerState();
-	auto ms = multisampleState();
-	auto dss = depthStencilState();
-	auto cbs = colorBlendState();
-	//auto ds = dynamicState();//Required if we wish to change viewport size at runtime
+		auto vi = vertexInput(vr);
+		auto ia = inputAssembly();
+		auto vs = viewportState();
+		auto rs = rasterizerState();
+		auto ms = multisampleState();
+		auto dss = depthStencilState();
+		auto cbs = colorBlendState();
+		//Viewport and scissor are set by RenderGraph from each pass's render area
+		const vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+		vk::PipelineDynamicStateCreateInfo ds;
+		{
+			ds.flags = {};
+			ds.dynamicStateCount = 2;
+			ds.pDynamicStates = dynamicStates;
+		}
 
-	vk::GraphicsPipelineCreateInfo pipelineInfo;
-	{
-		pipelineInfo.flags = {};
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = s.data();
-		pipelineInfo.pVertexInputState = &vi;
-		pipelineInfo.pInputAssemblyState = &ia;
-		pipelineInfo.pTessellationState = nullptr;
-		pipelineInfo.pViewportState = &vs;
-		pipelineInfo.pRasterizationState = &rs;
-		pipelineInfo.pMultisampleState = &ms;
-		pipelineInfo.pDepthStencilState = &dss;
-		pipelineInfo.pColorBlendState = &cbs;
-		pipelineInfo.pDynamicState = nullptr;
-		pipelineInfo.layout = m_pipelineLayout;
-		pipelineInfo.renderPass = m_renderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.basePipelineHandle = nullptr;
-		pipelineInfo.basePipelineIndex = -1;
+		vk::GraphicsPipelineCreateInfo pipelineInfo;
+		{
+			pipelineInfo.flags = {};
+			pipelineInfo.stageCount = (unsigned int)s.size();
+			pipelineInfo.pStages = s.data();
+			pipelineInfo.pVertexInputState = &vi;
+			pipelineInfo.pInputAssemblyState = &ia;
+			pipelineInfo.pTessellationState = nullptr;
+			pipelineInfo.pViewportState = &vs;
+			pipelineInfo.pRasterizationState = &rs;
+			pipelineInfo.pMultisampleState = &ms;
+			pipelineInfo.pDepthStencilState = &dss;
+			pipelineInfo.pColorBlendState = &cbs;
+			pipelineInfo.pDynamicState = &ds;
+			pipelineInfo.layout = layout;
+			pipelineInfo.renderPass = m_renderPass;
+			pipelineInfo.subpass = 0;
+			pipelineInfo.basePipelineHandle = nullptr;
+			pipelineInfo.basePipelineIndex = -1;
+		}
+		rtn = m_context.Device().createGraphicsPipeline(m_context.PipelineCache(), pipelineInfo);
+	}
+	catch (...)
+	{//e.g. a hot reloaded shader the driver rejects
+		m_context.Device().destroyShaderModule(_v);
+		if (_f)
+			m_context.Device().destroyShaderModule(_f);
+		throw;
 	}
-	m_pipeline = m_context.Device().createGraphicsPipeline(m_context.PipelineCache(), pipelineInfo);
 	m_context.Device().destroyShaderModule(_v);
-	m_context.Device().destroyShaderModule(_f);
+	if (_f)
+		m_context.Device().destroyShaderModule(_f);
+	return rtn;
 }
-GraphicsPipeline::~GraphicsPipeline()
+vk::Pipeline GraphicsPipeline::swapPipeline(const vk::Pipeline &pipeline)
 {
-	m_context.Device().destroyPipeline(m_pipeline);
-	m_pipeline = nullptr;
-	m_context.Device().destroyPipelineLayout(m_pipelineLayout);
-	m_pipelineLayout = nullptr;
-	m_context.Device().destroyRenderPass(m_renderPass);
-	m_renderPass = nullptr;
+	vk::Pipeline rtn = m_pipeline;
+	m_pipeline = pipeline;
+	m_stateKey = m_builtKey;
+	return rtn;
 }
-
-std::vector<char> GraphicsPipeline::readFile(const char * file)
+void GraphicsPipeline::setSpecialization(const SpecializationConstants &spec)
 {
-	//Read file
-	std::ifstream f(file, std::ios::binary | std::ios::ate);
-
-	if (!f.is_open()) {
-		throw std::exception("Failed to open shader file!");
-	}
-
-	size_t fileSize = (size_t)f.tellg();
-	std::vector<char> buffer(fileSize);
-
-	f.seekg(0);
-	f.read(buffer.data(), fileSize);
-
-	f.close();
-	return buffer;
+	std::lock_guard<std::mutex> lock(m_specMutex);
+	m_spec = spec;
+	m_rebuildRequested = true;
 }
-
-vk::ShaderModule GraphicsPipeline::createShader(const std::vector<char>& code) const
+SpecializationConstants GraphicsPipeline::Specialization() const
 {
-	vk::ShaderModuleCreateInfo createInfo;
-	{
-		createInfo.flags = {};
-		createInfo.codeSize = code.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-	}
-	return m_context.Device().createShaderModule(createInfo);
+	std::lock_guard<std::mutex> lock(m_specMutex);
+	return m_spec;
+}
+bool GraphicsPipeline::usesShader(const std::string &filename) const
+{
+	return pathMatches(m_vertPath, filename) || pathMatches(m_fragPath, filename);
+}
+GraphicsPipeline::~GraphicsPipeline()
+{
+	m_context.Device().destroyPipeline(m_pipeline);
+	m_pipeline = nullptr;
+	m_pipelineLayout = nullptr;
+	m_setLayouts.clear();
 }
 
-std::vector<vk::PipelineShaderStageCreateInfo> GraphicsPipeline::createPipelineInfo(vk::ShaderModule &v, vk::ShaderModule &f)
+std::vector<vk::PipelineShaderStageCreateInfo> GraphicsPipeline::createPipelineInfo(vk::ShaderModule &v, vk::ShaderModule &f, const SpecializationConstants &spec)
 {
+	const bool vSpec = spec.buildInfo(vk::ShaderStageFlagBits::eVertex, t_vsi, t_vsme, t_vsd);
+	const bool fSpec = spec.buildInfo(vk::ShaderStageFlagBits::eFragment, t_fsi, t_fsme, t_fsd);
 	vk::PipelineShaderStageCreateInfo vss;
 	{
 		vss.flags = {};
 		vss.stage = vk::ShaderStageFlagBits::eVertex;
 		vss.module = v;
 		vss.pName = "main";
-		vss.pSpecializationInfo = nullptr;
+		vss.pSpecializationInfo = vSpec ? &t_vsi : nullptr;
 	}
 	vk::PipelineShaderStageCreateInfo fss;
 	{
@@ -105,14 +152,34 @@ std::vector<vk::PipelineShaderStageCreateInfo> GraphicsPipeline::createPipelineI
 		fss.stage = vk::ShaderStageFlagBits::eFragment;
 		fss.module = f;
 		fss.pName = "main";
-		fss.pSpecializationInfo = nullptr;
+		fss.pSpecializationInfo = fSpec ? &t_fsi : nullptr;
 	}
+	if (!f)
+		return std::vector<vk::PipelineShaderStageCreateInfo>{ vss };
 	return std::vector<vk::PipelineShaderStageCreateInfo>{ vss, fss };
 }
-vk::PipelineVertexInputStateCreateInfo GraphicsPipeline::vertexInput()
+vk::PipelineVertexInputStateCreateInfo GraphicsPipeline::vertexInput(const ShaderReflection &v)
 {
 	t_vibd = Vertex::getBindingDesc();
-	t_viad = Vertex::getAttributeDesc();
+	t_viad.clear();
+	//Only declare the attributes consumed by the shader, sourced from the matching location of Vertex
+	const auto vertexAttributes = Vertex::getAttributeDesc();
+	for (auto &in : v.Inputs())
+	{
+		bool found = false;
+		for (auto &va : vertexAttributes)
+		{
+			if (va.location != in.location)
+				continue;
+			if (va.format != in.format)
+				throw std::runtime_error("Vertex shader input '" + in.name + "' format does not match Vertex.");
+			t_viad.push_back(va);
+			found = true;
+			break;
+		}
+		if (!found)
+			throw std::runtime_error("Vertex shader input '" + in.name + "' location " + std::to_string(in.location) + " is not provided by Vertex.");
+	}
 	vk::PipelineVertexInputStateCreateInfo rtn;
 	{
 		rtn.flags = {};
@@ -134,25 +201,15 @@ vk::PipelineInputAssemblyStateCreateInfo GraphicsPipeline::inputAssembly() const
 	return rtn;
 }
 
-vk::PipelineViewportStateCreateInfo GraphicsPipeline::viewportState()
+vk::PipelineViewportStateCreateInfo GraphicsPipeline::viewportState() const
 {
-	auto ex = m_context.SurfaceDims();
-	t_viewport = vk::Viewport(
-		0.0f, 0.0f,							/*x,y*/
-		(float)ex.width, (float)ex.height,	/*Width, Height*/
-		0.0f, 1.0f							/*Depth Min, Max*/
-	);
-	t_scissors = vk::Rect2D(
-		{ 0,0 },	/*Offset*/
-		ex			/*Extent*/
-	);
 	vk::PipelineViewportStateCreateInfo rtn;
 	{
 		rtn.flags = {};
 		rtn.viewportCount = 1;
-		rtn.pViewports = &t_viewport;
+		rtn.pViewports = nullptr;//Dynamic
 		rtn.scissorCount = 1;
-		rtn.pScissors = &t_scissors;
+		rtn.pScissors = nullptr;//Dynamic
 	}
 	return rtn;
 }
@@ -180,7 +237,7 @@ vk::PipelineMultisampleStateCreateInfo GraphicsPipeline::multisampleState() cons
 	vk::PipelineMultisampleStateCreateInfo rtn;
 	{
 		rtn.flags = {};
-		rtn.rasterizationSamples = vk::SampleCountFlagBits::e1;
+		rtn.rasterizationSamples = m_state.samples;
 		rtn.sampleShadingEnable = false;
 		rtn.minSampleShading = 1.0f;
 		rtn.pSampleMask = nullptr;
@@ -195,8 +252,8 @@ vk::PipelineDepthStencilStateCreateInfo GraphicsPipeline::depthStencilState() co
 	vk::PipelineDepthStencilStateCreateInfo rtn;
 	{
 		rtn.depthTestEnable = true;
-		rtn.depthWriteEnable = true;
-		rtn.depthCompareOp = vk::CompareOp::eLess;
+		rtn.depthWriteEnable = m_state.depthWrite;
+		rtn.depthCompareOp = m_state.depthCompareOp;
 		rtn.depthBoundsTestEnable = false;
 		rtn.minDepthBounds = 0.0f; // Optional
 		rtn.maxDepthBounds = 1.0f; // Optional
@@ -211,7 +268,7 @@ vk::PipelineColorBlendStateCreateInfo GraphicsPipeline::colorBlendState()
 {
 	//vk::PipelineColorBlendAttachmentState t_cbas;
 	{
-		t_cbas.blendEnable = true;//Enable Alpha Blending!
+		t_cbas.blendEnable = m_state.blend;//Alpha blending, transparent pipelines only
 		t_cbas.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
 		t_cbas.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
 		t_cbas.colorBlendOp = vk::BlendOp::eAdd;
@@ -225,7 +282,7 @@ vk::PipelineColorBlendStateCreateInfo GraphicsPipeline::colorBlendState()
 		rtn.flags = {};
 		rtn.logicOpEnable = false;
 		rtn.logicOp = vk::LogicOp::eCopy;
-		rtn.attachmentCount = 1;
+		rtn.attachmentCount = m_fragPath.empty() ? 0 : 1;
 		rtn.pAttachments = &t_cbas;
 		rtn.blendConstants[0] = 0.0f;//These interact with blend factors which have a 'constant colour'
 		rtn.blendConstants[1] = 0.0f;//Otherwise they have no effect
@@ -235,87 +292,44 @@ vk::PipelineColorBlendStateCreateInfo GraphicsPipeline::colorBlendState()
 	return rtn;
 }
 
-vk::PipelineLayout GraphicsPipeline::pipelineLayout()
-{
-	vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
-	{
-		pipelineLayoutInfo.flags = {};
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &m_context.DescriptorSetLayout();
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-		pipelineLayoutInfo.pPushConstantRanges = nullptr;
-	}
-	return m_context.Device().createPipelineLayout(pipelineLayoutInfo);
-}
-vk::RenderPass GraphicsPipeline::renderPass() const
+vk::PipelineLayout GraphicsPipeline::pipelineLayout(const ShaderReflection &v, const ShaderReflection *f)
 {
-	vk::AttachmentDescription colorAttachment;
-	{
-		colorAttachment.flags = {};
-		colorAttachment.format = m_context.SurfaceFormat().format;
-		colorAttachment.samples = vk::SampleCountFlagBits::e1;
-		colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-		colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
-		colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-		colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-		colorAttachment.initialLayout = vk::ImageLayout::eUndefined;
-		colorAttachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
-	}
-	vk::AttachmentReference colorAttachmentRef;
-	{
-		colorAttachmentRef.attachment = 0;
-		colorAttachmentRef.layout = vk::ImageLayout::eColorAttachmentOptimal;
-	}
-	vk::AttachmentDescription depthAttachment;
-	{
-		depthAttachment.flags = {};
-		depthAttachment.format = m_context.findDepthFormat();
-		depthAttachment.samples = vk::SampleCountFlagBits::e1;
-		depthAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-		depthAttachment.storeOp = vk::AttachmentStoreOp::eDontCare;
-		depthAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-		depthAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-		depthAttachment.initialLayout = vk::ImageLayout::eUndefined;
-		depthAttachment.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-	}
-	vk::AttachmentReference depthAttachmentRef;
-	{
-		depthAttachmentRef.attachment = 1;
-		depthAttachmentRef.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-	}
-	std::array<vk::AttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
-	vk::SubpassDescription subpass;
-	{
-		subpass.flags = {};
-		subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-		subpass.inputAttachmentCount = 0;
-		subpass.pInputAttachments = nullptr;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colorAttachmentRef;
-		subpass.pResolveAttachments = nullptr;
-		subpass.pDepthStencilAttachment = &depthAttachmentRef;
-		subpass.preserveAttachmentCount = 0;
-		subpass.pPreserveAttachments = nullptr;
+	if (m_state.layoutSource)
+	{//Borrow the layout, after checking it declares everything these shaders use
+		const GraphicsPipeline &src = *m_state.layoutSource;
+		for (auto &stage : { &v, f })
+		{
+			if (!stage)
+				continue;
+			for (auto &b : stage->Bindings())
+			{
+				bool found = false;
+				if (b.set < src.m_setLayouts.size())
+				{
+					for (auto &sb : m_context.Layouts().Bindings(src.m_setLayouts[b.set]))
+						found |= sb.binding == b.binding && sb.descriptorType == b.type && sb.descriptorCount >= b.count && (sb.stageFlags & stage->Stage());
+				}
+				if (!found)
+					throw std::runtime_error("Descriptor '" + b.name + "' (set " + std::to_string(b.set) + ", binding " + std::to_string(b.binding) + ") is not provided by the shared pipeline layout.");
+			}
+		}
+		m_pipelineLayout = src.m_pipelineLayout;
+		m_setLayouts = src.m_setLayouts;
+		return m_pipelineLayout;
 	}
-	vk::SubpassDependency spDependency;
-	{
-		spDependency.srcSubpass = VK_SUBPASS_EXTERNAL;//Previous renderpass
-		spDependency.dstSubpass = 0;//Index of subpass
-		spDependency.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		spDependency.srcAccessMask = vk::AccessFlags();
-		//Wait for swapchain to finish reading from image
-		spDependency.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		spDependency.dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+	std::vector<const ShaderReflection*> stages = { &v };
+	if (f)
+		stages.push_back(f);
+	std::vector<vk::DescriptorSetLayout> setLayouts;
+	vk::PipelineLayout rtn = m_context.Layouts().getPipelineLayout(stages, &setLayouts);
+	if (!m_pipelineLayout)
+	{//First build
+		m_pipelineLayout = rtn;
+		m_setLayouts = setLayouts;
 	}
-	vk::RenderPassCreateInfo rpInfo;
-	{
-		rpInfo.flags = {};
-		rpInfo.attachmentCount = (unsigned int)attachments.size();
-		rpInfo.pAttachments = attachments.data();
-		rpInfo.subpassCount = 1;
-		rpInfo.pSubpasses = &subpass;
-		rpInfo.dependencyCount = 1;
-		rpInfo.pDependencies = &spDependency;
+	else if (rtn != m_pipelineLayout)
+	{//Rebuild, descriptor sets and command buffers are bound against the existing layout
+		throw std::runtime_error("Shader resource interface has changed, the pipeline layout is no longer compatible. Restart required.");
 	}
-	return m_context.Device().createRenderPass(rpInfo);
+	return rtn;
 }
\ No newline at end of file
@@ -1,15 +1,34 @@
 #ifndef __GraphicsPipeline_h__
 #define __GraphicsPipeline_h__
 #include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
 #include <vulkan/vulkan.hpp>
+#include "SpecializationConstants.h"
+#include "ReloadablePipeline.h"
 class Context;
+class ShaderReflection;
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE //Vulkan prefers depth range 0 - 1, GL uses -1 - 1
 #include <glm/glm.hpp>
-struct UniformBufferObject {
+/**
+ * Matches FrameUniforms in test.vert (set 0, binding 0)
+ * Per view matrices for multiview, indexed by gl_ViewIndex (only [0] is used when rendering a single view)
+ */
+struct FrameUniforms {
+	static const unsigned int MaxViews = 4;//MAX_VIEWS in the shaders
+	glm::mat4 view[MaxViews];
+	glm::mat4 proj[MaxViews];
+};
+/**
+ * Matches the push constant block DrawConstants in test.vert
+ * Only Size bytes are pushed, as host alignment of glm types may pad the struct
+ */
+struct DrawConstants {
 	glm::mat4 model;
-	glm::mat4 view;
-	glm::mat4 proj;
+	uint32_t objectIndex;
+	static const uint32_t Size = sizeof(glm::mat4) + sizeof(uint32_t);
 };
 struct Vertex {
 	glm::vec3 pos;
@@ -60,50 +79,116 @@ const std::vector<Vertex> tempVertices = {
 	{ { 0.5f, 0.5f, -0.5f },{ 0.0f, 0.0f, 1.0f },{ 1.0f, 1.0f } },
 	{ { -0.5f, 0.5f, -0.5f },{ 1.0f, 1.0f, 1.0f },{ 0.0f, 1.0f } }
 };
-//Render in back to front order for transparency/blending
+//Two quads, drawn separately (first index 0 and 6), so RenderQueue can order them
 static const std::vector<uint16_t> tempIndices = {
 	4, 5, 6, 6, 7, 4,
 	0, 1, 2, 2, 3, 0
 };
+class GraphicsPipeline;
 /**
- * Consider using SPIRV-Cross for Shader introspection to detect layout/binding points by name
- * https://github.com/KhronosGroup/SPIRV-Cross
- * https://www.khronos.org/assets/uploads/developers/library/2016-vulkan-devday-uk/4-Using-spir-v-with-spirv-cross.pdf
+ * Fixed function state which differs between the pipelines of different passes
+ * Depth uses reversed-Z (cleared to 0, nearer is greater)
  */
-class GraphicsPipeline
+struct PipelineState
+{
+	PipelineState()
+		: samples(vk::SampleCountFlagBits::e1)
+		, depthWrite(true)
+		, depthCompareOp(vk::CompareOp::eGreater)
+		, blend(false)
+		, multiview(false)
+		, layoutSource(nullptr) { }
+	vk::SampleCountFlagBits samples;//Must match the sample count of the subpass's attachments
+	bool depthWrite;
+	vk::CompareOp depthCompareOp;
+	bool blend;//Src alpha blending, transparent draws must be ordered back to front (see RenderQueue)
+	bool multiview;//Shaders are compiled with MULTIVIEW defined, so use gl_ViewIndex, the render pass must have a view mask
+	/**
+	 * If set, the pipeline layout of layoutSource is used instead of one generated from this pipeline's shaders
+	 * so descriptor sets can be shared, this pipeline's descriptors must be a subset of layoutSource's
+	 * layoutSource must outlive this pipeline
+	 */
+	const GraphicsPipeline *layoutSource;
+};
+/**
+ * Descriptor set and pipeline layouts are generated from SPIR-V reflection of the shaders (see ShaderReflection)
+ * and shared via Context's LayoutCache, vertex inputs are matched by location against Vertex
+ * Specialization constant values are validated against the constants each stage declares
+ * Pipelines without a fragment shader (e.g. depth pre-pass) have no colour attachments
+ */
+class GraphicsPipeline : public ReloadablePipeline
 {
 public:
-	GraphicsPipeline(Context &ctx, const char * vertPath, const char * fragPath);
+	/**
+	 * @param renderPass Render pass the pipeline will be used within (subpass 0), must outlive the pipeline's rebuilds
+	 * @param fragPath nullptr for a vertex only pipeline
+	 */
+	GraphicsPipeline(Context &ctx, const vk::RenderPass &renderPass, const char * vertPath, const char * fragPath, const SpecializationConstants &spec = SpecializationConstants(), const PipelineState &state = PipelineState());
 	~GraphicsPipeline();
 	const vk::RenderPass& RenderPass() const { return m_renderPass;  }
 	const vk::Pipeline& Pipeline() const { return m_pipeline; }
 	const vk::PipelineLayout& PipelineLayout() const { return m_pipelineLayout; }
+	const vk::DescriptorSetLayout& DescriptorSetLayout(const unsigned int &set) const { return m_setLayouts.at(set); }
+	/**
+	 * Compiles the shaders and builds a new vk::Pipeline from the current state
+	 * The active pipeline is not modified, so this may be called from a worker thread whilst it is in use
+	 * (but not concurrently with another buildPipeline() on the same object)
+	 * Shader compile errors are thrown as std::runtime_error, as are changes to the resource interface
+	 * which would require a different pipeline layout to the existing pipeline, or specialization constants
+	 * whose size doesn't match their declaration
+	 * @return nullptr if the pipeline state key (SPIR-V and specialization constants) matches the active pipeline
+	 */
+	vk::Pipeline buildPipeline() override;
+	/**
+	 * Replaces the active pipeline
+	 * @return The previous pipeline, the caller must destroy this once the GPU is no longer using it
+	 */
+	vk::Pipeline swapPipeline(const vk::Pipeline &pipeline) override;
+	/**
+	 * Replaces the specialization constant values, these take effect at the next buildPipeline()
+	 * Thread-safe, also flags that a rebuild is required (see rebuildRequested())
+	 */
+	void setSpecialization(const SpecializationConstants &spec);
+	SpecializationConstants Specialization() const;
+	bool rebuildRequested() const override { return m_rebuildRequested.load(); }
+	/**
+	 * Returns true if either shader stage was loaded from a file with the provided name
+	 */
+	bool usesShader(const std::string &filename) const override;
 private:
-	static std::vector<char> readFile(const char * file);
-	vk::ShaderModule createShader(const std::vector<char>& code) const;
-	static std::vector<vk::PipelineShaderStageCreateInfo> createPipelineInfo(vk::ShaderModule &v, vk::ShaderModule &f);
+	std::vector<vk::PipelineShaderStageCreateInfo> createPipelineInfo(vk::ShaderModule &v, vk::ShaderModule &f, const SpecializationConstants &spec);
 	Context &m_context;
+	const vk::RenderPass m_renderPass;//Owned by RenderGraph
+	const PipelineState m_state;
+	const std::string m_vertPath;
+	const std::string m_fragPath;
 	
-	vk::PipelineVertexInputStateCreateInfo vertexInput();
+	vk::PipelineVertexInputStateCreateInfo vertexInput(const ShaderReflection &v);
 	vk::PipelineInputAssemblyStateCreateInfo inputAssembly() const;
-	vk::PipelineViewportStateCreateInfo viewportState();
+	vk::PipelineViewportStateCreateInfo viewportState() const;
 	vk::PipelineRasterizationStateCreateInfo rasterizerState() const;
 	vk::PipelineMultisampleStateCreateInfo multisampleState() const;
 	vk::PipelineDepthStencilStateCreateInfo depthStencilState() const;
 	vk::PipelineColorBlendStateCreateInfo colorBlendState();
-	vk::PipelineLayout pipelineLayout();
-	vk::RenderPass renderPass() const;
+	vk::PipelineLayout pipelineLayout(const ShaderReflection &v, const ShaderReflection *f);
 
 	vk::Pipeline m_pipeline = nullptr;
-	vk::PipelineLayout m_pipelineLayout = nullptr;
-	vk::RenderPass m_renderPass = nullptr;
+	vk::PipelineLayout m_pipelineLayout = nullptr;//Owned by LayoutCache
+	std::vector<vk::DescriptorSetLayout> m_setLayouts;//Owned by LayoutCache
+
+	mutable std::mutex m_specMutex;
+	SpecializationConstants m_spec;
+	std::atomic<bool> m_rebuildRequested;
+	uint64_t m_stateKey = 0;//State key of m_pipeline
+	uint64_t m_builtKey = 0;//State key of the most recent buildPipeline(), becomes m_stateKey on swap
 
 	//Temp structs that need pointers passed to CreateInfo's
-	vk::Viewport t_viewport;
-	vk::Rect2D t_scissors;
 	vk::PipelineColorBlendAttachmentState t_cbas;
 	vk::VertexInputBindingDescription t_vibd;
-	std::array<vk::VertexInputAttributeDescription, 3> t_viad;
+	std::vector<vk::VertexInputAttributeDescription> t_viad;
+	vk::SpecializationInfo t_vsi, t_fsi;
+	std::vector<vk::SpecializationMapEntry> t_vsme, t_fsme;
+	std::vector<unsigned char> t_vsd, t_fsd;
 };
 
 #endif //__GraphicsPipeline_h__
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef __Hash_h__
+#define __Hash_h__
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * 64bit FNV-1a, mixed incrementally
+ * Not cryptographic, used for cache and state keys
+ */
+class Hash
+{
+public:
+	void mix(const void *data, const size_t &len)
+	{
+		const unsigned char *d = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < len; ++i)
+		{
+			m_h ^= d[i];
+			m_h *= 1099511628211ull;
+		}
+	}
+	/**
+	 * Mixes the value's bytes, T must have no padding
+	 */
+	template<typename T>
+	void mix(const T &value) { mix(&value, sizeof(T)); }
+	uint64_t value() const { return m_h; }
+private:
+	uint64_t m_h = 14695981039346656037ull;
+};
+
+#endif //__Hash_h__
@@ -0,0 +1,215 @@
+#include "ImageLayoutTracker.h"
+#include <algorithm>
+
+void ImageLayoutTracker::track(const vk::Image &image, const vk::Format &format, const uint32_t &mipLevels, const uint32_t &arrayLayers, const vk::ImageLayout &initialLayout)
+{
+	forget(image);
+	ImageState s;
+	{
+		s.format = format;
+		s.mipLevels = mipLevels;
+		s.arrayLayers = arrayLayers;
+		s.layouts.resize(mipLevels * arrayLayers, initialLayout);
+	}
+	m_images[static_cast<VkImage>(image)] = s;
+}
+void ImageLayoutTracker::forget(const vk::Image &image)
+{
+	const VkImage key = static_cast<VkImage>(image);
+	m_images.erase(key);
+	m_pending.erase(m_pending.lower_bound(SubresourceKey(key, 0)), m_pending.upper_bound(SubresourceKey(key, UINT32_MAX)));
+}
+vk::ImageLayout ImageLayoutTracker::Layout(const vk::Image &image, const uint32_t &mipLevel, const uint32_t &arrayLayer) const
+{
+	auto it = m_images.find(static_cast<VkImage>(image));
+	if (it == m_images.end())
+		throw std::exception("ImageLayoutTracker: Image is not tracked.");
+	return it->second.layouts.at(mipLevel * it->second.arrayLayers + arrayLayer);
+}
+void ImageLayoutTracker::transition(const vk::Image &image, const vk::ImageLayout &newLayout, const uint32_t &baseMipLevel, const uint32_t &levelCount, const uint32_t &baseArrayLayer, const uint32_t &layerCount, const bool &discard)
+{
+	const VkImage key = static_cast<VkImage>(image);
+	auto it = m_images.find(key);
+	if (it == m_images.end())
+		throw std::exception("ImageLayoutTracker: Image is not tracked.");
+	ImageState &s = it->second;
+	const uint32_t mipEnd = levelCount == VK_REMAINING_MIP_LEVELS ? s.mipLevels : std::min(s.mipLevels, baseMipLevel + levelCount);
+	const uint32_t layerEnd = layerCount == VK_REMAINING_ARRAY_LAYERS ? s.arrayLayers : std::min(s.arrayLayers, baseArrayLayer + layerCount);
+	for (uint32_t mip = baseMipLevel; mip < mipEnd; ++mip)
+	{
+		for (uint32_t layer = baseArrayLayer; layer < layerEnd; ++layer)
+		{
+			const uint32_t i = mip * s.arrayLayers + layer;
+			auto p = m_pending.find(SubresourceKey(key, i));
+			if (s.layouts[i] == newLayout && !(discard && p != m_pending.end()))
+			{//Already in (or already queued for) newLayout
+				m_stats.dropped++;
+				continue;
+			}
+			if (p == m_pending.end())
+			{
+				PendingTransition t;
+				{
+					t.oldLayout = discard ? vk::ImageLayout::eUndefined : s.layouts[i];
+				}
+				m_pending.emplace(SubresourceKey(key, i), t);
+			}
+			else
+			{//Transitioned again before a flush, skip the intermediate layout
+				m_stats.dropped++;
+				if (discard)
+					p->second.oldLayout = vk::ImageLayout::eUndefined;
+				else if (p->second.oldLayout == newLayout)
+					m_pending.erase(p);//Back to where it started
+			}
+			s.layouts[i] = newLayout;
+		}
+	}
+}
+void ImageLayoutTracker::flush(vk::CommandBuffer &cb)
+{
+	if (m_pending.empty())
+		return;
+	std::vector<vk::ImageMemoryBarrier> barriers;
+	vk::PipelineStageFlags srcStages, dstStages;
+	VkImage currentImage = VK_NULL_HANDLE;
+	size_t imageBegin = 0;//First barrier of currentImage
+	for (auto it = m_pending.begin(); it != m_pending.end();)
+	{
+		const VkImage image = it->first.first;
+		const ImageState &s = m_images.at(image);
+		const uint32_t mip = it->first.second / s.arrayLayers;
+		const uint32_t layer = it->first.second % s.arrayLayers;
+		const vk::ImageLayout oldLayout = it->second.oldLayout;
+		const vk::ImageLayout newLayout = s.layouts[it->first.second];
+		if (image != currentImage)
+		{
+			currentImage = image;
+			imageBegin = barriers.size();
+		}
+		//Extend over the following layers of this mip level which make the same transition
+		uint32_t layerCount = 1;
+		auto next = std::next(it);
+		while (next != m_pending.end() && next->first.first == image && next->first.second == it->first.second + layerCount
+			&& layer + layerCount < s.arrayLayers && next->second.oldLayout == oldLayout && s.layouts[next->first.second] == newLayout)
+		{
+			++layerCount;
+			++next;
+		}
+		it = next;
+		//Extend a barrier of the previous mip level with the same layers and transition
+		bool merged = false;
+		for (size_t b = imageBegin; b < barriers.size() && !merged; ++b)
+		{
+			vk::ImageSubresourceRange &r = barriers[b].subresourceRange;
+			if (barriers[b].oldLayout == oldLayout && barriers[b].newLayout == newLayout
+				&& r.baseArrayLayer == layer && r.layerCount == layerCount && r.baseMipLevel + r.levelCount == mip)
+			{
+				r.levelCount++;
+				merged = true;
+			}
+		}
+		if (merged)
+			continue;
+		vk::PipelineStageFlags srcStage, dstStage;
+		vk::ImageMemoryBarrier barrier;
+		{
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = newLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = vk::Image(image);
+			barrier.subresourceRange.aspectMask = aspectMask(s.format);
+			barrier.subresourceRange.baseMipLevel = mip;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.subresourceRange.baseArrayLayer = layer;
+			barrier.subresourceRange.layerCount = layerCount;
+			layoutUsage(oldLayout, true, srcStage, barrier.srcAccessMask);
+			layoutUsage(newLayout, false, dstStage, barrier.dstAccessMask);
+		}
+		srcStages |= srcStage;
+		dstStages |= dstStage;
+		barriers.push_back(barrier);
+	}
+	m_pending.clear();
+	cb.pipelineBarrier(
+		srcStages, dstStages,
+		{},
+		0, nullptr,
+		0, nullptr,
+		(unsigned int)barriers.size(), barriers.data()
+	);
+	m_stats.flushes++;
+	m_stats.barriers += (unsigned int)barriers.size();
+}
+vk::ImageAspectFlags ImageLayoutTracker::aspectMask(const vk::Format &format)
+{
+	switch (format)
+	{
+	case vk::Format::eD16Unorm:
+	case vk::Format::eX8D24UnormPack32:
+	case vk::Format::eD32Sfloat:
+		return vk::ImageAspectFlagBits::eDepth;
+	case vk::Format::eS8Uint:
+		return vk::ImageAspectFlagBits::eStencil;
+	case vk::Format::eD16UnormS8Uint:
+	case vk::Format::eD24UnormS8Uint:
+	case vk::Format::eD32SfloatS8Uint:
+		return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+	default:
+		return vk::ImageAspectFlagBits::eColor;
+	}
+}
+void ImageLayoutTracker::layoutUsage(const vk::ImageLayout &layout, const bool &asSource, vk::PipelineStageFlags &stages, vk::AccessFlags &access)
+{
+	switch (layout)
+	{
+	case vk::ImageLayout::eUndefined:
+		stages = vk::PipelineStageFlagBits::eTopOfPipe;
+		access = {};
+		break;
+	case vk::ImageLayout::ePreinitialized:
+		stages = vk::PipelineStageFlagBits::eHost;
+		access = vk::AccessFlagBits::eHostWrite;
+		break;
+	case vk::ImageLayout::eColorAttachmentOptimal:
+		stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		access = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+		break;
+	case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+		stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+		access = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+		break;
+	case vk::ImageLayout::eDepthStencilReadOnlyOptimal:
+		stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eFragmentShader;
+		access = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eShaderRead;
+		break;
+	case vk::ImageLayout::eShaderReadOnlyOptimal:
+		stages = vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+		access = vk::AccessFlagBits::eShaderRead;
+		break;
+	case vk::ImageLayout::eTransferSrcOptimal:
+		stages = vk::PipelineStageFlagBits::eTransfer;
+		access = vk::AccessFlagBits::eTransferRead;
+		break;
+	case vk::ImageLayout::eTransferDstOptimal:
+		stages = vk::PipelineStageFlagBits::eTransfer;
+		access = vk::AccessFlagBits::eTransferWrite;
+		break;
+	case vk::ImageLayout::ePresentSrcKHR:
+		//Presentation is synchronised by semaphores, the barrier only needs to order the layout transition
+		stages = asSource ? vk::PipelineStageFlagBits::eTopOfPipe : vk::PipelineStageFlagBits::eBottomOfPipe;
+		access = {};
+		break;
+	case vk::ImageLayout::eGeneral:
+	default:
+		//Could be used by anything, so be conservative
+		stages = vk::PipelineStageFlagBits::eAllCommands;
+		access = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+		break;
+	}
+	//Source access masks only need to make writes available
+	if (asSource)
+		access &= vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite
+			| vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eMemoryWrite;
+}
@@ -0,0 +1,71 @@
+#ifndef __ImageLayoutTracker_h__
+#define __ImageLayoutTracker_h__
+#include <vector>
+#include <map>
+#include <vulkan/vulkan.hpp>
+
+/**
+ * Tracks the current layout of each subresource (mip level/array layer) of registered images
+ * Transitions are accumulated, and recorded as a single vkCmdPipelineBarrier by flush()
+ * Transitions to a subresource's current layout are dropped, as are intermediate layouts of
+ * subresources transitioned multiple times between flushes
+ * Access masks and pipeline stages are derived from the layouts, so any pair of layouts is supported
+ * Not thread-safe
+ */
+class ImageLayoutTracker
+{
+public:
+	struct Stats
+	{
+		unsigned int flushes;//vkCmdPipelineBarrier calls
+		unsigned int barriers;//Image barriers recorded
+		unsigned int dropped;//Requested subresource transitions which were redundant
+	};
+	/**
+	 * Registers an image, images must be registered before they are transitioned
+	 */
+	void track(const vk::Image &image, const vk::Format &format, const uint32_t &mipLevels = 1, const uint32_t &arrayLayers = 1, const vk::ImageLayout &initialLayout = vk::ImageLayout::eUndefined);
+	/**
+	 * Unregisters an image, any pending transitions of it are discarded
+	 */
+	void forget(const vk::Image &image);
+	vk::ImageLayout Layout(const vk::Image &image, const uint32_t &mipLevel = 0, const uint32_t &arrayLayer = 0) const;
+	/**
+	 * Queues a transition of the given subresources to newLayout
+	 * @param discard If true the previous contents are not required, the transition is from eUndefined
+	 */
+	void transition(const vk::Image &image, const vk::ImageLayout &newLayout,
+		const uint32_t &baseMipLevel = 0, const uint32_t &levelCount = VK_REMAINING_MIP_LEVELS,
+		const uint32_t &baseArrayLayer = 0, const uint32_t &layerCount = VK_REMAINING_ARRAY_LAYERS,
+		const bool &discard = false);
+	bool pending() const { return !m_pending.empty(); }
+	/**
+	 * Records all pending transitions into cb as a single pipeline barrier
+	 */
+	void flush(vk::CommandBuffer &cb);
+	const Stats &getStats() const { return m_stats; }
+	static vk::ImageAspectFlags aspectMask(const vk::Format &format);
+private:
+	struct ImageState
+	{
+		vk::Format format;
+		uint32_t mipLevels;
+		uint32_t arrayLayers;
+		std::vector<vk::ImageLayout> layouts;//[mip * arrayLayers + layer]
+	};
+	//Layout of a subresource before its first pending transition
+	struct PendingTransition
+	{
+		vk::ImageLayout oldLayout;
+	};
+	typedef std::pair<VkImage, uint32_t> SubresourceKey;//image, mip * arrayLayers + layer
+	/**
+	 * Stages and accesses which use an image in the given layout
+	 */
+	static void layoutUsage(const vk::ImageLayout &layout, const bool &asSource, vk::PipelineStageFlags &stages, vk::AccessFlags &access);
+	std::map<VkImage, ImageState> m_images;
+	std::map<SubresourceKey, PendingTransition> m_pending;
+	Stats m_stats = Stats();
+};
+
+#endif //__ImageLayoutTracker_h__
@@ -0,0 +1,146 @@
+#include "LayoutCache.h"
+#include "ShaderReflection.h"
+#include "Hash.h"
+#include <map>
+#include <algorithm>
+
+LayoutCache::LayoutCache(const vk::Device &device)
+	: m_device(device)
+{ }
+LayoutCache::~LayoutCache()
+{
+	for (auto &p : m_pipelineLayouts)
+		m_device.destroyPipelineLayout(p.second.layout);
+	m_pipelineLayouts.clear();
+	for (auto &s : m_setLayouts)
+		m_device.destroyDescriptorSetLayout(s.second.layout);
+	m_setLayouts.clear();
+}
+vk::PipelineLayout LayoutCache::getPipelineLayout(const std::vector<const ShaderReflection*> &stages, std::vector<vk::DescriptorSetLayout> *setLayoutsOut)
+{
+	//Merge bindings across stages: set -> binding -> layout binding
+	std::map<uint32_t, std::map<uint32_t, vk::DescriptorSetLayoutBinding>> sets;
+	std::vector<vk::PushConstantRange> pushConstants;
+	for (auto &s : stages)
+	{
+		for (auto &b : s->Bindings())
+		{
+			auto &set = sets[b.set];
+			auto it = set.find(b.binding);
+			if (it == set.end())
+			{
+				vk::DescriptorSetLayoutBinding lb;
+				{
+					lb.binding = b.binding;
+					lb.descriptorType = b.type;
+					lb.descriptorCount = b.count;
+					lb.stageFlags = s->Stage();
+					lb.pImmutableSamplers = nullptr;
+				}
+				set.emplace(b.binding, lb);
+			}
+			else
+			{
+				if (it->second.descriptorType != b.type)
+					throw std::runtime_error("LayoutCache: Shader stages disagree on the type of set " + std::to_string(b.set) + " binding " + std::to_string(b.binding) + ".");
+				it->second.descriptorCount = std::max(it->second.descriptorCount, b.count);
+				it->second.stageFlags |= s->Stage();
+			}
+		}
+		//Each stage keeps its own range, a stage may only appear in one range
+		for (auto &pc : s->PushConstants())
+			pushConstants.push_back(pc);
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	//Sets must be contiguous, so unused set indices receive an empty layout
+	std::vector<vk::DescriptorSetLayout> setLayouts(sets.empty() ? 0 : sets.rbegin()->first + 1);
+	for (uint32_t i = 0; i < setLayouts.size(); ++i)
+	{
+		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		auto it = sets.find(i);
+		if (it != sets.end())
+			for (auto &b : it->second)
+				bindings.push_back(b.second);
+		setLayouts[i] = getDescriptorSetLayout_(bindings);
+	}
+	if (setLayoutsOut)
+		*setLayoutsOut = setLayouts;
+	//Find/create pipeline layout
+	Hash h;
+	for (auto &sl : setLayouts)
+		h.mix(static_cast<VkDescriptorSetLayout>(sl));
+	for (auto &pc : pushConstants)
+	{
+		h.mix(static_cast<VkShaderStageFlags>(pc.stageFlags));
+		h.mix(pc.offset);
+		h.mix(pc.size);
+	}
+	auto range = m_pipelineLayouts.equal_range(h.value());
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.setLayouts == setLayouts && it->second.pushConstants.size() == pushConstants.size()
+			&& std::equal(pushConstants.begin(), pushConstants.end(), it->second.pushConstants.begin()))
+			return it->second.layout;
+	}
+	vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
+	{
+		pipelineLayoutInfo.flags = {};
+		pipelineLayoutInfo.setLayoutCount = (unsigned int)setLayouts.size();
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = (unsigned int)pushConstants.size();
+		pipelineLayoutInfo.pPushConstantRanges = pushConstants.data();
+	}
+	PipelineLayoutEntry entry;
+	{
+		entry.setLayouts = setLayouts;
+		entry.pushConstants = pushConstants;
+		entry.layout = m_device.createPipelineLayout(pipelineLayoutInfo);
+	}
+	m_pipelineLayouts.emplace(h.value(), entry);
+	return entry.layout;
+}
+vk::DescriptorSetLayout LayoutCache::getDescriptorSetLayout(std::vector<vk::DescriptorSetLayoutBinding> bindings)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return getDescriptorSetLayout_(bindings);
+}
+vk::DescriptorSetLayout LayoutCache::getDescriptorSetLayout_(std::vector<vk::DescriptorSetLayoutBinding> &bindings)
+{
+	std::sort(bindings.begin(), bindings.end(), [](const vk::DescriptorSetLayoutBinding &a, const vk::DescriptorSetLayoutBinding &b) { return a.binding < b.binding; });
+	Hash h;
+	for (auto &b : bindings)
+	{
+		h.mix(b.binding);
+		h.mix(b.descriptorType);
+		h.mix(b.descriptorCount);
+		h.mix(static_cast<VkShaderStageFlags>(b.stageFlags));
+	}
+	auto range = m_setLayouts.equal_range(h.value());
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.bindings.size() == bindings.size() && std::equal(bindings.begin(), bindings.end(), it->second.bindings.begin()))
+			return it->second.layout;
+	}
+	vk::DescriptorSetLayoutCreateInfo descSetCreateInfo;
+	{
+		descSetCreateInfo.bindingCount = (unsigned int)bindings.size();
+		descSetCreateInfo.pBindings = bindings.data();
+	}
+	SetLayoutEntry entry;
+	{
+		entry.bindings = bindings;
+		entry.layout = m_device.createDescriptorSetLayout(descSetCreateInfo);
+	}
+	m_setLayouts.emplace(h.value(), entry);
+	return entry.layout;
+}
+std::vector<vk::DescriptorSetLayoutBinding> LayoutCache::Bindings(const vk::DescriptorSetLayout &layout)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto &s : m_setLayouts)
+	{
+		if (s.second.layout == layout)
+			return s.second.bindings;
+	}
+	throw std::runtime_error("LayoutCache: Descriptor set layout was not created by this cache.");
+}
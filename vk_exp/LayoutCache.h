@@ -0,0 +1,57 @@
+#ifndef __LayoutCache_h__
+#define __LayoutCache_h__
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <vulkan/vulkan.hpp>
+class ShaderReflection;
+
+/**
+ * Builds descriptor set layouts and pipeline layouts from shader reflection data
+ * Layouts are deduplicated by a hash of their contents, so pipelines with matching
+ * resource interfaces share the same (and hence compatible) layout objects
+ * All layouts are owned by the cache and destroyed with it
+ * Methods are thread-safe, as pipelines may be built on worker threads
+ */
+class LayoutCache
+{
+public:
+	LayoutCache(const vk::Device &device);
+	~LayoutCache();
+	/**
+	 * Merges the resource interfaces of each shader stage of a pipeline and returns the matching pipeline layout
+	 * Bindings used by multiple stages have their stage flags combined
+	 * @param stages Reflection of each shader stage within the pipeline
+	 * @param setLayoutsOut If provided, receives the descriptor set layouts (indexed by set) used by the pipeline layout
+	 * @throws std::runtime_error If stages disagree on the type of a binding
+	 */
+	vk::PipelineLayout getPipelineLayout(const std::vector<const ShaderReflection*> &stages, std::vector<vk::DescriptorSetLayout> *setLayoutsOut = nullptr);
+	/**
+	 * Returns the descriptor set layout matching the provided bindings
+	 */
+	vk::DescriptorSetLayout getDescriptorSetLayout(std::vector<vk::DescriptorSetLayoutBinding> bindings);
+	/**
+	 * Returns the bindings a descriptor set layout was created from, e.g. for sizing descriptor pools
+	 */
+	std::vector<vk::DescriptorSetLayoutBinding> Bindings(const vk::DescriptorSetLayout &layout);
+private:
+	struct SetLayoutEntry
+	{
+		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		vk::DescriptorSetLayout layout;
+	};
+	struct PipelineLayoutEntry
+	{
+		std::vector<vk::DescriptorSetLayout> setLayouts;
+		std::vector<vk::PushConstantRange> pushConstants;
+		vk::PipelineLayout layout;
+	};
+	vk::DescriptorSetLayout getDescriptorSetLayout_(std::vector<vk::DescriptorSetLayoutBinding> &bindings);//Requires m_mutex
+	const vk::Device m_device;
+	std::mutex m_mutex;
+	//Hash -> entries, multiple entries per hash only in the case of collisions
+	std::unordered_multimap<uint64_t, SetLayoutEntry> m_setLayouts;
+	std::unordered_multimap<uint64_t, PipelineLayoutEntry> m_pipelineLayouts;
+};
+
+#endif //__LayoutCache_h__
@@ -1,18 +1,27 @@
 #include "MainLoop.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #define MOUSE_SPEED 0.001f
 #define SHIFT_MULTIPLIER 5.0f
-#define DELTA_ROLL 0.01f
+#define DELTA_ROLL 0.001f
 #define DELTA_MOVE 0.005f
 #define DELTA_STRAFE 0.005f
 #define DELTA_ASCEND 0.005f
+#define SIM_RATE 250 //Simulation steps per second
+#define MAX_CATCHUP_STEPS 25 //Steps run at most to catch up after a stall, the simulation slows down beyond this
+#define IDLE_EVENT_TIMEOUT_MS 100 //Longest the idle simulation thread blocks waiting for events, bounds how long stop() takes
 
 MainLoop::MainLoop()
 	: loopContinue(false)
 	, loopThread(nullptr)
+	, renderThread(nullptr)
 	, m_camera(glm::vec3(2, 2, 2))
 {
-	ctxt.setViewMatPtr(m_camera.getViewMatPtr());
 }
 MainLoop::~MainLoop()
 {
@@ -24,6 +33,7 @@ MainLoop::~MainLoop()
 
 bool MainLoop::init()
 {
+	PROFILE_THREAD("simulation");
 	try
 	{
 		ctxt.init();
@@ -37,59 +47,182 @@ bool MainLoop::init()
 void MainLoop::loop()
 {
 	loopContinue.store(true);
-	Uint32 previousTime = 0;
+	//Fixed timestep, so motion and simulation cost are independent of the display rate
+	const clock::duration simStep = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / SIM_RATE));
+	const float stepMs = 1000.0f / SIM_RATE;
+	m_simFrame = 0;
+	m_simTime = 0;
+	m_currentState = captureState();
+	m_previousState = m_currentState;
+	resetPowerStats();
+	//The render thread has something to draw from its first frame
+	publishSnapshot(clock::now(), simStep, clock::now());
+	renderThread = new std::thread(&MainLoop::renderLoop, this);
+	clock::time_point previousTime = clock::now();
+	clock::duration accumulator = clock::duration::zero();
 	do
 	{
-		//Calc time since last frame
-		Uint32 currentTime = SDL_GetTicks();
-		Uint32 frameTime = currentTime>previousTime?currentTime - previousTime:0;
-		previousTime = currentTime;
+		const clock::time_point iterationStart = clock::now();
+		//Bounded, so a stall (e.g. the window being dragged) doesn't lead to a burst of steps
+		accumulator += std::min<clock::duration>(iterationStart - previousTime, simStep * MAX_CATCHUP_STEPS);
+		previousTime = iterationStart;
 
-		//Poll Events
-		// Handle continuous key presses (movement)
-		handleKeyboardState(SDL_GetKeyboardState(NULL), frameTime);
-		// handle each event on the queue
-		SDL_Event e;
-		while (SDL_PollEvent(&e) != 0) {
-			switch (e.type) {
-				case SDL_QUIT:
-					loopContinue.store(false);
-					break;
-				case SDL_KEYDOWN:
-				{
-					int x = 0;
-					int y = 0;
-					SDL_GetMouseState(&x, &y);
-					handleKeypress(e.key.keysym.sym, x, y);
-				}
-				break;
-				//case SDL_MOUSEWHEEL:
-				//break;
-				case SDL_MOUSEMOTION:
-				{
-					handleMouseMove(e.motion.xrel, e.motion.yrel);
-					break;
-				}
-				case SDL_MOUSEBUTTONDOWN:
-				{
-					toggleMouseMode();
+		{
+			PROFILE_ZONE("MainLoop::events");
+			//Poll Events
+			// handle each event on the queue
+			//Mouse motion is applied to the camera immediately, so is interpolated in over the next step
+			SDL_Event e;
+			while (SDL_PollEvent(&e) != 0) {
+				switch (e.type) {
+					case SDL_QUIT:
+						loopContinue.store(false);
+						break;
+					case SDL_KEYDOWN:
+					{
+						int x = 0;
+						int y = 0;
+						SDL_GetMouseState(&x, &y);
+						handleKeypress(e.key.keysym.sym, x, y);
+					}
 					break;
-				}
-				case SDL_WINDOWEVENT:
-				{
-					if (e.window.event == SDL_WINDOWEVENT_RESIZED)
+					//case SDL_MOUSEWHEEL:
+					//break;
+					case SDL_MOUSEMOTION:
+					{
+						handleMouseMove(e.motion.xrel, e.motion.yrel);
+						break;
+					}
+					case SDL_MOUSEBUTTONDOWN:
+					{
+						toggleMouseMode();
+						break;
+					}
+					case SDL_WINDOWEVENT:
 					{
-						ctxt.rebuildSwapChain();
+						//Sent for both user and toggleFullScreen() resizes
+						if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+						{
+							enqueueRender([this]() { ctxt.rebuildSwapChain(); });
+						}
 					}
 				}
 			}
 		}
-		//Draw Frame
-		drawFrame();
+		bool stepped = false;
+		while (accumulator >= simStep)
+		{
+			PROFILE_ZONE("MainLoop::step");
+			const clock::time_point stepStart = clock::now();
+			m_previousState = m_currentState;
+			// Handle continuous key presses (movement)
+			handleKeyboardState(SDL_GetKeyboardState(NULL), stepMs);
+			if (m_animate)
+				m_simTime += 1.0 / SIM_RATE;
+			m_simFrame++;
+			m_currentState = captureState();
+			accumulator -= simStep;
+			stepped = true;
+			m_simStats.add(clock::now() - stepStart);
+		}
+		//The current state was due accumulator ago
+		if (stepped)
+			publishSnapshot(iterationStart - accumulator, simStep, iterationStart);
+		const clock::time_point idleStart = clock::now();
+		if (m_onDemand.load(std::memory_order_relaxed) && stepped && m_currentState == m_previousState)
+		{
+			//Nothing is moving (no held keys or animation), so further steps would be identical
+			//Block until input arrives, the event is left queued for the next iteration
+			SDL_WaitEventTimeout(nullptr, IDLE_EVENT_TIMEOUT_MS);
+			//Idle time isn't simulated
+			previousTime = clock::now();
+		}
+		else
+		{
+			std::this_thread::sleep_until(iterationStart + simStep - accumulator);
+		}
+		m_simIdleUs += std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - idleStart).count();
 	} while (loopContinue.load(std::memory_order_relaxed));
+	//The render thread must be idle before the context is destroyed
+	renderThread->join();
+	delete renderThread;
+	renderThread = nullptr;
 	//Kill context, close window
 	ctxt.destroy();
 }
+void MainLoop::renderLoop()
+{
+	PROFILE_THREAD("render");
+	clock::time_point previousFrameStart;
+	FrameSnapshot::State drawn;//State of the last frame drawn
+	bool drawnValid = false;
+	try
+	{
+		while (loopContinue.load(std::memory_order_relaxed))
+		{
+			const bool commandsRan = runRenderCommands();
+			if (m_onDemand.load(std::memory_order_relaxed) && !commandsRan && drawnValid)
+			{
+				if (m_snapshots.update())
+					m_snapshotsRendered++;
+				const FrameSnapshot &snapshot = m_snapshots.read();
+				if (snapshot.interpolate(snapshot.alpha(clock::now())) == drawn && !ctxt.needsRedraw())
+				{
+					//The frame would be identical to the one presented, so skip acquiring and presenting it
+					//Woken early by a new snapshot or command
+					const clock::time_point idleStart = clock::now();
+					{
+						std::unique_lock<std::mutex> lock(m_renderWakeMutex);
+						m_renderWake.wait_for(lock, std::chrono::duration<double, std::milli>(ctxt.Pacer().RefreshMs()));
+					}
+					m_renderIdleUs += std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - idleStart).count();
+					m_framesSkipped++;
+					continue;
+				}
+			}
+			//In FIFO modes, sleep until as late as the frame can start, so the snapshot taken is as recent as possible
+			{
+				PROFILE_ZONE("MainLoop::pacing");
+				ctxt.Pacer().waitForFrameStart();
+			}
+			const clock::time_point frameStart = clock::now();
+			if (previousFrameStart != clock::time_point())
+				m_frameInterval.add(frameStart - previousFrameStart);
+			previousFrameStart = frameStart;
+			if (m_snapshots.update())
+				m_snapshotsRendered++;
+			else
+				m_framesReusingSnapshot++;
+			const FrameSnapshot &snapshot = m_snapshots.read();
+			m_snapshotAge.add(frameStart - snapshot.inputTime);
+			//Interpolated for the time the frame starts, lagging the simulation by up to one step
+			drawn = snapshot.interpolate(snapshot.alpha(frameStart));
+			drawnValid = true;
+			ctxt.setFrameState(drawn, snapshot.inputTime);
+			//Draw Frame
+			drawFrame();
+			m_framesRendered++;
+			m_renderStats.add(clock::now() - frameStart);
+			const unsigned int cap = m_frameCap.load(std::memory_order_relaxed);
+			if (cap)
+			{
+				const clock::time_point idleStart = clock::now();
+				std::this_thread::sleep_until(frameStart + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / cap)));
+				m_renderIdleUs += std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - idleStart).count();
+			}
+		}
+	}
+	catch (std::exception &e)
+	{//e.g. vk::SystemError on device loss, stop the simulation thread so it joins this one and destroys the context
+		fprintf(stderr, "Render thread: %s\n", e.what());
+		loopContinue.store(false);
+	}
+	catch (...)
+	{
+		fprintf(stderr, "Render thread: Unknown exception\n");
+		loopContinue.store(false);
+	}
+}
 void MainLoop::loopAsync()
 {
 	if (ctxt.ready())
@@ -140,19 +273,140 @@ bool MainLoop::isRunning() const
 }
 void MainLoop::drawFrame()
 {
+	PROFILE_FUNCTION();
 	ctxt.updateUniformBuffer();
 	ctxt.getNextImage();
 }
+FrameSnapshot::State MainLoop::captureState() const
+{
+	FrameSnapshot::State state;
+	state.camera = m_camera.transform();
+	//Spin around z axis
+	state.model.rotation = glm::angleAxis((float)fmod(m_simTime * glm::radians(90.0), glm::two_pi<double>()), glm::vec3(0.0f, 0.0f, 1.0f));
+	return state;
+}
+void MainLoop::publishSnapshot(const clock::time_point &stepTime, const clock::duration &step, const clock::time_point &inputTime)
+{
+	FrameSnapshot &snapshot = m_snapshots.writeBuffer();
+	snapshot.previous = m_previousState;
+	snapshot.current = m_currentState;
+	snapshot.stepTime = stepTime;
+	snapshot.step = step;
+	snapshot.simFrame = m_simFrame;
+	snapshot.inputTime = inputTime;
+	m_snapshots.publish();
+	m_snapshotsPublished++;
+	m_renderWake.notify_one();
+}
+void MainLoop::enqueueRender(std::function<void()> command)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_renderCommandsMutex);
+		m_renderCommands.push_back(std::move(command));
+	}
+	m_renderWake.notify_one();
+}
+bool MainLoop::runRenderCommands()
+{
+	std::vector<std::function<void()>> commands;
+	{
+		std::lock_guard<std::mutex> lock(m_renderCommandsMutex);
+		commands.swap(m_renderCommands);
+	}
+	if (commands.empty())
+		return false;
+	PROFILE_FUNCTION();
+	for (auto &c : commands)
+		c();
+	return !commands.empty();
+}
+void MainLoop::StageStats::add(const std::chrono::steady_clock::duration &d)
+{
+	const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+	count.fetch_add(1, std::memory_order_relaxed);
+	totalUs.fetch_add(us, std::memory_order_relaxed);
+	//Single writer, so no compare-exchange is required
+	if (us > maxUs.load(std::memory_order_relaxed))
+		maxUs.store(us, std::memory_order_relaxed);
+}
+void MainLoop::StageStats::print(const char *name) const
+{
+	const uint64_t n = count.load(std::memory_order_relaxed);
+	printf("\t%s: %.3fms avg (%.3fms max) over %llu\n", name,
+		n ? totalUs.load(std::memory_order_relaxed) / (1000.0 * n) : 0.0, maxUs.load(std::memory_order_relaxed) / 1000.0, (unsigned long long)n);
+}
+void MainLoop::printStageStats() const
+{
+	printf("Stage timings:\n");
+	m_simStats.print("Simulation step");
+	m_renderStats.print("Render frame");
+	m_frameInterval.print("Frame interval");
+	m_snapshotAge.print("Snapshot age when rendered");
+	const uint64_t published = m_snapshotsPublished.load(), rendered = m_snapshotsRendered.load();
+	printf("\tSnapshots: %llu published, %llu rendered, %llu replaced before being rendered, %llu frames reused the previous snapshot\n",
+		(unsigned long long)published, (unsigned long long)rendered, (unsigned long long)(published - std::min(published, rendered + 1)), (unsigned long long)m_framesReusingSnapshot.load());
+	printPowerStats();
+}
+void MainLoop::printPowerStats() const
+{
+	const double wallUs = (double)std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - m_powerStatsStart).count();
+	const unsigned int cap = m_frameCap.load();
+	printf("On-demand rendering %s, frame cap %s%s: %llu frames rendered, %llu skipped; idle: simulation thread %.1f%%, render thread %.1f%%\n",
+		m_onDemand.load() ? "on" : "off", cap ? std::to_string(cap).c_str() : "off", cap ? "fps" : "",
+		(unsigned long long)m_framesRendered.load(), (unsigned long long)m_framesSkipped.load(),
+		wallUs > 0 ? 100.0 * m_simIdleUs.load() / wallUs : 0.0, wallUs > 0 ? 100.0 * m_renderIdleUs.load() / wallUs : 0.0);
+}
+void MainLoop::resetPowerStats()
+{
+	m_framesRendered = 0;
+	m_framesSkipped = 0;
+	m_simIdleUs = 0;
+	m_renderIdleUs = 0;
+	m_powerStatsStart = clock::now();
+}
+void MainLoop::toggleOnDemand()
+{
+	printPowerStats();
+	m_onDemand = !m_onDemand.load();
+	resetPowerStats();
+	printf("On-demand rendering %s\n", m_onDemand.load() ? "on" : "off");
+}
+void MainLoop::toggleProfiling()
+{
+	//The profiler is thread-safe, so captures needn't be routed through the render thread
+	if (!Profiler::startCapture())
+		Profiler::stopCapture("profile");
+}
+void MainLoop::cycleFrameCap()
+{
+	static const unsigned int caps[] = { 0, 30, 60, 120 };
+	const unsigned int count = sizeof(caps) / sizeof(unsigned int);
+	unsigned int i = 0;
+	while (i < count && caps[i] != m_frameCap.load())
+		++i;
+	m_frameCap = caps[(i + 1) % count];
+	if (m_frameCap.load())
+		printf("Frame rate capped at %ufps\n", m_frameCap.load());
+	else
+		printf("Frame rate uncapped\n");
+}
+void MainLoop::toggleAnimation()
+{
+	m_animate = !m_animate;
+	const bool paused = !m_animate;
+	enqueueRender([this, paused]() { ctxt.setAnimationPaused(paused); });
+	printf("Animation %s\n", m_animate ? "resumed" : "paused");
+}
 
 void MainLoop::handleMouseMove(int x, int y) {
 	if (SDL_GetRelativeMouseMode()) {
 		m_camera.turn(x * MOUSE_SPEED, y * MOUSE_SPEED);
 	}
 }
-void MainLoop::handleKeyboardState(const Uint8 *state, unsigned int&frameTime)
+void MainLoop::handleKeyboardState(const Uint8 *state, const float &stepMs)
 {
 	float turboMultiplier = state[SDL_SCANCODE_LSHIFT] ? SHIFT_MULTIPLIER : 1.0f;
-	turboMultiplier*= frameTime;//Adjust motion based on frame rate
+	turboMultiplier*= stepMs;//Deltas are per millisecond
 	if (state[SDL_SCANCODE_W]) {
 		m_camera.move(DELTA_MOVE*turboMultiplier);
 	}
@@ -166,10 +420,10 @@ void MainLoop::handleKeyboardState(const Uint8 *state, unsigned int&frameTime)
 		m_camera.strafe(DELTA_STRAFE*turboMultiplier);
 	}
 	if (state[SDL_SCANCODE_Q]) {
-		m_camera.roll(-DELTA_ROLL);
+		m_camera.roll(-DELTA_ROLL*stepMs);
 	}
 	if (state[SDL_SCANCODE_E]) {
-		m_camera.roll(DELTA_ROLL);
+		m_camera.roll(DELTA_ROLL*stepMs);
 	}
 	if (state[SDL_SCANCODE_SPACE]) {
 		m_camera.ascend(DELTA_ASCEND*turboMultiplier);
@@ -179,15 +433,62 @@ void MainLoop::handleKeyboardState(const Uint8 *state, unsigned int&frameTime)
 	}
 }
 void MainLoop::handleKeypress(SDL_Keycode keycode, int x, int y) {
+	PROFILE_FUNCTION();
 	switch (keycode) {
 	case SDLK_ESCAPE:
 		stop();
 		break;
 	case SDLK_F11:
+		//Window calls stay on the thread polling its events, the resulting resize event rebuilds the swapchain
 		ctxt.toggleFullScreen();
 		break;
 	case SDLK_F10:
-		//this->setMSAA(!this->msaaState);
+		enqueueRender([this]() { ctxt.cycleMSAA(); });
+		break;
+	case SDLK_F9:
+		enqueueRender([this]() { ctxt.toggleDepthPrepass(); });
+		break;
+	case SDLK_F3:
+		enqueueRender([this]() { ctxt.cycleViewCount(); });
+		break;
+	case SDLK_F5:
+		enqueueRender([this]() { ctxt.Memory().printReport(); });
+		break;
+	case SDLK_F6:
+		enqueueRender([this]() { ctxt.toggleTexturing(); });
+		break;
+	case SDLK_F4:
+		enqueueRender([this]() { ctxt.DrawQueue().printStats(); ctxt.printDeletionStats(); });
+		break;
+	case SDLK_F8:
+		enqueueRender([this]() { ctxt.benchmarkParticles(); });
+		break;
+	case SDLK_F2:
+		enqueueRender([this]() { ctxt.toggleDynamicResolution(); });
+		break;
+	case SDLK_F7:
+		enqueueRender([this]() { ctxt.cyclePresentMode(); });
+		break;
+	case SDLK_F1:
+		printStageStats();
+		break;
+	case SDLK_p:
+		enqueueRender([this]() { ctxt.toggleFramePacing(); });
+		break;
+	case SDLK_o:
+		toggleOnDemand();
+		break;
+	case SDLK_l:
+		cycleFrameCap();
+		break;
+	case SDLK_k:
+		toggleAnimation();
+		break;
+	case SDLK_u:
+		enqueueRender([this]() { ctxt.Queues().printUtilisation(); ctxt.Queues().resetUtilisation(); });
+		break;
+	case SDLK_F12:
+		toggleProfiling();
 		break;
 	default:
 		// Do nothing?
@@ -2,11 +2,24 @@
 #define __MainLoop_h__
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <functional>
 #include "Context.h"
 #include "Camera.h"
+#include "TripleBuffer.h"
+#include "FrameSnapshot.h"
 
 /**
  * This class controls the main loop of the application
+ * The loop is split across two threads:
+ *  simulation: polls input and window events, then advances the camera and scene in fixed timesteps,
+ *              publishing the states either side of the latest step as a FrameSnapshot
+ *  render:     draws each frame from the most recent snapshot, interpolated for the time the frame starts,
+ *              and owns all Context calls after init
+ * Snapshots are handed over through a lock-free triple buffer, so neither thread waits on the other
+ * The simulation thread is the one which created the window, so it is the only thread polling its events
  */
 class MainLoop
 {
@@ -19,18 +32,112 @@ public:
 	void stop();
 	void waitForStop();
 	bool isRunning() const;
+	/**
+	 * See Context::setDeviceOverride(), must be called before the loop is started
+	 */
+	void setDeviceOverride(const std::string &deviceOverride) { ctxt.setDeviceOverride(deviceOverride); }
 private:
+	/**
+	 * Durations of one stage's iterations, written by a single thread and readable from any
+	 */
+	struct StageStats
+	{
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> totalUs{ 0 };
+		std::atomic<uint64_t> maxUs{ 0 };
+		void add(const std::chrono::steady_clock::duration &d);
+		void print(const char *name) const;
+	};
+	typedef std::chrono::steady_clock clock;
+	/**
+	 * Simulation thread
+	 */
 	void loop();
 	void loopAsync();
+	/**
+	 * Render thread
+	 * An exception (e.g. device loss) is reported and stops both loops, rather than terminating the process
+	 */
+	void renderLoop();
 	void handleMouseMove(int x, int y);
-	void handleKeyboardState(const Uint8 *state, unsigned int&frameTime);
+	/**
+	 * Applies held keys for one simulation step
+	 */
+	void handleKeyboardState(const Uint8 *state, const float &stepMs);
 	void handleKeypress(SDL_Keycode keycode, int x, int y);
 	void toggleMouseMode();
+	/**
+	 * Captures the interpolated parts of the simulation state
+	 */
+	FrameSnapshot::State captureState() const;
+	/**
+	 * Copies the simulation state into the triple buffer's write slot and publishes it
+	 * @param stepTime When the current state was due
+	 * @param step Duration of a simulation step
+	 */
+	void publishSnapshot(const clock::time_point &stepTime, const clock::duration &step, const clock::time_point &inputTime);
+	/**
+	 * Queues a call to be made on the render thread before its next frame
+	 * Context is not thread-safe, so input handlers reach it through here
+	 */
+	void enqueueRender(std::function<void()> command);
+	/**
+	 * @return Whether any commands were run
+	 */
+	bool runRenderCommands();
 	void drawFrame();
+	void printStageStats() const;
+	/**
+	 * On-demand rendering
+	 * The simulation thread blocks on SDL events once a step changes nothing, and the render thread skips frames
+	 * (no acquire or present) whilst the interpolated state matches the last frame drawn and Context needs no redraw
+	 * Frame counts and each thread's idle (blocked) time are recorded from the last toggle
+	 */
+	void toggleOnDemand();
+	void cycleFrameCap();
+	/**
+	 * Pauses the scene's animation, so the scene can become idle
+	 */
+	void toggleAnimation();
+	/**
+	 * Starts a CPU profiler capture, or stops it and writes it to profile.json and profile.bin
+	 */
+	void toggleProfiling();
+	void printPowerStats() const;
+	void resetPowerStats();
 	std::atomic<bool> loopContinue;
 	std::thread *loopThread;
+	std::thread *renderThread;
 	Context ctxt;
 	Camera m_camera;
+	//Simulation state
+	uint64_t m_simFrame = 0;
+	double m_simTime = 0;//Seconds, advanced by whole steps
+	bool m_animate = true;
+	FrameSnapshot::State m_previousState;
+	FrameSnapshot::State m_currentState;
+	//Hand-off
+	TripleBuffer<FrameSnapshot> m_snapshots;
+	std::mutex m_renderCommandsMutex;
+	std::vector<std::function<void()>> m_renderCommands;
+	std::mutex m_renderWakeMutex;
+	std::condition_variable m_renderWake;//Notified by new snapshots and commands, whilst the render thread is idle
+	//On-demand rendering
+	std::atomic<bool> m_onDemand{ false };
+	std::atomic<unsigned int> m_frameCap{ 0 };//Frames per second, 0 uncapped
+	std::atomic<uint64_t> m_framesRendered{ 0 };
+	std::atomic<uint64_t> m_framesSkipped{ 0 };//Refresh intervals the render thread waited through with nothing to draw
+	std::atomic<uint64_t> m_simIdleUs{ 0 };
+	std::atomic<uint64_t> m_renderIdleUs{ 0 };
+	clock::time_point m_powerStatsStart;
+	//Per stage timings
+	StageStats m_simStats;
+	StageStats m_renderStats;
+	StageStats m_frameInterval;//Render thread frame start to frame start
+	StageStats m_snapshotAge;//Input sampled to the render thread taking the snapshot
+	std::atomic<uint64_t> m_snapshotsPublished{ 0 };
+	std::atomic<uint64_t> m_snapshotsRendered{ 0 };
+	std::atomic<uint64_t> m_framesReusingSnapshot{ 0 };//Rendered without a new snapshot since the previous frame
 };
 
 #endif //__MainLoop_h__
\ No newline at end of file
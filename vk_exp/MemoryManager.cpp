@@ -0,0 +1,207 @@
+#include "MemoryManager.h"
+#include <algorithm>
+#include <set>
+#include <string>
+#include <cstdio>
+
+namespace
+{
+	unsigned int countBits(VkMemoryPropertyFlags f)
+	{
+		unsigned int rtn = 0;
+		for (; f; f &= f - 1)
+			++rtn;
+		return rtn;
+	}
+	std::string formatMB(const vk::DeviceSize &bytes)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.1fMB", bytes / (1024.0 * 1024.0));
+		return buf;
+	}
+}
+MemoryManager::MemoryManager(const vk::PhysicalDevice &physicalDevice, const vk::Device &device, bool budgetExtension)
+	: m_physicalDevice(physicalDevice)
+	, m_device(device)
+	, m_budgetExtension(budgetExtension)
+	, m_memoryProps(physicalDevice.getMemoryProperties())
+{
+	m_heapBudget.resize(m_memoryProps.memoryHeapCount, 0);
+	m_heapUsage.resize(m_memoryProps.memoryHeapCount, 0);
+	m_heapAllocated.resize(m_memoryProps.memoryHeapCount, 0);
+	m_heapAllocatedAtUpdate.resize(m_memoryProps.memoryHeapCount, 0);
+	m_heapAllocationCount.resize(m_memoryProps.memoryHeapCount, 0);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	updateBudget_();
+}
+MemoryManager::~MemoryManager()
+{
+	if (!m_allocations.empty())
+		fprintf(stderr, "MemoryManager: %u allocations were not freed.\n", (unsigned int)m_allocations.size());
+	for (auto &a : m_allocations)
+		m_device.freeMemory(a.first);
+	m_allocations.clear();
+}
+void MemoryManager::updateBudget()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	updateBudget_();
+}
+void MemoryManager::updateBudget_()
+{
+	if (m_budgetExtension)
+	{
+		auto chain = m_physicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+		const vk::PhysicalDeviceMemoryBudgetPropertiesEXT &budget = chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+		for (uint32_t h = 0; h < m_memoryProps.memoryHeapCount; ++h)
+		{
+			m_heapBudget[h] = budget.heapBudget[h];
+			m_heapUsage[h] = budget.heapUsage[h];
+			m_heapAllocatedAtUpdate[h] = m_heapAllocated[h];
+		}
+	}
+	else
+	{//No way to see other processes' usage, so leave some headroom
+		for (uint32_t h = 0; h < m_memoryProps.memoryHeapCount; ++h)
+		{
+			m_heapBudget[h] = m_memoryProps.memoryHeaps[h].size * 8 / 10;
+			m_heapUsage[h] = m_heapAllocated[h];
+			m_heapAllocatedAtUpdate[h] = m_heapAllocated[h];
+		}
+	}
+}
+vk::DeviceSize MemoryManager::heapUsage(const uint32_t &heap) const
+{
+	//Driver reported usage lags until the next updateBudget(), so account for our allocations since
+	//(Unsigned wrap-around cancels out, as the driver's usage includes m_heapAllocatedAtUpdate)
+	return m_heapUsage[heap] + m_heapAllocated[heap] - m_heapAllocatedAtUpdate[heap];
+}
+std::vector<uint32_t> MemoryManager::rankMemoryTypes(const uint32_t &typeFilter, const Usage &usage) const
+{
+	std::vector<uint32_t> rtn;
+	for (uint32_t i = 0; i < m_memoryProps.memoryTypeCount; ++i)
+	{
+		if ((typeFilter & (1 << i)) && (m_memoryProps.memoryTypes[i].propertyFlags & usage.required) == usage.required)
+			rtn.push_back(i);
+	}
+	//Most preferred flags first, then fewest avoided flags, otherwise retain the driver's ordering
+	auto score = [this, &usage](const uint32_t &i)
+	{
+		const vk::MemoryPropertyFlags f = m_memoryProps.memoryTypes[i].propertyFlags;
+		return (int)countBits(static_cast<VkMemoryPropertyFlags>(f & usage.preferred)) * 32
+			- (int)countBits(static_cast<VkMemoryPropertyFlags>(f & usage.avoided));
+	};
+	std::stable_sort(rtn.begin(), rtn.end(), [&score](const uint32_t &a, const uint32_t &b) { return score(a) > score(b); });
+	return rtn;
+}
+vk::DeviceMemory MemoryManager::allocate(const vk::MemoryRequirements &requirements, const Usage &usage, uint32_t *memoryTypeOut)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const std::vector<uint32_t> ranked = rankMemoryTypes(requirements.memoryTypeBits, usage);
+	if (ranked.empty())
+		throw std::runtime_error("MemoryManager: No memory type satisfies the required properties.");
+	std::set<uint32_t> failed;
+	//First pass respects heap budgets, the second lets the driver decide (it may be able to page)
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (auto &t : ranked)
+		{
+			if (failed.count(t))
+				continue;
+			const uint32_t h = m_memoryProps.memoryTypes[t].heapIndex;
+			if (pass == 0 && heapUsage(h) + requirements.size > m_heapBudget[h])
+				continue;
+			vk::MemoryAllocateInfo allocInfo;
+			{
+				allocInfo.allocationSize = requirements.size;
+				allocInfo.memoryTypeIndex = t;
+			}
+			vk::DeviceMemory rtn;
+			try
+			{
+				rtn = m_device.allocateMemory(allocInfo);
+			}
+			catch (vk::OutOfDeviceMemoryError &)
+			{
+				failed.insert(t);
+				continue;
+			}
+			catch (vk::OutOfHostMemoryError &)
+			{
+				failed.insert(t);
+				continue;
+			}
+			if (t != ranked[0])
+				fprintf(stderr, "MemoryManager: %s allocation fell back from memory type %u to %u (heap %u).\n", formatMB(requirements.size).c_str(), ranked[0], t, h);
+			Allocation a;
+			{
+				a.memoryType = t;
+				a.size = requirements.size;
+			}
+			m_allocations.emplace(static_cast<VkDeviceMemory>(rtn), a);
+			m_heapAllocated[h] += requirements.size;
+			m_heapAllocationCount[h]++;
+			if (memoryTypeOut)
+				*memoryTypeOut = t;
+			return rtn;
+		}
+	}
+	throw std::runtime_error("MemoryManager: Failed to allocate " + formatMB(requirements.size) + ", all suitable heaps are exhausted.");
+}
+void MemoryManager::free(vk::DeviceMemory &memory)
+{
+	if (!memory)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_allocations.find(static_cast<VkDeviceMemory>(memory));
+		if (it == m_allocations.end())
+			throw std::exception("MemoryManager: Memory was not allocated by this MemoryManager.");
+		const uint32_t h = m_memoryProps.memoryTypes[it->second.memoryType].heapIndex;
+		m_heapAllocated[h] -= it->second.size;
+		m_heapAllocationCount[h]--;
+		m_allocations.erase(it);
+	}
+	m_device.freeMemory(memory);
+	memory = nullptr;
+}
+vk::MemoryPropertyFlags MemoryManager::Properties(const vk::DeviceMemory &memory) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_allocations.find(static_cast<VkDeviceMemory>(memory));
+	if (it == m_allocations.end())
+		throw std::exception("MemoryManager: Memory was not allocated by this MemoryManager.");
+	return m_memoryProps.memoryTypes[it->second.memoryType].propertyFlags;
+}
+std::vector<MemoryManager::HeapReport> MemoryManager::report() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<HeapReport> rtn;
+	for (uint32_t h = 0; h < m_memoryProps.memoryHeapCount; ++h)
+	{
+		HeapReport r;
+		{
+			r.heapIndex = h;
+			r.flags = m_memoryProps.memoryHeaps[h].flags;
+			r.size = m_memoryProps.memoryHeaps[h].size;
+			r.budget = m_heapBudget[h];
+			r.usage = heapUsage(h);
+			r.allocated = m_heapAllocated[h];
+			r.allocationCount = m_heapAllocationCount[h];
+		}
+		rtn.push_back(r);
+	}
+	return rtn;
+}
+void MemoryManager::printReport() const
+{
+	printf("Memory heaps (%s):\n", m_budgetExtension ? "VK_EXT_memory_budget" : "estimated budget");
+	for (auto &r : report())
+	{
+		printf("\tHeap %u%s: %s used / %s budget / %s size, %s in %u allocations by vk_exp\n",
+			r.heapIndex,
+			(r.flags & vk::MemoryHeapFlagBits::eDeviceLocal) ? " (device local)" : "",
+			formatMB(r.usage).c_str(), formatMB(r.budget).c_str(), formatMB(r.size).c_str(),
+			formatMB(r.allocated).c_str(), r.allocationCount);
+	}
+}
@@ -0,0 +1,91 @@
+#ifndef __MemoryManager_h__
+#define __MemoryManager_h__
+#include <vector>
+#include <map>
+#include <mutex>
+#include <vulkan/vulkan.hpp>
+
+/**
+ * Places device memory allocations across memory types/heaps, taking into account each heap's budget
+ * Budgets are queried from VK_EXT_memory_budget when available, otherwise they are estimated from
+ * heap sizes and the allocations made through this class
+ * When the best memory type's heap is over budget (or the allocation fails), the next best type is tried,
+ * so under memory pressure resources degrade to slower memory rather than failing
+ * Methods are thread-safe
+ */
+class MemoryManager
+{
+public:
+	/**
+	 * Describes the memory properties an allocation needs
+	 * required: Memory types lacking any of these flags are never used
+	 * preferred: Memory types with more of these flags are tried first
+	 * avoided: Memory types with these flags are tried last
+	 * e.g. Streaming data: required HostVisible|HostCoherent, preferred DeviceLocal
+	 */
+	struct Usage
+	{
+		Usage(const vk::MemoryPropertyFlags &required = {}, const vk::MemoryPropertyFlags &preferred = {}, const vk::MemoryPropertyFlags &avoided = {})
+			: required(required), preferred(preferred), avoided(avoided) { }
+		Usage(const vk::MemoryPropertyFlagBits &required)
+			: required(required) { }
+		vk::MemoryPropertyFlags required;
+		vk::MemoryPropertyFlags preferred;
+		vk::MemoryPropertyFlags avoided;
+	};
+	struct HeapReport
+	{
+		uint32_t heapIndex;
+		vk::MemoryHeapFlags flags;
+		vk::DeviceSize size;
+		vk::DeviceSize budget;//Estimated if the budget extension is unavailable
+		vk::DeviceSize usage;//Process-wide usage reported by the driver, or allocated if unavailable
+		vk::DeviceSize allocated;//Allocated through this MemoryManager
+		unsigned int allocationCount;
+	};
+	/**
+	 * @param budgetExtension Whether VK_EXT_memory_budget was enabled on device (requires Vulkan 1.1)
+	 */
+	MemoryManager(const vk::PhysicalDevice &physicalDevice, const vk::Device &device, bool budgetExtension);
+	~MemoryManager();
+	/**
+	 * Refreshes heap budgets, call once per frame
+	 */
+	void updateBudget();
+	/**
+	 * Allocates memory satisfying the requirements, trying memory types in order of preference
+	 * @param memoryTypeOut If provided, receives the index of the chosen memory type
+	 * @throws std::runtime_error If no memory type satisfies the requirements, or all suitable heaps are exhausted
+	 */
+	vk::DeviceMemory allocate(const vk::MemoryRequirements &requirements, const Usage &usage, uint32_t *memoryTypeOut = nullptr);
+	void free(vk::DeviceMemory &memory);
+	/**
+	 * Returns the property flags of the memory type an allocation was placed in
+	 */
+	vk::MemoryPropertyFlags Properties(const vk::DeviceMemory &memory) const;
+	bool hasBudgetExtension() const { return m_budgetExtension; }
+	std::vector<HeapReport> report() const;
+	void printReport() const;
+private:
+	struct Allocation
+	{
+		uint32_t memoryType;
+		vk::DeviceSize size;
+	};
+	std::vector<uint32_t> rankMemoryTypes(const uint32_t &typeFilter, const Usage &usage) const;//Requires m_mutex
+	void updateBudget_();//Requires m_mutex
+	vk::DeviceSize heapUsage(const uint32_t &heap) const;//Requires m_mutex
+	const vk::PhysicalDevice m_physicalDevice;
+	const vk::Device m_device;
+	const bool m_budgetExtension;
+	vk::PhysicalDeviceMemoryProperties m_memoryProps;
+	mutable std::mutex m_mutex;
+	std::map<VkDeviceMemory, Allocation> m_allocations;
+	std::vector<vk::DeviceSize> m_heapBudget;
+	std::vector<vk::DeviceSize> m_heapUsage;//Driver reported
+	std::vector<vk::DeviceSize> m_heapAllocated;//Tracked by us
+	std::vector<vk::DeviceSize> m_heapAllocatedAtUpdate;//m_heapAllocated when m_heapUsage was last queried
+	std::vector<unsigned int> m_heapAllocationCount;
+};
+
+#endif //__MemoryManager_h__
@@ -0,0 +1,414 @@
+#include "ParticleSystem.h"
+
+#include "Context.h"
+#include "ComputePipeline.h"
+#include "GraphicsPipeline.h"
+#include "GpuTimer.h"
+#include "DeviceCapabilities.h"
+#include <algorithm>
+#include <string>
+#include <cstdio>
+#include <cstddef>
+
+const float ParticleSystem::FrameBudgetMs = 1000.0f / 60.0f;
+const float ParticleSystem::MaxTimestep = 1.0f / 30.0f;
+
+ParticleSystem::ParticleSystem(Context &ctx, const vk::Buffer &frameUniforms, const vk::DeviceSize &frameUniformsStride, const unsigned int &frameUniformSlots, const uint32_t &capacity)
+	: m_context(ctx)
+	, m_frameUniforms(frameUniforms)
+	, m_frameUniformsStride(frameUniformsStride)
+	, m_renderSets(frameUniformSlots)
+	, m_emissionRate(capacity / 2.0f)
+{
+	for (unsigned int b = 0; b < BufferCount; ++b)
+	{
+		m_buffers[b] = nullptr;
+		m_memory[b] = nullptr;
+	}
+	for (unsigned int s = 0; s < StepCount; ++s)
+		m_steps[s] = nullptr;
+	try
+	{
+		for (unsigned int s = 0; s < StepCount; ++s)
+		{
+			SpecializationConstants spec;
+			spec.set(vk::ShaderStageFlagBits::eCompute, 0, (uint32_t)s);//STEP
+			m_steps[s] = m_context.createComputePipeline("../shaders/particles.comp", spec);
+		}
+		//Compute set (bindings 0-8), render set per uniform slot (uniforms + instances)
+		const uint32_t renderSets = (uint32_t)m_renderSets.size();
+		vk::DescriptorPoolSize poolSizes[2];
+		{
+			poolSizes[0].type = vk::DescriptorType::eStorageBuffer;
+			poolSizes[0].descriptorCount = BufferCount + renderSets;
+			poolSizes[1].type = vk::DescriptorType::eUniformBuffer;
+			poolSizes[1].descriptorCount = renderSets;
+		}
+		vk::DescriptorPoolCreateInfo poolInfo;
+		{
+			poolInfo.flags = {};
+			poolInfo.maxSets = 1 + renderSets;
+			poolInfo.poolSizeCount = 2;
+			poolInfo.pPoolSizes = poolSizes;
+		}
+		m_descriptorPool = m_context.Device().createDescriptorPool(poolInfo);
+		//Every step is specialized from the same shader, so shares the pipeline layout
+		vk::DescriptorSetLayout layout = m_steps[Init]->DescriptorSetLayout(0);
+		vk::DescriptorSetAllocateInfo allocInfo;
+		{
+			allocInfo.descriptorPool = m_descriptorPool;
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &layout;
+		}
+		m_computeSet = m_context.Device().allocateDescriptorSets(allocInfo)[0];
+		m_timer = new GpuTimer(m_context.PhysicalDevice(), m_context.Device(), m_context.ComputeQueueFamily(), TimerSlots);
+		createBuffers(capacity);
+		writeDescriptors();
+	}
+	catch (...)
+	{
+		release();
+		throw;
+	}
+}
+ParticleSystem::~ParticleSystem()
+{
+	release();
+}
+void ParticleSystem::release()
+{
+	destroyRenderPipeline();
+	destroyBuffers();
+	delete m_timer;
+	m_timer = nullptr;
+	if (m_descriptorPool)
+	{//Frees the descriptor sets
+		m_context.Device().destroyDescriptorPool(m_descriptorPool);
+		m_descriptorPool = nullptr;
+	}
+	m_computeSet = nullptr;
+	for (auto &set : m_renderSets)
+		set = nullptr;
+	for (unsigned int s = 0; s < StepCount; ++s)
+	{
+		if (m_steps[s])
+			m_context.destroyComputePipeline(m_steps[s]);
+		m_steps[s] = nullptr;
+	}
+}
+void ParticleSystem::setCapacity(const uint32_t &capacity)
+{
+	//Every submission may be using the buffers being replaced
+	m_context.waitForSubmitted();
+	const uint32_t previous = m_capacity;
+	destroyBuffers();
+	try
+	{
+		createBuffers(capacity);
+	}
+	catch (...)
+	{
+		destroyBuffers();
+		createBuffers(previous);
+		writeDescriptors();
+		throw;
+	}
+	writeDescriptors();
+}
+void ParticleSystem::createBuffers(const uint32_t &capacity)
+{
+	const vk::PhysicalDeviceLimits &limits = m_context.Capabilities().Properties().limits;
+	if (m_steps[Init]->groupCount(capacity) > limits.maxComputeWorkGroupCount[0])
+		throw std::runtime_error("ParticleSystem: " + std::to_string(capacity) + " particles exceeds the device's maximum dispatch size.");
+	const vk::DeviceSize sizes[BufferCount] = {
+		capacity * sizeof(float) * 4ull,//Positions
+		capacity * sizeof(float) * 4ull,//Velocities
+		capacity * sizeof(float) * 1ull,//Ages
+		capacity * sizeof(float) * 1ull,//Lifetimes
+		capacity * sizeof(uint32_t) * 2ull,//AliveLists
+		capacity * sizeof(uint32_t) * 1ull,//FreeList
+		sizeof(Counters),
+		capacity * sizeof(float) * 4ull * 2ull,//Instances
+		sizeof(VkDrawIndirectCommand) * 2ull//Draws
+	};
+	//Instances and draws are written on the compute queue and read on the graphics queue, the rest only used by compute
+	const uint32_t families[] = { m_context.GraphicsQueueFamily(), m_context.ComputeQueueFamily() };
+	for (unsigned int b = 0; b < BufferCount; ++b)
+	{
+		if (sizes[b] > limits.maxStorageBufferRange)
+			throw std::runtime_error("ParticleSystem: " + std::to_string(capacity) + " particles exceeds the device's maximum storage buffer range.");
+		vk::BufferCreateInfo bufferInfo;
+		{
+			bufferInfo.flags = {};
+			bufferInfo.size = sizes[b];
+			bufferInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+			if (b == CounterBuffer || b == Draws)
+				bufferInfo.usage |= vk::BufferUsageFlagBits::eIndirectBuffer;
+			const bool shared = m_context.hasAsyncCompute() && (b == Instances || b == Draws);
+			bufferInfo.sharingMode = shared ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+			bufferInfo.queueFamilyIndexCount = shared ? 2 : 0;
+			bufferInfo.pQueueFamilyIndices = families;
+		}
+		m_buffers[b] = m_context.Device().createBuffer(bufferInfo);
+		const vk::MemoryRequirements memReq = m_context.Device().getBufferMemoryRequirements(m_buffers[b]);
+		m_memory[b] = m_context.Memory().allocate(memReq, MemoryManager::Usage(vk::MemoryPropertyFlagBits::eDeviceLocal));
+		m_context.Device().bindBufferMemory(m_buffers[b], m_memory[b], 0);
+	}
+	m_capacity = capacity;
+	m_current = 0;
+	m_emitAccumulator = 0;
+	m_needsInit = true;
+}
+void ParticleSystem::destroyBuffers()
+{
+	for (unsigned int b = 0; b < BufferCount; ++b)
+	{
+		if (m_buffers[b])
+			m_context.Device().destroyBuffer(m_buffers[b]);
+		m_buffers[b] = nullptr;
+		if (m_memory[b])
+			m_context.Memory().free(m_memory[b]);
+		m_memory[b] = nullptr;
+	}
+	m_capacity = 0;
+}
+void ParticleSystem::writeDescriptors()
+{
+	vk::DescriptorBufferInfo bufferInfo[BufferCount];
+	std::vector<vk::WriteDescriptorSet> descWrites;
+	for (unsigned int b = 0; b < BufferCount; ++b)
+	{
+		bufferInfo[b].buffer = m_buffers[b];
+		bufferInfo[b].offset = 0;
+		bufferInfo[b].range = VK_WHOLE_SIZE;
+		vk::WriteDescriptorSet w;
+		{
+			w.dstSet = m_computeSet;
+			w.dstBinding = b;
+			w.dstArrayElement = 0;
+			w.descriptorType = vk::DescriptorType::eStorageBuffer;
+			w.descriptorCount = 1;
+			w.pBufferInfo = &bufferInfo[b];
+		}
+		descWrites.push_back(w);
+	}
+	std::vector<vk::DescriptorBufferInfo> uniformInfo(m_renderSets.size());
+	for (size_t slot = 0; slot < m_renderSets.size() && m_renderSets[slot]; ++slot)
+	{
+		{
+			uniformInfo[slot].buffer = m_frameUniforms;
+			uniformInfo[slot].offset = slot * m_frameUniformsStride;
+			uniformInfo[slot].range = sizeof(FrameUniforms);
+		}
+		vk::WriteDescriptorSet w;
+		{
+			w.dstSet = m_renderSets[slot];
+			w.dstBinding = 0;
+			w.dstArrayElement = 0;
+			w.descriptorType = vk::DescriptorType::eUniformBuffer;
+			w.descriptorCount = 1;
+			w.pBufferInfo = &uniformInfo[slot];
+		}
+		descWrites.push_back(w);
+		w.dstBinding = 1;
+		w.descriptorType = vk::DescriptorType::eStorageBuffer;
+		w.pBufferInfo = &bufferInfo[Instances];
+		descWrites.push_back(w);
+	}
+	m_context.Device().updateDescriptorSets((unsigned int)descWrites.size(), descWrites.data(), 0, nullptr);
+}
+void ParticleSystem::createRenderPipeline(const vk::RenderPass &renderPass, const PipelineState &state)
+{
+	destroyRenderPipeline();
+	m_renderPipeline = new GraphicsPipeline(m_context, renderPass, "../shaders/particle.vert", "../shaders/particle.frag", SpecializationConstants(), state);
+	//The set layout comes from LayoutCache, so is shared by every rebuild of the pipeline
+	if (!m_renderSets[0])
+	{
+		const std::vector<vk::DescriptorSetLayout> layouts(m_renderSets.size(), m_renderPipeline->DescriptorSetLayout(0));
+		vk::DescriptorSetAllocateInfo allocInfo;
+		{
+			allocInfo.descriptorPool = m_descriptorPool;
+			allocInfo.descriptorSetCount = (uint32_t)layouts.size();
+			allocInfo.pSetLayouts = layouts.data();
+		}
+		m_renderSets = m_context.Device().allocateDescriptorSets(allocInfo);
+		writeDescriptors();
+	}
+}
+void ParticleSystem::destroyRenderPipeline()
+{
+	GraphicsPipeline *pipeline = m_renderPipeline;
+	if (pipeline)
+		m_context.deferDestroy("pipeline", [pipeline]() { delete pipeline; });
+	m_renderPipeline = nullptr;
+}
+void ParticleSystem::recordCompute(vk::CommandBuffer &cb, const unsigned int &frame, const unsigned int &copy)
+{
+	const auto now = std::chrono::steady_clock::now();
+	const bool frozen = m_paused && !m_benchmark.active;
+	const float dt = m_lastStep.time_since_epoch().count() && !frozen ? std::min(MaxTimestep, std::chrono::duration<float>(now - m_lastStep).count()) : 0.0f;
+	m_lastStep = now;
+	m_emitAccumulator = std::min(m_emitAccumulator + m_emissionRate * dt, (float)m_capacity);
+	StepConstants constants;
+	{
+		constants.dt = dt;
+		constants.emitCount = (uint32_t)m_emitAccumulator;
+		constants.seed = m_seed++;
+		constants.current = 1 - copy;
+		constants.capacity = m_capacity;
+	}
+	m_emitAccumulator -= constants.emitCount;
+	//Each step reads the previous step's writes, args also writes the following indirect dispatch
+	vk::MemoryBarrier barrier;
+	{
+		barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eIndirectCommandRead;
+	}
+	auto stepBarrier = [&cb, &barrier]()
+	{
+		cb.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect,
+			{}, 1, &barrier, 0, nullptr, 0, nullptr);
+	};
+	const vk::PipelineLayout &layout = m_steps[Init]->PipelineLayout();
+	//Compute no longer waits on the graphics submission which waited on the previous frame's steps, so they may still be running
+	stepBarrier();
+	if (frame < TimerSlots)
+		m_timer->begin(cb, frame);
+	cb.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, { m_computeSet }, {});
+	cb.pushConstants(layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(StepConstants), &constants);
+	if (m_needsInit)
+	{
+		cb.bindPipeline(vk::PipelineBindPoint::eCompute, m_steps[Init]->Pipeline());
+		cb.dispatch(m_steps[Init]->groupCount(m_capacity), 1, 1);
+		stepBarrier();
+		m_needsInit = false;
+	}
+	if (constants.emitCount)
+	{
+		cb.bindPipeline(vk::PipelineBindPoint::eCompute, m_steps[Emit]->Pipeline());
+		cb.dispatch(m_steps[Emit]->groupCount(constants.emitCount), 1, 1);
+		stepBarrier();
+	}
+	cb.bindPipeline(vk::PipelineBindPoint::eCompute, m_steps[Args]->Pipeline());
+	cb.dispatch(1, 1, 1);
+	stepBarrier();
+	cb.bindPipeline(vk::PipelineBindPoint::eCompute, m_steps[Simulate]->Pipeline());
+	cb.dispatchIndirect(m_buffers[CounterBuffer], offsetof(Counters, dispatch));
+	stepBarrier();
+	cb.bindPipeline(vk::PipelineBindPoint::eCompute, m_steps[Compact]->Pipeline());
+	cb.dispatchIndirect(m_buffers[CounterBuffer], offsetof(Counters, dispatch));
+	if (frame < TimerSlots)
+		m_timer->end(cb, frame);
+	//Graphics draws the compacted instances, the next frame's steps read the compacted list
+	m_current = copy;
+}
+void ParticleSystem::recordDraw(vk::CommandBuffer &cb, const unsigned int &uniformSlot)
+{
+	if (!m_renderPipeline || m_needsInit)
+		return;
+	DrawConstants constants;
+	{
+		constants.instanceOffset = m_current * m_capacity;
+		constants.size = m_size;
+	}
+	cb.bindPipeline(vk::PipelineBindPoint::eGraphics, m_renderPipeline->Pipeline());
+	cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_renderPipeline->PipelineLayout(), 0, { m_renderSets[uniformSlot] }, {});
+	cb.pushConstants(m_renderPipeline->PipelineLayout(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(DrawConstants), &constants);
+	cb.drawIndirect(m_buffers[Draws], m_current * sizeof(VkDrawIndirectCommand), 1, sizeof(VkDrawIndirectCommand));
+}
+/**
+ * Benchmark
+ */
+void ParticleSystem::frameCompleted(const unsigned int &frame, const double &graphicsMs)
+{
+	const double computeMs = frame < TimerSlots ? m_timer->collect(frame) : -1;
+	if (!m_benchmark.active || computeMs < 0 || graphicsMs < 0)
+		return;
+	//Frames recorded before the stage's reallocation were completed by its waitForSubmitted(), and fall within the warm up
+	if (++m_benchmark.frames <= WarmupFrames)
+		return;
+	m_benchmark.computeMs += computeMs;
+	m_benchmark.graphicsMs += graphicsMs;
+	if (m_benchmark.frames < WarmupFrames + MeasuredFrames)
+		return;
+	BenchmarkResult r;
+	{
+		r.capacity = m_capacity;
+		r.computeMs = m_benchmark.computeMs / MeasuredFrames;
+		r.graphicsMs = m_benchmark.graphicsMs / MeasuredFrames;
+	}
+	m_benchmark.results.push_back(r);
+	printf("Particle benchmark: %.1fM particles, compute %.3fms, graphics %.3fms\n", r.capacity / 1e6, r.computeMs, r.graphicsMs);
+	//Larger capacities won't fit either
+	if (r.computeMs + r.graphicsMs > 2 * FrameBudgetMs)
+		m_benchmark.stage = m_benchmark.capacities.size();
+	else
+		++m_benchmark.stage;
+	nextBenchmarkStage();
+}
+void ParticleSystem::startBenchmark()
+{
+	if (m_benchmark.active)
+		return;
+	if (!m_timer->supported())
+	{
+		fprintf(stderr, "Particle benchmark requires timestamp support on the compute queue.\n");
+		return;
+	}
+	m_benchmark = Benchmark();
+	m_benchmark.active = true;
+	m_benchmark.capacities = { 1u << 20, 2u << 20, 4u << 20, 8u << 20, 16u << 20 };
+	m_benchmark.restoreCapacity = m_capacity;
+	m_benchmark.restoreEmissionRate = m_emissionRate;
+	printf("Particle benchmark started, emission saturated (%u warm up and %u measured frames per capacity)\n", WarmupFrames, MeasuredFrames);
+	nextBenchmarkStage();
+}
+void ParticleSystem::nextBenchmarkStage()
+{
+	if (m_benchmark.stage < m_benchmark.capacities.size())
+	{
+		try
+		{
+			setCapacity(m_benchmark.capacities[m_benchmark.stage]);
+			//Lifetimes average 2s, so emitting the capacity each second keeps the pool full
+			m_emissionRate = (float)m_capacity;
+			m_benchmark.frames = 0;
+			m_benchmark.computeMs = 0;
+			m_benchmark.graphicsMs = 0;
+			return;
+		}
+		catch (std::exception &e)
+		{
+			fprintf(stderr, "Particle benchmark: %.1fM particles could not be allocated.\n%s\n", m_benchmark.capacities[m_benchmark.stage] / 1e6, e.what());
+		}
+	}
+	finishBenchmark();
+}
+void ParticleSystem::finishBenchmark()
+{
+	m_benchmark.active = false;
+	printf("Particle benchmark results, %.2fms frame budget at 60Hz:\n", FrameBudgetMs);
+	uint32_t sustainable = 0;
+	for (auto &r : m_benchmark.results)
+	{
+		//Conservatively assumes compute doesn't overlap graphics
+		const double total = r.computeMs + r.graphicsMs;
+		const bool fits = total <= FrameBudgetMs;
+		if (fits)
+			sustainable = std::max(sustainable, r.capacity);
+		printf("\t%5.1fM: %.3fms compute + %.3fms graphics = %.3fms%s\n", r.capacity / 1e6, r.computeMs, r.graphicsMs, total, fits ? "" : " (over budget)");
+	}
+	if (sustainable)
+		printf("Sustainable at 60Hz: %.1fM particles per frame\n", sustainable / 1e6);
+	else
+		printf("Sustainable at 60Hz: less than %.1fM particles per frame\n", m_benchmark.capacities[0] / 1e6);
+	try
+	{
+		setCapacity(m_benchmark.restoreCapacity);
+	}
+	catch (std::exception &e)
+	{
+		fprintf(stderr, "Particle benchmark: Failed to restore capacity.\n%s\n", e.what());
+	}
+	m_emissionRate = m_benchmark.restoreEmissionRate;
+}
@@ -0,0 +1,164 @@
+#ifndef __ParticleSystem_h__
+#define __ParticleSystem_h__
+#include <vector>
+#include <chrono>
+#include <vulkan/vulkan.hpp>
+class Context;
+class ComputePipeline;
+class GraphicsPipeline;
+class GpuTimer;
+struct PipelineState;
+
+/**
+ * GPU particle system, per-particle data is only ever read or written by shaders (particles.comp, particle.vert)
+ * Each frame, recorded on the compute queue via Context::addComputeWork():
+ *  emit:     pops indices from an atomic counter free list, initialises them and appends them to the alive list
+ *  args:     writes the indirect dispatch size from the alive count, resets the other alive list and its draw
+ *  simulate: integrates the alive particles (indirect dispatch)
+ *  compact:  appends survivors to the other alive list, their position and age to its instances, pushes the dead onto the free list
+ * The compacted instances are then drawn as instanced billboards with vkCmdDrawIndirect, so particle counts never reach the CPU
+ * Graphics only reads the instances and draws, which have a copy per alive list (Context::ComputeCopies)
+ * so the simulation state is private to the compute queue, and the next frame's steps can overlap this frame's graphics
+ * Attributes are stored as a structure of arrays, so each step and the vertex shader only load what they use
+ */
+class ParticleSystem
+{
+public:
+	/**
+	 * Matches Counters in particles.comp
+	 */
+	struct Counters
+	{
+		VkDispatchIndirectCommand dispatch;
+		int32_t freeCount;
+		uint32_t aliveCount[2];
+	};
+	/**
+	 * @param frameUniforms Buffer of FrameUniforms, bound to the billboard pipeline
+	 * @param frameUniformsStride, frameUniformSlots The buffer holds a FrameUniforms every stride bytes, a render set is allocated for each
+	 */
+	ParticleSystem(Context &ctx, const vk::Buffer &frameUniforms, const vk::DeviceSize &frameUniformsStride, const unsigned int &frameUniformSlots, const uint32_t &capacity);
+	~ParticleSystem();
+	/**
+	 * Reallocates the particle buffers, discarding all particles
+	 * Waits for the device to idle, if allocation fails the previous capacity is restored and the exception rethrown
+	 */
+	void setCapacity(const uint32_t &capacity);
+	uint32_t Capacity() const { return m_capacity; }
+	/**
+	 * Particles emitted per second, emission stalls whilst the free list is empty
+	 */
+	void setEmissionRate(const float &perSecond) { m_emissionRate = perSecond; }
+	/**
+	 * Whilst paused, steps advance by zero time and emit nothing, so particles hold their state
+	 * The benchmark runs regardless
+	 */
+	void setPaused(const bool &paused) { m_paused = paused; }
+	bool paused() const { return m_paused; }
+	/**
+	 * Creates the billboard pipeline, the render pass must be compatible with state
+	 */
+	void createRenderPipeline(const vk::RenderPass &renderPass, const PipelineState &state);
+	void destroyRenderPipeline();
+	GraphicsPipeline *RenderPipeline() const { return m_renderPipeline; }
+	/**
+	 * Records the frame's compute steps
+	 * @param copy The alive list, instances and draw compacted into, the other copy's alive list is read
+	 */
+	void recordCompute(vk::CommandBuffer &cb, const unsigned int &frame, const unsigned int &copy);
+	/**
+	 * Records the indirect draw of the most recently compacted instances, within the forward pass
+	 * Must be recorded after the frame's recordCompute()
+	 * @param uniformSlot The slot of frameUniforms the frame reads
+	 */
+	void recordDraw(vk::CommandBuffer &cb, const unsigned int &uniformSlot);
+	/**
+	 * Called once the frame's submissions have completed (its graphics sync point has been reached)
+	 * @param graphicsMs GPU time of the frame's graphics submission, negative if unavailable
+	 */
+	void frameCompleted(const unsigned int &frame, const double &graphicsMs);
+	/**
+	 * Steps through increasing capacities with emission saturated, timing the compute and graphics submissions of each
+	 * then reports how many particles fit within a 60Hz frame, the previous capacity is then restored
+	 */
+	void startBenchmark();
+	bool benchmarkRunning() const { return m_benchmark.active; }
+private:
+	enum Step : unsigned int { Init = 0, Emit, Args, Simulate, Compact, StepCount };//STEP in particles.comp
+	enum Buffer : unsigned int { Positions = 0, Velocities, Ages, Lifetimes, AliveLists, FreeList, CounterBuffer, Instances, Draws, BufferCount };//Bindings in particles.comp
+	/**
+	 * Matches StepConstants in particles.comp
+	 */
+	struct StepConstants
+	{
+		float dt;
+		uint32_t emitCount;
+		uint32_t seed;
+		uint32_t current;
+		uint32_t capacity;
+	};
+	/**
+	 * Matches DrawConstants in particle.vert
+	 */
+	struct DrawConstants
+	{
+		uint32_t instanceOffset;
+		float size;
+	};
+	struct BenchmarkResult
+	{
+		uint32_t capacity;
+		double computeMs;
+		double graphicsMs;
+	};
+	struct Benchmark
+	{
+		bool active = false;
+		std::vector<uint32_t> capacities;
+		size_t stage = 0;
+		unsigned int frames = 0;//Completed frames of the current stage, including warm up
+		double computeMs = 0;
+		double graphicsMs = 0;
+		std::vector<BenchmarkResult> results;
+		uint32_t restoreCapacity = 0;
+		float restoreEmissionRate = 0;
+	};
+	static const unsigned int TimerSlots = 8;//Frames in flight which can be timed
+	static const unsigned int WarmupFrames = 180;//Longer than the maximum lifetime, so the pool reaches steady state
+	static const unsigned int MeasuredFrames = 120;
+	static const float FrameBudgetMs;
+	static const float MaxTimestep;
+	void release();
+	void createBuffers(const uint32_t &capacity);
+	void destroyBuffers();
+	void writeDescriptors();
+	/**
+	 * Moves to the next benchmark capacity, or reports and finishes
+	 */
+	void nextBenchmarkStage();
+	void finishBenchmark();
+	Context &m_context;
+	const vk::Buffer m_frameUniforms;
+	const vk::DeviceSize m_frameUniformsStride;
+	uint32_t m_capacity = 0;
+	float m_emissionRate;
+	float m_emitAccumulator = 0;//Fractional emissions carried between frames
+	float m_size = 0.02f;//Billboard half extent
+	uint32_t m_seed = 0;
+	uint32_t m_current = 0;//Copy compacted by the last recordCompute(), and drawn after it
+	bool m_needsInit = true;//Free list and counters are initialised by the next recordCompute()
+	bool m_paused = false;
+	std::chrono::steady_clock::time_point m_lastStep;
+	vk::Buffer m_buffers[BufferCount];
+	vk::DeviceMemory m_memory[BufferCount];
+
+	ComputePipeline *m_steps[StepCount];//Owned by Context
+	GraphicsPipeline *m_renderPipeline = nullptr;
+	vk::DescriptorPool m_descriptorPool = nullptr;
+	vk::DescriptorSet m_computeSet = nullptr;
+	std::vector<vk::DescriptorSet> m_renderSets;//Per uniform slot, allocated with the first render pipeline
+	GpuTimer *m_timer = nullptr;//Compute queue family
+	Benchmark m_benchmark;
+};
+
+#endif //__ParticleSystem_h__
@@ -0,0 +1,335 @@
+#include "Profiler.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+
+//How often the collector drains the threads' buffers, each buffer must not fill faster than this
+#define COLLECT_INTERVAL_MS 10
+//Zones kept by one capture, beyond this zones are dropped (sizeof(CapturedZone) each, 32 bytes, so 128MB)
+#define MAX_CAPTURED_ZONES (1 << 22)
+
+namespace
+{
+	const uint32_t BinaryMagic = 0x46504B56;//"VKPF"
+	const uint32_t BinaryVersion = 1;
+	/**
+	 * Binary capture layout, little endian
+	 * BinaryHeader
+	 * threadCount x { uint32_t id, uint16_t length, char name[length] }
+	 * nameCount x { uint16_t length, char name[length] }
+	 * zoneCount x BinaryZone, ordered by start
+	 */
+	struct BinaryHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t threadCount;
+		uint32_t nameCount;
+		uint64_t zoneCount;
+		uint64_t droppedCount;
+	};
+	struct BinaryZone
+	{
+		uint64_t start;//Nanoseconds since the capture started
+		uint32_t duration;//Nanoseconds, saturates at ~4.3s
+		uint16_t name;//Index into the names
+		uint16_t thread;//Index into the threads
+	};
+	struct ZoneRecord
+	{
+		const char *name;
+		uint64_t start;
+		uint64_t end;
+	};
+	/**
+	 * Single producer (the owning thread), single consumer (whichever thread holds ProfilerState::mutex)
+	 */
+	struct ThreadBuffer
+	{
+		static const uint64_t Capacity = 1 << 14;//Power of 2
+		uint32_t id = 0;
+		std::string name;//Guarded by ProfilerState::mutex
+		std::atomic<uint64_t> head{ 0 };//Written by the producer
+		std::atomic<uint64_t> tail{ 0 };//Written by the consumer
+		std::atomic<uint64_t> dropped{ 0 };
+		ZoneRecord zones[Capacity];
+	};
+	struct CapturedZone
+	{
+		ZoneRecord zone;
+		uint32_t thread;
+	};
+	struct ProfilerState
+	{
+		std::mutex mutex;//Guards the members below, and consuming from the threads' buffers
+		std::vector<std::shared_ptr<ThreadBuffer>> threads;//A thread's buffer outlives it until drained
+		uint32_t nextThreadId = 0;
+		std::vector<CapturedZone> captured;
+		uint64_t droppedCount = 0;//Zones dropped as the capture was full
+		uint64_t captureStart = 0;
+		bool collecting = false;//collector has been started and not yet joined, a capture may only start once it has been
+		std::atomic<bool> stopCollector{ false };
+		std::thread collector;
+		~ProfilerState()
+		{//A capture left running at exit
+			stopCollector.store(true);
+			if (collector.joinable())
+				collector.join();
+		}
+	};
+	ProfilerState &state()
+	{
+		static ProfilerState s;
+		return s;
+	}
+	thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+	/**
+	 * Registers the calling thread's buffer on first use
+	 */
+	ThreadBuffer &threadBuffer()
+	{
+		if (!t_buffer)
+		{
+			ProfilerState &s = state();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			t_buffer = std::make_shared<ThreadBuffer>();
+			t_buffer->id = s.nextThreadId++;
+			s.threads.push_back(t_buffer);
+		}
+		return *t_buffer;
+	}
+	/**
+	 * Moves every completed zone into the capture, s.mutex must be held
+	 * @param keep Whether drained zones are captured or discarded
+	 */
+	void drain(ProfilerState &s, const bool &keep)
+	{
+		for (auto &t : s.threads)
+		{
+			ThreadBuffer &b = *t;
+			uint64_t tail = b.tail.load(std::memory_order_relaxed);
+			const uint64_t head = b.head.load(std::memory_order_acquire);
+			for (; tail != head; ++tail)
+			{
+				if (!keep)
+					continue;
+				CapturedZone c = { b.zones[tail & (ThreadBuffer::Capacity - 1)], b.id };
+				//Zones still open when the previous capture stopped began before this one, so are clipped to its start (or skipped if they also ended before it)
+				if (c.zone.end < s.captureStart)
+					continue;
+				if (s.captured.size() >= MAX_CAPTURED_ZONES)
+				{
+					s.droppedCount++;
+					continue;
+				}
+				c.zone.start = std::max(c.zone.start, s.captureStart);
+				s.captured.push_back(c);
+			}
+			b.tail.store(tail, std::memory_order_release);
+		}
+	}
+	void collectLoop(ProfilerState &s)
+	{
+		while (!s.stopCollector.load())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(COLLECT_INTERVAL_MS));
+			std::lock_guard<std::mutex> lock(s.mutex);
+			drain(s, true);
+		}
+	}
+	void writeString(std::ofstream &f, const std::string &str)
+	{
+		const uint16_t length = (uint16_t)std::min<size_t>(str.size(), UINT16_MAX);
+		f.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		f.write(str.data(), length);
+	}
+	std::string jsonEscape(const std::string &str)
+	{
+		std::string out;
+		for (const char c : str)
+		{
+			if (c == '"' || c == '\\')
+				out += '\\';
+			if ((unsigned char)c >= 0x20)
+				out += c;
+		}
+		return out;
+	}
+}
+
+std::atomic<bool> Profiler::s_capturing(false);
+
+uint64_t Profiler::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+void Profiler::record(const char *name, const uint64_t &start, const uint64_t &end)
+{
+	ThreadBuffer &b = threadBuffer();
+	const uint64_t head = b.head.load(std::memory_order_relaxed);
+	if (head - b.tail.load(std::memory_order_acquire) >= ThreadBuffer::Capacity)
+	{//Full, never wait for the collector
+		b.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ZoneRecord &z = b.zones[head & (ThreadBuffer::Capacity - 1)];
+	{
+		z.name = name;
+		z.start = start;
+		z.end = end;
+	}
+	b.head.store(head + 1, std::memory_order_release);
+}
+void Profiler::setThreadName(const char *name)
+{
+	ThreadBuffer &b = threadBuffer();
+	std::lock_guard<std::mutex> lock(state().mutex);//Read when exporting
+	b.name = name;
+}
+bool Profiler::startCapture()
+{
+#if !PROFILER_ENABLED
+	fprintf(stderr, "Profiler: Zones were compiled out (PROFILER_ENABLED 0), the capture will be empty.\n");
+#endif
+	ProfilerState &s = state();
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		//The previous capture's collector is joined by stopCapture() before it clears collecting
+		if (s_capturing.load() || s.collecting)
+			return false;
+		//Zones recorded by the end of the previous capture
+		drain(s, false);
+		for (auto &t : s.threads)
+			t->dropped.store(0);
+		//Buffers only referenced here belong to threads which have exited
+		s.threads.erase(std::remove_if(s.threads.begin(), s.threads.end(), [](const std::shared_ptr<ThreadBuffer> &t) { return t.use_count() == 1; }), s.threads.end());
+		s.captured.clear();
+		s.droppedCount = 0;
+		s.captureStart = now();
+		//The collector first drains once the mutex is released
+		s.stopCollector.store(false);
+		s.collector = std::thread(collectLoop, std::ref(s));
+		s.collecting = true;
+		s_capturing.store(true);
+	}
+	printf("Profiler: Capture started.\n");
+	return true;
+}
+bool Profiler::stopCapture(const std::string &path)
+{
+	ProfilerState &s = state();
+	std::thread collector;
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (!s_capturing.exchange(false))
+			return false;
+		s.stopCollector.store(true);
+		collector.swap(s.collector);
+	}
+	//Joined without the lock, which the collector takes to drain
+	collector.join();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	s.collecting = false;
+	//Zones open when the capture stopped are still recorded, so may be missed here
+	drain(s, true);
+	for (auto &t : s.threads)
+		s.droppedCount += t->dropped.exchange(0);
+	std::sort(s.captured.begin(), s.captured.end(), [](const CapturedZone &a, const CapturedZone &b) { return a.zone.start < b.zone.start; });
+	//Names are deduplicated by pointer, identical literals may appear more than once
+	std::unordered_map<const char*, uint16_t> nameIndices;
+	std::vector<const char*> names;
+	std::unordered_map<uint32_t, uint16_t> threadIndices;
+	std::vector<std::pair<uint32_t, std::string>> threads;
+	for (auto &t : s.threads)
+	{
+		threadIndices.emplace(t->id, (uint16_t)threads.size());
+		threads.push_back({ t->id, t->name });
+	}
+	for (auto &c : s.captured)
+	{
+		if (nameIndices.emplace(c.zone.name, (uint16_t)names.size()).second)
+			names.push_back(c.zone.name);
+	}
+	bool success = true;
+	const std::string jsonPath = path + ".json";
+	{
+		std::ofstream f(jsonPath, std::ios::trunc);
+		if (f.is_open())
+		{
+			f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			bool first = true;
+			for (auto &t : threads)
+			{
+				f << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << t.first
+					<< ",\"args\":{\"name\":\"" << jsonEscape(t.second.empty() ? "thread " + std::to_string(t.first) : t.second) << "\"}}";
+				first = false;
+			}
+			char buffer[96];
+			for (auto &c : s.captured)
+			{
+				//Microseconds
+				snprintf(buffer, sizeof(buffer), "\"ts\":%.3f,\"dur\":%.3f}", (c.zone.start - s.captureStart) / 1000.0, (c.zone.end - c.zone.start) / 1000.0);
+				f << (first ? "" : ",\n") << "{\"name\":\"" << jsonEscape(c.zone.name) << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":" << c.thread << "," << buffer;
+				first = false;
+			}
+			f << "\n]}\n";
+		}
+		if (!f.is_open() || !f.good())
+		{
+			fprintf(stderr, "Profiler: Failed to write '%s'.\n", jsonPath.c_str());
+			success = false;
+		}
+	}
+	const std::string binaryPath = path + ".bin";
+	{
+		std::ofstream f(binaryPath, std::ios::binary | std::ios::trunc);
+		if (f.is_open())
+		{
+			BinaryHeader header;
+			{
+				header.magic = BinaryMagic;
+				header.version = BinaryVersion;
+				header.threadCount = (uint32_t)threads.size();
+				header.nameCount = (uint32_t)names.size();
+				header.zoneCount = s.captured.size();
+				header.droppedCount = s.droppedCount;
+			}
+			f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (auto &t : threads)
+			{
+				f.write(reinterpret_cast<const char*>(&t.first), sizeof(t.first));
+				writeString(f, t.second);
+			}
+			for (auto &n : names)
+				writeString(f, n);
+			for (auto &c : s.captured)
+			{
+				BinaryZone z;
+				{
+					z.start = c.zone.start - s.captureStart;
+					z.duration = (uint32_t)std::min<uint64_t>(c.zone.end - c.zone.start, UINT32_MAX);
+					z.name = nameIndices[c.zone.name];
+					z.thread = threadIndices[c.thread];
+				}
+				f.write(reinterpret_cast<const char*>(&z), sizeof(z));
+			}
+		}
+		if (!f.is_open() || !f.good())
+		{
+			fprintf(stderr, "Profiler: Failed to write '%s'.\n", binaryPath.c_str());
+			success = false;
+		}
+	}
+	printf("Profiler: Captured %u zones over %.1fms from %u threads (%llu dropped), written to %s and %s\n",
+		(unsigned int)s.captured.size(), (now() - s.captureStart) / 1e6, (unsigned int)threads.size(), (unsigned long long)s.droppedCount,
+		jsonPath.c_str(), binaryPath.c_str());
+	s.captured.clear();
+	s.captured.shrink_to_fit();
+	return success;
+}
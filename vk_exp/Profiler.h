@@ -0,0 +1,80 @@
+#ifndef __Profiler_h__
+#define __Profiler_h__
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+//Define as 0 (e.g. in the project's preprocessor definitions) to compile every zone away
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+/**
+ * Scoped CPU profiler
+ * A zone times its scope on the thread which created it, zones are only timed whilst a capture is active
+ * Each thread writes its completed zones to its own ring buffer, wait-free (if full the zone is dropped and counted)
+ * During a capture a collector thread drains every thread's buffer
+ * Stopping a capture writes it as Chrome trace-event JSON (chrome://tracing or ui.perfetto.dev) and a compact binary file
+ * Methods are thread-safe
+ */
+class Profiler
+{
+public:
+	/**
+	 * RAII zone, see PROFILE_ZONE()
+	 * @param name Only the pointer is recorded, so it must outlive the capture (e.g. a string literal)
+	 */
+	class Zone
+	{
+	public:
+		explicit Zone(const char *name)
+			: m_name(s_capturing.load(std::memory_order_relaxed) ? name : nullptr)
+			, m_start(m_name ? now() : 0)
+		{ }
+		~Zone() { if (m_name) record(m_name, m_start, now()); }
+		Zone(const Zone &) = delete;
+		Zone &operator=(const Zone &) = delete;
+	private:
+		const char *m_name;//Null if not capturing when created
+		uint64_t m_start;
+	};
+	/**
+	 * Names the calling thread in captures, otherwise it is only numbered
+	 */
+	static void setThreadName(const char *name);
+	/**
+	 * Discards zones completed before now and starts the collector thread
+	 * @return false if a capture is already active, or still being stopped
+	 */
+	static bool startCapture();
+	/**
+	 * Stops the collector and writes the capture to <path>.json and <path>.bin
+	 * @return false if no capture was active, or either file couldn't be written
+	 */
+	static bool stopCapture(const std::string &path);
+	static bool capturing() { return s_capturing.load(std::memory_order_relaxed); }
+	/**
+	 * Steady clock time in nanoseconds
+	 */
+	static uint64_t now();
+private:
+	static void record(const char *name, const uint64_t &start, const uint64_t &end);
+	static std::atomic<bool> s_capturing;
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+/**
+ * Times the remainder of the enclosing scope
+ */
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif //__Profiler_h__
@@ -0,0 +1,312 @@
+#include "QueuePool.h"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include "DeviceCapabilities.h"
+#include "GpuTimer.h"
+
+QueuePool::QueuePool(const DeviceCapabilities &caps, const uint32_t &graphicsFamily, const uint32_t &presentFamily, const uint32_t &computeFamily)
+{
+	const std::vector<vk::QueueFamilyProperties> &families = caps.QueueFamilies();
+	//Prefer a transfer-only family, its queues are backed by DMA engines which run alongside graphics and compute
+	uint32_t transferFamily = computeFamily;
+	for (uint32_t f = 0; f < families.size(); ++f)
+	{
+		if (families[f].queueCount && (families[f].queueFlags & vk::QueueFlagBits::eTransfer) && !(families[f].queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+		{
+			transferFamily = f;
+			break;
+		}
+	}
+	m_roleFamilies[Graphics] = graphicsFamily;
+	m_roleFamilies[Compute] = computeFamily;
+	m_roleFamilies[Transfer] = transferFamily;
+	for (const uint32_t &f : { graphicsFamily, presentFamily, computeFamily, transferFamily })
+	{
+		if (std::find(m_families.begin(), m_families.end(), f) == m_families.end())
+			m_families.push_back(f);
+	}
+	//Priorities must outlive the create infos, so are sized before any are referenced
+	m_priorities.resize(m_families.size());
+	for (size_t i = 0; i < m_families.size(); ++i)
+	{
+		const uint32_t count = std::min(families[m_families[i]].queueCount, MaxQueuesPerFamily);
+		//The first queue of each family takes the frame's work, additional queues are for background submissions
+		m_priorities[i].assign(count, 0.5f);
+		m_priorities[i][0] = 1.0f;
+		vk::DeviceQueueCreateInfo queueCreateInfo;
+		{
+			queueCreateInfo.flags = {};
+			queueCreateInfo.queueFamilyIndex = m_families[i];
+			queueCreateInfo.queueCount = count;
+			queueCreateInfo.pQueuePriorities = m_priorities[i].data();
+		}
+		m_createInfos.push_back(queueCreateInfo);
+		for (uint32_t q = 0; q < count; ++q)
+		{
+			m_queues.emplace_back(new Queue());
+			m_queues.back()->family = m_families[i];
+			m_queues.back()->index = q;
+			m_queues.back()->transferOnly = !(families[m_families[i]].queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute));
+		}
+	}
+}
+QueuePool::~QueuePool()
+{
+	destroy();
+}
+void QueuePool::init(const vk::PhysicalDevice &physicalDevice, const vk::Device &device, const vk::DispatchLoaderDynamic &loader)
+{
+	m_device = device;
+	m_loader = &loader;
+	for (auto &q : m_queues)
+	{
+		q->pool = this;
+		q->device = device;
+		q->queue = device.getQueue(q->family, q->index);
+		vk::CommandPoolCreateInfo commandPoolCreateInfo;
+		{
+			commandPoolCreateInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;//Command buffers are freed after each submission
+			commandPoolCreateInfo.queueFamilyIndex = q->family;
+		}
+		q->commandPool = device.createCommandPool(commandPoolCreateInfo);
+		vk::SemaphoreTypeCreateInfoKHR timelineInfo;
+		{
+			timelineInfo.semaphoreType = vk::SemaphoreTypeKHR::eTimeline;
+			timelineInfo.initialValue = 0;
+		}
+		vk::SemaphoreCreateInfo semaphoreInfo;
+		{
+			semaphoreInfo.pNext = &timelineInfo;
+		}
+		q->timeline = device.createSemaphore(semaphoreInfo);
+		q->submitted.store(0);
+		//vkCmdResetQueryPool requires a graphics or compute queue, so transfer-only queues are timed on the host
+		if (!q->transferOnly)
+			q->timer = new GpuTimer(physicalDevice, device, q->family, 1);
+	}
+	m_resetTime = std::chrono::steady_clock::now();
+}
+void QueuePool::destroy()
+{
+	for (auto &q : m_queues)
+	{
+		if (q->leased.load())
+			fprintf(stderr, "QueuePool: Queue %u of family %u is still leased at destruction.\n", q->index, q->family);
+		delete q->timer;
+		q->timer = nullptr;
+		if (q->timeline)
+			q->device.destroySemaphore(q->timeline);
+		q->timeline = nullptr;
+		if (q->commandPool)
+			q->device.destroyCommandPool(q->commandPool);
+		q->commandPool = nullptr;
+		q->queue = nullptr;
+	}
+}
+QueuePool::Lease QueuePool::tryAcquire(const uint32_t &family)
+{
+	for (auto &q : m_queues)
+	{
+		if (q->family != family)
+			continue;
+		bool expected = false;
+		if (q->leased.compare_exchange_strong(expected, true, std::memory_order_acquire))
+			return Lease(q.get());
+	}
+	return Lease();
+}
+QueuePool::Lease QueuePool::tryAcquire(const Role &role)
+{
+	for (int r = role; r >= Graphics; --r)
+	{
+		Lease l = tryAcquire(m_roleFamilies[r]);
+		if (l)
+			return l;
+	}
+	return Lease();
+}
+bool QueuePool::reached(const SyncPoint &point) const
+{
+	return !point || completedValue(point.timeline) >= point.value;
+}
+void QueuePool::wait(const std::vector<SyncPoint> &points) const
+{
+	std::vector<vk::Semaphore> semaphores;
+	std::vector<uint64_t> values;
+	for (auto &p : points)
+	{
+		if (!p)
+			continue;
+		semaphores.push_back(p.timeline);
+		values.push_back(p.value);
+	}
+	if (semaphores.empty())
+		return;
+	vk::SemaphoreWaitInfoKHR waitInfo;
+	{
+		waitInfo.flags = {};//Wait for all
+		waitInfo.semaphoreCount = (uint32_t)semaphores.size();
+		waitInfo.pSemaphores = semaphores.data();
+		waitInfo.pValues = values.data();
+	}
+	m_device.waitSemaphoresKHR(waitInfo, std::numeric_limits<uint64_t>::max(), *m_loader);
+}
+uint64_t QueuePool::completedValue(const vk::Semaphore &timeline) const
+{
+	return m_device.getSemaphoreCounterValueKHR(timeline, *m_loader);
+}
+void QueuePool::printUtilisation() const
+{
+	const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_resetTime).count();
+	printf("Queue utilisation over %.1fs\n", wallMs / 1000.0);
+	for (auto &q : m_queues)
+	{
+		const char *role = q->family == m_roleFamilies[Graphics] ? "graphics" : q->family == m_roleFamilies[Compute] ? "compute" : q->family == m_roleFamilies[Transfer] ? "transfer" : "present";
+		const uint64_t submissions = q->submissions.load(std::memory_order_relaxed);
+		const double busyMs = q->busyUs.load(std::memory_order_relaxed) / 1000.0;
+		printf("  Family %u queue %u (%s%s): %llu submissions, %.1fms busy, %.1f%%%s, timeline %llu/%llu\n",
+			q->family, q->index, role, q->leased.load(std::memory_order_relaxed) ? ", leased" : "",
+			(unsigned long long)submissions, busyMs, wallMs > 0 ? 100.0 * busyMs / wallMs : 0.0, q->timer && q->timer->supported() ? "" : " (host timed)",
+			(unsigned long long)completedValue(q->timeline), (unsigned long long)q->submitted.load());
+	}
+}
+void QueuePool::resetUtilisation()
+{
+	for (auto &q : m_queues)
+	{
+		q->busyUs.store(0, std::memory_order_relaxed);
+		q->submissions.store(0, std::memory_order_relaxed);
+	}
+	m_resetTime = std::chrono::steady_clock::now();
+}
+/**
+ * Lease
+ */
+QueuePool::Lease &QueuePool::Lease::operator=(Lease &&other)
+{
+	if (this != &other)
+	{
+		release();
+		m_queue = other.m_queue;
+		other.m_queue = nullptr;
+	}
+	return *this;
+}
+void QueuePool::Lease::release()
+{
+	if (m_queue)
+		m_queue->leased.store(false, std::memory_order_release);
+	m_queue = nullptr;
+}
+const vk::Queue &QueuePool::Lease::Queue() const
+{
+	return m_queue->queue;
+}
+uint32_t QueuePool::Lease::Family() const
+{
+	return m_queue->family;
+}
+uint32_t QueuePool::Lease::Index() const
+{
+	return m_queue->index;
+}
+vk::CommandBuffer QueuePool::Lease::begin() const
+{
+	vk::CommandBufferAllocateInfo cbAllocInfo;
+	{
+		cbAllocInfo.level = vk::CommandBufferLevel::ePrimary;
+		cbAllocInfo.commandPool = m_queue->commandPool;
+		cbAllocInfo.commandBufferCount = 1;
+	}
+	vk::CommandBuffer cb = m_queue->device.allocateCommandBuffers(cbAllocInfo)[0];
+	vk::CommandBufferBeginInfo cbBeginInfo;
+	{
+		cbBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+	}
+	cb.begin(cbBeginInfo);
+	if (m_queue->timer)
+		m_queue->timer->begin(cb, 0);
+	return cb;
+}
+void QueuePool::Lease::submitAndWait(vk::CommandBuffer &cb, const std::vector<Wait> &waits) const
+{
+	if (m_queue->timer)
+		m_queue->timer->end(cb, 0);
+	cb.end();
+	const auto submitTime = std::chrono::steady_clock::now();
+	m_queue->pool->wait(submit(cb, waits));
+	const double hostMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitTime).count();
+	m_queue->device.freeCommandBuffers(m_queue->commandPool, 1, &cb);
+	const double gpuMs = m_queue->timer ? m_queue->timer->collect(0) : -1;
+	addBusy(gpuMs >= 0 ? gpuMs : hostMs);
+}
+QueuePool::SyncPoint QueuePool::Lease::submit(const vk::CommandBuffer &cb, const std::vector<Wait> &waits,
+	const vk::Semaphore &binaryWait, const vk::PipelineStageFlags &binaryWaitStages, const vk::Semaphore &binarySignal) const
+{
+	//Binary semaphores take a value of 0, which is ignored
+	std::vector<vk::Semaphore> waitSemaphores;
+	std::vector<uint64_t> waitValues;
+	std::vector<vk::PipelineStageFlags> waitStages;
+	for (auto &w : waits)
+	{
+		if (!w.point)
+			continue;
+		waitSemaphores.push_back(w.point.timeline);
+		waitValues.push_back(w.point.value);
+		waitStages.push_back(w.stages);
+	}
+	if (binaryWait)
+	{
+		waitSemaphores.push_back(binaryWait);
+		waitValues.push_back(0);
+		waitStages.push_back(binaryWaitStages);
+	}
+	SyncPoint signal;
+	{
+		signal.timeline = m_queue->timeline;
+		signal.value = m_queue->submitted.load(std::memory_order_relaxed) + 1;
+	}
+	const vk::Semaphore signalSemaphores[] = { signal.timeline, binarySignal };
+	const uint64_t signalValues[] = { signal.value, 0 };
+	vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+	{
+		timelineInfo.waitSemaphoreValueCount = (uint32_t)waitValues.size();
+		timelineInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineInfo.signalSemaphoreValueCount = binarySignal ? 2 : 1;
+		timelineInfo.pSignalSemaphoreValues = signalValues;
+	}
+	vk::SubmitInfo submitInfo;
+	{
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cb;
+		submitInfo.signalSemaphoreCount = binarySignal ? 2 : 1;
+		submitInfo.pSignalSemaphores = signalSemaphores;
+	}
+	m_queue->queue.submit(1, &submitInfo, nullptr);
+	//Only published once submitted, so other threads never wait on a value which won't be signalled
+	m_queue->submitted.store(signal.value, std::memory_order_release);
+	return signal;
+}
+QueuePool::SyncPoint QueuePool::Lease::Submitted() const
+{
+	SyncPoint p;
+	if (!m_queue)
+		return p;//Nothing submitted, always reached
+	{
+		p.timeline = m_queue->timeline;
+		p.value = m_queue->submitted.load(std::memory_order_acquire);
+	}
+	return p;
+}
+void QueuePool::Lease::addBusy(const double &ms) const
+{
+	if (ms < 0)
+		return;
+	m_queue->busyUs.fetch_add((uint64_t)(ms * 1000.0), std::memory_order_relaxed);
+	m_queue->submissions.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,173 @@
+#ifndef __QueuePool_h__
+#define __QueuePool_h__
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <vulkan/vulkan.hpp>
+
+class DeviceCapabilities;
+class GpuTimer;
+
+/**
+ * Every queue created on the logical device
+ * A family is chosen per role: graphics, compute (a compute-only family where available) and transfer (a transfer-only, DMA, family where available)
+ * Up to MaxQueuesPerFamily queues are created in each family used, so several threads can submit to one family
+ * A thread takes exclusive use of a queue and its command pool by acquiring a Lease, so submissions to different queues need no locking
+ * Each queue has a timeline semaphore (VK_KHR_timeline_semaphore), signalled with an increasing value by every submission
+ * Dependencies between queues, and CPU waits, are expressed as a SyncPoint (a queue's timeline and a value) rather than fences or idling
+ * Each queue's busy time is accumulated from timestamp queries, and reported as a percentage of the wall time since the last reset
+ */
+class QueuePool
+{
+	struct Queue;
+public:
+	enum Role { Graphics, Compute, Transfer, RoleCount };
+	static const unsigned int MaxQueuesPerFamily = 4;
+	/**
+	 * Reached once every submission to the timeline's queue, up to and including the one which signalled value, has completed
+	 * A default constructed point is always reached
+	 */
+	struct SyncPoint
+	{
+		vk::Semaphore timeline = nullptr;
+		uint64_t value = 0;
+		explicit operator bool() const { return !!timeline; }
+	};
+	/**
+	 * A submission waits for the point to be reached before executing stages
+	 */
+	struct Wait
+	{
+		SyncPoint point;
+		vk::PipelineStageFlags stages;
+	};
+	/**
+	 * Exclusive use of one queue, released when destroyed
+	 * A lease may be passed between threads, but only used by one at a time
+	 */
+	class Lease
+	{
+	public:
+		Lease() = default;
+		Lease(Lease &&other) : m_queue(other.m_queue) { other.m_queue = nullptr; }
+		Lease &operator=(Lease &&other);
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+		~Lease() { release(); }
+		void release();
+		explicit operator bool() const { return m_queue != nullptr; }
+		const vk::Queue &Queue() const;
+		uint32_t Family() const;
+		uint32_t Index() const;
+		/**
+		 * Allocates a one time submit command buffer from the queue's command pool and begins recording it
+		 */
+		vk::CommandBuffer begin() const;
+		/**
+		 * Ends and submits a command buffer from begin(), blocks until it has completed and frees it
+		 * Its execution time is added to the queue's busy time
+		 */
+		void submitAndWait(vk::CommandBuffer &cb, const std::vector<Wait> &waits = {}) const;
+		/**
+		 * Submits a recorded command buffer, signalling the queue's next timeline value
+		 * @param waits Points on any queue's timeline to wait for
+		 * @param binaryWait, binarySignal Optional binary semaphores, for swapchain acquire and present which can't use timelines
+		 * @return The point reached once the submission completes
+		 */
+		SyncPoint submit(const vk::CommandBuffer &cb, const std::vector<Wait> &waits = {},
+			const vk::Semaphore &binaryWait = nullptr, const vk::PipelineStageFlags &binaryWaitStages = {}, const vk::Semaphore &binarySignal = nullptr) const;
+		/**
+		 * The point reached once everything submitted to the queue so far has completed, always reached for an empty lease
+		 */
+		SyncPoint Submitted() const;
+		/**
+		 * Adds work timed by the caller (e.g. a frame's command buffer, bracketed by a GpuTimer) to the queue's busy time
+		 */
+		void addBusy(const double &ms) const;
+	private:
+		friend class QueuePool;
+		explicit Lease(QueuePool::Queue *queue) : m_queue(queue) {}
+		QueuePool::Queue *m_queue = nullptr;
+	};
+	/**
+	 * Chooses the families and queue counts, from which the device is created
+	 */
+	QueuePool(const DeviceCapabilities &caps, const uint32_t &graphicsFamily, const uint32_t &presentFamily, const uint32_t &computeFamily);
+	~QueuePool();
+	/**
+	 * Passed to vk::DeviceCreateInfo, valid for the pool's lifetime
+	 */
+	const std::vector<vk::DeviceQueueCreateInfo> &CreateInfos() const { return m_createInfos; }
+	/**
+	 * Retrieves the queues and creates their command pools, timelines and timers, call once after the device is created
+	 * @param loader Must outlive the pool, provides the VK_KHR_timeline_semaphore commands
+	 */
+	void init(const vk::PhysicalDevice &physicalDevice, const vk::Device &device, const vk::DispatchLoaderDynamic &loader);
+	/**
+	 * All leases must have been released, call before the device is destroyed
+	 */
+	void destroy();
+	uint32_t Family(const Role &role) const { return m_roleFamilies[role]; }
+	/**
+	 * Each family queues were created in, once
+	 * Resources written on one role's queue and read on another's should be shared concurrently across these
+	 */
+	const std::vector<uint32_t> &Families() const { return m_families; }
+	/**
+	 * Leases a free queue of the family, never blocks
+	 * @return An empty lease if every queue of the family is leased
+	 */
+	Lease tryAcquire(const uint32_t &family);
+	/**
+	 * Leases a free queue of the role's family, otherwise of the next family able to perform the role
+	 * (transfer falls back to compute then graphics, compute to graphics)
+	 * @return An empty lease if no suitable queue is free
+	 */
+	Lease tryAcquire(const Role &role);
+	/**
+	 * Whether the point has been reached, never blocks
+	 */
+	bool reached(const SyncPoint &point) const;
+	/**
+	 * Blocks until every point has been reached
+	 */
+	void wait(const std::vector<SyncPoint> &points) const;
+	void wait(const SyncPoint &point) const { wait(std::vector<SyncPoint>{ point }); }
+	/**
+	 * The value the timeline's semaphore has reached
+	 */
+	uint64_t completedValue(const vk::Semaphore &timeline) const;
+	/**
+	 * Prints each queue's submissions and busy time since the last reset
+	 */
+	void printUtilisation() const;
+	void resetUtilisation();
+private:
+	struct Queue
+	{
+		const QueuePool *pool = nullptr;
+		vk::Device device = nullptr;
+		vk::Queue queue = nullptr;
+		uint32_t family = 0;
+		uint32_t index = 0;
+		bool transferOnly = false;
+		vk::CommandPool commandPool = nullptr;
+		vk::Semaphore timeline = nullptr;
+		std::atomic<uint64_t> submitted{ 0 };//Last value signalled by a submission
+		GpuTimer *timer = nullptr;//Null for transfer-only families, which can't reset queries
+		std::atomic<bool> leased{ false };
+		std::atomic<uint64_t> busyUs{ 0 };
+		std::atomic<uint64_t> submissions{ 0 };
+	};
+	std::vector<std::unique_ptr<Queue>> m_queues;//Grouped by family, atomics can't be moved
+	std::vector<vk::DeviceQueueCreateInfo> m_createInfos;
+	std::vector<std::vector<float>> m_priorities;//Per create info
+	std::vector<uint32_t> m_families;
+	uint32_t m_roleFamilies[RoleCount];
+	vk::Device m_device = nullptr;
+	const vk::DispatchLoaderDynamic *m_loader = nullptr;
+	std::chrono::steady_clock::time_point m_resetTime;
+};
+
+#endif //__QueuePool_h__
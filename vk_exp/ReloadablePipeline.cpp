@@ -0,0 +1,54 @@
+#include "ReloadablePipeline.h"
+#include "ShaderReflection.h"
+#include "Hash.h"
+#include <cstdio>
+#include <stdexcept>
+
+vk::ShaderModule ReloadablePipeline::createShader(const vk::Device &device, const std::vector<uint32_t> &code)
+{
+	vk::ShaderModuleCreateInfo createInfo;
+	{
+		createInfo.flags = {};
+		createInfo.codeSize = code.size() * sizeof(uint32_t);
+		createInfo.pCode = code.data();
+	}
+	return device.createShaderModule(createInfo);
+}
+void ReloadablePipeline::validateSpecialization(const SpecializationConstants &spec, const ShaderReflection &r)
+{
+	auto values = spec.Stage(r.Stage());
+	if (!values)
+		return;
+	for (auto &v : *values)
+	{
+		auto sc = r.findSpecConstant(v.first);
+		if (!sc)
+		{//Vulkan ignores entries without a matching constant, but it likely indicates a typo
+			fprintf(stderr, "Pipeline: Specialization constant %u is not declared by stage %s.\n", v.first, vk::to_string(r.Stage()).c_str());
+			continue;
+		}
+		if (sc->size != v.second.size())
+			throw std::runtime_error("Pipeline: Specialization constant " + std::to_string(v.first) + " ('" + sc->name + "') is " + std::to_string(sc->size) + " bytes, but " + std::to_string(v.second.size()) + " bytes were provided.");
+	}
+}
+uint64_t ReloadablePipeline::stateKey(const std::vector<const std::vector<uint32_t>*> &stages, const SpecializationConstants &spec)
+{
+	//The specialization is folded in so each variant has a distinct key
+	Hash h;
+	for (auto &s : stages)
+		h.mix(s->data(), s->size() * sizeof(uint32_t));
+	const uint64_t specHash = spec.hash();
+	h.mix(&specHash, sizeof(specHash));
+	return h.value();
+}
+bool ReloadablePipeline::pathMatches(const std::string &path, const std::string &filename)
+{
+	if (filename.empty() || path.size() < filename.size())
+		return false;
+	if (path.compare(path.size() - filename.size(), filename.size(), filename) != 0)
+		return false;
+	if (path.size() == filename.size())
+		return true;
+	const char sep = path[path.size() - filename.size() - 1];
+	return sep == '/' || sep == '\\';
+}
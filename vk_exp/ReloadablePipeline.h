@@ -0,0 +1,51 @@
+#ifndef __ReloadablePipeline_h__
+#define __ReloadablePipeline_h__
+#include <vector>
+#include <string>
+#include <vulkan/vulkan.hpp>
+#include "SpecializationConstants.h"
+class ShaderReflection;
+
+/**
+ * Interface through which Context hot reloads pipelines (see Context::processShaderReloads())
+ * Also holds the utilities shared by GraphicsPipeline and ComputePipeline
+ */
+class ReloadablePipeline
+{
+public:
+	virtual ~ReloadablePipeline() { }
+	/**
+	 * Compiles the shaders and builds a new vk::Pipeline from the current state, without modifying the active pipeline
+	 * @return nullptr if the pipeline state key matches the active pipeline
+	 */
+	virtual vk::Pipeline buildPipeline() = 0;
+	/**
+	 * Replaces the active pipeline
+	 * @return The previous pipeline, the caller must destroy this once the GPU is no longer using it
+	 */
+	virtual vk::Pipeline swapPipeline(const vk::Pipeline &pipeline) = 0;
+	/**
+	 * Whether a setting (e.g. specialization constants) has changed since the last buildPipeline()
+	 */
+	virtual bool rebuildRequested() const = 0;
+	/**
+	 * Returns true if any shader stage was loaded from a file with the provided name
+	 */
+	virtual bool usesShader(const std::string &filename) const = 0;
+protected:
+	static vk::ShaderModule createShader(const vk::Device &device, const std::vector<uint32_t> &code);
+	/**
+	 * Throws std::runtime_error if a value's size doesn't match its declaration in the stage
+	 */
+	static void validateSpecialization(const SpecializationConstants &spec, const ShaderReflection &r);
+	/**
+	 * Hash of each stage's SPIR-V and the specialization, identifying the built pipeline
+	 */
+	static uint64_t stateKey(const std::vector<const std::vector<uint32_t>*> &stages, const SpecializationConstants &spec);
+	/**
+	 * Compares filename against the trailing path component(s), so '../shaders/test.vert' matches 'test.vert'
+	 */
+	static bool pathMatches(const std::string &path, const std::string &filename);
+};
+
+#endif //__ReloadablePipeline_h__
@@ -0,0 +1,891 @@
+#include "RenderGraph.h"
+#include "Context.h"
+#include <set>
+#include <algorithm>
+
+RenderGraph::RenderGraph(Context &ctx)
+	: m_context(ctx)
+	, m_stats()
+{ }
+RenderGraph::~RenderGraph()
+{
+	destroyCompiled();
+}
+/**
+ * Declaration
+ */
+RenderGraph::Resource RenderGraph::importImage(const std::string &name, const ImageDesc &desc, const vk::ImageLayout &initialLayout, const vk::PipelineStageFlags &initialStages, const vk::ImageLayout &finalLayout)
+{
+	ResourceNode r;
+	{
+		r.name = name;
+		r.isImage = true;
+		r.imported = true;
+		r.desc = desc;
+		r.initialLayout = initialLayout;
+		r.initialStages = initialStages;
+		r.finalLayout = finalLayout;
+	}
+	m_resources.push_back(r);
+	m_compiled = false;
+	return (Resource)m_resources.size() - 1;
+}
+void RenderGraph::setImportedImage(const Resource &resource, const vk::Image &image, const vk::ImageView &view)
+{
+	ResourceNode &r = m_resources.at(resource);
+	if (!r.imported || !r.isImage)
+		throw std::runtime_error("RenderGraph: '" + r.name + "' is not an imported image.");
+	r.image = image;
+	r.view = view;
+}
+RenderGraph::Resource RenderGraph::importBuffer(const std::string &name, const vk::Buffer &buffer)
+{
+	ResourceNode r;
+	{
+		r.name = name;
+		r.isImage = false;
+		r.imported = true;
+		r.buffer = buffer;
+	}
+	m_resources.push_back(r);
+	m_compiled = false;
+	return (Resource)m_resources.size() - 1;
+}
+RenderGraph::Resource RenderGraph::createImage(const std::string &name, const ImageDesc &desc)
+{
+	ResourceNode r;
+	{
+		r.name = name;
+		r.isImage = true;
+		r.imported = false;
+		r.desc = desc;
+	}
+	m_resources.push_back(r);
+	m_compiled = false;
+	return (Resource)m_resources.size() - 1;
+}
+RenderGraph::Pass RenderGraph::addPass(const std::string &name, const PassType &type, RecordFn record)
+{
+	PassNode p;
+	{
+		p.name = name;
+		p.type = type;
+		p.record = record;
+	}
+	m_passes.push_back(p);
+	m_compiled = false;
+	return (Pass)m_passes.size() - 1;
+}
+void RenderGraph::read(const Pass &pass, const Resource &resource, const Access &access)
+{
+	UsageNode u;
+	{
+		u.resource = resource;
+		u.access = access;
+		u.write = false;
+		u.clear = false;
+	}
+	m_passes.at(pass).usages.push_back(u);
+	m_compiled = false;
+}
+void RenderGraph::write(const Pass &pass, const Resource &resource, const Access &access)
+{
+	UsageNode u;
+	{
+		u.resource = resource;
+		u.access = access;
+		u.write = true;
+		u.clear = false;
+	}
+	m_passes.at(pass).usages.push_back(u);
+	m_compiled = false;
+}
+void RenderGraph::clear(const Pass &pass, const Resource &resource, const Access &access, const vk::ClearValue &value)
+{
+	if (access != Access::ColorAttachment && access != Access::DepthAttachment)
+		throw std::exception("RenderGraph: Only attachments can be cleared.");
+	UsageNode u;
+	{
+		u.resource = resource;
+		u.access = access;
+		u.write = true;
+		u.clear = true;
+		u.clearValue = value;
+	}
+	m_passes.at(pass).usages.push_back(u);
+	m_compiled = false;
+}
+void RenderGraph::resolve(const Pass &pass, const Resource &source, const Resource &destination)
+{
+	UsageNode u;
+	{
+		u.resource = destination;
+		u.access = Access::ResolveAttachment;
+		u.write = true;
+		u.clear = false;
+		u.resolveSource = source;
+	}
+	m_passes.at(pass).usages.push_back(u);
+	m_compiled = false;
+}
+void RenderGraph::setViewMask(const Pass &pass, const uint32_t &viewMask)
+{
+	if (m_passes.at(pass).type != PassType::Graphics)
+		throw std::runtime_error("RenderGraph: Pass '" + m_passes[pass].name + "' is not a graphics pass, so cannot use multiview.");
+	m_passes[pass].viewMask = viewMask;
+	m_compiled = false;
+}
+void RenderGraph::setRenderArea(const Pass &pass, const vk::Extent2D &extent)
+{
+	if (m_passes.at(pass).type != PassType::Graphics)
+		throw std::runtime_error("RenderGraph: Pass '" + m_passes[pass].name + "' is not a graphics pass, so has no render area.");
+	m_passes[pass].renderArea = extent;
+}
+void RenderGraph::keepAlive(const Pass &pass)
+{
+	m_passes.at(pass).keepAlive = true;
+	m_compiled = false;
+}
+/**
+ * Compilation
+ */
+void RenderGraph::compile()
+{
+	destroyCompiled();
+	m_stats = Stats();
+	cullPasses();
+	createTransientImages();
+	planBarriers();
+	for (auto &p : m_schedule)
+	{
+		if (m_passes[p].type == PassType::Graphics)
+			createRenderPass(m_passes[p]);
+	}
+	m_stats.passes = (unsigned int)m_schedule.size();
+	m_stats.culledPasses = (unsigned int)(m_passes.size() - m_schedule.size());
+	m_compiled = true;
+}
+void RenderGraph::destroyCompiled()
+{
+	const vk::Device &device = m_context.Device();
+	for (auto &p : m_passes)
+	{
+		for (auto &fb : p.framebuffers)
+			device.destroyFramebuffer(fb.second);
+		p.framebuffers.clear();
+		if (p.renderPass)
+			device.destroyRenderPass(p.renderPass);
+		p.renderPass = nullptr;
+		p.attachments.clear();
+		p.clearValues.clear();
+		p.culled = false;
+	}
+	for (auto &r : m_resources)
+	{
+		r.firstPass = r.lastPass = -1;
+		r.memorySlot = -1;
+		if (r.imported)
+			continue;
+		if (r.view)
+			device.destroyImageView(r.view);
+		if (r.image)
+			device.destroyImage(r.image);
+		r.view = nullptr;
+		r.image = nullptr;
+		r.usage = {};
+	}
+	for (auto &s : m_memorySlots)
+		m_context.Memory().free(s.memory);
+	m_memorySlots.clear();
+	m_schedule.clear();
+	m_passBarriers.clear();
+	m_finalBarriers = BarrierBatch();
+	m_compiled = false;
+}
+void RenderGraph::cullPasses()
+{
+	//Walk backwards, a pass is required if it has side effects, or writes something a required pass reads
+	std::set<Resource> consumed;
+	for (int i = (int)m_passes.size() - 1; i >= 0; --i)
+	{
+		PassNode &p = m_passes[i];
+		bool required = p.keepAlive;
+		for (auto &u : p.usages)
+			required |= u.write && (m_resources[u.resource].imported || consumed.count(u.resource));
+		p.culled = !required;
+		if (p.culled)
+			continue;
+		for (auto &u : p.usages)
+		{
+			//Writes which don't clear (or resolve over) preserve, and hence depend on, previous contents
+			if (!u.clear && u.access != Access::ResolveAttachment)
+				consumed.insert(u.resource);
+		}
+	}
+	for (Pass i = 0; i < m_passes.size(); ++i)
+	{
+		if (m_passes[i].culled)
+			continue;
+		const int s = (int)m_schedule.size();
+		m_schedule.push_back(i);
+		for (auto &u : m_passes[i].usages)
+		{
+			ResourceNode &r = m_resources[u.resource];
+			if (r.firstPass < 0)
+				r.firstPass = s;
+			r.lastPass = s;
+			r.usage |= accessInfo(u.access, m_passes[i].type, u.write).usage;
+		}
+	}
+}
+void RenderGraph::createTransientImages()
+{
+	const vk::Device &device = m_context.Device();
+	std::vector<Resource> transients;
+	std::map<Resource, vk::MemoryRequirements> requirements;
+	for (Resource i = 0; i < m_resources.size(); ++i)
+	{
+		ResourceNode &r = m_resources[i];
+		if (r.imported || r.firstPass < 0)
+			continue;//Imported or unused
+		//Attachments whose contents never leave a single render pass need not be backed by memory
+		const vk::ImageUsageFlags attachmentUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eInputAttachment;
+		if (r.firstPass == r.lastPass && m_passes[m_schedule[r.firstPass]].type == PassType::Graphics && !(r.usage & ~attachmentUsage))
+		{
+			r.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+			m_stats.lazyImages++;
+		}
+		vk::ImageCreateInfo imgCreate;
+		{
+			imgCreate.flags = {};
+			imgCreate.imageType = vk::ImageType::e2D;
+			imgCreate.format = r.desc.format;
+			imgCreate.extent = vk::Extent3D(r.desc.extent.width, r.desc.extent.height, 1);
+			imgCreate.mipLevels = 1;
+			imgCreate.arrayLayers = r.desc.layers;
+			imgCreate.samples = r.desc.samples;
+			imgCreate.tiling = vk::ImageTiling::eOptimal;
+			imgCreate.usage = r.usage;
+			imgCreate.sharingMode = vk::SharingMode::eExclusive;
+			imgCreate.initialLayout = vk::ImageLayout::eUndefined;
+		}
+		r.image = device.createImage(imgCreate);
+		requirements[i] = device.getImageMemoryRequirements(r.image);
+		transients.push_back(i);
+		m_stats.unaliasedBytes += requirements[i].size;
+	}
+	//Largest first, each image joins the first slot whose occupants' lifetimes don't overlap it
+	std::sort(transients.begin(), transients.end(), [&requirements](const Resource &a, const Resource &b) { return requirements[a].size > requirements[b].size; });
+	for (auto &t : transients)
+	{
+		ResourceNode &r = m_resources[t];
+		const vk::MemoryRequirements &req = requirements[t];
+		for (int s = 0; s < (int)m_memorySlots.size() && r.memorySlot < 0; ++s)
+		{
+			MemorySlot &slot = m_memorySlots[s];
+			if (!(slot.requirements.memoryTypeBits & req.memoryTypeBits))
+				continue;
+			bool overlaps = false;
+			for (auto &o : slot.resources)
+				overlaps |= !(m_resources[o].lastPass < r.firstPass || r.lastPass < m_resources[o].firstPass);
+			if (overlaps)
+				continue;
+			slot.requirements.size = std::max(slot.requirements.size, req.size);
+			slot.requirements.alignment = std::max(slot.requirements.alignment, req.alignment);
+			slot.requirements.memoryTypeBits &= req.memoryTypeBits;
+			slot.resources.push_back(t);
+			r.memorySlot = s;
+			m_stats.aliasedImages++;
+		}
+		if (r.memorySlot < 0)
+		{
+			MemorySlot slot;
+			{
+				slot.requirements = req;
+				slot.resources.push_back(t);
+			}
+			r.memorySlot = (int)m_memorySlots.size();
+			m_memorySlots.push_back(slot);
+		}
+	}
+	for (auto &slot : m_memorySlots)
+	{
+		//Lazily allocated types are only in memoryTypeBits if every occupant is a transient attachment
+		slot.memory = m_context.Memory().allocate(slot.requirements, MemoryManager::Usage({}, vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eLazilyAllocated, vk::MemoryPropertyFlagBits::eHostVisible));
+		m_stats.transientBytes += slot.requirements.size;
+		for (auto &t : slot.resources)
+		{
+			ResourceNode &r = m_resources[t];
+			device.bindImageMemory(r.image, slot.memory, 0);
+			vk::ImageViewCreateInfo viewInfo;
+			{
+				viewInfo.image = r.image;
+				viewInfo.viewType = r.desc.layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
+				viewInfo.format = r.desc.format;
+				viewInfo.subresourceRange.aspectMask = isDepthFormat(r.desc.format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+				viewInfo.subresourceRange.baseMipLevel = 0;
+				viewInfo.subresourceRange.levelCount = 1;
+				viewInfo.subresourceRange.baseArrayLayer = 0;
+				viewInfo.subresourceRange.layerCount = r.desc.layers;
+				viewInfo.components = vk::ComponentMapping();//eIdentity
+			}
+			r.view = device.createImageView(viewInfo);
+		}
+	}
+	m_stats.transientImages = (unsigned int)transients.size();
+}
+void RenderGraph::planBarriers()
+{
+	//Synchronisation state of a resource as of the most recently planned usage
+	struct State
+	{
+		vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+		vk::PipelineStageFlags writeStages;//Stages which must complete before the next access (the last write, or layout transition)
+		vk::AccessFlags writeAccess;//Writes yet to be made available
+		vk::PipelineStageFlags readStages;//Stages which have read since writeStages, must complete before the next write
+		vk::AccessFlags readAccess;//Accesses the last write has been made visible to
+	};
+	//Cross-frame hazards: Resources which aren't imported with an explicit initial state begin the frame waiting on
+	//their final stages of the previous frame (barriers also order against prior submissions to the queue)
+	//Aliased transients instead wait on the final stages of the previous occupant of their memory
+	std::vector<State> resourceEnd(m_resources.size());
+	std::vector<State> slotEnd(m_memorySlots.size());//Only writeStages/writeAccess are used
+	for (int iteration = 0; iteration < 2; ++iteration)
+	{
+		const bool emit = iteration == 1;
+		std::vector<State> states(m_resources.size());
+		std::vector<State> slots = slotEnd;
+		for (Resource i = 0; i < m_resources.size(); ++i)
+		{
+			ResourceNode &r = m_resources[i];
+			if (r.imported && r.isImage)
+			{
+				states[i].layout = r.initialLayout;
+				states[i].writeStages = r.initialStages;
+			}
+			else if (r.imported)
+			{
+				states[i] = resourceEnd[i];
+			}
+		}
+		if (emit)
+		{
+			m_passBarriers.clear();
+			m_stats.barriers = m_stats.barrierBatches = m_stats.elidedBarriers = 0;
+		}
+		for (int s = 0; s < (int)m_schedule.size(); ++s)
+		{
+			BarrierBatch batch;
+			for (auto &u : mergeUsages(m_passes[m_schedule[s]]))
+			{
+				ResourceNode &r = m_resources[u.resource];
+				State &st = states[u.resource];
+				const bool firstUse = !r.imported && r.firstPass == s;
+				if (firstUse)
+				{//Contents are undefined at first use, but the memory may still be in use
+					st = slots[r.memorySlot];
+					st.layout = vk::ImageLayout::eUndefined;
+				}
+				bool needsBarrier = false;
+				vk::PipelineStageFlags src;
+				vk::AccessFlags srcAccess;
+				vk::ImageLayout oldLayout = st.layout;
+				const bool transition = r.isImage && st.layout != u.info.layout;
+				if (u.write)
+				{
+					//WAR only requires an execution dependency, WAW also requires the previous write be made available
+					src = st.readStages ? st.readStages : st.writeStages;
+					srcAccess = st.readStages ? vk::AccessFlags() : st.writeAccess;
+					needsBarrier = transition || src;
+					if (u.clear || u.access == Access::ResolveAttachment)
+						oldLayout = vk::ImageLayout::eUndefined;//Discard
+					st.layout = u.info.layout;
+					st.writeStages = u.info.stages;
+					st.writeAccess = u.info.access;
+					st.readStages = {};
+					st.readAccess = {};
+				}
+				else if (transition)
+				{
+					src = st.writeStages | st.readStages;
+					srcAccess = st.writeAccess;
+					needsBarrier = true;
+					//Later reads chain from this barrier, the transition's writes are already available
+					st.layout = u.info.layout;
+					st.writeStages = u.info.stages;
+					st.writeAccess = {};
+					st.readStages = u.info.stages;
+					st.readAccess = u.info.access;
+				}
+				else if (st.writeStages && ((u.info.stages & ~st.readStages) || (u.info.access & ~st.readAccess)))
+				{//Reads which have not yet been synchronised with the last write
+					src = st.writeStages;
+					srcAccess = st.writeAccess;
+					needsBarrier = true;
+					st.readStages |= u.info.stages;
+					st.readAccess |= u.info.access;
+				}
+				if (!r.imported && r.lastPass == s)
+				{
+					slots[r.memorySlot].writeStages = st.writeStages | st.readStages;
+					slots[r.memorySlot].writeAccess = st.writeAccess;
+				}
+				if (!emit)
+					continue;
+				if (!needsBarrier)
+				{
+					m_stats.elidedBarriers++;
+					continue;
+				}
+				batch.srcStages |= src ? src : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+				batch.dstStages |= u.info.stages;
+				if (r.isImage && (transition || srcAccess))
+				{
+					PlannedBarrier b;
+					{
+						b.resource = u.resource;
+						b.oldLayout = oldLayout;
+						b.newLayout = u.info.layout;
+						b.srcAccess = srcAccess;
+						b.dstAccess = u.info.access;
+					}
+					batch.images.push_back(b);
+				}
+				else if (!r.isImage && srcAccess)
+				{
+					batch.bufferSrcAccess |= srcAccess;
+					batch.bufferDstAccess |= u.info.access;
+				}
+			}
+			if (emit)
+			{
+				if (!batch.empty())
+				{
+					m_stats.barrierBatches++;
+					m_stats.barriers += (unsigned int)batch.images.size() + ((batch.bufferSrcAccess || batch.bufferDstAccess) ? 1 : 0);
+				}
+				m_passBarriers.push_back(batch);
+			}
+		}
+		//Record end of frame state for the next iteration
+		resourceEnd = states;
+		slotEnd = slots;
+		if (!emit)
+			continue;
+		//Return imported images to their expected layout
+		m_finalBarriers = BarrierBatch();
+		for (Resource i = 0; i < m_resources.size(); ++i)
+		{
+			ResourceNode &r = m_resources[i];
+			if (!r.imported || !r.isImage || states[i].layout == r.finalLayout || r.firstPass < 0)
+				continue;
+			PlannedBarrier b;
+			{
+				b.resource = i;
+				b.oldLayout = states[i].layout;
+				b.newLayout = r.finalLayout;
+				b.srcAccess = states[i].writeAccess;
+				b.dstAccess = {};
+			}
+			m_finalBarriers.images.push_back(b);
+			m_finalBarriers.srcStages |= states[i].writeStages | states[i].readStages;
+			m_finalBarriers.dstStages |= vk::PipelineStageFlagBits::eBottomOfPipe;
+		}
+		if (!m_finalBarriers.empty())
+		{
+			m_stats.barrierBatches++;
+			m_stats.barriers += (unsigned int)m_finalBarriers.images.size();
+		}
+	}
+}
+void RenderGraph::createRenderPass(PassNode &pass)
+{
+	std::vector<vk::AttachmentDescription> attachments;
+	std::vector<vk::AttachmentReference> colorRefs;
+	std::vector<vk::AttachmentReference> resolveRefs;//Parallel to colorRefs
+	bool hasResolve = false;
+	vk::AttachmentReference depthRef;
+	bool hasDepth = false;
+	const int s = (int)(std::find(m_schedule.begin(), m_schedule.end(), (Pass)(&pass - m_passes.data())) - m_schedule.begin());
+	//Colour attachments in declaration order, followed by depth, then resolve destinations
+	std::vector<MergedUsage> usages = mergeUsages(pass);
+	std::stable_partition(usages.begin(), usages.end(), [](const MergedUsage &u) { return u.access != Access::ResolveAttachment; });
+	std::stable_partition(usages.begin(), usages.end(), [](const MergedUsage &u) { return u.access == Access::ColorAttachment; });
+	for (auto &u : usages)
+	{
+		if (u.access != Access::ColorAttachment && u.access != Access::DepthAttachment && u.access != Access::DepthReadOnly && u.access != Access::ResolveAttachment)
+			continue;
+		const ResourceNode &r = m_resources[u.resource];
+		//Each view renders to the layer of its index
+		if (pass.viewMask && (pass.viewMask >> r.desc.layers))
+			throw std::runtime_error("RenderGraph: Attachment '" + r.name + "' of multiview pass '" + pass.name + "' has fewer layers than views.");
+		const bool firstUse = !r.imported && r.firstPass == s;
+		const bool usedLater = r.imported || r.lastPass > s;
+		vk::AttachmentDescription a;
+		{
+			a.flags = {};
+			a.format = r.desc.format;
+			a.samples = r.desc.samples;
+			a.loadOp = u.clear ? vk::AttachmentLoadOp::eClear : ((firstUse || u.access == Access::ResolveAttachment) ? vk::AttachmentLoadOp::eDontCare : vk::AttachmentLoadOp::eLoad);
+			a.storeOp = usedLater ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+			a.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+			a.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+			//The graph's barriers perform all transitions
+			a.initialLayout = u.info.layout;
+			a.finalLayout = u.info.layout;
+		}
+		vk::AttachmentReference ref;
+		{
+			ref.attachment = (unsigned int)attachments.size();
+			ref.layout = u.info.layout;
+		}
+		if (u.access == Access::ColorAttachment)
+		{
+			colorRefs.push_back(ref);
+			resolveRefs.push_back(vk::AttachmentReference(VK_ATTACHMENT_UNUSED, vk::ImageLayout::eUndefined));
+		}
+		else if (u.access == Access::ResolveAttachment)
+		{
+			//Colour attachments were added first, so their index in pass.attachments is their colorRefs index
+			const auto src = std::find(pass.attachments.begin(), pass.attachments.end(), u.resolveSource);
+			const size_t c = src - pass.attachments.begin();
+			if (c >= colorRefs.size())
+				throw std::runtime_error("RenderGraph: Pass '" + pass.name + "' resolves '" + m_resources[u.resolveSource].name + "', which is not one of its colour attachments.");
+			if (m_resources[u.resolveSource].desc.samples == vk::SampleCountFlagBits::e1)
+				throw std::runtime_error("RenderGraph: Pass '" + pass.name + "' resolves '" + m_resources[u.resolveSource].name + "', which is not multisampled.");
+			resolveRefs[c] = ref;
+			hasResolve = true;
+		}
+		else
+		{
+			if (hasDepth)
+				throw std::runtime_error("RenderGraph: Pass '" + pass.name + "' uses multiple depth attachments.");
+			depthRef = ref;
+			hasDepth = true;
+		}
+		attachments.push_back(a);
+		pass.attachments.push_back(u.resource);
+		pass.clearValues.push_back(u.clearValue);
+	}
+	if (attachments.empty())
+		return;
+	vk::SubpassDescription subpass;
+	{
+		subpass.flags = {};
+		subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+		subpass.inputAttachmentCount = 0;
+		subpass.pInputAttachments = nullptr;
+		subpass.colorAttachmentCount = (unsigned int)colorRefs.size();
+		subpass.pColorAttachments = colorRefs.data();
+		subpass.pResolveAttachments = hasResolve ? resolveRefs.data() : nullptr;
+		subpass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+		subpass.preserveAttachmentCount = 0;
+		subpass.pPreserveAttachments = nullptr;
+	}
+	vk::RenderPassCreateInfo rpInfo;
+	{
+		rpInfo.flags = {};
+		rpInfo.attachmentCount = (unsigned int)attachments.size();
+		rpInfo.pAttachments = attachments.data();
+		rpInfo.subpassCount = 1;
+		rpInfo.pSubpasses = &subpass;
+		rpInfo.dependencyCount = 0;
+		rpInfo.pDependencies = nullptr;
+	}
+	vk::RenderPassMultiviewCreateInfo multiview;
+	if (pass.viewMask)
+	{
+		multiview.subpassCount = 1;
+		multiview.pViewMasks = &pass.viewMask;
+		multiview.dependencyCount = 0;
+		multiview.pViewOffsets = nullptr;
+		//Views are near identical, so implementations may render them concurrently
+		multiview.correlationMaskCount = 1;
+		multiview.pCorrelationMasks = &pass.viewMask;
+		rpInfo.pNext = &multiview;
+	}
+	pass.renderPass = m_context.Device().createRenderPass(rpInfo);
+}
+/**
+ * Execution
+ */
+void RenderGraph::execute(vk::CommandBuffer &cb)
+{
+	if (!m_compiled)
+		throw std::exception("RenderGraph: compile() must be called before execute().");
+	for (size_t s = 0; s < m_schedule.size(); ++s)
+	{
+		PassNode &pass = m_passes[m_schedule[s]];
+		recordBarriers(cb, m_passBarriers[s]);
+		if (pass.renderPass)
+		{
+			const ResourceNode &first = m_resources[pass.attachments[0]];
+			vk::Rect2D area(vk::Offset2D(0, 0), first.desc.extent);
+			if (pass.renderArea.width && pass.renderArea.height)
+			{
+				area.extent.width = std::min(pass.renderArea.width, first.desc.extent.width);
+				area.extent.height = std::min(pass.renderArea.height, first.desc.extent.height);
+			}
+			vk::RenderPassBeginInfo rpBegin;
+			{
+				rpBegin.renderPass = pass.renderPass;
+				rpBegin.framebuffer = getFramebuffer(pass);
+				rpBegin.renderArea = area;
+				rpBegin.clearValueCount = (unsigned int)pass.clearValues.size();
+				rpBegin.pClearValues = pass.clearValues.data();
+			}
+			cb.beginRenderPass(rpBegin, vk::SubpassContents::eInline);
+			const vk::Viewport viewport(0.0f, 0.0f, (float)area.extent.width, (float)area.extent.height, 0.0f, 1.0f);
+			cb.setViewport(0, 1, &viewport);
+			cb.setScissor(0, 1, &area);
+			pass.record(cb);
+			cb.endRenderPass();
+		}
+		else
+		{
+			pass.record(cb);
+		}
+	}
+	recordBarriers(cb, m_finalBarriers);
+}
+vk::Framebuffer RenderGraph::getFramebuffer(PassNode &pass)
+{
+	//Imported attachments (e.g. the swapchain image) vary per frame, so framebuffers are cached by view
+	std::vector<VkImageView> views;
+	for (auto &a : pass.attachments)
+	{
+		if (!m_resources[a].view)
+			throw std::runtime_error("RenderGraph: Imported image '" + m_resources[a].name + "' has not been set.");
+		views.push_back(static_cast<VkImageView>(m_resources[a].view));
+	}
+	auto it = pass.framebuffers.find(views);
+	if (it != pass.framebuffers.end())
+		return it->second;
+	const ResourceNode &first = m_resources[pass.attachments[0]];
+	vk::FramebufferCreateInfo fbCreate;
+	{
+		fbCreate.renderPass = pass.renderPass;
+		fbCreate.attachmentCount = (unsigned int)views.size();
+		fbCreate.pAttachments = reinterpret_cast<const vk::ImageView*>(views.data());
+		fbCreate.width = first.desc.extent.width;
+		fbCreate.height = first.desc.extent.height;
+		fbCreate.layers = 1;//Also 1 for multiview, each view selects its layer
+	}
+	vk::Framebuffer rtn = m_context.Device().createFramebuffer(fbCreate);
+	pass.framebuffers.emplace(views, rtn);
+	return rtn;
+}
+void RenderGraph::recordBarriers(vk::CommandBuffer &cb, const BarrierBatch &batch) const
+{
+	if (batch.empty())
+		return;
+	std::vector<vk::ImageMemoryBarrier> imageBarriers;
+	for (auto &b : batch.images)
+	{
+		const ResourceNode &r = m_resources[b.resource];
+		if (!r.image)
+			throw std::runtime_error("RenderGraph: Imported image '" + r.name + "' has not been set.");
+		vk::ImageMemoryBarrier ib;
+		{
+			ib.oldLayout = b.oldLayout;
+			ib.newLayout = b.newLayout;
+			ib.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			ib.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			ib.image = r.image;
+			ib.subresourceRange.aspectMask = isDepthFormat(r.desc.format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+			ib.subresourceRange.baseMipLevel = 0;
+			ib.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			ib.subresourceRange.baseArrayLayer = 0;
+			ib.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+			ib.srcAccessMask = b.srcAccess;
+			ib.dstAccessMask = b.dstAccess;
+		}
+		imageBarriers.push_back(ib);
+	}
+	vk::MemoryBarrier memoryBarrier;
+	{
+		memoryBarrier.srcAccessMask = batch.bufferSrcAccess;
+		memoryBarrier.dstAccessMask = batch.bufferDstAccess;
+	}
+	const bool hasMemoryBarrier = batch.bufferSrcAccess || batch.bufferDstAccess;
+	cb.pipelineBarrier(
+		batch.srcStages ? batch.srcStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe),
+		batch.dstStages ? batch.dstStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eBottomOfPipe),
+		{},
+		hasMemoryBarrier ? 1 : 0, hasMemoryBarrier ? &memoryBarrier : nullptr,
+		0, nullptr,
+		(unsigned int)imageBarriers.size(), imageBarriers.data());
+}
+/**
+ * Util
+ */
+const vk::RenderPass &RenderGraph::RenderPass(const Pass &pass) const
+{
+	const PassNode &p = m_passes.at(pass);
+	if (!p.renderPass)
+		throw std::runtime_error("RenderGraph: Pass '" + p.name + "' has no render pass (is the graph compiled, or was it culled?).");
+	return p.renderPass;
+}
+const vk::Image &RenderGraph::Image(const Resource &resource) const
+{
+	return m_resources.at(resource).image;
+}
+const vk::ImageView &RenderGraph::ImageView(const Resource &resource) const
+{
+	return m_resources.at(resource).view;
+}
+std::vector<RenderGraph::MergedUsage> RenderGraph::mergeUsages(const PassNode &pass) const
+{
+	std::vector<MergedUsage> rtn;
+	for (auto &u : pass.usages)
+	{
+		const AccessInfo info = accessInfo(u.access, pass.type, u.write);
+		auto it = std::find_if(rtn.begin(), rtn.end(), [&u](const MergedUsage &m) { return m.resource == u.resource; });
+		if (it == rtn.end())
+		{
+			MergedUsage m;
+			{
+				m.resource = u.resource;
+				m.access = u.access;
+				m.info = info;
+				m.write = u.write;
+				m.clear = u.clear;
+				m.clearValue = u.clearValue;
+				m.resolveSource = u.resolveSource;
+			}
+			rtn.push_back(m);
+			continue;
+		}
+		if (m_resources[u.resource].isImage && it->info.layout != info.layout)
+			throw std::runtime_error("RenderGraph: Pass '" + pass.name + "' uses '" + m_resources[u.resource].name + "' in multiple layouts.");
+		it->info.stages |= info.stages;
+		it->info.access |= info.access;
+		it->info.usage |= info.usage;
+		it->write |= u.write;
+		if (u.clear)
+		{
+			it->clear = true;
+			it->clearValue = u.clearValue;
+		}
+	}
+	return rtn;
+}
+RenderGraph::AccessInfo RenderGraph::accessInfo(const Access &access, const PassType &type, const bool &write)
+{
+	vk::PipelineStageFlags shaderStages;
+	if (type == PassType::Compute)
+		shaderStages = vk::PipelineStageFlagBits::eComputeShader;
+	else if (type == PassType::Graphics)
+		shaderStages = vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+	AccessInfo rtn;
+	rtn.layout = vk::ImageLayout::eUndefined;
+	switch (access)
+	{
+	case Access::ColorAttachment:
+		rtn.stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		rtn.access = write ? vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite : vk::AccessFlagBits::eColorAttachmentRead;
+		rtn.layout = vk::ImageLayout::eColorAttachmentOptimal;
+		rtn.usage = vk::ImageUsageFlagBits::eColorAttachment;
+		break;
+	case Access::ResolveAttachment:
+		rtn.stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		rtn.access = vk::AccessFlagBits::eColorAttachmentWrite;
+		rtn.layout = vk::ImageLayout::eColorAttachmentOptimal;
+		rtn.usage = vk::ImageUsageFlagBits::eColorAttachment;
+		break;
+	case Access::DepthAttachment:
+		rtn.stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+		rtn.access = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+		rtn.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+		rtn.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+		break;
+	case Access::DepthReadOnly:
+		rtn.stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+		rtn.access = vk::AccessFlagBits::eDepthStencilAttachmentRead;
+		rtn.layout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+		rtn.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+		break;
+	case Access::Sampled:
+		rtn.stages = shaderStages;
+		rtn.access = vk::AccessFlagBits::eShaderRead;
+		rtn.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+		rtn.usage = vk::ImageUsageFlagBits::eSampled;
+		break;
+	case Access::StorageImage:
+		rtn.stages = shaderStages;
+		rtn.access = write ? vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite : vk::AccessFlagBits::eShaderRead;
+		rtn.layout = vk::ImageLayout::eGeneral;
+		rtn.usage = vk::ImageUsageFlagBits::eStorage;
+		break;
+	case Access::TransferSrc:
+		rtn.stages = vk::PipelineStageFlagBits::eTransfer;
+		rtn.access = vk::AccessFlagBits::eTransferRead;
+		rtn.layout = vk::ImageLayout::eTransferSrcOptimal;
+		rtn.usage = vk::ImageUsageFlagBits::eTransferSrc;
+		break;
+	case Access::TransferDst:
+		rtn.stages = vk::PipelineStageFlagBits::eTransfer;
+		rtn.access = vk::AccessFlagBits::eTransferWrite;
+		rtn.layout = vk::ImageLayout::eTransferDstOptimal;
+		rtn.usage = vk::ImageUsageFlagBits::eTransferDst;
+		break;
+	case Access::VertexBuffer:
+		rtn.stages = vk::PipelineStageFlagBits::eVertexInput;
+		rtn.access = vk::AccessFlagBits::eVertexAttributeRead;
+		break;
+	case Access::IndexBuffer:
+		rtn.stages = vk::PipelineStageFlagBits::eVertexInput;
+		rtn.access = vk::AccessFlagBits::eIndexRead;
+		break;
+	case Access::IndirectBuffer:
+		rtn.stages = vk::PipelineStageFlagBits::eDrawIndirect;
+		rtn.access = vk::AccessFlagBits::eIndirectCommandRead;
+		break;
+	case Access::UniformBuffer:
+		rtn.stages = shaderStages;
+		rtn.access = vk::AccessFlagBits::eUniformRead;
+		break;
+	case Access::StorageBuffer:
+		rtn.stages = shaderStages;
+		rtn.access = write ? vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite : vk::AccessFlagBits::eShaderRead;
+		break;
+	case Access::TransferSrcBuffer:
+		rtn.stages = vk::PipelineStageFlagBits::eTransfer;
+		rtn.access = vk::AccessFlagBits::eTransferRead;
+		break;
+	case Access::TransferDstBuffer:
+		rtn.stages = vk::PipelineStageFlagBits::eTransfer;
+		rtn.access = vk::AccessFlagBits::eTransferWrite;
+		break;
+	}
+	if (!rtn.stages)
+		throw std::exception("RenderGraph: Shader access is not valid within a transfer pass.");
+	return rtn;
+}
+bool RenderGraph::isDepthFormat(const vk::Format &format)
+{
+	return format == vk::Format::eD16Unorm || format == vk::Format::eD32Sfloat || format == vk::Format::eD16UnormS8Uint
+		|| format == vk::Format::eD24UnormS8Uint || format == vk::Format::eD32SfloatS8Uint || format == vk::Format::eX8D24UnormPack32;
+}
+void RenderGraph::printSchedule() const
+{
+	printf("Render graph: %u passes (%u culled), %u barrier batches, %u barriers, %u elided\n",
+		m_stats.passes, m_stats.culledPasses, m_stats.barrierBatches, m_stats.barriers, m_stats.elidedBarriers);
+	for (size_t s = 0; s < m_schedule.size(); ++s)
+	{
+		const PassNode &p = m_passes[m_schedule[s]];
+		printf("\t%u: %s", (unsigned int)s, p.name.c_str());
+		if (p.viewMask)
+			printf(" (view mask 0x%x)", p.viewMask);
+		if (!m_passBarriers[s].empty())
+			printf(" [%u image barriers%s]", (unsigned int)m_passBarriers[s].images.size(), (m_passBarriers[s].bufferSrcAccess || m_passBarriers[s].bufferDstAccess) ? " + memory barrier" : "");
+		printf("\n");
+	}
+	for (auto &p : m_passes)
+	{
+		if (p.culled)
+			printf("\tculled: %s\n", p.name.c_str());
+	}
+	printf("\tTransient images: %u (%u aliased, %u lazily allocated), %.1fMB allocated vs %.1fMB unaliased\n",
+		m_stats.transientImages, m_stats.aliasedImages, m_stats.lazyImages, m_stats.transientBytes / (1024.0 * 1024.0), m_stats.unaliasedBytes / (1024.0 * 1024.0));
+}
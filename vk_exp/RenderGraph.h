@@ -0,0 +1,237 @@
+#ifndef __RenderGraph_h__
+#define __RenderGraph_h__
+#include <vector>
+#include <string>
+#include <map>
+#include <functional>
+#include <vulkan/vulkan.hpp>
+class Context;
+
+/**
+ * Frame graph of passes and the resources they read/write
+ * Passes are declared in execution order with their resource usages, compile() then:
+ *  - Culls passes whose outputs are never consumed
+ *  - Plans the barriers/layout transitions between passes, merging each pass's barriers into a single
+ *    vkCmdPipelineBarrier and eliding those which are redundant (e.g. read after read in the same layout)
+ *  - Creates transient images, aliasing the memory of those whose lifetimes don't overlap
+ *    Attachments used by a single pass are created as transient attachments in lazily allocated memory where available
+ *  - Creates a render pass for each graphics pass, without subpass dependencies as the graph's barriers
+ *    perform all synchronisation (attachments are already in their subpass layout at vkCmdBeginRenderPass)
+ * execute() then records the passes with their barriers into a command buffer
+ * Graphics passes are recorded with the viewport and scissor covering their render area, so pipelines must declare them dynamic
+ * Any change to the declared graph requires compile() to be called again
+ */
+class RenderGraph
+{
+public:
+	typedef unsigned int Resource;
+	typedef unsigned int Pass;
+	typedef std::function<void(vk::CommandBuffer &cb)> RecordFn;
+	enum class Access
+	{
+		//Images
+		ColorAttachment,
+		ResolveAttachment,//Destination of a multisample resolve, see resolve()
+		DepthAttachment,
+		DepthReadOnly,//Depth test without writes
+		Sampled,
+		StorageImage,
+		TransferSrc,
+		TransferDst,
+		//Buffers
+		VertexBuffer,
+		IndexBuffer,
+		IndirectBuffer,
+		UniformBuffer,
+		StorageBuffer,
+		TransferSrcBuffer,
+		TransferDstBuffer
+	};
+	enum class PassType { Graphics, Compute, Transfer };
+	struct ImageDesc
+	{
+		ImageDesc(const vk::Format &format = vk::Format::eUndefined, const vk::Extent2D &extent = vk::Extent2D(), const vk::SampleCountFlagBits &samples = vk::SampleCountFlagBits::e1, const uint32_t &layers = 1)
+			: format(format), extent(extent), samples(samples), layers(layers) { }
+		vk::Format format;
+		vk::Extent2D extent;
+		vk::SampleCountFlagBits samples;
+		uint32_t layers;//Array layers, the view of transient images with multiple layers is e2DArray
+	};
+	struct Stats
+	{
+		unsigned int passes;
+		unsigned int culledPasses;
+		unsigned int barrierBatches;//vkCmdPipelineBarrier calls per frame
+		unsigned int barriers;//Image/memory barriers per frame
+		unsigned int elidedBarriers;//Usages which required no barrier
+		unsigned int transientImages;
+		unsigned int lazyImages;//Transient attachments, which may never be backed by memory on tiled GPUs
+		unsigned int aliasedImages;//Transient images sharing memory with another
+		vk::DeviceSize transientBytes;//Memory allocated for transient images
+		vk::DeviceSize unaliasedBytes;//Memory that would be required without aliasing
+	};
+	RenderGraph(Context &ctx);
+	~RenderGraph();
+	/**
+	 * Declares an externally owned image, set the vk::Image/vk::ImageView with setImportedImage() before execute()
+	 * @param initialLayout Layout of the image at the start of the graph
+	 * @param initialStages Stages the graph must wait on before first accessing the image
+	 *        (e.g. eColorAttachmentOutput for a swapchain image acquired with a semaphore wait at that stage)
+	 * @param finalLayout Layout the image is transitioned to at the end of the graph
+	 */
+	Resource importImage(const std::string &name, const ImageDesc &desc, const vk::ImageLayout &initialLayout, const vk::PipelineStageFlags &initialStages, const vk::ImageLayout &finalLayout);
+	void setImportedImage(const Resource &resource, const vk::Image &image, const vk::ImageView &view);
+	/**
+	 * Declares an externally owned buffer, buffers are synchronised with global memory barriers
+	 */
+	Resource importBuffer(const std::string &name, const vk::Buffer &buffer);
+	/**
+	 * Declares an image created by the graph, contents do not persist between frames
+	 */
+	Resource createImage(const std::string &name, const ImageDesc &desc);
+	/**
+	 * Passes execute in the order they are added
+	 * @param record Records the pass's commands, graphics passes are recorded within their render pass
+	 */
+	Pass addPass(const std::string &name, const PassType &type, RecordFn record);
+	void read(const Pass &pass, const Resource &resource, const Access &access);
+	void write(const Pass &pass, const Resource &resource, const Access &access);
+	/**
+	 * Attachment write whose previous contents are discarded and cleared at the start of the render pass
+	 */
+	void clear(const Pass &pass, const Resource &resource, const Access &access, const vk::ClearValue &value);
+	/**
+	 * Resolves a multisample colour attachment of a graphics pass into destination at the end of the pass
+	 * source must also be declared as a colour attachment of the pass, destination's previous contents are discarded
+	 */
+	void resolve(const Pass &pass, const Resource &source, const Resource &destination);
+	/**
+	 * Renders a graphics pass once per bit of viewMask with VK_KHR_multiview, each view writing the matching layer of every attachment
+	 * Shaders select per view data with gl_ViewIndex, attachments require more layers than the highest set bit
+	 * The multiview feature must be enabled on the device
+	 */
+	void setViewMask(const Pass &pass, const uint32_t &viewMask);
+	/**
+	 * Restricts a graphics pass to the top-left extent of its attachments (e.g. for dynamic resolution), the rest is left untouched
+	 * Takes effect at the next execute() without recompiling, an empty extent renders the full attachments
+	 */
+	void setRenderArea(const Pass &pass, const vk::Extent2D &extent);
+	/**
+	 * Marks a pass as having side effects outside the graph, so it is never culled
+	 */
+	void keepAlive(const Pass &pass);
+	void compile();
+	void execute(vk::CommandBuffer &cb);
+	/**
+	 * Render pass used by a graphics pass, for creating compatible pipelines
+	 */
+	const vk::RenderPass &RenderPass(const Pass &pass) const;
+	const vk::Image &Image(const Resource &resource) const;
+	const vk::ImageView &ImageView(const Resource &resource) const;
+	const Stats &getStats() const { return m_stats; }
+	void printSchedule() const;
+private:
+	struct ResourceNode
+	{
+		std::string name;
+		bool isImage;
+		bool imported;
+		ImageDesc desc;
+		vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined;
+		vk::PipelineStageFlags initialStages;
+		vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+		vk::Image image;
+		vk::ImageView view;
+		vk::Buffer buffer;
+		vk::ImageUsageFlags usage;//Accumulated from accesses (transient only)
+		int firstPass = -1, lastPass = -1;//Lifetime within the schedule
+		int memorySlot = -1;//Transient only
+	};
+	struct UsageNode
+	{
+		Resource resource;
+		Access access;
+		bool write;
+		bool clear;
+		vk::ClearValue clearValue;
+		Resource resolveSource = 0;//ResolveAttachment only
+	};
+	struct PassNode
+	{
+		std::string name;
+		PassType type;
+		RecordFn record;
+		std::vector<UsageNode> usages;
+		bool keepAlive = false;
+		bool culled = false;
+		uint32_t viewMask = 0;//Multiview, 0 if disabled
+		vk::Extent2D renderArea;//Empty for the full attachment extent
+		//Compiled
+		vk::RenderPass renderPass;
+		std::vector<Resource> attachments;
+		std::vector<vk::ClearValue> clearValues;
+		std::map<std::vector<VkImageView>, vk::Framebuffer> framebuffers;
+	};
+	struct PlannedBarrier
+	{
+		Resource resource;
+		vk::ImageLayout oldLayout, newLayout;
+		vk::AccessFlags srcAccess, dstAccess;
+	};
+	struct BarrierBatch
+	{
+		vk::PipelineStageFlags srcStages, dstStages;
+		std::vector<PlannedBarrier> images;
+		vk::AccessFlags bufferSrcAccess, bufferDstAccess;//Merged into one vk::MemoryBarrier
+		bool empty() const { return images.empty() && !bufferSrcAccess && !bufferDstAccess && !srcStages; }
+	};
+	struct MemorySlot
+	{
+		vk::MemoryRequirements requirements;
+		vk::DeviceMemory memory;
+		std::vector<Resource> resources;
+	};
+	struct AccessInfo
+	{
+		vk::PipelineStageFlags stages;
+		vk::AccessFlags access;
+		vk::ImageLayout layout;
+		vk::ImageUsageFlags usage;
+	};
+	struct MergedUsage
+	{
+		Resource resource;
+		Access access;
+		AccessInfo info;
+		bool write;
+		bool clear;
+		vk::ClearValue clearValue;
+		Resource resolveSource = 0;
+	};
+	static AccessInfo accessInfo(const Access &access, const PassType &type, const bool &write);
+	/**
+	 * Combines multiple usages of the same resource within a pass, in order of first use
+	 * @throws std::runtime_error If a pass uses an image in two different layouts
+	 */
+	std::vector<MergedUsage> mergeUsages(const PassNode &pass) const;
+	static bool isDepthFormat(const vk::Format &format);
+	void destroyCompiled();
+	void cullPasses();
+	void createTransientImages();
+	void planBarriers();
+	void createRenderPass(PassNode &pass);
+	vk::Framebuffer getFramebuffer(PassNode &pass);
+	void recordBarriers(vk::CommandBuffer &cb, const BarrierBatch &batch) const;
+
+	Context &m_context;
+	std::vector<ResourceNode> m_resources;
+	std::vector<PassNode> m_passes;
+	std::vector<Pass> m_schedule;
+	std::vector<BarrierBatch> m_passBarriers;//Parallel to m_schedule
+	BarrierBatch m_finalBarriers;//Transitions imported images to their final layout
+	std::vector<MemorySlot> m_memorySlots;
+	bool m_compiled = false;
+	Stats m_stats;
+};
+
+#endif //__RenderGraph_h__
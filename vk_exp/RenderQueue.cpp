@@ -0,0 +1,189 @@
+#include "RenderQueue.h"
+#include <array>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+namespace
+{
+	typedef std::array<size_t, 256> Histogram;
+	/**
+	 * Runs fn(chunk, begin, end) over [0, n) split into chunks, chunk 0 runs on the calling thread
+	 */
+	template<typename Fn>
+	void forEachChunk(const unsigned int &chunks, const size_t &n, Fn fn)
+	{
+		if (chunks == 1)
+		{
+			fn(0u, (size_t)0, n);
+			return;
+		}
+		std::vector<std::future<void>> workers;
+		const size_t chunkSize = (n + chunks - 1) / chunks;
+		for (unsigned int c = 1; c < chunks; ++c)
+		{
+			const size_t begin = std::min(n, c * chunkSize);
+			const size_t end = std::min(n, begin + chunkSize);
+			workers.push_back(std::async(std::launch::async, fn, c, begin, end));
+		}
+		fn(0u, (size_t)0, std::min(n, chunkSize));
+		for (auto &w : workers)
+			w.get();
+	}
+}
+
+void RenderQueue::clear()
+{
+	m_lastStats = m_stats;
+	m_stats = Stats();
+	m_draws.clear();
+	m_entries.clear();
+	m_pipelineIds.clear();
+	m_materialIds.clear();
+	m_sorted = false;
+}
+uint32_t RenderQueue::depthBits(const float &viewDepth)
+{
+	//Positive IEEE floats order the same as their bit patterns, keep the top 24 bits (exponent + 15 bits of mantissa)
+	const float d = viewDepth > 0 ? viewDepth : 0.0f;
+	uint32_t bits;
+	memcpy(&bits, &d, sizeof(float));
+	return bits >> 8;
+}
+void RenderQueue::submit(const unsigned int &pass, const Draw &draw, const float &viewDepth, const bool &transparent)
+{
+	if (pass >= MaxPasses)
+		throw std::exception("RenderQueue: Pass id exceeds the 4 bits of the sort key.");
+	//Ids are dense, so only need enough bits for the number of distinct pipelines/sets this frame
+	const uint64_t pipeline = m_pipelineIds.emplace(draw.pipeline, (uint32_t)m_pipelineIds.size()).first->second;
+	const uint64_t material = m_materialIds.emplace(static_cast<VkDescriptorSet>(draw.descriptorSet), (uint32_t)m_materialIds.size()).first->second;
+	if (pipeline >= MaxPipelines || material >= MaxMaterials)
+		throw std::exception("RenderQueue: Too many distinct pipelines or descriptor sets in one frame.");
+	const uint64_t depth = depthBits(viewDepth);
+	SortKey key = (uint64_t)pass << 60;
+	if (!transparent)
+	{
+		key |= pipeline << 48 | material << 32 | depth << 8;
+	}
+	else
+	{
+		key |= 1ull << 59;
+		key |= (~depth & 0xFFFFFF) << 35 | pipeline << 24 | material << 8;
+	}
+	m_entries.push_back({ key, (uint32_t)m_draws.size() });
+	m_draws.push_back(draw);
+	m_sorted = false;
+}
+void RenderQueue::sort()
+{
+	auto start = std::chrono::steady_clock::now();
+	radixSort();
+	m_stats.sortMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	m_sorted = true;
+}
+void RenderQueue::radixSort()
+{
+	//LSD radix sort, 8 bits per pass, stable so equal keys retain submission order
+	const size_t n = m_entries.size();
+	if (n < 2)
+		return;
+	m_scratch.resize(n);
+	const unsigned int hwThreads = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned int chunks = n < ParallelThreshold ? 1 : (unsigned int)std::min<size_t>(hwThreads, n / (ParallelThreshold / 4));
+	std::vector<Histogram> hist(chunks);
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		const std::vector<Entry> &src = m_entries;
+		forEachChunk(chunks, n, [&](unsigned int c, size_t begin, size_t end)
+		{
+			hist[c].fill(0);
+			for (size_t i = begin; i < end; ++i)
+				++hist[c][(src[i].key >> shift) & 0xFF];
+		});
+		//If every key shares this digit the pass would not move anything
+		bool trivial = false;
+		for (unsigned int d = 0; d < 256 && !trivial; ++d)
+		{
+			size_t total = 0;
+			for (unsigned int c = 0; c < chunks; ++c)
+				total += hist[c][d];
+			trivial = total == n;
+		}
+		if (trivial)
+			continue;
+		//Exclusive prefix sum ordered by digit then chunk, so each chunk scatters into its own ranges
+		size_t offset = 0;
+		for (unsigned int d = 0; d < 256; ++d)
+			for (unsigned int c = 0; c < chunks; ++c)
+			{
+				const size_t count = hist[c][d];
+				hist[c][d] = offset;
+				offset += count;
+			}
+		std::vector<Entry> &dst = m_scratch;
+		forEachChunk(chunks, n, [&](unsigned int c, size_t begin, size_t end)
+		{
+			Histogram &h = hist[c];
+			for (size_t i = begin; i < end; ++i)
+				dst[h[(src[i].key >> shift) & 0xFF]++] = src[i];
+		});
+		std::swap(m_entries, m_scratch);
+		++m_stats.radixPasses;
+	}
+}
+void RenderQueue::record(vk::CommandBuffer &cb, const unsigned int &pass)
+{
+	if (!m_sorted)
+		throw std::exception("RenderQueue: sort() must be called before record().");
+	//Entries are sorted by pass first, so the pass is a contiguous range
+	const SortKey passKey = (uint64_t)pass << 60;
+	auto begin = std::lower_bound(m_entries.begin(), m_entries.end(), passKey, [](const Entry &e, const SortKey &k) { return e.key < k; });
+	const GraphicsPipeline *pipeline = nullptr;
+	vk::PipelineLayout layout;
+	vk::DescriptorSet descriptorSet;
+	vk::Buffer vertexBuffer, indexBuffer;
+	for (auto it = begin; it != m_entries.end() && (it->key >> 60) == pass; ++it)
+	{
+		const Draw &d = m_draws[it->draw];
+		if (d.pipeline != pipeline)
+		{
+			cb.bindPipeline(vk::PipelineBindPoint::eGraphics, d.pipeline->Pipeline());
+			pipeline = d.pipeline;
+			++m_stats.pipelineBinds;
+		}
+		//Layouts are shared via LayoutCache, so bound sets remain valid across pipelines with the same layout
+		if (d.descriptorSet != descriptorSet || pipeline->PipelineLayout() != layout)
+		{
+			cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline->PipelineLayout(), 0, { d.descriptorSet }, {});
+			descriptorSet = d.descriptorSet;
+			layout = pipeline->PipelineLayout();
+			++m_stats.descriptorSetBinds;
+		}
+		if (d.vertexBuffer != vertexBuffer)
+		{
+			VkDeviceSize offsets[] = { 0 };
+			cb.bindVertexBuffers(0, 1, &d.vertexBuffer, offsets);
+			vertexBuffer = d.vertexBuffer;
+			++m_stats.vertexBufferBinds;
+		}
+		if (d.indexBuffer != indexBuffer)
+		{
+			cb.bindIndexBuffer(d.indexBuffer, 0, vk::IndexType::eUint16);
+			indexBuffer = d.indexBuffer;
+			++m_stats.indexBufferBinds;
+		}
+		cb.pushConstants(pipeline->PipelineLayout(), vk::ShaderStageFlagBits::eVertex, 0, DrawConstants::Size, &d.constants);
+		cb.drawIndexed(d.indexCount, 1, d.firstIndex, 0, 0);
+		++m_stats.draws;
+	}
+}
+void RenderQueue::printStats() const
+{
+	const Stats &s = m_lastStats;
+	printf("Render queue: %u draws, %u pipeline binds, %u descriptor set binds, %u vertex buffer binds, %u index buffer binds\n",
+		s.draws, s.pipelineBinds, s.descriptorSetBinds, s.vertexBufferBinds, s.indexBufferBinds);
+	printf("              sorted in %.3fms (%u radix passes)\n", s.sortMs, s.radixPasses);
+}
@@ -0,0 +1,85 @@
+#ifndef __RenderQueue_h__
+#define __RenderQueue_h__
+#include <vector>
+#include <map>
+#include <vulkan/vulkan.hpp>
+#include "GraphicsPipeline.h"
+
+/**
+ * Collects a frame's draws with 64-bit sort keys, which are radix sorted (in parallel for large queues) before recording
+ * Key layout, most significant bits first:
+ *  Opaque:      pass(4) | 0 | pipeline(11) | material(16) | depth(24)          | unused(8)
+ *  Transparent: pass(4) | 1 | inverse depth(24)           | pipeline(11) | material(16) | unused(8)
+ * So within each pass, opaque draws are grouped by pipeline then descriptor set and front to back within a group,
+ * followed by transparent draws back to front
+ * Pipeline and material ids are assigned in submission order each frame
+ * Not thread-safe
+ */
+class RenderQueue
+{
+public:
+	typedef uint64_t SortKey;
+	struct Draw
+	{
+		const GraphicsPipeline *pipeline;
+		vk::DescriptorSet descriptorSet;//Set 0, the material
+		vk::Buffer vertexBuffer;
+		vk::Buffer indexBuffer;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		DrawConstants constants;//Pushed per draw
+	};
+	struct Stats
+	{
+		unsigned int draws;
+		unsigned int pipelineBinds;
+		unsigned int descriptorSetBinds;
+		unsigned int vertexBufferBinds;
+		unsigned int indexBufferBinds;
+		unsigned int radixPasses;//Digit passes performed, constant digits are skipped
+		double sortMs;
+	};
+	static const unsigned int MaxPasses = 16;
+	static const unsigned int MaxPipelines = 2048;
+	static const unsigned int MaxMaterials = 65536;
+	/**
+	 * Starts a new frame, the previous frame's stats become available from getStats()
+	 */
+	void clear();
+	/**
+	 * @param pass Draws are recorded per pass, see record()
+	 * @param viewDepth Distance from the camera along the view direction, used to order draws
+	 */
+	void submit(const unsigned int &pass, const Draw &draw, const float &viewDepth, const bool &transparent);
+	void sort();
+	/**
+	 * Records the sorted draws of a pass, binding state only when it differs from the previous draw
+	 */
+	void record(vk::CommandBuffer &cb, const unsigned int &pass);
+	size_t size() const { return m_draws.size(); }
+	/**
+	 * Stats of the most recently completed frame
+	 */
+	const Stats &getStats() const { return m_lastStats; }
+	void printStats() const;
+private:
+	struct Entry
+	{
+		SortKey key;
+		uint32_t draw;//Index into m_draws
+	};
+	//Queues smaller than this are sorted on the calling thread
+	static const size_t ParallelThreshold = 16384;
+	static uint32_t depthBits(const float &viewDepth);
+	void radixSort();
+	std::vector<Draw> m_draws;
+	std::vector<Entry> m_entries;
+	std::vector<Entry> m_scratch;
+	std::map<const GraphicsPipeline*, uint32_t> m_pipelineIds;
+	std::map<VkDescriptorSet, uint32_t> m_materialIds;
+	bool m_sorted = false;
+	Stats m_stats = Stats();
+	Stats m_lastStats = Stats();
+};
+
+#endif //__RenderQueue_h__
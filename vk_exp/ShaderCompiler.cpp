@@ -0,0 +1,240 @@
+#include "ShaderCompiler.h"
+#include "Hash.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+#include <direct.h>
+#define MKDIR(a) _mkdir(a)
+#else
+#include <sys/stat.h>
+#define MKDIR(a) mkdir(a, 0755)
+#endif
+
+//Bump this if the compiler configuration changes in a way not captured by Options, to invalidate old cache files
+#define SHADER_CACHE_VERSION 1
+
+ShaderCompiler::ShaderCompiler(const std::string &cacheDir, unsigned int workerCount)
+	: m_cacheDir(cacheDir)
+	, m_cacheHits(0)
+	, m_cacheMisses(0)
+{
+	MKDIR(m_cacheDir.c_str());//Fails harmlessly if it already exists
+	if (workerCount == 0)
+		workerCount = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+	for (unsigned int i = 0; i < workerCount; ++i)
+		m_workers.push_back(std::thread(&ShaderCompiler::workerLoop, this));
+}
+ShaderCompiler::~ShaderCompiler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_jobsMutex);
+		m_stop = true;
+	}
+	m_jobsCV.notify_all();
+	for (auto &w : m_workers)
+		w.join();
+	m_workers.clear();
+}
+std::shared_future<std::vector<uint32_t>> ShaderCompiler::compileAsync(const std::string &path, const Options &options)
+{
+	//Precompiled SPIR-V is passed straight through
+	if (path.size() > 4 && path.compare(path.size() - 4, 4, ".spv") == 0)
+	{
+		std::promise<std::vector<uint32_t>> p;
+		try
+		{
+			auto bytes = readFile(path);
+			std::vector<uint32_t> spirv(bytes.size() / sizeof(uint32_t));
+			memcpy(spirv.data(), bytes.data(), spirv.size() * sizeof(uint32_t));
+			p.set_value(std::move(spirv));
+		}
+		catch (...)
+		{
+			p.set_exception(std::current_exception());
+		}
+		return p.get_future().share();
+	}
+	std::vector<char> src;
+	try
+	{
+		src = readFile(path);
+	}
+	catch (...)
+	{//Reported through the future, like compile errors
+		std::promise<std::vector<uint32_t>> p;
+		p.set_exception(std::current_exception());
+		return p.get_future().share();
+	}
+	Job job;
+	{
+		job.path = path;
+		job.source = std::string(src.begin(), src.end());
+		job.kind = detectKind(path);
+		job.options = options;
+		job.hash = hash(job.source, job.kind, options);
+		job.promise = std::make_shared<std::promise<std::vector<uint32_t>>>();
+	}
+	std::shared_future<std::vector<uint32_t>> rtn;
+	{
+		std::lock_guard<std::mutex> lock(m_jobsMutex);
+		auto it = m_inFlight.find(job.hash);
+		if (it != m_inFlight.end())
+			return it->second;
+		rtn = job.promise->get_future().share();
+		m_inFlight.emplace(job.hash, rtn);
+		m_jobs.push(std::move(job));
+	}
+	m_jobsCV.notify_one();
+	return rtn;
+}
+void ShaderCompiler::workerLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_jobsMutex);
+			m_jobsCV.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+			if (m_stop && m_jobs.empty())
+				return;
+			job = std::move(m_jobs.front());
+			m_jobs.pop();
+		}
+		try
+		{
+			job.promise->set_value(runJob(job));
+		}
+		catch (...)
+		{
+			job.promise->set_exception(std::current_exception());
+		}
+		std::lock_guard<std::mutex> lock(m_jobsMutex);
+		m_inFlight.erase(job.hash);
+	}
+}
+std::vector<uint32_t> ShaderCompiler::runJob(const Job &job)
+{
+	std::vector<uint32_t> spirv;
+	if (loadCached(job.hash, spirv))
+	{
+		m_cacheHits++;
+		return spirv;
+	}
+	m_cacheMisses++;
+	shaderc::CompileOptions compileOptions;
+	{
+		for (auto &d : job.options.defines)
+			compileOptions.AddMacroDefinition(d.first, d.second);
+		compileOptions.SetOptimizationLevel(job.options.optimise ? shaderc_optimization_level_performance : shaderc_optimization_level_zero);
+		if (job.options.debugInfo)
+			compileOptions.SetGenerateDebugInfo();
+		compileOptions.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+	}
+	shaderc::SpvCompilationResult result = m_compiler.CompileGlslToSpv(job.source, job.kind, job.path.c_str(), compileOptions);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+	{
+		throw std::runtime_error(result.GetErrorMessage());
+	}
+	spirv.assign(result.cbegin(), result.cend());
+	storeCached(job.hash, spirv);
+	printf("Compiled shader '%s'.\n", job.path.c_str());
+	return spirv;
+}
+std::vector<char> ShaderCompiler::readFile(const std::string &path)
+{
+	std::ifstream f(path, std::ios::binary | std::ios::ate);
+
+	if (!f.is_open()) {
+		throw std::runtime_error("Failed to open shader file '" + path + "'!");
+	}
+
+	size_t fileSize = (size_t)f.tellg();
+	std::vector<char> buffer(fileSize);
+
+	f.seekg(0);
+	f.read(buffer.data(), fileSize);
+
+	f.close();
+	return buffer;
+}
+shaderc_shader_kind ShaderCompiler::detectKind(const std::string &path)
+{
+	static const std::pair<const char*, shaderc_shader_kind> KINDS[] = {
+		{ ".vert", shaderc_vertex_shader },
+		{ ".frag", shaderc_fragment_shader },
+		{ ".comp", shaderc_compute_shader },
+		{ ".geom", shaderc_geometry_shader },
+		{ ".tesc", shaderc_tess_control_shader },
+		{ ".tese", shaderc_tess_evaluation_shader },
+	};
+	for (auto &k : KINDS)
+	{
+		const size_t len = strlen(k.first);
+		if (path.size() > len && path.compare(path.size() - len, len, k.first) == 0)
+			return k.second;
+	}
+	//Let shaderc read '#pragma shader_stage()' from the source
+	return shaderc_glsl_infer_from_source;
+}
+uint64_t ShaderCompiler::hash(const std::string &source, const shaderc_shader_kind &kind, const Options &options)
+{
+	Hash h;
+	const unsigned int version = SHADER_CACHE_VERSION;
+	h.mix(&version, sizeof(version));
+	h.mix(&kind, sizeof(kind));
+	h.mix(source.data(), source.size());
+	for (auto &d : options.defines)
+	{
+		//Include terminators so ("AB","C") and ("A","BC") differ
+		h.mix(d.first.c_str(), d.first.size() + 1);
+		h.mix(d.second.c_str(), d.second.size() + 1);
+	}
+	const unsigned char flags = (options.optimise ? 1 : 0) | (options.debugInfo ? 2 : 0);
+	h.mix(&flags, sizeof(flags));
+	return h.value();
+}
+std::string ShaderCompiler::cacheFilepath(const uint64_t &hash) const
+{
+	std::ostringstream cachepath;
+	cachepath << m_cacheDir;
+	cachepath << "/";
+	cachepath << std::hex << std::setw(16) << std::setfill('0') << hash;
+	cachepath << ".spv";
+	return cachepath.str();
+}
+bool ShaderCompiler::loadCached(const uint64_t &hash, std::vector<uint32_t> &spirv) const
+{
+	std::ifstream f(cacheFilepath(hash), std::ios::binary | std::ios::ate);
+	if (!f.is_open())
+		return false;
+	size_t fileSize = (size_t)f.tellg();
+	if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0)
+		return false;
+	spirv.resize(fileSize / sizeof(uint32_t));
+	f.seekg(0);
+	f.read(reinterpret_cast<char*>(spirv.data()), fileSize);
+	//Reject truncated/foreign files, first word must be the SPIR-V magic number
+	return f.good() && spirv[0] == 0x07230203;
+}
+void ShaderCompiler::storeCached(const uint64_t &hash, const std::vector<uint32_t> &spirv) const
+{
+	//Write to a temporary then rename, so a reader never sees a partially written file
+	const std::string cachepath = cacheFilepath(hash);
+	const std::string tmppath = cachepath + ".tmp";
+	{
+		std::ofstream f(tmppath, std::ios::binary | std::ios::trunc);
+		if (!f.is_open())
+		{
+			fprintf(stderr, "Failed to open file '%s' to update shader cache.\n", tmppath.c_str());
+			return;
+		}
+		f.write(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+	}
+	std::remove(cachepath.c_str());
+	if (std::rename(tmppath.c_str(), cachepath.c_str()) != 0)
+		std::remove(tmppath.c_str());
+}
@@ -0,0 +1,81 @@
+#ifndef __ShaderCompiler_h__
+#define __ShaderCompiler_h__
+#include <vector>
+#include <string>
+#include <queue>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <condition_variable>
+#include <shaderc/shaderc.hpp>
+
+/**
+ * In-process GLSL to SPIR-V compiler service (links against shaderc from the Vulkan SDK)
+ * Compiled SPIR-V is stored in an on-disk cache keyed by a hash of the source, defines and compiler options
+ * so warm starts only read the cached binary
+ * Compilation is performed by a small pool of worker threads
+ * Note: #include'd files are not resolved, and hence do not contribute to the cache key
+ */
+class ShaderCompiler
+{
+public:
+	struct Options
+	{
+		Options() : optimise(true), debugInfo(false) { }
+		std::vector<std::pair<std::string, std::string>> defines;
+		bool optimise;
+		bool debugInfo;
+	};
+	/**
+	 * @param cacheDir Directory compiled SPIR-V is stored within, created if missing
+	 * @param workerCount Number of compile threads, 0 selects based on hardware concurrency
+	 */
+	ShaderCompiler(const std::string &cacheDir, unsigned int workerCount = 0);
+	~ShaderCompiler();
+	/**
+	 * Queue a shader for compilation, the stage is detected from the file extension (.vert, .frag, .comp etc)
+	 * Paths ending .spv are loaded directly without compilation
+	 * Read and compile errors are thrown as std::runtime_error when the future is accessed, never by this call
+	 */
+	std::shared_future<std::vector<uint32_t>> compileAsync(const std::string &path, const Options &options = Options());
+	/**
+	 * Blocking version of compileAsync()
+	 */
+	std::vector<uint32_t> compile(const std::string &path, const Options &options = Options()) { return compileAsync(path, options).get(); }
+	unsigned int CacheHits() const { return m_cacheHits.load(); }
+	unsigned int CacheMisses() const { return m_cacheMisses.load(); }
+	static std::vector<char> readFile(const std::string &path);
+private:
+	struct Job
+	{
+		std::string path;
+		std::string source;
+		shaderc_shader_kind kind;
+		Options options;
+		uint64_t hash;
+		std::shared_ptr<std::promise<std::vector<uint32_t>>> promise;
+	};
+	void workerLoop();
+	std::vector<uint32_t> runJob(const Job &job);
+	static shaderc_shader_kind detectKind(const std::string &path);
+	static uint64_t hash(const std::string &source, const shaderc_shader_kind &kind, const Options &options);
+	std::string cacheFilepath(const uint64_t &hash) const;
+	bool loadCached(const uint64_t &hash, std::vector<uint32_t> &spirv) const;
+	void storeCached(const uint64_t &hash, const std::vector<uint32_t> &spirv) const;
+
+	const std::string m_cacheDir;
+	shaderc::Compiler m_compiler;//Thread-safe for concurrent compilation
+	std::vector<std::thread> m_workers;
+	std::queue<Job> m_jobs;
+	//Jobs currently queued/compiling, so concurrent requests for the same shader share a result
+	std::map<uint64_t, std::shared_future<std::vector<uint32_t>>> m_inFlight;
+	std::mutex m_jobsMutex;
+	std::condition_variable m_jobsCV;
+	bool m_stop = false;
+	std::atomic<unsigned int> m_cacheHits;
+	std::atomic<unsigned int> m_cacheMisses;
+};
+
+#endif //__ShaderCompiler_h__
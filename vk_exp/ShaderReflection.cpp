@@ -0,0 +1,429 @@
+#include "ShaderReflection.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	//Subset of spirv.h, to avoid depending on SPIRV-Headers
+	const uint32_t SpvMagicNumber = 0x07230203;
+	enum SpvOp
+	{
+		OpName = 5,
+		OpMemberName = 6,
+		OpEntryPoint = 15,
+		OpExecutionMode = 16,
+		OpTypeBool = 20,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpSpecConstantTrue = 48,
+		OpSpecConstantFalse = 49,
+		OpSpecConstant = 50,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72,
+	};
+	enum SpvExecutionMode
+	{
+		ExecutionModeLocalSize = 17,
+	};
+	enum SpvDecoration
+	{
+		DecorationSpecId = 1,
+		DecorationBlock = 2,
+		DecorationBufferBlock = 3,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBuiltIn = 11,
+		DecorationLocation = 30,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35,
+	};
+	enum SpvStorageClass
+	{
+		StorageClassUniformConstant = 0,
+		StorageClassInput = 1,
+		StorageClassUniform = 2,
+		StorageClassPushConstant = 9,
+		StorageClassStorageBuffer = 12,
+	};
+	enum SpvDim
+	{
+		DimBuffer = 5,
+		DimSubpassData = 6,
+	};
+	const uint32_t NONE = UINT32_MAX;
+	struct Id
+	{
+		uint32_t opcode = 0;
+		//Type info
+		uint32_t typeId = NONE;//Component/element/pointee/image type
+		uint32_t width = 0;//Scalar bit width, vector/matrix count, constant value or storage class
+		uint32_t arrayLength = NONE;//Id of array length constant
+		uint32_t signedness = 0;
+		uint32_t imageDim = 0;
+		uint32_t imageSampled = 0;
+		std::vector<uint32_t> members;
+		std::vector<uint32_t> memberOffsets;
+		std::vector<uint32_t> memberMatrixStrides;
+		//Decorations
+		uint32_t set = NONE;
+		uint32_t binding = NONE;
+		uint32_t location = NONE;
+		uint32_t specId = NONE;
+		uint32_t arrayStride = 0;
+		bool block = false;
+		bool bufferBlock = false;
+		bool builtIn = false;
+		std::string name;
+	};
+	std::string readString(const uint32_t *words, const uint32_t &count)
+	{
+		const char *str = reinterpret_cast<const char*>(words);
+		return std::string(str, strnlen(str, count * sizeof(uint32_t)));
+	}
+	vk::ShaderStageFlagBits executionModelStage(const uint32_t &model)
+	{
+		switch (model)
+		{
+		case 0: return vk::ShaderStageFlagBits::eVertex;
+		case 1: return vk::ShaderStageFlagBits::eTessellationControl;
+		case 2: return vk::ShaderStageFlagBits::eTessellationEvaluation;
+		case 3: return vk::ShaderStageFlagBits::eGeometry;
+		case 4: return vk::ShaderStageFlagBits::eFragment;
+		case 5: return vk::ShaderStageFlagBits::eCompute;
+		default:
+			throw std::runtime_error("SPIR-V reflection: Unsupported execution model.");
+		}
+	}
+	/**
+	 * Size in bytes of a type as laid out within a block
+	 */
+	uint32_t typeSize(const std::vector<Id> &ids, const uint32_t &typeId, const uint32_t &matrixStride = 0)
+	{
+		const Id &t = ids[typeId];
+		switch (t.opcode)
+		{
+		case OpTypeBool:
+			return 4;
+		case OpTypeInt:
+		case OpTypeFloat:
+			return t.width / 8;
+		case OpTypeVector:
+			return t.width * typeSize(ids, t.typeId);
+		case OpTypeMatrix:
+			return t.width * (matrixStride ? matrixStride : typeSize(ids, t.typeId));
+		case OpTypeArray:
+			return ids[t.arrayLength].width * (t.arrayStride ? t.arrayStride : typeSize(ids, t.typeId, matrixStride));
+		case OpTypeStruct:
+		{
+			uint32_t size = 0;
+			for (size_t i = 0; i < t.members.size(); ++i)
+			{
+				size = std::max(size, t.memberOffsets[i] + typeSize(ids, t.members[i], t.memberMatrixStrides[i]));
+			}
+			return size;
+		}
+		default://Runtime arrays have no static size
+			return 0;
+		}
+	}
+	vk::Format inputFormat(const std::vector<Id> &ids, const uint32_t &typeId)
+	{
+		const Id &t = ids[typeId];
+		const Id &c = t.opcode == OpTypeVector ? ids[t.typeId] : t;
+		const uint32_t count = t.opcode == OpTypeVector ? t.width : 1;
+		if (c.width == 32)
+		{
+			static const vk::Format FLOATS[] = { vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat };
+			static const vk::Format INTS[] = { vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint };
+			static const vk::Format UINTS[] = { vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint };
+			if (c.opcode == OpTypeFloat)
+				return FLOATS[count - 1];
+			if (c.opcode == OpTypeInt)
+				return c.signedness ? INTS[count - 1] : UINTS[count - 1];
+		}
+		throw std::runtime_error("SPIR-V reflection: Unsupported vertex input type.");
+	}
+}
+
+ShaderReflection::ShaderReflection(const std::vector<uint32_t> &spirv)
+	: m_stage(vk::ShaderStageFlagBits::eVertex)
+{
+	if (spirv.size() < 5 || spirv[0] != SpvMagicNumber)
+		throw std::runtime_error("SPIR-V reflection: Invalid SPIR-V header.");
+	const uint32_t bound = spirv[3];
+	std::vector<Id> ids(bound);
+	std::vector<uint32_t> variables;
+	auto checkId = [&bound](const uint32_t &id)
+	{
+		if (id >= bound)
+			throw std::runtime_error("SPIR-V reflection: Id out of bounds.");
+		return id;
+	};
+	//Pass over the instruction stream, collecting types, decorations and variables
+	for (size_t i = 5; i < spirv.size();)
+	{
+		const uint32_t opcode = spirv[i] & 0xFFFF;
+		const uint32_t count = spirv[i] >> 16;
+		if (count == 0 || i + count > spirv.size())
+			throw std::runtime_error("SPIR-V reflection: Malformed instruction.");
+		const uint32_t *op = &spirv[i];
+		switch (opcode)
+		{
+		case OpName:
+			ids[checkId(op[1])].name = readString(op + 2, count - 2);
+			break;
+		case OpEntryPoint:
+			m_stage = executionModelStage(op[1]);
+			m_entryPoint = readString(op + 3, count - 3);
+			break;
+		case OpExecutionMode:
+			if (op[2] == ExecutionModeLocalSize && count >= 6)
+			{
+				m_localSize[0] = op[3];
+				m_localSize[1] = op[4];
+				m_localSize[2] = op[5];
+			}
+			break;
+		case OpTypeBool:
+			ids[checkId(op[1])].opcode = opcode;
+			break;
+		case OpTypeInt:
+			ids[checkId(op[1])].signedness = op[3];
+			//Fallthrough
+		case OpTypeFloat:
+			ids[checkId(op[1])].opcode = opcode;
+			ids[op[1]].width = op[2];
+			break;
+		case OpTypeVector:
+		case OpTypeMatrix:
+			ids[checkId(op[1])].opcode = opcode;
+			ids[op[1]].typeId = checkId(op[2]);
+			ids[op[1]].width = op[3];
+			break;
+		case OpTypeImage:
+			ids[checkId(op[1])].opcode = opcode;
+			ids[op[1]].imageDim = op[3];
+			ids[op[1]].imageSampled = op[7];
+			break;
+		case OpTypeSampler:
+			ids[checkId(op[1])].opcode = opcode;
+			break;
+		case OpTypeSampledImage:
+		case OpTypeRuntimeArray:
+			ids[checkId(op[1])].opcode = opcode;
+			ids[op[1]].typeId = checkId(op[2]);
+			break;
+		case OpTypeArray:
+			ids[checkId(op[1])].opcode = opcode;
+			ids[op[1]].typeId = checkId(op[2]);
+			ids[op[1]].arrayLength = checkId(op[3]);
+			break;
+		case OpTypeStruct:
+		{
+			Id &s = ids[checkId(op[1])];
+			s.opcode = opcode;
+			s.members.assign(op + 2, op + count);
+			s.memberOffsets.resize(s.members.size(), 0);
+			s.memberMatrixStrides.resize(s.members.size(), 0);
+			for (auto &m : s.members)
+				checkId(m);
+			break;
+		}
+		case OpTypePointer:
+			ids[checkId(op[1])].opcode = opcode;
+			ids[op[1]].width = op[2];//Storage class
+			ids[op[1]].typeId = checkId(op[3]);
+			break;
+		case OpConstant:
+		case OpSpecConstant:
+			ids[checkId(op[2])].opcode = opcode;
+			ids[op[2]].typeId = checkId(op[1]);
+			ids[op[2]].width = op[3];//Low word of value, sufficient for array lengths
+			break;
+		case OpSpecConstantTrue:
+		case OpSpecConstantFalse:
+			ids[checkId(op[2])].opcode = opcode;
+			ids[op[2]].typeId = checkId(op[1]);
+			break;
+		case OpVariable:
+			ids[checkId(op[2])].opcode = opcode;
+			ids[op[2]].typeId = checkId(op[1]);
+			ids[op[2]].width = op[3];//Storage class
+			variables.push_back(op[2]);
+			break;
+		case OpDecorate:
+		{
+			Id &t = ids[checkId(op[1])];
+			switch (op[2])
+			{
+			case DecorationSpecId: t.specId = op[3]; break;
+			case DecorationBlock: t.block = true; break;
+			case DecorationBufferBlock: t.bufferBlock = true; break;
+			case DecorationArrayStride: t.arrayStride = op[3]; break;
+			case DecorationBuiltIn: t.builtIn = true; break;
+			case DecorationLocation: t.location = op[3]; break;
+			case DecorationBinding: t.binding = op[3]; break;
+			case DecorationDescriptorSet: t.set = op[3]; break;
+			default: break;
+			}
+			break;
+		}
+		case OpMemberDecorate:
+		{
+			//Struct declarations follow decorations, so store against the member index and resolve when sizing
+			Id &t = ids[checkId(op[1])];
+			const uint32_t member = op[2];
+			if (t.memberOffsets.size() <= member)
+			{
+				t.memberOffsets.resize(member + 1, 0);
+				t.memberMatrixStrides.resize(member + 1, 0);
+			}
+			if (op[3] == DecorationOffset)
+				t.memberOffsets[member] = op[4];
+			else if (op[3] == DecorationMatrixStride)
+				t.memberMatrixStrides[member] = op[4];
+			else if (op[3] == DecorationBuiltIn)
+				t.builtIn = true;
+			break;
+		}
+		default:
+			break;
+		}
+		i += count;
+	}
+	//Build interface from variables
+	for (auto &v : variables)
+	{
+		const Id &var = ids[v];
+		const Id &ptr = ids[var.typeId];
+		uint32_t typeId = ptr.typeId;
+		uint32_t arrayCount = 1;
+		//Unwrap arrays of descriptors
+		while (ids[typeId].opcode == OpTypeArray || ids[typeId].opcode == OpTypeRuntimeArray)
+		{
+			//Runtime arrays (unbounded descriptor arrays) are treated as a single descriptor
+			if (ids[typeId].opcode == OpTypeArray)
+				arrayCount *= ids[ids[typeId].arrayLength].width;
+			typeId = ids[typeId].typeId;
+		}
+		const Id &type = ids[typeId];
+		switch (var.width)
+		{
+		case StorageClassUniformConstant:
+		case StorageClassUniform:
+		case StorageClassStorageBuffer:
+		{
+			DescriptorBinding b;
+			{
+				b.set = var.set == NONE ? 0 : var.set;
+				b.binding = var.binding == NONE ? 0 : var.binding;
+				b.count = arrayCount;
+				b.name = var.name.empty() ? type.name : var.name;
+			}
+			if (type.opcode == OpTypeSampledImage)
+				b.type = vk::DescriptorType::eCombinedImageSampler;
+			else if (type.opcode == OpTypeSampler)
+				b.type = vk::DescriptorType::eSampler;
+			else if (type.opcode == OpTypeImage)
+			{
+				if (type.imageDim == DimBuffer)
+					b.type = type.imageSampled == 2 ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+				else if (type.imageDim == DimSubpassData)
+					b.type = vk::DescriptorType::eInputAttachment;
+				else
+					b.type = type.imageSampled == 2 ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+			}
+			else if (type.opcode == OpTypeStruct)
+			{
+				if (var.width == StorageClassStorageBuffer || type.bufferBlock)
+					b.type = vk::DescriptorType::eStorageBuffer;
+				else
+					b.type = vk::DescriptorType::eUniformBuffer;
+			}
+			else
+				continue;//Not a descriptor
+			m_bindings.push_back(b);
+			break;
+		}
+		case StorageClassPushConstant:
+		{
+			uint32_t minOffset = UINT32_MAX;
+			for (auto &o : type.memberOffsets)
+				minOffset = std::min(minOffset, o);
+			if (minOffset == UINT32_MAX)
+				minOffset = 0;
+			vk::PushConstantRange pcr;
+			{
+				pcr.stageFlags = m_stage;
+				pcr.offset = minOffset;
+				pcr.size = typeSize(ids, typeId) - minOffset;
+			}
+			m_pushConstants.push_back(pcr);
+			break;
+		}
+		case StorageClassInput:
+		{
+			if (m_stage != vk::ShaderStageFlagBits::eVertex || var.builtIn || type.builtIn || var.location == NONE)
+				continue;
+			VertexInput vi;
+			{
+				vi.location = var.location;
+				vi.format = inputFormat(ids, typeId);
+				vi.name = var.name;
+			}
+			m_inputs.push_back(vi);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	std::sort(m_inputs.begin(), m_inputs.end(), [](const VertexInput &a, const VertexInput &b) { return a.location < b.location; });
+	//Specialization constants
+	for (uint32_t id = 0; id < bound; ++id)
+	{
+		const Id &c = ids[id];
+		if (c.specId == NONE)
+			continue;
+		if (c.opcode != OpSpecConstant && c.opcode != OpSpecConstantTrue && c.opcode != OpSpecConstantFalse)
+			continue;//e.g. WorkgroupSize composite
+		const Id &t = ids[c.typeId];
+		SpecConstant sc;
+		{
+			sc.id = c.specId;
+			sc.name = c.name;
+			if (t.opcode == OpTypeBool)
+			{
+				sc.type = SpecConstant::Bool;
+				sc.size = sizeof(VkBool32);
+			}
+			else
+			{
+				sc.type = t.opcode == OpTypeFloat ? SpecConstant::Float : (t.signedness ? SpecConstant::Int : SpecConstant::UInt);
+				sc.size = t.width / 8;
+			}
+		}
+		m_specConstants.push_back(sc);
+	}
+	std::sort(m_specConstants.begin(), m_specConstants.end(), [](const SpecConstant &a, const SpecConstant &b) { return a.id < b.id; });
+}
+const ShaderReflection::SpecConstant *ShaderReflection::findSpecConstant(const uint32_t &id) const
+{
+	for (auto &sc : m_specConstants)
+		if (sc.id == id)
+			return &sc;
+	return nullptr;
+}
@@ -0,0 +1,72 @@
+#ifndef __ShaderReflection_h__
+#define __ShaderReflection_h__
+#include <vector>
+#include <string>
+#include <vulkan/vulkan.hpp>
+
+/**
+ * Lightweight SPIR-V parser, extracts the resource interface of a single shader module
+ * This covers the subset of SPIR-V produced by glslang for our shaders, rather than attempting
+ * to be as thorough as SPIRV-Cross
+ * https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
+ */
+class ShaderReflection
+{
+public:
+	struct DescriptorBinding
+	{
+		uint32_t set;
+		uint32_t binding;
+		vk::DescriptorType type;
+		uint32_t count;
+		std::string name;
+	};
+	struct VertexInput
+	{
+		uint32_t location;
+		vk::Format format;
+		std::string name;
+	};
+	struct SpecConstant
+	{
+		enum Type { Bool, Int, UInt, Float };
+		uint32_t id;
+		Type type;
+		uint32_t size;//Bytes
+		std::string name;
+	};
+	/**
+	 * Parses the provided SPIR-V, throws std::runtime_error if it is malformed
+	 */
+	ShaderReflection(const std::vector<uint32_t> &spirv);
+	vk::ShaderStageFlagBits Stage() const { return m_stage; }
+	const std::string &EntryPoint() const { return m_entryPoint; }
+	const std::vector<DescriptorBinding> &Bindings() const { return m_bindings; }
+	/**
+	 * Empty if the shader has no push constant block, otherwise a single range covering the block
+	 */
+	const std::vector<vk::PushConstantRange> &PushConstants() const { return m_pushConstants; }
+	/**
+	 * Only populated for vertex shaders, sorted by location
+	 */
+	const std::vector<VertexInput> &Inputs() const { return m_inputs; }
+	const std::vector<SpecConstant> &SpecConstants() const { return m_specConstants; }
+	/**
+	 * Returns nullptr if the shader doesn't declare a specialization constant with the given id
+	 */
+	const SpecConstant *findSpecConstant(const uint32_t &id) const;
+	/**
+	 * Workgroup size of compute shaders (local_size_x/y/z), 1x1x1 if not declared with literals
+	 */
+	const uint32_t *LocalSize() const { return m_localSize; }
+private:
+	vk::ShaderStageFlagBits m_stage;
+	std::string m_entryPoint;
+	std::vector<DescriptorBinding> m_bindings;
+	std::vector<vk::PushConstantRange> m_pushConstants;
+	std::vector<VertexInput> m_inputs;
+	std::vector<SpecConstant> m_specConstants;
+	uint32_t m_localSize[3] = { 1, 1, 1 };
+};
+
+#endif //__ShaderReflection_h__
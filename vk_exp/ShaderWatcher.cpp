@@ -0,0 +1,149 @@
+#include "ShaderWatcher.h"
+#include <map>
+#include <chrono>
+#include <cstdio>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+//How long a file must be quiet before its change is reported
+#define DEBOUNCE_MS 50
+//How often the stop flag is checked
+#define POLL_MS 100
+
+ShaderWatcher::ShaderWatcher(const std::string &directory, Callback callback)
+	: m_directory(directory)
+	, m_callback(callback)
+	, m_stop(false)
+	, m_thread(&ShaderWatcher::watchLoop, this)
+{ }
+ShaderWatcher::~ShaderWatcher()
+{
+	m_stop.store(true);
+	if (m_thread.joinable())
+		m_thread.join();
+}
+void ShaderWatcher::watchLoop()
+{
+	typedef std::chrono::steady_clock clock;
+	//Filename -> time of most recent event
+	std::map<std::string, clock::time_point> pending;
+	auto flushPending = [&]()
+	{
+		const auto now = clock::now();
+		for (auto it = pending.begin(); it != pending.end();)
+		{
+			if (now - it->second >= std::chrono::milliseconds(DEBOUNCE_MS))
+			{
+				m_callback(it->first);
+				it = pending.erase(it);
+			}
+			else
+				++it;
+		}
+	};
+#ifdef _WIN32
+	HANDLE dir = CreateFileA(
+		m_directory.c_str(),
+		FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+		nullptr
+	);
+	if (dir == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "ShaderWatcher: Failed to open directory '%s'.\n", m_directory.c_str());
+		return;
+	}
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	alignas(DWORD) char buffer[16384];
+	bool readIssued = false;
+	while (!m_stop.load())
+	{
+		if (!readIssued)
+		{
+			ResetEvent(overlapped.hEvent);
+			readIssued = ReadDirectoryChangesW(
+				dir, buffer, sizeof(buffer), FALSE,
+				FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME,
+				nullptr, &overlapped, nullptr
+			) != 0;
+			if (!readIssued)
+			{
+				fprintf(stderr, "ShaderWatcher: ReadDirectoryChangesW() failed.\n");
+				break;
+			}
+		}
+		if (WaitForSingleObject(overlapped.hEvent, pending.empty() ? POLL_MS : DEBOUNCE_MS) == WAIT_OBJECT_0)
+		{
+			DWORD bytes = 0;
+			readIssued = false;
+			if (GetOverlappedResult(dir, &overlapped, &bytes, FALSE) && bytes)
+			{
+				const char *ptr = buffer;
+				while (true)
+				{
+					auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(ptr);
+					if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+					{
+						char name[MAX_PATH] = {};
+						WideCharToMultiByte(CP_UTF8, 0, info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)), name, MAX_PATH - 1, nullptr, nullptr);
+						pending[name] = clock::now();
+					}
+					if (!info->NextEntryOffset)
+						break;
+					ptr += info->NextEntryOffset;
+				}
+			}
+		}
+		flushPending();
+	}
+	if (readIssued)
+	{//The cancelled read may still write to buffer and overlapped until it completes
+		CancelIo(dir);
+		DWORD bytes = 0;
+		GetOverlappedResult(dir, &overlapped, &bytes, TRUE);
+	}
+	CloseHandle(overlapped.hEvent);
+	CloseHandle(dir);
+#else
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0 || inotify_add_watch(fd, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+	{
+		fprintf(stderr, "ShaderWatcher: Failed to watch directory '%s'.\n", m_directory.c_str());
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+	alignas(inotify_event) char buffer[16384];
+	while (!m_stop.load())
+	{
+		pollfd pfd = { fd, POLLIN, 0 };
+		if (poll(&pfd, 1, pending.empty() ? POLL_MS : DEBOUNCE_MS) > 0 && (pfd.revents & POLLIN))
+		{
+			ssize_t len;
+			while ((len = read(fd, buffer, sizeof(buffer))) > 0)
+			{
+				for (char *ptr = buffer; ptr < buffer + len;)
+				{
+					auto event = reinterpret_cast<const inotify_event*>(ptr);
+					if (event->len && !(event->mask & IN_ISDIR))
+						pending[event->name] = clock::now();
+					ptr += sizeof(inotify_event) + event->len;
+				}
+			}
+		}
+		flushPending();
+	}
+	close(fd);
+#endif
+}
@@ -0,0 +1,33 @@
+#ifndef __ShaderWatcher_h__
+#define __ShaderWatcher_h__
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+/**
+ * Watches a directory (non-recursively) for modified files on a background thread
+ * Uses inotify on Linux and ReadDirectoryChangesW on Windows
+ * Bursts of events for the same file (editors often write several times per save) are coalesced
+ * before the callback is triggered, the callback is executed on the watcher thread
+ */
+class ShaderWatcher
+{
+public:
+	typedef std::function<void(const std::string &filename)> Callback;
+	/**
+	 * @param directory The directory to watch
+	 * @param callback Called with the name (relative to directory) of each changed file
+	 */
+	ShaderWatcher(const std::string &directory, Callback callback);
+	~ShaderWatcher();
+	const std::string &Directory() const { return m_directory; }
+private:
+	void watchLoop();
+	const std::string m_directory;
+	Callback m_callback;
+	std::atomic<bool> m_stop;
+	std::thread m_thread;
+};
+
+#endif //__ShaderWatcher_h__
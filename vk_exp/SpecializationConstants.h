@@ -0,0 +1,90 @@
+#ifndef __SpecializationConstants_h__
+#define __SpecializationConstants_h__
+#include <map>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+#include <vulkan/vulkan.hpp>
+#include "Hash.h"
+
+/**
+ * Typed specialization constant values for each shader stage of a pipeline
+ * These are baked in at pipeline creation, so the driver can constant-fold and eliminate dead branches
+ * (e.g. light counts, feature toggles, loop bounds) without maintaining separate GLSL permutations
+ * In GLSL: layout(constant_id = 0) const bool USE_TEXTURE = true;
+ */
+class SpecializationConstants
+{
+public:
+	/**
+	 * Set the value of a constant, the type must match the declaration in the shader (bool, int, uint, float, double)
+	 */
+	template<typename T>
+	void set(const vk::ShaderStageFlagBits &stage, const uint32_t &constantId, const T &value)
+	{
+		static_assert(std::is_arithmetic<T>::value, "Specialization constants must be scalars.");
+		std::vector<unsigned char> &bytes = m_values[static_cast<VkShaderStageFlags>(vk::ShaderStageFlags(stage))][constantId];
+		bytes.resize(sizeof(T));
+		memcpy(bytes.data(), &value, sizeof(T));
+	}
+	/**
+	 * SPIR-V booleans are 32 bit
+	 */
+	void set(const vk::ShaderStageFlagBits &stage, const uint32_t &constantId, const bool &value)
+	{
+		set<VkBool32>(stage, constantId, value ? VK_TRUE : VK_FALSE);
+	}
+	bool empty() const { return m_values.empty(); }
+	/**
+	 * Constant id -> value bytes for the given stage, nullptr if the stage has no constants set
+	 */
+	const std::map<uint32_t, std::vector<unsigned char>> *Stage(const vk::ShaderStageFlagBits &stage) const
+	{
+		auto it = m_values.find(static_cast<VkShaderStageFlags>(vk::ShaderStageFlags(stage)));
+		return it == m_values.end() ? nullptr : &it->second;
+	}
+	/**
+	 * Fills out a vk::SpecializationInfo for the given stage, entries and data must outlive its use
+	 * @return False if the stage has no constants set (info is left unmodified)
+	 */
+	bool buildInfo(const vk::ShaderStageFlagBits &stage, vk::SpecializationInfo &info, std::vector<vk::SpecializationMapEntry> &entries, std::vector<unsigned char> &data) const
+	{
+		auto values = Stage(stage);
+		if (!values)
+			return false;
+		entries.clear();
+		data.clear();
+		for (auto &v : *values)
+		{
+			entries.push_back(vk::SpecializationMapEntry(v.first, (uint32_t)data.size(), v.second.size()));
+			data.insert(data.end(), v.second.begin(), v.second.end());
+		}
+		info.mapEntryCount = (uint32_t)entries.size();
+		info.pMapEntries = entries.data();
+		info.dataSize = data.size();
+		info.pData = data.data();
+		return true;
+	}
+	/**
+	 * Hash of all stages, ids and values, for use within pipeline state keys
+	 */
+	uint64_t hash() const
+	{
+		Hash h;
+		for (auto &s : m_values)
+		{
+			h.mix(&s.first, sizeof(s.first));
+			for (auto &v : s.second)
+			{
+				h.mix(&v.first, sizeof(v.first));
+				h.mix(v.second.data(), v.second.size());
+			}
+		}
+		return h.value();
+	}
+private:
+	//Stage -> constant id -> value bytes
+	std::map<VkShaderStageFlags, std::map<uint32_t, std::vector<unsigned char>>> m_values;
+};
+
+#endif //__SpecializationConstants_h__
@@ -0,0 +1,42 @@
+#ifndef __Transform_h__
+#define __Transform_h__
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+/**
+ * Rigid transform stored as position and rotation, rather than a matrix, so states can be interpolated
+ */
+struct Transform
+{
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	/**
+	 * Local to world
+	 */
+	glm::mat4 matrix() const
+	{
+		return glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation);
+	}
+	/**
+	 * World to local, e.g. the view matrix of a camera's transform
+	 */
+	glm::mat4 inverseMatrix() const
+	{
+		return glm::mat4_cast(glm::conjugate(rotation)) * glm::translate(glm::mat4(1.0f), -position);
+	}
+	bool operator==(const Transform &o) const { return position == o.position && rotation == o.rotation; }
+	bool operator!=(const Transform &o) const { return !(*this == o); }
+	/**
+	 * Linear interpolation of position, spherical (shortest path) of rotation
+	 */
+	static Transform interpolate(const Transform &a, const Transform &b, const float &t)
+	{
+		Transform r;
+		r.position = glm::mix(a.position, b.position, t);
+		r.rotation = glm::slerp(a.rotation, b.rotation, t);
+		return r;
+	}
+};
+
+#endif //__Transform_h__
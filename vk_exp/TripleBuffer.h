@@ -0,0 +1,52 @@
+#ifndef __TripleBuffer_h__
+#define __TripleBuffer_h__
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free single producer, single consumer hand-off of the latest value
+ * The producer fills writeBuffer() then publish()es it, the consumer update()s then reads read()
+ * Neither side ever waits on the other: a value published whilst the consumer is busy replaces any unread value,
+ * and the consumer keeps reading its last value until a new one is published
+ * Each slot is only ever accessed by one thread at a time, ownership passes through the atomic middle index
+ */
+template<typename T>
+class TripleBuffer
+{
+public:
+	/**
+	 * Producer only, the slot retains whatever it held when last swapped out, so must be fully rewritten
+	 */
+	T &writeBuffer() { return m_buffers[m_write]; }
+	/**
+	 * Producer only, swaps the written slot with the middle slot, marking it unread
+	 */
+	void publish()
+	{
+		m_write = m_middle.exchange(m_write | NewBit, std::memory_order_acq_rel) & IndexMask;
+	}
+	/**
+	 * Consumer only, takes the most recently published value if one is unread
+	 * @return false if nothing has been published since the previous update(), read() is then unchanged
+	 */
+	bool update()
+	{
+		if (!(m_middle.load(std::memory_order_relaxed) & NewBit))
+			return false;
+		m_read = m_middle.exchange(m_read, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+	/**
+	 * Consumer only
+	 */
+	const T &read() const { return m_buffers[m_read]; }
+private:
+	static const uint8_t IndexMask = 3;
+	static const uint8_t NewBit = 4;//Set on the middle index when it holds a value the consumer hasn't taken
+	T m_buffers[3];
+	uint8_t m_write = 0;//Producer's slot
+	std::atomic<uint8_t> m_middle{ 1 };
+	uint8_t m_read = 2;//Consumer's slot
+};
+
+#endif //__TripleBuffer_h__
@@ -2,16 +2,32 @@
 #define __main_cpp__
 
 #include "MainLoop.h"
+#include "Profiler.h"
+#include <cstring>
 
 int main(int argc, char *argv[])
 {
+	PROFILE_THREAD("main");
 	MainLoop *ml = new MainLoop();
+	//--device <index|UUID|name> overrides physical device selection
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		if (0 == strcmp(argv[i], "--device"))
+			ml->setDeviceOverride(argv[i + 1]);
+	}
+	//--profile captures from startup (so includes Context::init), until F12 or exit
+	for (int i = 1; i < argc; ++i)
+	{
+		if (0 == strcmp(argv[i], "--profile"))
+			Profiler::startCapture();
+	}
 	ml->startAsync();
 	using namespace std::chrono_literals;
 	//for(unsigned int i = 0;i<1000;++i)
 	while(ml->isRunning())
 		std::this_thread::sleep_for(100ms);
 	delete ml;
+	Profiler::stopCapture("profile");
 	return EXIT_SUCCESS;
 }
 #endif //__main_cpp__
\ No newline at end of file